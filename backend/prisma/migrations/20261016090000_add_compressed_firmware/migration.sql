@@ -0,0 +1,3 @@
+-- AlterTable
+ALTER TABLE "firmware" ADD COLUMN     "compressedS3Key" TEXT,
+ADD COLUMN     "size" INTEGER;
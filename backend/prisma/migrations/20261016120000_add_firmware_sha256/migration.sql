@@ -0,0 +1,3 @@
+-- AlterTable
+ALTER TABLE "firmware" ADD COLUMN     "sha256" TEXT,
+ADD COLUMN     "signature" TEXT;
@@ -24,6 +24,7 @@ const configuration = () => ({
   storage: {
     firmwareDir: process.env.FIRMWARE_DIR || './public/firmware',
     manifestPath: process.env.MANIFEST_PATH || './firmware_manifest.json',
+    signingKeyPath: process.env.FIRMWARE_SIGNING_KEY_PATH,
   },
   database: {
     databaseUrl: process.env.DATABASE_URL,
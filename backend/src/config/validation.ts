@@ -14,4 +14,5 @@ export const validationSchema = Joi.object({
 
   FIRMWARE_DIR: Joi.string().default('./firmware'),
   MANIFEST_PATH: Joi.string().default('./firmware_manifest.json'),
+  FIRMWARE_SIGNING_KEY_PATH: Joi.string().allow('', null),
 });
\ No newline at end of file
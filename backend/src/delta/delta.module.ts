@@ -0,0 +1,10 @@
+import { Module } from '@nestjs/common';
+import { DeltaService } from './delta.service';
+import { S3Module } from '../s3/s3.module';
+
+@Module({
+  imports: [S3Module],
+  providers: [DeltaService],
+  exports: [DeltaService],
+})
+export class DeltaModule {}
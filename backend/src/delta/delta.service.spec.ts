@@ -0,0 +1,63 @@
+import { Test, TestingModule } from '@nestjs/testing';
+import { DeltaService } from './delta.service';
+import { S3Service } from '../s3/s3.service';
+import { applyPatch, createPatch } from './rdp';
+
+describe('DeltaService', () => {
+  let service: DeltaService;
+
+  beforeEach(async () => {
+    const module: TestingModule = await Test.createTestingModule({
+      providers: [DeltaService, { provide: S3Service, useValue: {} }],
+    }).compile();
+
+    service = module.get<DeltaService>(DeltaService);
+  });
+
+  it('should be defined', () => {
+    expect(service).toBeDefined();
+  });
+
+  it('should round-trip a patch between two images', () => {
+    const source = Buffer.alloc(64 * 1024);
+    for (let i = 0; i < source.length; i++) source[i] = (i * 31 + (i >> 7)) & 0xff;
+    const target = Buffer.concat([source.subarray(0, 1000), Buffer.from('inserted'), source.subarray(1000)]);
+    target[40000] ^= 0xff;
+
+    const patch = createPatch(source, target);
+    expect(patch.length).toBeLessThan(target.length / 10);
+    expect(applyPatch(source, patch).equals(target)).toBe(true);
+  });
+
+  it('should delete the patches from and to a firmware only', async () => {
+    const deleted: string[] = [];
+    const s3 = {
+      listKeys: async () => ['patches/a_b.rdp', 'patches/b_c.rdp', 'patches/c_a.rdp', 'patches/ab_c.rdp'],
+      deleteFirmware: async (key: string) => { deleted.push(key); },
+    };
+    await new DeltaService(s3 as unknown as S3Service).deletePatches('a');
+    expect(deleted).toEqual(['patches/a_b.rdp', 'patches/c_a.rdp']);
+  });
+
+  it('should queue a patch on a miss and build each one once', async () => {
+    const source = Buffer.alloc(16 * 1024, 7);
+    const image = Buffer.from(source);
+    image[100] = 1;
+    const stored = new Map<string, { size: number; metadata: Record<string, string> }>();
+    const s3 = {
+      headObject: async (key: string) => stored.get(key) ?? null,
+      downloadFirmware: async (key: string) => (key === 'base' ? source : image),
+      uploadFirmware: async (key: string, patch: Buffer, _type: string, metadata: Record<string, string>) => {
+        stored.set(key, { size: patch.length, metadata });
+      },
+    };
+    const delta = new DeltaService(s3 as unknown as S3Service);
+    const base = { id: 'a', s3Key: 'base' };
+    const target = { id: 'b', s3Key: 'target' };
+
+    expect(await delta.getPatch(base, target)).toBeNull();
+    await delta.schedulePatch(base, target);
+    expect(stored.size).toBe(1);
+    expect(await delta.getPatch(base, target)).toMatchObject({ s3Key: 'patches/a_b.rdp' });
+  });
+});
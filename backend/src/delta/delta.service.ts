@@ -0,0 +1,120 @@
+import { Injectable, Logger } from '@nestjs/common';
+import { createHash } from 'crypto';
+import { S3Service } from '../s3/s3.service';
+import { applyPatch, createPatch } from './rdp';
+
+export interface DeltaPatch {
+  s3Key: string;
+  baseMd5: string;
+  size: number;
+}
+
+interface FirmwareRef {
+  id: string;
+  s3Key: string;
+}
+
+@Injectable()
+export class DeltaService {
+  private readonly logger = new Logger(DeltaService.name);
+
+  // Patches above this share of the full image aren't worth the extra
+  // on-device work, so the device just gets the full image.
+  private static readonly MAX_PATCH_RATIO = 0.7;
+
+  constructor(private readonly s3Service: S3Service) {}
+
+  patchKey(baseId: string, targetId: string): string {
+    return `patches/${baseId}_${targetId}.rdp`;
+  }
+
+  // Patches are built off the response path: for every running image when
+  // a new one is uploaded, or queued the first time a response misses one.
+  // Jobs run one at a time, as createPatch() holds the event loop.
+  private queue: Promise<void> = Promise.resolve();
+  private readonly pending = new Map<string, Promise<void>>();
+
+  // A patch prepared earlier, or null; a miss queues one for next time
+  async getPatch(base: FirmwareRef, target: FirmwareRef): Promise<DeltaPatch | null> {
+    if (base.id === target.id) {
+      return null;
+    }
+
+    const key = this.patchKey(base.id, target.id);
+    const existing = await this.s3Service.headObject(key);
+    if (!existing) {
+      this.schedulePatch(base, target);
+      return null;
+    }
+    return this.toPatch(key, existing.size, existing.metadata['base-md5'], Number(existing.metadata['target-size']));
+  }
+
+  // Settles once every patch to target is stored; failures are logged
+  async preparePatches(bases: FirmwareRef[], target: FirmwareRef): Promise<void> {
+    await Promise.all(bases.map(base => this.schedulePatch(base, target)));
+  }
+
+  schedulePatch(base: FirmwareRef, target: FirmwareRef): Promise<void> {
+    if (base.id === target.id) {
+      return Promise.resolve();
+    }
+
+    const key = this.patchKey(base.id, target.id);
+    const queued = this.pending.get(key);
+    if (queued) {
+      return queued;
+    }
+
+    const job = this.queue
+      .then(() => this.createPatchObject(key, base, target))
+      .catch(error => this.logger.error(`Failed to generate patch ${key}`, error))
+      .finally(() => this.pending.delete(key));
+    this.queue = job;
+    this.pending.set(key, job);
+    return job;
+  }
+
+  // Patches from or to this firmware
+  async deletePatches(firmwareId: string): Promise<void> {
+    const keys = await this.s3Service.listKeys('patches/');
+    const from = `patches/${firmwareId}_`;
+    const to = `_${firmwareId}.rdp`;
+    for (const key of keys.filter(k => k.startsWith(from) || k.endsWith(to))) {
+      await this.s3Service.deleteFirmware(key);
+    }
+  }
+
+  private async createPatchObject(key: string, base: FirmwareRef, target: FirmwareRef): Promise<void> {
+    if (await this.s3Service.headObject(key)) {
+      return;
+    }
+
+    const [source, image] = await Promise.all([
+      this.s3Service.downloadFirmware(base.s3Key),
+      this.s3Service.downloadFirmware(target.s3Key),
+    ]);
+
+    const patch = createPatch(source, image);
+    if (!applyPatch(source, patch).equals(image)) {
+      throw new Error(`Patch verification failed for ${key}`);
+    }
+
+    // The device compares this against ESP.getSketchMD5() of its running
+    // image. Patches too big to be worth it are stored all the same, so
+    // they are not built again; toPatch() leaves them out.
+    const baseMd5 = createHash('md5').update(source).digest('hex');
+    await this.s3Service.uploadFirmware(key, patch, 'application/octet-stream', {
+      'base-md5': baseMd5,
+      'target-size': String(image.length),
+    });
+
+    this.logger.log(`Generated patch ${key}: ${patch.length} bytes for a ${image.length} byte image`);
+  }
+
+  private toPatch(s3Key: string, size: number, baseMd5: string | undefined, targetSize: number): DeltaPatch | null {
+    if (!baseMd5 || !targetSize || size >= targetSize * DeltaService.MAX_PATCH_RATIO) {
+      return null;
+    }
+    return { s3Key, baseMd5, size };
+  }
+}
@@ -0,0 +1,192 @@
+/**
+ * RDP1 binary patch format, applied on-device by lib/RoidOTA/RoidDelta.
+ *
+ *   "RDP1" | u32 sourceSize | u32 targetSize | ops... | 0x00
+ *   0x01 COPY    zigzag-varint offset delta from the end of the previous copy,
+ *                varint length; bytes come from the source image
+ *   0x02 LITERAL varint length, followed by that many bytes
+ *
+ * Relative copy offsets keep patches small when code moves by a few bytes
+ * between builds, which is the common case for firmware images.
+ */
+export const RDP_MAGIC = 'RDP1';
+
+const OP_END = 0x00;
+const OP_COPY = 0x01;
+const OP_LITERAL = 0x02;
+
+const KEY_LENGTH = 8;
+const MIN_MATCH = 16;
+const HASH_BITS = 20;
+
+class PatchWriter {
+  private chunks: Buffer[] = [];
+  private ops: number[] = [];
+
+  header(sourceSize: number, targetSize: number) {
+    const header = Buffer.alloc(12);
+    header.write(RDP_MAGIC, 0, 'ascii');
+    header.writeUInt32LE(sourceSize, 4);
+    header.writeUInt32LE(targetSize, 8);
+    this.chunks.push(header);
+  }
+
+  copy(offsetDelta: number, length: number) {
+    this.ops.push(OP_COPY);
+    this.varint(offsetDelta >= 0 ? offsetDelta * 2 : -offsetDelta * 2 - 1);
+    this.varint(length);
+  }
+
+  literal(bytes: Buffer) {
+    if (bytes.length === 0) return;
+    this.ops.push(OP_LITERAL);
+    this.varint(bytes.length);
+    this.flushOps();
+    this.chunks.push(bytes);
+  }
+
+  end(): Buffer {
+    this.ops.push(OP_END);
+    this.flushOps();
+    return Buffer.concat(this.chunks);
+  }
+
+  private varint(value: number) {
+    while (value >= 0x80) {
+      this.ops.push((value % 0x80) | 0x80);
+      value = Math.floor(value / 0x80);
+    }
+    this.ops.push(value);
+  }
+
+  private flushOps() {
+    if (this.ops.length === 0) return;
+    this.chunks.push(Buffer.from(this.ops));
+    this.ops = [];
+  }
+}
+
+function hashAt(buf: Buffer, i: number): number {
+  const a = buf.readUInt32LE(i);
+  const b = buf.readUInt32LE(i + 4);
+  return (Math.imul(a, 0x9e3779b1) ^ Math.imul(b, 0x85ebca77)) >>> (32 - HASH_BITS);
+}
+
+function matchLength(source: Buffer, s: number, target: Buffer, t: number): number {
+  let n = 0;
+  while (s + n < source.length && t + n < target.length && source[s + n] === target[t + n]) n++;
+  return n;
+}
+
+export function createPatch(source: Buffer, target: Buffer): Buffer {
+  const index = new Int32Array(1 << HASH_BITS).fill(-1);
+  for (let i = 0; i + KEY_LENGTH <= source.length; i++) {
+    index[hashAt(source, i)] = i;
+  }
+
+  const writer = new PatchWriter();
+  writer.header(source.length, target.length);
+
+  let literalStart = 0;
+  let lastSourceEnd = 0;
+  let i = 0;
+
+  while (i + KEY_LENGTH <= target.length) {
+    // Candidates: the same relative position as the previous copy (an
+    // in-place edit) and the last source position with the same 8-byte key.
+    const candidates = [lastSourceEnd + (i - literalStart), index[hashAt(target, i)]];
+    let bestOffset = -1;
+    let bestLength = 0;
+    let bestBack = 0;
+
+    for (const candidate of candidates) {
+      if (candidate < 0 || candidate + KEY_LENGTH > source.length) continue;
+      const length = matchLength(source, candidate, target, i);
+      if (length < KEY_LENGTH) continue;
+
+      let back = 0;
+      while (i - back > literalStart && candidate - back > 0 && target[i - back - 1] === source[candidate - back - 1]) {
+        back++;
+      }
+      if (length + back > bestLength + bestBack) {
+        bestOffset = candidate;
+        bestLength = length;
+        bestBack = back;
+      }
+    }
+
+    if (bestLength + bestBack >= MIN_MATCH) {
+      const copyStart = bestOffset - bestBack;
+      writer.literal(target.subarray(literalStart, i - bestBack));
+      writer.copy(copyStart - lastSourceEnd, bestLength + bestBack);
+      lastSourceEnd = bestOffset + bestLength;
+      i += bestLength;
+      literalStart = i;
+    } else {
+      i++;
+    }
+  }
+
+  writer.literal(target.subarray(literalStart));
+  return writer.end();
+}
+
+export function applyPatch(source: Buffer, patch: Buffer): Buffer {
+  if (patch.length < 12 || patch.toString('ascii', 0, 4) !== RDP_MAGIC) {
+    throw new Error('Bad patch magic');
+  }
+  if (patch.readUInt32LE(4) !== source.length) {
+    throw new Error('Patch base size mismatch');
+  }
+
+  const output = Buffer.alloc(patch.readUInt32LE(8));
+  let pos = 12;
+  let out = 0;
+  let lastSourceEnd = 0;
+
+  const varint = (): number => {
+    let value = 0;
+    let scale = 1;
+    for (;;) {
+      if (pos >= patch.length) throw new Error('Truncated patch');
+      const b = patch[pos++];
+      value += (b & 0x7f) * scale;
+      if ((b & 0x80) === 0) return value;
+      scale *= 0x80;
+    }
+  };
+
+  for (;;) {
+    if (pos >= patch.length) throw new Error('Truncated patch');
+    const op = patch[pos++];
+    if (op === OP_END) break;
+
+    if (op === OP_COPY) {
+      const zigzag = varint();
+      const delta = zigzag % 2 === 0 ? zigzag / 2 : -(zigzag + 1) / 2;
+      const offset = lastSourceEnd + delta;
+      const length = varint();
+      if (offset < 0 || offset + length > source.length || out + length > output.length) {
+        throw new Error('Patch copy out of range');
+      }
+      source.copy(output, out, offset, offset + length);
+      out += length;
+      lastSourceEnd = offset + length;
+    } else if (op === OP_LITERAL) {
+      const length = varint();
+      if (pos + length > patch.length || out + length > output.length) {
+        throw new Error('Patch literal out of range');
+      }
+      patch.copy(output, out, pos, pos + length);
+      pos += length;
+      out += length;
+    } else {
+      throw new Error(`Unknown patch op ${op}`);
+    }
+  }
+
+  if (out !== output.length) {
+    throw new Error('Patch output size mismatch');
+  }
+  return output;
+}
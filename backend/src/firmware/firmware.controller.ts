@@ -63,7 +63,7 @@ export class FirmwareController {
 
     @Post('deploy/batch')
     @ApiOperation({ summary: 'Deploy firmware to multiple devices' })
-    async batchDeploy(@Body() deployData: { devices: string[]; firmwareId: string }) {
+    async batchDeploy(@Body() deployData: { devices: string[]; firmwareId: string; broadcast?: boolean }) {
         try {
             if (!deployData.firmwareId) {
                 throw new HttpException('Firmware ID is required', HttpStatus.BAD_REQUEST);
@@ -73,7 +73,7 @@ export class FirmwareController {
             }
             
             console.log('Batch deploy request:', deployData);
-            const result = await this.firmwareService.batchDeploy(deployData.devices, deployData.firmwareId);
+            const result = await this.firmwareService.batchDeploy(deployData.devices, deployData.firmwareId, !!deployData.broadcast);
             console.log('Batch deploy result:', result);
             return result;
         } catch (error) {
@@ -3,6 +3,7 @@ import { MqttService } from '../mqtt/mqtt.service';
 import { StorageService } from '../storage/storage.service';
 import { S3Service } from '../s3/s3.service';
 import { UploadFirmwareDto } from './dtos/upload-firmware.dto';
+import { BroadcastOffer } from '../mqtt/firmware-broadcast';
 
 
 @Injectable()
@@ -16,7 +17,7 @@ export class FirmwareService {
     private readonly s3Service: S3Service,
   ) { }
 
-  async deployToDevice(deviceId: string, firmwareId: string) {
+  async deployToDevice(deviceId: string, firmwareId: string, broadcast?: BroadcastOffer) {
     try {
       console.log(`Attempting to deploy firmware ${firmwareId} to device ${deviceId}`);
       const firmware = await this.storageService.getFirmwareById(firmwareId);
@@ -30,8 +31,14 @@ export class FirmwareService {
       const deployment = await this.storageService.recordFirmwareDeployment(deviceId, firmwareId, 'PENDING');
       console.log(`Recorded deployment with ID: ${deployment.id}`);
 
-      // Send firmware URL to device via MQTT
-      await this.mqttService.publishFirmwareResponse(deviceId, firmware.s3Key);
+      // Send firmware URL to device via MQTT. A response that was never sent
+      // will not be answered, so the deployment fails now.
+      try {
+        await this.mqttService.publishFirmwareResponse(deviceId, firmware.s3Key, firmware, broadcast);
+      } catch (error) {
+        await this.storageService.updateDeploymentStatus(deviceId, 'FAILED', error.message);
+        throw error;
+      }
       console.log(`Sent firmware URL to device ${deviceId} via MQTT`);
 
       this.logger.log(`Initiated firmware deployment ${firmware.name} v${firmware.version} to device ${deviceId}`);
@@ -54,12 +61,23 @@ export class FirmwareService {
     }
   }
 
-  async batchDeploy(deviceIds: string[], firmwareId: string) {
+  async batchDeploy(deviceIds: string[], firmwareId: string, broadcast = false) {
     try {
       console.log(`Starting batch deployment of firmware ${firmwareId} to devices:`, deviceIds);
-      
+
+      // A broadcast sends the image once over MQTT to every device at the
+      // same time. Otherwise devices on a known LAN are released in waves
+      // as their peers come up, so each site pulls the image from S3 about
+      // once; the rest are deployed right away.
+      const firmware = await this.storageService.getFirmwareById(firmwareId);
+      const offer = firmware && broadcast ? await this.mqttService.startBroadcast(firmware, deviceIds) : null;
+      const direct = firmware && !offer
+        ? this.mqttService.stagePeerRollout(deviceIds, firmware.sha256, deviceId => this.deployToDevice(deviceId, firmwareId))
+        : deviceIds;
+      const staged = deviceIds.length - direct.length;
+
       const results = await Promise.allSettled(
-        deviceIds.map(deviceId => this.deployToDevice(deviceId, firmwareId))
+        direct.map(deviceId => this.deployToDevice(deviceId, firmwareId, offer ?? undefined))
       );
 
       const successful = results.filter(r => r.status === 'fulfilled').length;
@@ -67,17 +85,19 @@ export class FirmwareService {
 
       results.forEach((result, index) => {
         if (result.status === 'rejected') {
-          console.error(`Failed to deploy to ${deviceIds[index]}:`, result.reason);
+          console.error(`Failed to deploy to ${direct[index]}:`, result.reason);
         }
       });
 
-      console.log(`Batch deployment completed: ${successful} successful, ${failed} failed`);
+      console.log(`Batch deployment completed: ${successful} successful, ${failed} failed, ${staged} staged for peer rollout${offer ? ', broadcast' : ''}`);
 
       return {
         status: 'completed',
-        message: `Deployment completed: ${successful} successful, ${failed} failed`,
+        message: `Deployment completed: ${successful} successful, ${failed} failed, ${staged} staged for peer rollout`,
         successful,
         failed,
+        staged,
+        broadcast: !!offer,
         results,
       };
     } catch (error) {
@@ -245,6 +265,8 @@ export class FirmwareService {
         firmwareVersion,
         file.buffer
       );
+      // Built in the background; failures are logged
+      void this.storageService.preparePatches(firmware);
 
       return {
         status: 'success',
@@ -280,8 +302,10 @@ export class FirmwareService {
         }
       }
 
-      // Auto-deploy if requested
+      // Auto-deploy if requested, once the patches are there to offer
+      const patches = this.storageService.preparePatches(firmware);
       if (uploadDto.autoDeploy && uploadDto.targetDevices?.length) {
+        await patches;
         await this.batchDeploy(uploadDto.targetDevices, firmware.id);
       }
 
@@ -356,6 +380,9 @@ export class FirmwareService {
         },
         appliedAt: p.appliedAt,
       })),
+      // Batch deploys still held for LAN peers
+      rollouts: this.mqttService.getPeerRollouts(),
+      broadcasts: this.mqttService.getBroadcasts(),
     };
   }
 
@@ -0,0 +1,168 @@
+/**
+ * Sends one firmware image over a shared topic, roidota/fw/<firmwareId>, to
+ * every device updating to it, instead of one S3 download per device. Each
+ * chunk goes out as <index: uint32 big-endian><bytes>, paced, and a pass
+ * ends with a bare 0xFFFFFFFF index. Devices tick chunks off in a bitmap
+ * (lib/RoidOTA/RoidBroadcast) and ask for what they missed on
+ * roidota/repair. Requests are pooled for a short window and their union is
+ * sent again on the same topic, so a chunk many devices lost goes out once.
+ */
+
+// Must divide the 4096-byte flash sector and fit ROIDOTA_OTA_CHUNK_SIZE
+export const BROADCAST_CHUNK_SIZE = 1024;
+// Pacing: chunks per tick, about 160 KB/s at these values
+export const BROADCAST_CHUNKS_PER_TICK = 8;
+export const BROADCAST_TICK_MS = 50;
+// Time between the offers and the first pass, for devices to subscribe
+export const BROADCAST_LEAD_MS = 3000;
+export const BROADCAST_REPAIR_WINDOW_MS = 1000;
+// A broadcast nobody has asked anything of for this long is dropped;
+// devices still on it download the image instead.
+export const BROADCAST_IDLE_TIMEOUT_MS = 2 * 60 * 1000;
+
+const END_OF_PASS = 0xffffffff;
+
+// The "broadcast" field of an OTA offer
+export interface BroadcastOffer {
+  id: string;
+  chunk_size: number;
+  size: number;
+}
+
+export class FirmwareBroadcast {
+  readonly chunkCount: number;
+  private readonly waiting: Set<string>;
+  // Chunks still to send in the current pass, and repairs for the next
+  private queue: number[] = [];
+  private readonly repairs = new Set<number>();
+  private repairTimer?: NodeJS.Timeout;
+  private passTimer?: NodeJS.Timeout;
+  private sending = false;
+  private lastActivity = Date.now();
+  private passes = 0;
+  private chunksSent = 0;
+  private repairRequests = 0;
+
+  constructor(
+    readonly firmwareId: string,
+    private readonly image: Buffer,
+    deviceIds: string[],
+    private readonly publish: (payload: Buffer) => Promise<unknown>,
+    private readonly onDone: () => void,
+  ) {
+    this.chunkCount = Math.ceil(image.length / BROADCAST_CHUNK_SIZE);
+    this.waiting = new Set(deviceIds);
+  }
+
+  offer(): BroadcastOffer {
+    return { id: this.firmwareId, chunk_size: BROADCAST_CHUNK_SIZE, size: this.image.length };
+  }
+
+  start(): void {
+    this.passTimer = setTimeout(() => this.send(Array.from({ length: this.chunkCount }, (_, i) => i)), BROADCAST_LEAD_MS);
+  }
+
+  // Devices offered this image after the first pass pick up the rest
+  // through repairs.
+  join(deviceIds: string[]): void {
+    for (const deviceId of deviceIds) this.waiting.add(deviceId);
+    this.lastActivity = Date.now();
+  }
+
+  repair(deviceId: string, missing: unknown): void {
+    if (!Array.isArray(missing)) return;
+    this.lastActivity = Date.now();
+    this.repairRequests++;
+    this.waiting.add(deviceId);
+
+    for (const range of missing) {
+      if (!Array.isArray(range) || range.length !== 2) continue;
+      const first = Math.max(0, Math.floor(Number(range[0])));
+      const last = Math.min(this.chunkCount - 1, Math.floor(Number(range[1])));
+      for (let i = first; i <= last; i++) this.repairs.add(i);
+    }
+
+    if (!this.repairTimer) {
+      this.repairTimer = setTimeout(() => {
+        this.repairTimer = undefined;
+        this.flushRepairs();
+      }, BROADCAST_REPAIR_WINDOW_MS);
+    }
+  }
+
+  // A device ACKed, either way; the broadcast ends with its last device.
+  finished(deviceId: string): boolean {
+    if (!this.waiting.delete(deviceId)) return false;
+    if (!this.waiting.size) this.stop();
+    return true;
+  }
+
+  expire(now = Date.now()): void {
+    if (now - this.lastActivity > BROADCAST_IDLE_TIMEOUT_MS) this.stop();
+  }
+
+  stop(): void {
+    clearTimeout(this.repairTimer);
+    clearTimeout(this.passTimer);
+    this.repairTimer = undefined;
+    this.passTimer = undefined;
+    this.queue = [];
+    this.onDone();
+  }
+
+  stats() {
+    return {
+      firmwareId: this.firmwareId,
+      chunks: this.chunkCount,
+      waiting: this.waiting.size,
+      passes: this.passes,
+      chunksSent: this.chunksSent,
+      repairRequests: this.repairRequests,
+    };
+  }
+
+  // Repairs wait for the pass in progress to end; it may well carry what
+  // was asked for.
+  private flushRepairs(): void {
+    if (this.sending) {
+      this.repairTimer = setTimeout(() => {
+        this.repairTimer = undefined;
+        this.flushRepairs();
+      }, BROADCAST_REPAIR_WINDOW_MS);
+      return;
+    }
+    const chunks = Array.from(this.repairs).sort((a, b) => a - b);
+    this.repairs.clear();
+    if (chunks.length) this.send(chunks);
+  }
+
+  private async send(chunks: number[]): Promise<void> {
+    this.passTimer = undefined;
+    this.sending = true;
+    this.queue = chunks;
+    try {
+      while (this.queue.length) {
+        const tick = this.queue.splice(0, BROADCAST_CHUNKS_PER_TICK);
+        await Promise.all(tick.map((index) => this.publish(this.chunk(index))));
+        this.chunksSent += tick.length;
+        if (this.queue.length) await new Promise((resolve) => setTimeout(resolve, BROADCAST_TICK_MS));
+      }
+      const end = Buffer.alloc(4);
+      end.writeUInt32BE(END_OF_PASS, 0);
+      await this.publish(end);
+      this.passes++;
+    } catch {
+      // Devices ask again for whatever did not go out
+    } finally {
+      this.sending = false;
+      this.lastActivity = Date.now();
+    }
+  }
+
+  private chunk(index: number): Buffer {
+    const header = Buffer.alloc(4);
+    header.writeUInt32BE(index, 0);
+    const start = index * BROADCAST_CHUNK_SIZE;
+    return Buffer.concat([header, this.image.subarray(start, start + BROADCAST_CHUNK_SIZE)]);
+  }
+}
@@ -0,0 +1,49 @@
+/**
+ * Firmware objects kept in memory for devices that download over MQTT
+ * (roidota/fetch), so a window of chunks is a slice of a Buffer rather than
+ * an S3 request. Least recently used objects are dropped past the byte
+ * limit; concurrent loads of one key share a single download.
+ */
+
+// Enough for a few images with their compressed and patch variants
+export const FIRMWARE_CACHE_MAX_BYTES = 32 * 1024 * 1024;
+
+export class FirmwareCache {
+  // Map iteration order doubles as the recency order
+  private readonly objects = new Map<string, Buffer>();
+  private readonly loading = new Map<string, Promise<Buffer>>();
+  private bytes = 0;
+
+  constructor(
+    private readonly load: (key: string) => Promise<Buffer>,
+    private readonly maxBytes = FIRMWARE_CACHE_MAX_BYTES,
+  ) {}
+
+  async get(key: string): Promise<Buffer> {
+    const cached = this.objects.get(key);
+    if (cached) {
+      this.objects.delete(key);
+      this.objects.set(key, cached);
+      return cached;
+    }
+
+    let pending = this.loading.get(key);
+    if (!pending) {
+      pending = this.load(key).finally(() => this.loading.delete(key));
+      this.loading.set(key, pending);
+      pending.then((object) => this.put(key, object), () => undefined);
+    }
+    return pending;
+  }
+
+  private put(key: string, object: Buffer): void {
+    if (this.objects.has(key) || object.length > this.maxBytes) return;
+    this.objects.set(key, object);
+    this.bytes += object.length;
+    for (const [oldest, buffer] of this.objects) {
+      if (this.bytes <= this.maxBytes) break;
+      this.objects.delete(oldest);
+      this.bytes -= buffer.length;
+    }
+  }
+}
@@ -4,9 +4,10 @@ import { ConfigModule } from '@nestjs/config';
 import { DeviceModule } from '../device/device.module';
 import { StorageModule } from '../storage/storage.module';
 import { S3Module } from '../s3/s3.module';
+import { DeltaModule } from '../delta/delta.module';
 
 @Module({
-  imports :[ConfigModule, DeviceModule, StorageModule, S3Module],
+  imports :[ConfigModule, DeviceModule, StorageModule, S3Module, DeltaModule],
   providers: [MqttService],
   exports: [MqttService],
 })
@@ -1,27 +1,55 @@
 import { Injectable, Logger, OnModuleInit, OnModuleDestroy } from '@nestjs/common';
 import { ConfigService } from '@nestjs/config';
 import * as mqtt from 'mqtt';
+import { Firmware } from '@prisma/client';
 import {
   DeviceStatus,
   DeviceRequest,
+  DeviceLogBatch,
+  DeviceRepair,
+  DeviceFetch,
   MQTT_TOPICS,
 } from './types';
 import { Cron } from '@nestjs/schedule';
 import { DeviceService } from 'src/device/device.service';
-import { StorageService } from 'src/storage/storage.service';
+import { DeploymentNotFoundError, StorageService } from 'src/storage/storage.service';
 import { S3Service } from 'src/s3/s3.service';
+import { DeltaService } from 'src/delta/delta.service';
+import { HEATSHRINK_LOOKAHEAD_BITS, HEATSHRINK_WINDOW_BITS } from 'src/storage/heatshrink';
+import { decodeDevicePayload } from './msgpack';
+import { PeerRollout, PeerSource } from './peer-rollout';
+import { BroadcastOffer, FirmwareBroadcast } from './firmware-broadcast';
+import { FirmwareCache } from './firmware-cache';
+
+// Bounds on a roidota/fetch window, whatever the device asks for
+const FETCH_MAX_CHUNK = 4096;
+const FETCH_MAX_COUNT = 64;
+// The largest OTA response a device can take, ROIDOTA_RESPONSE_MAX_BYTES in
+// lib/RoidOTA/RoidOTA.h; a bigger one would be dropped by its MQTT client.
+const MAX_RESPONSE_BYTES = 3072;
 
 @Injectable()
 export class MqttService implements OnModuleInit, OnModuleDestroy {
   private readonly logger = new Logger(MqttService.name);
   private client: mqtt.MqttClient;
   private deviceStatuses: Map<string, DeviceStatus> = new Map();
+  // Last ACK seen per device, by firmware ID and sequence number; devices
+  // resend an ACK until it is confirmed, so repeats must not be applied
+  // twice. The firmware ID keeps an ACK for the next update from looking
+  // like a repeat when the numbering has started over.
+  private ackSeqs: Map<string, string> = new Map();
+  private readonly peerRollout = new PeerRollout((lan, sha256) => this.peersOn(lan, sha256));
+  // Firmware broadcasts in progress, by firmware ID
+  private readonly broadcasts = new Map<string, FirmwareBroadcast>();
+  // Images served over MQTT to devices fetching them in windows
+  private readonly firmwareCache = new FirmwareCache((key) => this.s3Service.downloadFirmware(key));
 
   constructor(
     private readonly configService: ConfigService, 
     private readonly deviceService: DeviceService,
     private readonly storageService: StorageService,
     private readonly s3Service: S3Service,
+    private readonly deltaService: DeltaService,
   ) {}
 
   async onModuleInit() {
@@ -55,10 +83,20 @@ export class MqttService implements OnModuleInit, OnModuleDestroy {
         if (err) this.logger.error(`Failed to subscribe to ${MQTT_TOPICS.ACK}+`, err);
         else this.logger.log(`Subscribed to ${MQTT_TOPICS.ACK}+`);
       });
+
+      this.client.subscribe(MQTT_TOPICS.REPAIR, (err) => {
+        if (err) this.logger.error(`Failed to subscribe to ${MQTT_TOPICS.REPAIR}`, err);
+        else this.logger.log(`Subscribed to ${MQTT_TOPICS.REPAIR}`);
+      });
+
+      this.client.subscribe(MQTT_TOPICS.FETCH, (err) => {
+        if (err) this.logger.error(`Failed to subscribe to ${MQTT_TOPICS.FETCH}`, err);
+        else this.logger.log(`Subscribed to ${MQTT_TOPICS.FETCH}`);
+      });
     });
 
     this.client.on('message', (topic, payload) => {
-      this.handleMessage(topic, payload.toString());
+      this.handleMessage(topic, payload);
     });
 
     this.client.on('error', (error) => {
@@ -72,7 +110,7 @@ export class MqttService implements OnModuleInit, OnModuleDestroy {
     }
   }
 
-  private async getCurrentFirmware(deviceId: string): Promise<string | null> {
+  private async getCurrentFirmware(deviceId: string): Promise<Firmware | null> {
     try {
       const device = await this.deviceService.findByDeviceId(deviceId);
       return device?.currentFirmware || null;
@@ -96,23 +134,183 @@ export class MqttService implements OnModuleInit, OnModuleDestroy {
     });
   }
 
-  async publishFirmwareResponse(deviceId: string, s3Key: string): Promise<void> {
+  async publishFirmwareResponse(deviceId: string, s3Key: string, firmware?: { id: string; compressedS3Key?: string | null; size?: number | null; sha256?: string | null; signature?: string | null }, broadcast?: BroadcastOffer): Promise<void> {
     const topic = `${MQTT_TOPICS.RESPONSE}${deviceId}`;
     const currentFirmware = await this.getCurrentFirmware(deviceId);
 
     // Generate signed URL for the S3 key (valid for 1 hour)
     const signedUrl = await this.s3Service.getSignedDownloadUrl(s3Key, 3600);
+    const patchFields = await this.getPatchFields(deviceId, currentFirmware, firmware?.id, s3Key);
+    const compressionFields = await this.getCompressionFields(firmware);
 
     const message = JSON.stringify({
       firmware_url: signedUrl,
-      current_firmware: currentFirmware || 'unknown',
+      // Digest of the image as flashed, whichever download the device picks
+      ...(firmware?.sha256 ? { sha256: firmware.sha256 } : {}),
+      ...(firmware?.signature ? { signature: firmware.signature } : {}),
+      ...compressionFields,
+      ...patchFields,
+      ...this.getPeerFields(deviceId, firmware),
+      // Devices join the broadcast first and keep the URLs as fallback
+      ...(broadcast && firmware?.sha256 ? { broadcast } : {}),
+      // Devices set up for it fetch the same images over MQTT instead,
+      // see handleFetchRequest()
+      ...(firmware ? { firmware_id: firmware.id, mqtt_transport: true } : {}),
       timestamp: Date.now(),
       device_id: deviceId
     });
 
+    const bytes = Buffer.byteLength(message);
+    if (bytes > MAX_RESPONSE_BYTES) {
+      throw new Error(`OTA response for ${deviceId} is ${bytes} bytes, devices take at most ${MAX_RESPONSE_BYTES}`);
+    }
     await this.publish(topic, message);
   }
 
+  // Offers a binary patch against the device's current firmware when one is
+  // ready and worth it; the full image URL is always sent as the fallback.
+  private async getPatchFields(deviceId: string, currentFirmware: Pick<Firmware, 'id' | 's3Key'> | null, firmwareId: string | undefined, s3Key: string): Promise<Record<string, any>> {
+    if (!currentFirmware || !firmwareId || currentFirmware.id === firmwareId) {
+      return {};
+    }
+
+    try {
+      const patch = await this.deltaService.getPatch(currentFirmware, { id: firmwareId, s3Key });
+      if (!patch) {
+        return {};
+      }
+
+      return {
+        patch_url: await this.s3Service.getSignedDownloadUrl(patch.s3Key, 3600),
+        patch_base_md5: patch.baseMd5,
+        patch_size: patch.size,
+      };
+    } catch (error) {
+      this.logger.error(`Failed to prepare patch for device ${deviceId}, sending full image`, error);
+      return {};
+    }
+  }
+
+  // Older devices ignore these fields and keep using firmware_url.
+  private async getCompressionFields(firmware?: { compressedS3Key?: string | null; size?: number | null }): Promise<Record<string, any>> {
+    if (!firmware?.compressedS3Key) {
+      return {};
+    }
+
+    return {
+      compressed_url: await this.s3Service.getSignedDownloadUrl(firmware.compressedS3Key, 3600),
+      compression: 'heatshrink',
+      compression_window: HEATSHRINK_WINDOW_BITS,
+      compression_lookahead: HEATSHRINK_LOOKAHEAD_BITS,
+      ...(firmware.size ? { firmware_size: firmware.size } : {}),
+    };
+  }
+
+  // Devices on the same LAN already running this image, tried before any
+  // S3 URL. Without a digest the device could not check what a peer sends,
+  // so none are offered; older devices ignore the field.
+  private getPeerFields(deviceId: string, firmware?: { sha256?: string | null }): Record<string, any> {
+    const lan = this.deviceStatuses.get(deviceId)?.lan;
+    if (!lan || !firmware?.sha256) {
+      return {};
+    }
+
+    const urls = this.peerRollout.peerUrls(deviceId, lan, firmware.sha256);
+    return urls.length ? { peer_urls: urls } : {};
+  }
+
+  private peersOn(lan: string, sha256: string): PeerSource[] {
+    const peers: PeerSource[] = [];
+    for (const status of this.deviceStatuses.values()) {
+      if (status.status === 'offline' || status.lan !== lan || !status.ip || status.peer?.sha256 !== sha256) continue;
+      peers.push({
+        deviceId: status.deviceId,
+        url: `http://${status.ip}:${status.peer.port}/fw/${sha256}`,
+        slots: status.peer.slots,
+      });
+    }
+    return peers;
+  }
+
+  // Stages a batch deploy per LAN, see PeerRollout; deploy() is called for
+  // each device as its wave comes. Returns the devices that cannot be
+  // staged, with no known LAN or an image without a digest, for the caller
+  // to deploy directly.
+  stagePeerRollout(deviceIds: string[], sha256: string | null | undefined, deploy: (deviceId: string) => Promise<unknown>): string[] {
+    const direct: string[] = [];
+    const byLan = new Map<string, string[]>();
+    for (const deviceId of deviceIds) {
+      const lan = this.deviceStatuses.get(deviceId)?.lan;
+      if (!lan || !sha256) {
+        direct.push(deviceId);
+        continue;
+      }
+      byLan.set(lan, [...(byLan.get(lan) ?? []), deviceId]);
+    }
+
+    for (const [lan, ids] of byLan) {
+      this.logger.log(`Staging ${ids.length} device(s) on LAN ${lan} for peer rollout`);
+      this.peerRollout.stage(lan, sha256!, ids, deploy);
+    }
+    return direct;
+  }
+
+  getPeerRollouts() {
+    return this.peerRollout.pending();
+  }
+
+  // Starts sending an image on its broadcast topic, or adds devices to the
+  // broadcast already sending it, and returns the offer for their OTA
+  // responses. Devices verify what they assemble against the digest, so an
+  // image without one is not broadcast.
+  async startBroadcast(firmware: { id: string; s3Key: string; sha256?: string | null }, deviceIds: string[]): Promise<BroadcastOffer | null> {
+    if (!firmware.sha256) {
+      return null;
+    }
+
+    const running = this.broadcasts.get(firmware.id);
+    if (running) {
+      running.join(deviceIds);
+      return running.offer();
+    }
+
+    const image = await this.s3Service.downloadFirmware(firmware.s3Key);
+    const topic = `${MQTT_TOPICS.FIRMWARE}${firmware.id}`;
+    const broadcast = new FirmwareBroadcast(
+      firmware.id,
+      image,
+      deviceIds,
+      (payload) => this.publishChunk(topic, payload),
+      () => {
+        this.logger.log(`Broadcast of ${firmware.id} finished: ${JSON.stringify(broadcast.stats())}`);
+        this.broadcasts.delete(firmware.id);
+      },
+    );
+    this.broadcasts.set(firmware.id, broadcast);
+    broadcast.start();
+    this.logger.log(`Broadcasting ${firmware.id} to ${deviceIds.length} device(s) on ${topic}: ${broadcast.chunkCount} chunks`);
+    return broadcast.offer();
+  }
+
+  getBroadcasts() {
+    return Array.from(this.broadcasts.values()).map((broadcast) => broadcast.stats());
+  }
+
+  // QoS 0 and no per-message log: a lost chunk is repaired, or asked for
+  // again by a device fetching over MQTT
+  private publishChunk(topic: string, payload: Buffer): Promise<void> {
+    return new Promise((resolve, reject) => {
+      this.client.publish(topic, payload, { qos: 0 }, (error) => {
+        if (error) {
+          this.logger.error(`Failed to publish to ${topic}`, error);
+          reject(error);
+        } else {
+          resolve();
+        }
+      });
+    });
+  }
+
   async sendCommand(deviceId: string, command: string, params?: Record<string, any>): Promise<void> {
     const topic = `${MQTT_TOPICS.CMD}${deviceId}`;
     const message = JSON.stringify({
@@ -137,19 +335,29 @@ export class MqttService implements OnModuleInit, OnModuleDestroy {
     return this.deviceStatuses.get(deviceId);
   }
 
-  private handleMessage(topic: string, message: string) {
+  // Devices send JSON or, once negotiated, MessagePack; both decode to the
+  // same object, with the device ID taken from the topic for binary ones.
+  private decode(topic: string, prefix: string, payload: Buffer): any {
+    return decodeDevicePayload(payload, topic.replace(prefix, ''));
+  }
+
+  private handleMessage(topic: string, payload: Buffer) {
     try {
-      this.logger.debug(`Received MQTT message on topic: ${topic}, message: ${message}`);
+      this.logger.debug(`Received MQTT message on topic: ${topic}, ${payload.length} bytes`);
       
       if (topic === MQTT_TOPICS.REQUEST) {
-        this.handleDeviceRequest(message);
+        this.handleDeviceRequest(payload);
+      } else if (topic === MQTT_TOPICS.REPAIR) {
+        this.handleRepairRequest(payload);
+      } else if (topic === MQTT_TOPICS.FETCH) {
+        this.handleFetchRequest(payload);
       } else if (topic.startsWith(MQTT_TOPICS.STATUS)) {
-        this.handleDeviceStatus(topic, message);
+        this.handleDeviceStatus(topic, payload);
       } else if (topic.startsWith(MQTT_TOPICS.LOGS)) {
-        this.handleDeviceLogs(topic, message);
+        this.handleDeviceLogs(topic, payload);
       } else if (topic.startsWith(MQTT_TOPICS.ACK)) {
         this.logger.debug(`Calling handleDeviceAck for topic: ${topic}`);
-        this.handleDeviceAck(topic, message);
+        this.handleDeviceAck(topic, payload);
       } else {
         this.logger.warn(`Unhandled MQTT topic: ${topic}`);
       }
@@ -158,77 +366,235 @@ export class MqttService implements OnModuleInit, OnModuleDestroy {
     }
   }
 
-  private async handleDeviceRequest(message: string) {
+  private async handleDeviceRequest(payload: Buffer) {
     try {
-      const request: DeviceRequest = JSON.parse(message);
-      this.logger.log(`Device request from ${request.device_id}: ${message}`);
+      const request: DeviceRequest = decodeDevicePayload(payload);
+      this.logger.log(`Device request from ${request.device_id}: ${JSON.stringify(request)}`);
 
       await this.deviceService.findOrCreateDevice(request.device_id, request.ip);
 
       const currentFirmware = await this.getCurrentFirmware(request.device_id);
 
       const existingStatus = this.deviceStatuses.get(request.device_id) || {} as DeviceStatus;
+      // Sleeping devices send nothing but this request; it carries their
+      // heartbeat, and their wake interval stands in for the heartbeat
+      // interval when judging them offline.
+      const status = request.status?.toLowerCase();
+      const wake: Partial<DeviceStatus> = request.sleep ? {
+        status: status === 'updating' ? 'updating' : status === 'error' ? 'error' : 'online',
+        rssi: request.rssi ?? existingStatus.rssi,
+        freeHeap: request.free_heap ?? existingStatus.freeHeap,
+        minFreeHeap: request.min_free_heap ?? existingStatus.minFreeHeap,
+        largestFreeBlock: request.largest_block ?? existingStatus.largestFreeBlock,
+        heartbeatInterval: request.sleep.interval,
+        sleep: request.sleep,
+        boot: request.boot ?? existingStatus.boot,
+      } : {};
       this.deviceStatuses.set(request.device_id, {
         ...existingStatus,
         deviceId: request.device_id,
         ip: request.ip,
         lastSeen: new Date(),
+        lan: request.lan ?? existingStatus.lan,
+        // Only a device that says so serves; a rolled-back one stops
+        peer: request.peer,
+        ...wake,
       });
 
+      if (request.lan && request.peer) {
+        this.peerRollout.peerAnnounced(request.lan, request.peer.sha256);
+      }
+
+      // Devices offering the binary format switch to it once told to;
+      // older devices never offer and stay on JSON.
+      if (request.wire === 'msgpack') {
+        await this.sendCommand(request.device_id, 'wire', { format: 'msgpack' });
+      }
+
     } catch (error) {
       this.logger.error('Failed to handle device request', error);
     }
   }
 
-  private async handleDeviceStatus(topic: string, message: string) {
+  private handleRepairRequest(payload: Buffer) {
+    try {
+      const repair: DeviceRepair = JSON.parse(payload.toString());
+      const broadcast = this.broadcasts.get(repair.firmware_id);
+      if (!broadcast) {
+        this.logger.warn(`Repair request from ${repair.device_id} for ${repair.firmware_id}, which is not being broadcast`);
+        return;
+      }
+      this.logger.debug(`Repair request from ${repair.device_id}: ${repair.received}/${broadcast.chunkCount} chunks, ${repair.missing?.length ?? 0} range(s) missing`);
+      broadcast.repair(repair.device_id, repair.missing);
+    } catch (error) {
+      this.logger.error('Failed to handle repair request', error);
+    }
+  }
+
+  // Answers a window request on roidota/chunk/<device_id>, one message per
+  // chunk: <offset: uint32 big-endian><total: uint32 big-endian><bytes>,
+  // total being the object's size. A bare header with total 0 tells the
+  // device the object cannot be served. The device asks for the next window
+  // once it has written this one, so this is its flow control.
+  private async handleFetchRequest(payload: Buffer) {
+    let fetch: DeviceFetch | undefined;
+    try {
+      fetch = JSON.parse(payload.toString()) as DeviceFetch;
+      const topic = `${MQTT_TOPICS.CHUNK}${fetch.device_id}`;
+      const key = await this.resolveFetchKey(fetch);
+      const object = key ? await this.firmwareCache.get(key) : null;
+      if (!object) {
+        this.logger.warn(`Fetch from ${fetch.device_id} for ${fetch.source} of ${fetch.firmware_id}, which cannot be served`);
+        await this.publishChunk(topic, this.fetchChunk(0, 0));
+        return;
+      }
+
+      const chunk = Math.min(Math.max(Math.floor(Number(fetch.chunk)) || 0, 1), FETCH_MAX_CHUNK);
+      const count = Math.min(Math.max(Math.floor(Number(fetch.count)) || 0, 1), FETCH_MAX_COUNT);
+      const offset = Math.max(Math.floor(Number(fetch.offset)) || 0, 0);
+      this.logger.debug(`Fetch from ${fetch.device_id}: ${fetch.source} of ${fetch.firmware_id} at ${offset}/${object.length}, ${count} x ${chunk} bytes`);
+
+      const sends: Promise<void>[] = [];
+      for (let i = 0, start = offset; i < count && start < object.length; i++, start += chunk) {
+        sends.push(this.publishChunk(topic, this.fetchChunk(start, object.length, object.subarray(start, start + chunk))));
+      }
+      await Promise.all(sends);
+    } catch (error) {
+      this.logger.error(`Failed to handle fetch request${fetch?.device_id ? ` from ${fetch.device_id}` : ''}`, error);
+    }
+  }
+
+  // The S3 key behind a fetch, from the firmware record rather than the
+  // device; a patch is the one the OTA response offered, keyed by the
+  // device's current firmware.
+  private async resolveFetchKey(fetch: DeviceFetch): Promise<string | null> {
+    const firmware = fetch.firmware_id ? await this.storageService.getFirmwareById(fetch.firmware_id) : null;
+    if (!firmware) {
+      return null;
+    }
+
+    switch (fetch.source) {
+      case 'full':
+        return firmware.s3Key;
+      case 'compressed':
+        return firmware.compressedS3Key || null;
+      case 'patch': {
+        const currentFirmware = await this.getCurrentFirmware(fetch.device_id);
+        return currentFirmware ? this.deltaService.patchKey(currentFirmware.id, firmware.id) : null;
+      }
+      default:
+        return null;
+    }
+  }
+
+  private fetchChunk(offset: number, total: number, bytes?: Buffer): Buffer {
+    const header = Buffer.alloc(8);
+    header.writeUInt32BE(offset, 0);
+    header.writeUInt32BE(total, 4);
+    return bytes ? Buffer.concat([header, bytes]) : header;
+  }
+
+  private async handleDeviceStatus(topic: string, payload: Buffer) {
     try {
       const deviceId = topic.replace(MQTT_TOPICS.STATUS, '');
-      const status = JSON.parse(message.trim());
+      const status = this.decode(topic, MQTT_TOPICS.STATUS, payload);
 
       const currentFirmware = await this.getCurrentFirmware(deviceId);
       const currentTime = new Date();
 
+      // Between keyframes devices only send the fields that changed, so
+      // merge into what we already know.
+      // On-demand reports and the once-per-boot timings are not part of
+      // every heartbeat, so they survive keyframes.
+      const previous = this.deviceStatuses.get(deviceId);
+      const existing = status.keyframe ? undefined : previous;
+      const state = status.status === undefined ? existing?.status :
+        status.status === 'updating' ? 'updating' :
+        status.status === 'error' ? 'error' : 'online';
+
       this.deviceStatuses.set(deviceId, {
+        ...existing,
         deviceId,
-        status: status.status === 'updating' ? 'updating' :
-          status.status === 'error' ? 'error' : 'online',
-        ip: status.ip,
-        rssi: status.rssi,
-        uptime: status.uptime,
-        freeHeap: status.free_heap,
+        status: state === undefined || state === 'offline' ? 'online' : state,
+        ip: status.ip ?? existing?.ip,
+        rssi: status.rssi ?? existing?.rssi,
+        uptime: status.uptime ?? existing?.uptime,
+        freeHeap: status.free_heap ?? existing?.freeHeap,
+        minFreeHeap: status.min_free_heap ?? existing?.minFreeHeap,
+        largestFreeBlock: status.largest_block ?? existing?.largestFreeBlock,
+        heartbeatInterval: status.interval ?? existing?.heartbeatInterval,
+        memStats: status.memstats ?? previous?.memStats,
+        profile: status.profile ?? previous?.profile,
+        tasks: status.tasks ?? previous?.tasks,
+        boot: status.boot ?? previous?.boot,
         lastSeen: currentTime,
       });
 
-      this.logger.debug(`Status update from ${deviceId} at ${currentTime.toISOString()}: status=${status.status || 'online'}, RSSI=${status.rssi}, Uptime=${status.uptime}ms`);
+      this.logger.debug(`${status.keyframe ? 'Status' : 'Status delta'} from ${deviceId} at ${currentTime.toISOString()}: status=${status.status || 'online'}, RSSI=${status.rssi}, Uptime=${status.uptime}ms`);
     } catch (error) {
       this.logger.error(`Failed to parse device status from ${topic}`, error);
     }
   }
 
-  private handleDeviceLogs(topic: string, message: string) {
+  private handleDeviceLogs(topic: string, payload: Buffer) {
     try {
       const deviceId = topic.replace(MQTT_TOPICS.LOGS, '');
-      const logData = JSON.parse(message);
+      const logData = this.decode(topic, MQTT_TOPICS.LOGS, payload);
 
-      this.logger.log(`[${deviceId}] ${logData.level}: ${logData.message}`);
-      
+      // Older firmware sends one {level, message} object per line
+      if (!Array.isArray(logData.logs)) {
+        this.logger.log(`[${deviceId}] ${logData.level}: ${logData.message}`);
+        return;
+      }
+
+      const batch = logData as DeviceLogBatch;
+      for (const [timestamp, level, text] of batch.logs) {
+        this.logger.log(`[${deviceId}] ${level} @${timestamp}ms: ${text}`);
+      }
+      if (batch.dropped || batch.suppressed) {
+        this.logger.warn(`[${deviceId}] ${batch.dropped || 0} log entries dropped, ${batch.suppressed || 0} rate-limited`);
+      }
     } catch (error) {
       this.logger.error(`Failed to parse device logs from ${topic}`, error);
     }
   }
 
-  private async handleDeviceAck(topic: string, message: string) {
+  private async handleDeviceAck(topic: string, payload: Buffer) {
     try {
       const deviceId = topic.replace(MQTT_TOPICS.ACK, '');
-      const ackData = JSON.parse(message);
+      const ackData = this.decode(topic, MQTT_TOPICS.ACK, payload);
+      // Older firmware sends no sequence number and expects no confirmation
+      const ackKey = ackData.seq === undefined ? undefined : `${ackData.firmware_id ?? ''}:${ackData.seq}`;
+      if (ackKey !== undefined && this.ackSeqs.get(deviceId) === ackKey) {
+        // Already recorded; the device missed our confirm
+        this.logger.debug(`Repeated ACK ${ackKey} from ${deviceId}`);
+        await this.sendCommand(deviceId, 'confirm', { seq: ackData.seq });
+        return;
+      }
+      this.peerRollout.finished(deviceId, !!ackData.success);
+      for (const broadcast of this.broadcasts.values()) broadcast.finished(deviceId);
       this.logger.log(`success: ${ackData.success}, message: ${ackData.message}, status: ${ackData.status}, timestamp: ${ackData.timestamp}`);
-      if (ackData.success) {
-        this.logger.log(`OTA update successful for device ${deviceId} (status: ${ackData.status || 'unknown'}, timestamp: ${ackData.timestamp || 'unknown'})`);
-        await this.storageService.updateDeploymentStatus(deviceId, 'SUCCESS');
-      } else {
-        const errorMessage = ackData.message || 'Unknown error';
-        this.logger.error(`OTA update failed for device ${deviceId}: ${errorMessage} (status: ${ackData.status || 'unknown'})`);
-        await this.storageService.updateDeploymentStatus(deviceId, 'FAILED', errorMessage);
+      try {
+        if (ackData.success) {
+          this.logger.log(`OTA update successful for device ${deviceId} (status: ${ackData.status || 'unknown'}, timestamp: ${ackData.timestamp || 'unknown'})`);
+          await this.storageService.updateDeploymentStatus(deviceId, 'SUCCESS');
+        } else {
+          const errorMessage = ackData.message || 'Unknown error';
+          this.logger.error(`OTA update failed for device ${deviceId}: ${errorMessage} (status: ${ackData.status || 'unknown'})`);
+          await this.storageService.updateDeploymentStatus(deviceId, 'FAILED', errorMessage);
+        }
+      } catch (error) {
+        // Left unconfirmed, the device repeats the ACK until it is stored
+        if (!(error instanceof DeploymentNotFoundError)) {
+          this.logger.error(`Failed to record ACK from ${deviceId}${ackKey ? `, awaiting repeat of ${ackKey}` : ''}`, error);
+          return;
+        }
+        this.logger.warn(`${error.message}${ackKey ? `, confirming ACK ${ackKey} anyway` : ''}`);
+      }
+      // The device drops the ACK once confirmed, so only after it is stored
+      if (ackKey !== undefined) {
+        this.ackSeqs.set(deviceId, ackKey);
+        await this.sendCommand(deviceId, 'confirm', { seq: ackData.seq });
       }
     } catch (error) {
       this.logger.error(`Failed to parse device acknowledgment from ${topic}`, error);
@@ -250,10 +616,12 @@ export class MqttService implements OnModuleInit, OnModuleDestroy {
   @Cron('*/30 * * * * *')  // 30 seconds
   async checkDeviceExpirations() {
     const now = Date.now();
-    const offlineThreshold = 60000; // 60 seconds
+    const minOfflineThreshold = 60000; // 60 seconds
 
     for (const [deviceId, status] of this.deviceStatuses.entries()) {
       const lastSeen = new Date(status.lastSeen).getTime();
+      // Devices report their heartbeat interval; allow two missed beats
+      const offlineThreshold = Math.max(minOfflineThreshold, 2.5 * (status.heartbeatInterval ?? 0));
 
       if (now - lastSeen > offlineThreshold && status.status !== 'offline') {
         this.logger.log(`Device ${deviceId} marked as offline - last seen ${Math.floor((now - lastSeen) / 1000)}s ago`);
@@ -269,5 +637,7 @@ export class MqttService implements OnModuleInit, OnModuleDestroy {
     const cutoff = new Date(Date.now() - timeout);
     
     await this.storageService.timeoutPendingDeployments(cutoff);
+    this.peerRollout.expire();
+    for (const broadcast of this.broadcasts.values()) broadcast.expire();
   }
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+/**
+ * Decoder for the binary device messages built by lib/RoidOTA/RoidMsgPack.
+ * Devices that negotiated the format send MessagePack maps with the small
+ * integer keys below instead of JSON objects; decodeDevicePayload() turns
+ * either form into the same JSON-shaped object, so handlers never see the
+ * difference.
+ */
+export const WIRE_KEYS: Record<number, string> = {
+  1: 'timestamp',
+  2: 'status',
+  3: 'ip',
+  4: 'uptime',
+  5: 'rssi',
+  6: 'free_heap',
+  7: 'success',
+  8: 'message',
+  9: 'logs',
+  10: 'dropped',
+  11: 'suppressed',
+  12: 'keyframe',
+  13: 'interval',
+  14: 'largest_block',
+  15: 'min_free_heap',
+  16: 'seq',
+  17: 'boot',
+  18: 'firmware_id',
+};
+
+// RoidLog::Level, sent as its enum value in binary log batches
+const LOG_LEVELS = ['DEBUG', 'INFO', 'WARN', 'ERROR'];
+
+class Reader {
+  private offset = 0;
+
+  constructor(private readonly data: Buffer) {}
+
+  done(): boolean {
+    return this.offset === this.data.length;
+  }
+
+  value(): any {
+    const tag = this.byte();
+    if (tag < 0x80) return tag;
+    if (tag >= 0xe0) return tag - 0x100;
+    if (tag < 0x90) return this.map(tag & 0x0f);
+    if (tag < 0xa0) return this.array(tag & 0x0f);
+    if (tag < 0xc0) return this.str(tag & 0x1f);
+
+    switch (tag) {
+      case 0xc0: return null;
+      case 0xc2: return false;
+      case 0xc3: return true;
+      case 0xca: return this.read(4, (o) => this.data.readFloatBE(o));
+      case 0xcb: return this.read(8, (o) => this.data.readDoubleBE(o));
+      case 0xcc: return this.read(1, (o) => this.data.readUInt8(o));
+      case 0xcd: return this.read(2, (o) => this.data.readUInt16BE(o));
+      case 0xce: return this.read(4, (o) => this.data.readUInt32BE(o));
+      case 0xcf: return Number(this.read(8, (o) => this.data.readBigUInt64BE(o)));
+      case 0xd0: return this.read(1, (o) => this.data.readInt8(o));
+      case 0xd1: return this.read(2, (o) => this.data.readInt16BE(o));
+      case 0xd2: return this.read(4, (o) => this.data.readInt32BE(o));
+      case 0xd3: return Number(this.read(8, (o) => this.data.readBigInt64BE(o)));
+      case 0xd9: return this.str(this.read(1, (o) => this.data.readUInt8(o)));
+      case 0xda: return this.str(this.read(2, (o) => this.data.readUInt16BE(o)));
+      case 0xdb: return this.str(this.read(4, (o) => this.data.readUInt32BE(o)));
+      case 0xdc: return this.array(this.read(2, (o) => this.data.readUInt16BE(o)));
+      case 0xdd: return this.array(this.read(4, (o) => this.data.readUInt32BE(o)));
+      case 0xde: return this.map(this.read(2, (o) => this.data.readUInt16BE(o)));
+      case 0xdf: return this.map(this.read(4, (o) => this.data.readUInt32BE(o)));
+      default: throw new Error(`Unsupported MessagePack type 0x${tag.toString(16)}`);
+    }
+  }
+
+  private byte(): number {
+    return this.read(1, (o) => this.data[o]);
+  }
+
+  private read<T>(size: number, get: (offset: number) => T): T {
+    if (this.offset + size > this.data.length) {
+      throw new Error('Truncated MessagePack payload');
+    }
+    const value = get(this.offset);
+    this.offset += size;
+    return value;
+  }
+
+  private str(length: number): string {
+    return this.read(length, (o) => this.data.toString('utf8', o, o + length));
+  }
+
+  private array(count: number): any[] {
+    const items: any[] = [];
+    for (let i = 0; i < count; i++) items.push(this.value());
+    return items;
+  }
+
+  private map(count: number): Map<any, any> {
+    const entries = new Map<any, any>();
+    for (let i = 0; i < count; i++) {
+      const key = this.value();
+      entries.set(key, this.value());
+    }
+    return entries;
+  }
+}
+
+export function decodeMsgPack(data: Buffer): any {
+  const reader = new Reader(data);
+  const value = reader.value();
+  if (!reader.done()) {
+    throw new Error('Trailing bytes after MessagePack payload');
+  }
+  return value;
+}
+
+function isBinaryMap(payload: Buffer): boolean {
+  const tag = payload[0];
+  return (tag >= 0x80 && tag <= 0x8f) || tag === 0xde || tag === 0xdf;
+}
+
+/**
+ * Parses a device message in either wire format. A binary message is a
+ * MessagePack map, whose first byte can never start JSON text.
+ */
+export function decodeDevicePayload(payload: Buffer, deviceId?: string): any {
+  if (payload.length > 0 && isBinaryMap(payload)) {
+    const fields = decodeMsgPack(payload);
+    if (!(fields instanceof Map)) {
+      throw new Error('Binary device message is not a map');
+    }
+
+    const data: Record<string, any> = deviceId ? { device_id: deviceId } : {};
+    for (const [key, value] of fields) {
+      data[WIRE_KEYS[key] ?? String(key)] = value;
+    }
+    if (Array.isArray(data.logs)) {
+      data.logs = data.logs.map(([timestamp, level, message]: [number, number, string]) =>
+        [timestamp, LOG_LEVELS[level] ?? 'INFO', message]);
+    }
+    if (Array.isArray(data.boot)) {
+      const [wifi_ms, dhcp_ms, mqtt_ms, subscribe_ms, fast, lease_reused] = data.boot;
+      data.boot = { wifi_ms, dhcp_ms, mqtt_ms, subscribe_ms, fast, lease_reused };
+    }
+    return data;
+  }
+
+  return JSON.parse(payload.toString());
+}
@@ -0,0 +1,151 @@
+/**
+ * Spreads a firmware rollout over the devices of each LAN. Devices running
+ * a verified image serve it over HTTP (lib/RoidOTA/RoidPeer), and every
+ * offer lists such peers ahead of the S3 URLs. A staged LAN is released in
+ * waves sized to its peers' download slots: one device seeds it from S3,
+ * and each device that finishes adds its own slots to the next wave. Uplink
+ * traffic per site stays at about one image, and a rollout of n devices
+ * takes O(log n) waves.
+ */
+
+// Peer URLs per offer; matches ROIDOTA_PEER_MAX_OFFERS on the device
+export const MAX_PEER_OFFERS = 3;
+// A released device that has not ACKed by then no longer holds a slot
+export const PEER_DOWNLOAD_TIMEOUT_MS = 5 * 60 * 1000;
+// After a successful seed, how long to wait for it to come back as a peer
+// before the rest of the LAN is sent to S3, e.g. for firmware that does not
+// serve
+export const PEER_ANNOUNCE_GRACE_MS = 2 * 60 * 1000;
+
+export interface PeerSource {
+  deviceId: string;
+  url: string;
+  slots: number;
+}
+
+interface Wave {
+  lan: string;
+  sha256: string;
+  queue: string[];
+  // Released device -> release time, until its ACK
+  inFlight: Map<string, number>;
+  release: (deviceId: string) => Promise<unknown>;
+  seededAt?: number;
+  peerSeen: boolean;
+  direct: boolean;
+}
+
+export class PeerRollout {
+  private readonly waves = new Map<string, Wave>();
+  private readonly waveOf = new Map<string, string>();
+  // Peer -> devices pointed at it first, with the time, until they ACK
+  private readonly load = new Map<string, Map<string, number>>();
+
+  constructor(private readonly peersOf: (lan: string, sha256: string) => PeerSource[]) {}
+
+  // Holds devices of one LAN and releases them as capacity allows. A
+  // device already staged stays in its wave.
+  stage(lan: string, sha256: string, deviceIds: string[], release: (deviceId: string) => Promise<unknown>): void {
+    const key = `${lan}/${sha256}`;
+    let wave = this.waves.get(key);
+    if (!wave) {
+      wave = { lan, sha256, queue: [], inFlight: new Map(), release, peerSeen: false, direct: false };
+      this.waves.set(key, wave);
+    }
+    for (const deviceId of deviceIds) {
+      if (this.waveOf.has(deviceId)) continue;
+      this.waveOf.set(deviceId, key);
+      wave.queue.push(deviceId);
+    }
+    this.advance(key);
+  }
+
+  // Peers for one offer, least loaded first; the device is booked against
+  // the first, which it tries first.
+  peerUrls(deviceId: string, lan: string, sha256: string, now = Date.now()): string[] {
+    this.unbook(deviceId);
+    const ratio = (peer: PeerSource) => (this.load.get(peer.deviceId)?.size ?? 0) / Math.max(1, peer.slots);
+    const peers = this.peersOf(lan, sha256)
+      .filter((peer) => peer.deviceId !== deviceId)
+      .sort((a, b) => ratio(a) - ratio(b))
+      .slice(0, MAX_PEER_OFFERS);
+
+    if (peers.length) {
+      const booked = this.load.get(peers[0].deviceId) ?? new Map<string, number>();
+      booked.set(deviceId, now);
+      this.load.set(peers[0].deviceId, booked);
+    }
+    return peers.map((peer) => peer.url);
+  }
+
+  // A device ACKed its update, either way
+  finished(deviceId: string, success: boolean, now = Date.now()): void {
+    this.unbook(deviceId);
+    const key = this.waveOf.get(deviceId);
+    const wave = key ? this.waves.get(key) : undefined;
+    if (!key || !wave?.inFlight.delete(deviceId)) return;
+
+    this.waveOf.delete(deviceId);
+    if (success && !wave.peerSeen && wave.seededAt === undefined) wave.seededAt = now;
+    this.advance(key, now);
+  }
+
+  // A device reported serving an image; its slots may release more devices
+  peerAnnounced(lan: string, sha256: string): void {
+    this.advance(`${lan}/${sha256}`);
+  }
+
+  expire(now = Date.now()): void {
+    for (const booked of this.load.values()) {
+      for (const [deviceId, since] of booked) {
+        if (now - since > PEER_DOWNLOAD_TIMEOUT_MS) booked.delete(deviceId);
+      }
+    }
+
+    for (const [key, wave] of this.waves) {
+      for (const [deviceId, since] of wave.inFlight) {
+        if (now - since > PEER_DOWNLOAD_TIMEOUT_MS) {
+          wave.inFlight.delete(deviceId);
+          this.waveOf.delete(deviceId);
+        }
+      }
+      if (wave.seededAt !== undefined && !wave.peerSeen && now - wave.seededAt > PEER_ANNOUNCE_GRACE_MS) {
+        wave.direct = true;
+      }
+      this.advance(key, now);
+    }
+  }
+
+  // Devices still held and downloading, per LAN and image
+  pending(): { lan: string; sha256: string; held: number; inFlight: number }[] {
+    return Array.from(this.waves.values()).map((wave) => ({
+      lan: wave.lan,
+      sha256: wave.sha256,
+      held: wave.queue.length,
+      inFlight: wave.inFlight.size,
+    }));
+  }
+
+  private advance(key: string, now = Date.now()): void {
+    const wave = this.waves.get(key);
+    if (!wave) return;
+
+    const capacity = this.peersOf(wave.lan, wave.sha256).reduce((sum, peer) => sum + Math.max(1, peer.slots), 0);
+    if (capacity > 0) wave.peerSeen = true;
+    // With no peer yet, one device at a time seeds the LAN from S3, and
+    // after a successful seed nothing moves until it serves
+    const limit = wave.direct ? Infinity : capacity > 0 ? capacity : wave.seededAt === undefined ? 1 : 0;
+
+    while (wave.inFlight.size < limit && wave.queue.length) {
+      const deviceId = wave.queue.shift()!;
+      wave.inFlight.set(deviceId, now);
+      wave.release(deviceId).catch(() => this.finished(deviceId, false));
+    }
+
+    if (!wave.queue.length && !wave.inFlight.size) this.waves.delete(key);
+  }
+
+  private unbook(deviceId: string): void {
+    for (const booked of this.load.values()) booked.delete(deviceId);
+  }
+}
@@ -6,4 +6,8 @@ export const MQTT_TOPICS = {
   LOGS: 'roidota/logs/',
   CMD: 'roidota/cmd/',
   ACK: 'roidota/ack/',
+  FIRMWARE: 'roidota/fw/',
+  REPAIR: 'roidota/repair',
+  FETCH: 'roidota/fetch',
+  CHUNK: 'roidota/chunk/',
 } as const;
\ No newline at end of file
@@ -0,0 +1,11 @@
+// A window of chunks a device downloading over MQTT asks for: count chunks
+// of chunk bytes from offset into the image, its compressed form or the
+// patch to it from the device's current firmware
+export interface DeviceFetch {
+  device_id: string;
+  firmware_id: string;
+  source: 'full' | 'compressed' | 'patch';
+  offset: number;
+  chunk: number;
+  count: number;
+}
@@ -0,0 +1,9 @@
+export type DeviceLogEntry = [timestamp: number, level: string, message: string];
+
+export interface DeviceLogBatch {
+  device_id: string;
+  status: string;
+  logs: DeviceLogEntry[];
+  dropped?: number;
+  suppressed?: number;
+}
@@ -0,0 +1,8 @@
+// Chunks of a firmware broadcast a device is missing, as [first, last]
+// index ranges
+export interface DeviceRepair {
+  device_id: string;
+  firmware_id: string;
+  received: number;
+  missing: [first: number, last: number][];
+}
@@ -1,6 +1,24 @@
+import { DeviceBootTimes, DevicePeer, DeviceSleepCycle } from './device-status.type';
+
 export interface DeviceRequest {
   device_id: string;
   ip: string;
   version?: string;
   timestamp: number;
+  // Binary wire format the device can switch to, see msgpack.ts
+  wire?: 'msgpack';
+  // Network the device is on; devices with the same value can fetch
+  // firmware from each other
+  lan?: string;
+  // Present while the device serves its running image to LAN peers
+  peer?: DevicePeer;
+  // Sent by duty-cycled devices, whose request on each wake doubles as
+  // their heartbeat
+  status?: string;
+  rssi?: number;
+  free_heap?: number;
+  min_free_heap?: number;
+  largest_block?: number;
+  sleep?: DeviceSleepCycle;
+  boot?: DeviceBootTimes;
 }
\ No newline at end of file
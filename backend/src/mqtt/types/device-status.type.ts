@@ -7,4 +7,82 @@ export interface DeviceStatus {
   uptime: number;
   lastSeen: Date;
   freeHeap?: number;
-}
\ No newline at end of file
+  minFreeHeap?: number;
+  largestFreeBlock?: number;
+  heartbeatInterval?: number;
+  memStats?: DeviceMemStats;
+  profile?: DeviceProfile;
+  tasks?: DeviceTask[];
+  boot?: DeviceBootTimes;
+  sleep?: DeviceSleepCycle;
+  lan?: string;
+  peer?: DevicePeer;
+}
+
+// Sent in the OTA request by a device serving its running image at
+// http://<ip>:<port>/fw/<sha256> to up to `slots` peers at once
+export interface DevicePeer {
+  port: number;
+  sha256: string;
+  size: number;
+  slots: number;
+}
+
+// Duty cycle of a battery device, sent on every wake. The last_* figures
+// describe the previous wake and are 0 after a power-up.
+export interface DeviceSleepCycle {
+  interval: number;
+  wake: number;
+  failures: number;
+  last_awake_ms: number;
+  last_radio_ms: number;
+}
+
+// Sent once per boot with the first heartbeat keyframe, in ms since the
+// library started. wifi_ms equals dhcp_ms where association is not reported.
+export interface DeviceBootTimes {
+  wifi_ms: number;
+  dhcp_ms: number;
+  mqtt_ms: number;
+  subscribe_ms: number;
+  fast: boolean;
+  lease_reused: boolean;
+}
+
+// Reply to the "memstats" command, as sent by the device
+export interface DeviceMemStats {
+  heap_size: number;
+  free_heap: number;
+  min_free_heap: number;
+  largest_block: number;
+  min_largest_block: number;
+  fragmentation: number;
+  loop_stack_free: number;
+  lib_allocs: number;
+  lib_alloc_bytes: number;
+  lib_heap_drift: number;
+}
+// Reply to the "profile" command: one latency histogram per handle() phase.
+// buckets[i] counts iterations that took [2^i, 2^(i+1)) microseconds.
+export interface DeviceLoopHistogram {
+  count: number;
+  mean_us: number;
+  p50_us: number;
+  p99_us: number;
+  max_us: number;
+  stalls: number;
+  buckets: number[];
+}
+
+export type DeviceProfile = Record<'mqtt' | 'ota' | 'telemetry' | 'user' | 'total', DeviceLoopHistogram>;
+
+// Reply to the "tasks" command: the device's scheduled tasks
+export interface DeviceTask {
+  name: string;
+  interval_ms: number;
+  priority: number;
+  runs: number;
+  overruns: number;
+  skipped: number;
+  max_us: number;
+}
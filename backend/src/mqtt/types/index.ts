@@ -1,3 +1,5 @@
 export * from './device-status.type';
 export * from './device-request.type';
-export * from './constants.type';
\ No newline at end of file
+export * from './constants.type';export * from './device-log.type';
+export * from './device-repair.type';
+export * from './device-fetch.type';
\ No newline at end of file
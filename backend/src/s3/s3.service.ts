@@ -1,6 +1,6 @@
 import { Injectable, Logger } from '@nestjs/common';
 import { ConfigService } from '@nestjs/config';
-import { S3Client, PutObjectCommand, DeleteObjectCommand, GetObjectCommand } from '@aws-sdk/client-s3';
+import { S3Client, PutObjectCommand, DeleteObjectCommand, GetObjectCommand, HeadObjectCommand, ListObjectsV2Command } from '@aws-sdk/client-s3';
 import { getSignedUrl } from '@aws-sdk/s3-request-presigner';
 
 @Injectable()
@@ -25,13 +25,14 @@ export class S3Service {
     this.bucketName = s3Config.bucketName;
   }
 
-  async uploadFirmware(key: string, buffer: Buffer, contentType: string = 'application/octet-stream'): Promise<{ s3Key: string; signedUrl: string }> {
+  async uploadFirmware(key: string, buffer: Buffer, contentType: string = 'application/octet-stream', metadata?: Record<string, string>): Promise<{ s3Key: string; signedUrl: string }> {
     try {
       const command = new PutObjectCommand({
         Bucket: this.bucketName,
         Key: key,
         Body: buffer,
         ContentType: contentType,
+        Metadata: metadata,
       });
 
       await this.s3Client.send(command);
@@ -62,6 +63,64 @@ export class S3Service {
     }
   }
 
+  async downloadFirmware(key: string): Promise<Buffer> {
+    try {
+      const command = new GetObjectCommand({
+        Bucket: this.bucketName,
+        Key: key,
+      });
+
+      const response = await this.s3Client.send(command);
+      const bytes = await response.Body!.transformToByteArray();
+      return Buffer.from(bytes);
+    } catch (error) {
+      this.logger.error(`Failed to download firmware from S3: ${error.message}`, error);
+      throw error;
+    }
+  }
+
+  async headObject(key: string): Promise<{ size: number; metadata: Record<string, string> } | null> {
+    try {
+      const command = new HeadObjectCommand({
+        Bucket: this.bucketName,
+        Key: key,
+      });
+
+      const response = await this.s3Client.send(command);
+      return { size: response.ContentLength ?? 0, metadata: response.Metadata ?? {} };
+    } catch (error) {
+      if (error.name === 'NotFound' || error.$metadata?.httpStatusCode === 404) {
+        return null;
+      }
+      this.logger.error(`Failed to stat ${key} in S3: ${error.message}`, error);
+      throw error;
+    }
+  }
+
+  async listKeys(prefix: string): Promise<string[]> {
+    try {
+      const keys: string[] = [];
+      let continuationToken: string | undefined;
+      do {
+        const command = new ListObjectsV2Command({
+          Bucket: this.bucketName,
+          Prefix: prefix,
+          ContinuationToken: continuationToken,
+        });
+
+        const response = await this.s3Client.send(command);
+        for (const object of response.Contents ?? []) {
+          if (object.Key) keys.push(object.Key);
+        }
+        continuationToken = response.IsTruncated ? response.NextContinuationToken : undefined;
+      } while (continuationToken);
+      return keys;
+    } catch (error) {
+      this.logger.error(`Failed to list ${prefix} in S3: ${error.message}`, error);
+      throw error;
+    }
+  }
+
   async getSignedDownloadUrl(key: string, expiresIn: number = 3600): Promise<string> {
     try {
       const command = new GetObjectCommand({
@@ -0,0 +1,137 @@
+/**
+ * Heatshrink (LZSS) encoder matching the on-device decoder in
+ * lib/RoidOTA/RoidHeatshrink. The bitstream is MSB-first:
+ *
+ *   1 <8-bit literal>
+ *   0 <W-bit index = distance - 1> <L-bit count = length - 1>
+ *
+ * The last byte is zero-padded. W and L must match the device build, so they
+ * are sent alongside the compressed URL.
+ */
+export const HEATSHRINK_WINDOW_BITS = 10;
+export const HEATSHRINK_LOOKAHEAD_BITS = 4;
+
+// A back-reference costs 1 + W + L bits, two literals cost 18.
+const MIN_MATCH = 2;
+const MAX_CHAIN = 64;
+
+class BitWriter {
+  private bytes: number[] = [];
+  private current = 0;
+  private used = 0;
+
+  write(value: number, bits: number) {
+    for (let i = bits - 1; i >= 0; i--) {
+      this.current = (this.current << 1) | ((value >> i) & 1);
+      if (++this.used === 8) {
+        this.bytes.push(this.current);
+        this.current = 0;
+        this.used = 0;
+      }
+    }
+  }
+
+  finish(): Buffer {
+    if (this.used > 0) {
+      this.bytes.push(this.current << (8 - this.used));
+    }
+    return Buffer.from(this.bytes);
+  }
+}
+
+export function heatshrinkEncode(
+  input: Buffer,
+  windowBits = HEATSHRINK_WINDOW_BITS,
+  lookaheadBits = HEATSHRINK_LOOKAHEAD_BITS,
+): Buffer {
+  const windowSize = 1 << windowBits;
+  const maxMatch = 1 << lookaheadBits;
+  const out = new BitWriter();
+
+  // Hash chains over 2-byte prefixes; prev[] links positions within the window.
+  const head = new Int32Array(1 << 16).fill(-1);
+  const prev = new Int32Array(windowSize).fill(-1);
+  const insert = (pos: number) => {
+    if (pos + 1 >= input.length) return;
+    const key = (input[pos] << 8) | input[pos + 1];
+    prev[pos & (windowSize - 1)] = head[key];
+    head[key] = pos;
+  };
+
+  let pos = 0;
+  while (pos < input.length) {
+    let bestLength = 0;
+    let bestDistance = 0;
+
+    if (pos + 1 < input.length) {
+      const limit = Math.min(maxMatch, input.length - pos);
+      let candidate = head[(input[pos] << 8) | input[pos + 1]];
+      let chain = 0;
+
+      while (candidate >= 0 && pos - candidate <= windowSize && chain++ < MAX_CHAIN) {
+        let length = 0;
+        while (length < limit && input[candidate + length] === input[pos + length]) {
+          length++;
+        }
+        if (length > bestLength) {
+          bestLength = length;
+          bestDistance = pos - candidate;
+          if (length === limit) break;
+        }
+        const next = prev[candidate & (windowSize - 1)];
+        if (next >= candidate) break;
+        candidate = next;
+      }
+    }
+
+    if (bestLength >= MIN_MATCH) {
+      out.write(0, 1);
+      out.write(bestDistance - 1, windowBits);
+      out.write(bestLength - 1, lookaheadBits);
+      for (let i = 0; i < bestLength; i++) {
+        insert(pos++);
+      }
+    } else {
+      out.write(1, 1);
+      out.write(input[pos], 8);
+      insert(pos++);
+    }
+  }
+
+  return out.finish();
+}
+
+export function heatshrinkDecode(
+  input: Buffer,
+  windowBits = HEATSHRINK_WINDOW_BITS,
+  lookaheadBits = HEATSHRINK_LOOKAHEAD_BITS,
+): Buffer {
+  const out: number[] = [];
+  const totalBits = input.length * 8;
+  let bit = 0;
+
+  const read = (bits: number): number => {
+    let value = 0;
+    for (let i = 0; i < bits; i++, bit++) {
+      value = (value << 1) | ((input[bit >> 3] >> (7 - (bit & 7))) & 1);
+    }
+    return value;
+  };
+
+  while (bit < totalBits) {
+    if (read(1)) {
+      if (bit + 8 > totalBits) break;
+      out.push(read(8));
+    } else {
+      if (bit + windowBits + lookaheadBits > totalBits) break;
+      const distance = read(windowBits) + 1;
+      const length = read(lookaheadBits) + 1;
+      for (let i = 0; i < length; i++) {
+        const from = out.length - distance;
+        out.push(from >= 0 ? out[from] : 0);
+      }
+    }
+  }
+
+  return Buffer.from(out);
+}
@@ -1,9 +1,10 @@
 import { Module } from '@nestjs/common';
 import { StorageService } from './storage.service';
 import { S3Module } from '../s3/s3.module';
+import { DeltaModule } from '../delta/delta.module';
 
 @Module({
-  imports: [S3Module],
+  imports: [S3Module, DeltaModule],
   providers: [StorageService],
   exports: [StorageService],
 })
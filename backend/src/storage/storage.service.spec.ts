@@ -1,5 +1,6 @@
 import { Test, TestingModule } from '@nestjs/testing';
 import { StorageService } from './storage.service';
+import { heatshrinkDecode, heatshrinkEncode } from './heatshrink';
 
 describe('StorageService', () => {
   let service: StorageService;
@@ -15,4 +16,13 @@ describe('StorageService', () => {
   it('should be defined', () => {
     expect(service).toBeDefined();
   });
+
+  it('should round-trip heatshrink-compressed firmware', () => {
+    const image = Buffer.alloc(32 * 1024);
+    for (let i = 0; i < image.length; i++) image[i] = (i % 97) < 60 ? (i >> 4) & 0xff : 0xff;
+
+    const compressed = heatshrinkEncode(image);
+    expect(compressed.length).toBeLessThan(image.length);
+    expect(heatshrinkDecode(compressed).equals(image)).toBe(true);
+  });
 });
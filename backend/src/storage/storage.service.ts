@@ -2,8 +2,18 @@ import { Injectable, Logger } from '@nestjs/common';
 import { ConfigService } from '@nestjs/config';
 import { PrismaService } from '../prisma/prisma.service';
 import { S3Service } from '../s3/s3.service';
+import { DeltaService } from '../delta/delta.service';
+import { HEATSHRINK_LOOKAHEAD_BITS, HEATSHRINK_WINDOW_BITS, heatshrinkDecode, heatshrinkEncode } from './heatshrink';
 import * as fs from 'fs/promises';
 import * as path from 'path';
+import * as crypto from 'crypto';
+
+// Only keep a compressed variant if it saves at least this much.
+const MAX_COMPRESSED_RATIO = 0.95;
+
+// There is no deployment for a result to update. Unlike a failed write,
+// trying again cannot help.
+export class DeploymentNotFoundError extends Error {}
 
 @Injectable()
 export class StorageService {
@@ -13,6 +23,7 @@ export class StorageService {
     private readonly configService: ConfigService,
     private readonly prisma: PrismaService,
     private readonly s3Service: S3Service,
+    private readonly deltaService: DeltaService,
   ) {}
 
 
@@ -43,12 +54,19 @@ export class StorageService {
       
       // Upload to S3 and get signed URL
       const uploadResult = await this.s3Service.uploadFirmware(s3Key, buffer);
+      const compressedS3Key = await this.saveCompressedFirmware(s3Key, buffer);
+      const sha256 = crypto.createHash('sha256').update(buffer).digest('hex');
+      const signature = await this.signFirmware(buffer);
       
       const firmware = await this.prisma.firmware.create({
         data: {
           name: firmwareName,
           version,
           s3Key: uploadResult.s3Key, 
+          compressedS3Key,
+          size: buffer.length,
+          sha256,
+          signature,
         },
       });
 
@@ -64,6 +82,63 @@ export class StorageService {
     }
   }
 
+  // Stores a heatshrink-compressed copy next to the raw image. Devices that
+  // support it download this instead; the raw image stays the fallback.
+  private async saveCompressedFirmware(s3Key: string, buffer: Buffer): Promise<string | null> {
+    try {
+      const compressed = heatshrinkEncode(buffer);
+      if (compressed.length > buffer.length * MAX_COMPRESSED_RATIO) {
+        this.logger.log(`Firmware ${s3Key} does not compress well, skipping compressed variant`);
+        return null;
+      }
+      if (!heatshrinkDecode(compressed).equals(buffer)) {
+        this.logger.error(`Compressed firmware ${s3Key} failed verification`);
+        return null;
+      }
+
+      const compressedKey = `${s3Key}.hs`;
+      await this.s3Service.uploadFirmware(compressedKey, compressed, 'application/octet-stream', {
+        compression: 'heatshrink',
+        'compression-window': String(HEATSHRINK_WINDOW_BITS),
+        'compression-lookahead': String(HEATSHRINK_LOOKAHEAD_BITS),
+        'original-size': String(buffer.length),
+      });
+
+      this.logger.log(`Stored compressed firmware ${compressedKey} (${compressed.length}/${buffer.length} bytes)`);
+      return compressedKey;
+    } catch (error) {
+      this.logger.error(`Failed to store compressed firmware for ${s3Key}`, error);
+      return null;
+    }
+  }
+
+  // ECDSA P-256 over the image SHA-256, DER-encoded as hex. Devices built
+  // with ROIDOTA_SIGNING_KEY refuse images without a valid signature.
+  private async signFirmware(buffer: Buffer): Promise<string | null> {
+    const keyPath = this.configService.get<string>('storage.signingKeyPath');
+    if (!keyPath) {
+      return null;
+    }
+
+    const privateKey = crypto.createPrivateKey(await fs.readFile(keyPath));
+    return crypto.sign('sha256', buffer, privateKey).toString('hex');
+  }
+
+  // Patches to a new image from each one devices are running now, so OTA
+  // responses only have to look them up. Settles when they are stored;
+  // never rejects, as callers need not wait.
+  async preparePatches(firmware: { id: string; s3Key: string }): Promise<void> {
+    try {
+      const running = await this.prisma.firmware.findMany({
+        where: { Device: { some: {} } },
+        select: { id: true, s3Key: true },
+      });
+      await this.deltaService.preparePatches(running, firmware);
+    } catch (error) {
+      this.logger.error(`Failed to prepare patches for firmware ${firmware.id}`, error);
+    }
+  }
+
   async deleteFirmware(firmwareId: string): Promise<void> {
     try {
       const firmware = await this.prisma.firmware.findUnique({
@@ -76,6 +151,10 @@ export class StorageService {
 
       // Delete from S3 using the stored S3 key
       await this.s3Service.deleteFirmware(firmware.s3Key);
+      if (firmware.compressedS3Key) {
+        await this.s3Service.deleteFirmware(firmware.compressedS3Key);
+      }
+      await this.deltaService.deletePatches(firmware.id);
       
       // Delete from database
       await this.prisma.firmware.delete({
@@ -177,7 +256,7 @@ export class StorageService {
     });
 
     if (!device) {
-      throw new Error(`Device ${deviceId} not found`);
+      throw new DeploymentNotFoundError(`Device ${deviceId} not found`);
     }
 
     const pendingDeployment = await this.prisma.firmwareHistory.findFirst({
@@ -189,7 +268,7 @@ export class StorageService {
     });
 
     if (!pendingDeployment) {
-      throw new Error(`No pending deployment found for device ${deviceId}`);
+      throw new DeploymentNotFoundError(`No pending deployment found for device ${deviceId}`);
     }
 
     const updatedDeployment = await this.prisma.firmwareHistory.update({
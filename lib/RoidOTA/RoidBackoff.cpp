@@ -0,0 +1,49 @@
+#include "RoidBackoff.h"
+
+void RoidBackoff::seed(uint32_t state) {
+  jitterState = state != 0 ? state : 1;
+}
+
+uint32_t RoidBackoff::state() const {
+  return jitterState;
+}
+
+uint32_t RoidBackoff::jitter() {
+  // xorshift32
+  jitterState ^= jitterState << 13;
+  jitterState ^= jitterState >> 17;
+  jitterState ^= jitterState << 5;
+  return jitterState;
+}
+
+void RoidBackoff::configure(unsigned long base, unsigned long cap) {
+  baseMs = base > 0 ? base : 1;
+  capMs = cap >= baseMs ? cap : baseMs;
+}
+
+unsigned long RoidBackoff::first() {
+  attemptCount = 0;
+  return jitter() % baseMs;
+}
+
+// Equal-jitter exponential backoff: the wait is half the current ceiling
+// plus a random share of the other half, so retries never collapse to zero
+// but still decorrelate across devices.
+unsigned long RoidBackoff::next() {
+  uint8_t shift = attemptCount < 16 ? attemptCount : 16;
+  unsigned long ceiling = baseMs << shift;
+  if (ceiling > capMs || ceiling < baseMs) ceiling = capMs;
+
+  unsigned long half = ceiling / 2;
+  unsigned long wait = half + (half > 0 ? jitter() % (half + 1) : 0);
+  if (attemptCount < 255) attemptCount++;
+  return wait;
+}
+
+void RoidBackoff::reset() {
+  attemptCount = 0;
+}
+
+uint8_t RoidBackoff::attempts() const {
+  return attemptCount;
+}
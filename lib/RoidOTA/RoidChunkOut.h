@@ -0,0 +1,77 @@
+#ifndef ROIDCHUNKOUT_H
+#define ROIDCHUNKOUT_H
+
+#include <Arduino.h>
+
+// Receives serialized output a chunk at a time; false aborts the rest.
+typedef bool (*RoidChunkWriter)(const uint8_t* data, size_t len);
+
+// Buffers output in small chunks for a RoidChunkWriter, or with no writer
+// only counts it. Messages are serialized twice through this: once to
+// learn the length for a streamed publish, then for real.
+class RoidChunkOut {
+public:
+  explicit RoidChunkOut(RoidChunkWriter writer) : writer(writer) {}
+
+  void put(char c) {
+    ++total;
+    if (!writer) return;
+    chunk[len++] = (uint8_t)c;
+    if (len == sizeof(chunk)) flush();
+  }
+
+  void raw(const uint8_t* data, size_t n) {
+    for (size_t i = 0; i < n; ++i) put((char)data[i]);
+  }
+
+  void text(const char* s) {
+    while (*s) put(*s++);
+  }
+
+  void number(uint32_t value) {
+    char buf[11];
+    snprintf(buf, sizeof(buf), "%lu", (unsigned long)value);
+    text(buf);
+  }
+
+  // One character of a JSON string
+  void escaped(char c) {
+    static const char HEX_DIGITS[] = "0123456789abcdef";
+    uint8_t b = (uint8_t)c;
+    if (c == '"' || c == '\\') {
+      put('\\');
+      put(c);
+    } else if (c == '\n') {
+      text("\\n");
+    } else if (b < 0x20) {
+      text("\\u00");
+      put(HEX_DIGITS[b >> 4]);
+      put(HEX_DIGITS[b & 0xF]);
+    } else {
+      put(c);
+    }
+  }
+
+  void quoted(const char* s) {
+    put('"');
+    while (*s) escaped(*s++);
+    put('"');
+  }
+
+  // Returns false if the writer refused any chunk.
+  bool flush() {
+    if (writer && len > 0 && ok) ok = writer(chunk, len);
+    len = 0;
+    return ok;
+  }
+
+  size_t total = 0;
+
+private:
+  RoidChunkWriter writer;
+  uint8_t chunk[128];
+  size_t len = 0;
+  bool ok = true;
+};
+
+#endif
@@ -0,0 +1,557 @@
+#ifndef ROIDDEVICE_H
+#define ROIDDEVICE_H
+
+#include <WiFiManager.h>
+#include <PubSubClient.h>
+#include <ArduinoJson.h>
+#include <WiFiClient.h>
+#include "RoidDelta.h"
+#include "RoidHeatshrink.h"
+#include "RoidFlash.h"
+#include "RoidHttp.h"
+#include "RoidPipeline.h"
+#include "RoidSha256.h"
+#include "RoidSignature.h"
+#include "RoidLog.h"
+#include "RoidMsgPack.h"
+#include "RoidMemStats.h"
+#include "RoidProfiler.h"
+#include "RoidScheduler.h"
+#include "RoidRouter.h"
+#include "RoidOutbox.h"
+#include "RoidBackoff.h"
+#include "RoidHeartbeat.h"
+#include "RoidWiFi.h"
+#include "RoidSleep.h"
+#include "RoidPeer.h"
+#include "RoidBroadcast.h"
+
+typedef RoidTaskFunction UserFunction;
+
+// OTA engine tuning. Each handle() call moves at most ROIDOTA_OTA_MAX_BYTES_PER_TICK
+// bytes and spends at most ROIDOTA_OTA_TICK_BUDGET_MS in the download loop.
+#ifndef ROIDOTA_OTA_TICK_BUDGET_MS
+#define ROIDOTA_OTA_TICK_BUDGET_MS 20
+#endif
+#ifndef ROIDOTA_OTA_MAX_BYTES_PER_TICK
+#define ROIDOTA_OTA_MAX_BYTES_PER_TICK 8192
+#endif
+#ifndef ROIDOTA_OTA_CHUNK_SIZE
+#define ROIDOTA_OTA_CHUNK_SIZE 1024
+#endif
+// How long the response headers may take after the request is sent
+#ifndef ROIDOTA_OTA_HTTP_TIMEOUT_MS
+#define ROIDOTA_OTA_HTTP_TIMEOUT_MS 5000
+#endif
+#ifndef ROIDOTA_OTA_STALL_TIMEOUT_MS
+#define ROIDOTA_OTA_STALL_TIMEOUT_MS 20000
+#endif
+// The largest OTA response the backend sends, which refuses to send a
+// bigger one (MAX_RESPONSE_BYTES in backend/src/mqtt/mqtt.service.ts).
+// With every field present it comes to about 2400 bytes:
+//   firmware, compressed and patch URLs, presigned, for
+//     a 32-character name and 16-character version    1380
+//   3 peer URLs                                         285
+//   signature 144, sha256 64, patch MD5 32,
+//     firmware and broadcast IDs 72, device ID 32       344
+//   keys, numbers and punctuation                       ~380
+// leaving some 650 bytes for longer endpoints, buckets and names.
+#ifndef ROIDOTA_RESPONSE_MAX_BYTES
+#define ROIDOTA_RESPONSE_MAX_BYTES 3072
+#endif
+// Inbound JSON is parsed into fixed-size stack documents. The response is
+// copied in, so its document takes the strings, at most the payload, plus
+// a slot per member: up to 24 at the top, the peer list and the broadcast.
+#ifndef ROIDOTA_RESPONSE_DOC_SIZE
+#define ROIDOTA_RESPONSE_DOC_SIZE                                                             \
+  (ROIDOTA_RESPONSE_MAX_BYTES + JSON_OBJECT_SIZE(24) + JSON_ARRAY_SIZE(ROIDOTA_PEER_MAX_OFFERS) + \
+   JSON_OBJECT_SIZE(3))
+#endif
+#ifndef ROIDOTA_COMMAND_DOC_SIZE
+#define ROIDOTA_COMMAND_DOC_SIZE 512
+#endif
+// The OTA ACK is kept in RTC memory until confirmed, so the reboot after an
+// update need not wait for it to leave the socket.
+#ifndef ROIDOTA_OTA_REBOOT_DELAY_MS
+#define ROIDOTA_OTA_REBOOT_DELAY_MS 0
+#endif
+// Full-image download progress is saved to NVS at most every this many
+// bytes, so a power cut loses no more than that on resume.
+#ifndef ROIDOTA_OTA_RESUME_SAVE_BYTES
+#define ROIDOTA_OTA_RESUME_SAVE_BYTES 65536
+#endif
+// Downloads over the MQTT session instead of a second HTTP(S) connection,
+// where the backend offers it (setOtaTransport()). The device asks for
+// ROIDOTA_OTA_MQTT_WINDOW chunks at a time and for the next window once
+// they are written. A bigger window keeps more in flight, in lwIP's receive
+// buffers and the broker's queue, which buys throughput with socket RAM.
+// A window not delivered within ROIDOTA_OTA_MQTT_TIMEOUT_MS is asked for
+// again, up to ROIDOTA_OTA_MQTT_RETRIES times in a row.
+#ifndef ROIDOTA_OTA_MQTT
+#define ROIDOTA_OTA_MQTT 0
+#endif
+#ifndef ROIDOTA_OTA_MQTT_WINDOW
+#define ROIDOTA_OTA_MQTT_WINDOW 4
+#endif
+#ifndef ROIDOTA_OTA_MQTT_TIMEOUT_MS
+#define ROIDOTA_OTA_MQTT_TIMEOUT_MS 5000
+#endif
+#ifndef ROIDOTA_OTA_MQTT_RETRIES
+#define ROIDOTA_OTA_MQTT_RETRIES 3
+#endif
+// Hand flash writes to a RoidPipeline task on the other core, so the
+// download keeps going while a sector erases. Off on single-core chips.
+#ifndef ROIDOTA_OTA_PIPELINE
+#if defined(ESP32) && !defined(CONFIG_FREERTOS_UNICORE)
+#define ROIDOTA_OTA_PIPELINE 1
+#else
+#define ROIDOTA_OTA_PIPELINE 0
+#endif
+#endif
+
+// All per-device strings live in fixed buffers, so nothing in the library
+// allocates once begin() is done. Longer device IDs are refused by begin();
+// OTA offers with longer URLs are rejected.
+#ifndef ROIDOTA_MAX_DEVICE_ID
+#define ROIDOTA_MAX_DEVICE_ID 32
+#endif
+#ifndef ROIDOTA_MAX_URL_LENGTH
+#define ROIDOTA_MAX_URL_LENGTH 1024
+#endif
+// LAN peers an OTA offer may list, tried in order before the backend's
+// URLs. Peer URLs are plain http://<ip>:<port>/fw/<sha256>; longer ones
+// are skipped.
+#ifndef ROIDOTA_PEER_MAX_OFFERS
+#define ROIDOTA_PEER_MAX_OFFERS 3
+#endif
+#ifndef ROIDOTA_PEER_URL_SIZE
+#define ROIDOTA_PEER_URL_SIZE 112
+#endif
+// PubSubClient's packet buffer, allocated once in begin(). It takes the
+// largest OTA response with its header, at most 5 bytes, and its topic,
+// roidota/response/<device id> behind a 2-byte length. A firmware
+// broadcast is only joined if its chunks fit.
+#ifndef ROIDOTA_MQTT_BUFFER_SIZE
+#define ROIDOTA_MQTT_BUFFER_SIZE (ROIDOTA_RESPONSE_MAX_BYTES + 5 + 2 + 17 + ROIDOTA_MAX_DEVICE_ID)
+#endif
+// Firmware broadcast repair. Once no new chunk has come for
+// ROIDOTA_BCAST_IDLE_MS, or a pass ends with chunks missing, the device
+// asks for them after a random delay within ROIDOTA_BCAST_REPAIR_SPREAD_MS;
+// chunks arriving meanwhile, repaired for someone else, put it off. After
+// ROIDOTA_BCAST_MAX_REPAIRS requests without a new chunk, the image is
+// downloaded instead.
+#ifndef ROIDOTA_BCAST_IDLE_MS
+#define ROIDOTA_BCAST_IDLE_MS 5000
+#endif
+#ifndef ROIDOTA_BCAST_REPAIR_SPREAD_MS
+#define ROIDOTA_BCAST_REPAIR_SPREAD_MS 2000
+#endif
+#ifndef ROIDOTA_BCAST_MAX_REPAIRS
+#define ROIDOTA_BCAST_MAX_REPAIRS 4
+#endif
+
+#ifndef ROIDOTA_MQTT_SOCKET_TIMEOUT_S
+#define ROIDOTA_MQTT_SOCKET_TIMEOUT_S 3
+#endif
+// After (re)connecting, the OTA request and first heartbeat go out at a
+// per-device offset within ROIDOTA_ANNOUNCE_SPREAD_MS, and the OTA request
+// is sent at most once per ROIDOTA_ANNOUNCE_MIN_INTERVAL_MS.
+#ifndef ROIDOTA_ANNOUNCE_SPREAD_MS
+#define ROIDOTA_ANNOUNCE_SPREAD_MS 5000
+#endif
+#ifndef ROIDOTA_ANNOUNCE_MIN_INTERVAL_MS
+#define ROIDOTA_ANNOUNCE_MIN_INTERVAL_MS 60000
+#endif
+
+// Offer the MessagePack wire format in the OTA request. Heartbeats, logs
+// and ACKs switch to it once the backend accepts with a "wire" command;
+// every new MQTT session starts again in JSON.
+#ifndef ROIDOTA_BINARY_WIRE
+#define ROIDOTA_BINARY_WIRE 0
+#endif
+
+enum class RoidStatus {
+  BOOTING,
+  WIFI_CONNECTED,
+  MqTT_CONNECTED,
+  UPDATING,
+  ERROR
+};
+
+enum class OtaState {
+  IDLE,
+  REHASH,
+  CONNECT,
+  HEADERS,
+  WRITE,
+  BROADCAST,
+  FINALIZE,
+  COMMIT,
+  REBOOT
+};
+
+// What the OTA download carries: a raw image, a heatshrink-compressed image,
+// or an RDP1 patch against the running image.
+enum class OtaSource {
+  FULL,
+  COMPRESSED,
+  PATCH
+};
+
+// Everything a roidota/response message offers for one update. Only
+// firmwareUrl is required; empty strings mean "not offered".
+struct OtaOffer {
+  const char* firmwareUrl;
+  const char* patchUrl;
+  const char* patchBaseMd5;
+  const char* compressedUrl;
+  int firmwareSize;
+  const char* sha256;
+  const char* signature;
+  // Devices on the same LAN already running this image
+  const char* peerUrls[ROIDOTA_PEER_MAX_OFFERS];
+  uint8_t peerCount;
+  // Firmware broadcast to join instead of downloading, see RoidBroadcast
+  const char* broadcastId;
+  int broadcastChunkSize;
+  int broadcastSize;
+  // Set if the backend serves this firmware's images over MQTT too
+  const char* firmwareId;
+  bool mqttTransport;
+};
+
+
+class RoidDevice;
+
+// Called by a virtual device where a chip would restart, see
+// RoidDevice::setVirtual()
+typedef void (*RoidRestartHandler)(RoidDevice& device);
+
+// One device: its MQTT session, telemetry, commands and OTA engine. A
+// sketch has one, behind the static RoidOTA interface; a host simulation
+// can run many in one process as virtual devices. Nothing here blocks
+// beyond the MQTT and HTTP connects, so every device is driven by calling
+// its handle() in turn.
+class RoidDevice {
+public:
+  RoidDevice();
+  RoidDevice(const RoidDevice&) = delete;
+  RoidDevice& operator=(const RoidDevice&) = delete;
+
+  // Core methods
+  void begin(const char* id, UserFunction setupFn, UserFunction loopFn);
+  void begin(const char* id, const char* username, const char* password, UserFunction setupFn, UserFunction loopFn);
+  void handle();
+
+  // MQTT access method
+  PubSubClient& mqtt();
+
+  // Broker to connect to, MQTT_SERVER on port 1883 unless set. The host
+  // name must outlive the device. Call before begin().
+  void setBroker(const char* host, uint16_t port = 1883);
+
+  // Routes messages on topics matching an MQTT filter ('+' and '#'
+  // allowed) to a handler. Filters are subscribed now if connected, and
+  // again after every reconnect. Returns false for a malformed filter or
+  // once ROIDOTA_MAX_ROUTES are in use.
+  bool on(const char* filter, RoidTopicHandler handler);
+  bool off(const char* filter);
+
+  // Topic handling methods
+  static bool isRoidTopic(const char* topic);
+  void handleInternalMessage(const char* topic, const byte* payload, unsigned int length);
+
+  // Status tracking methods
+  RoidStatus status();
+  const char* statusStr();
+  // The name the backend knows a status by
+  static const char* getStatusStr(RoidStatus status);
+
+  // Queues a line for the next batch on roidota/logs/<device id>; level is
+  // DEBUG, INFO, WARN or ERROR.
+  void sendLog(const char* level, const char* message);
+
+  // OTA engine methods
+  void setOtaBudget(unsigned long tickBudgetMs, size_t maxBytesPerTick);
+  // Fetch the backend's images over the MQTT session, window chunks at a
+  // time, when it offers that; peers are still fetched over HTTP.
+  void setOtaTransport(bool overMqtt, uint8_t window = ROIDOTA_OTA_MQTT_WINDOW);
+  bool otaInProgress();
+  OtaState otaState();
+
+  // Fixed address instead of DHCP, on the fast path and in the portal.
+  // Call before begin().
+  void setStaticIp(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns);
+
+  // Boot phase timings, also sent with the first heartbeat
+  const RoidWiFi::BootTimes& bootTimes();
+
+  // Duty-cycled mode for battery devices. Each wake connects, sends one
+  // combined status and OTA request, listens listenMs for a response or
+  // command, then deep sleeps until intervalMs after the wake began.
+  // userSetup runs on every wake and userLoop while awake; the MQTT session
+  // persists on the broker, so nothing sent in between is lost. Call
+  // before begin().
+  void setSleepCycle(unsigned long intervalMs, unsigned long listenMs = ROIDOTA_SLEEP_LISTEN_MS);
+  // Holds off sleep while user code has work pending
+  void stayAwake(bool awake);
+  uint32_t wakeCount();
+
+  // Once an update verified, the running image is served to LAN peers on
+  // this port, and the port is reported in the OTA request so the backend
+  // can point other devices at it. 0 turns serving off; sleeping devices
+  // never serve. Call before begin().
+  void setPeerPort(uint16_t port);
+
+  // Runs the device without the chip around it, for host simulations with
+  // many devices in one process. begin() takes the network as up, nothing
+  // is served to LAN peers or kept in RTC memory, and onRestart is called
+  // where ESP.restart() would be; the device does nothing more after it,
+  // so the host can destroy it and begin a new one. Updates are
+  // downloaded and checked against their digest but not written: patches,
+  // broadcasts and resuming need flash, so a virtual device always takes
+  // a full or compressed image. Call before begin().
+  void setVirtual(RoidRestartHandler onRestart);
+
+  // MQTT reconnect tuning
+  void setReconnectBackoff(unsigned long baseMs, unsigned long capMs);
+
+  // Heartbeat tuning, also settable with the "heartbeat_config" command.
+  // Beats land on a per-device phase within the interval, derived from the
+  // device ID, so a fleet that boots together does not beat together.
+  void setHeartbeat(unsigned long intervalMs, uint8_t keyframeEvery);
+
+  // Heap and loop stack telemetry, also sent on the "memstats" command
+  RoidMemStats::Snapshot memStats();
+
+  // Latency histograms of the handle() phases, also sent on the "profile"
+  // command. Phases slower than ROIDOTA_PROFILE_STALL_MS are logged as stalls.
+  const RoidProfiler& loopProfile();
+
+  // Cooperative tasks, run by handle() after the user loop in deadline
+  // order. They must not block: runs over ROIDOTA_TASK_OVERRUN_MS are
+  // logged as overruns and listed by the "tasks" command. Registration
+  // returns a task ID, or -1 once ROIDOTA_MAX_TASKS are registered.
+  int every(const char* name, unsigned long intervalMs, UserFunction fn,
+            RoidScheduler::Priority priority = RoidScheduler::PRIO_NORMAL);
+  int after(const char* name, unsigned long delayMs, UserFunction fn,
+            RoidScheduler::Priority priority = RoidScheduler::PRIO_NORMAL);
+  bool cancelTask(int id);
+  bool rescheduleTask(int id, unsigned long delayMs);
+
+  // Wire format negotiation, see ROIDOTA_BINARY_WIRE
+  void setBinaryWire(bool offer);
+  bool binaryWire();
+
+private:
+  // The host benchmarks in test/bench drive the private send paths directly,
+  // and the response test in test/test the OTA response handler.
+  friend class RoidOTABench;
+  friend class RoidOTATest;
+
+  // The device whose begin(), handle() or MQTT callback is running. The
+  // library's writers and handlers are plain function pointers, so the
+  // trampolines at the bottom find their device through it. One per thread,
+  // so a host can run devices on several (test/bench/fleet_sim.cpp).
+  static thread_local RoidDevice* current;
+
+  RoidStatus currentStatus = RoidStatus::BOOTING;
+  WiFiClient espClient;
+  PubSubClient mqttClient;
+  const char* brokerHost;
+  uint16_t brokerPort = 1883;
+  const char* deviceId = "esp_x";
+  const char* mqttUsername = "";
+  const char* mqttPassword = "";
+  UserFunction userSetup = nullptr;
+  UserFunction userLoop = nullptr;
+  unsigned long bootTime = 0;
+  RoidWiFi::BootTimes bootPhases = {0, 0, 0, 0, false, false};
+  bool bootReported = false;
+  // Set for a virtual device; stopped once it has "restarted"
+  RoidRestartHandler virtualRestart = nullptr;
+  bool stopped = false;
+  // Duty cycle, off while sleepInterval is 0. bootTime is the wake start.
+  unsigned long sleepInterval = 0;
+  unsigned long sleepListenMs = ROIDOTA_SLEEP_LISTEN_MS;
+  bool sleepRadio = true;
+  bool sleepHold = false;
+  bool wakeReported = false;
+  unsigned long wakeListenFrom = 0;
+  unsigned long radioOnAt = 0;
+  // LAN peer serving, and the network it is reachable on
+  RoidPeer peer;
+  uint16_t peerPort = ROIDOTA_PEER_PORT;
+  uint32_t lanId = 0;
+  RoidHeartbeat heartbeat;
+  unsigned long lastReconnect = 0;
+
+  // Reconnect/announce state, advanced by reconnectMQTT() and handle()
+  unsigned long reconnectWait = 0;
+  RoidBackoff backoff;
+  bool announcePending = false;
+  bool announcedOnce = false;
+  unsigned long announceDelay = 0;
+  unsigned long connectedAt = 0;
+  unsigned long lastAnnounce = 0;
+
+  // Sized for the longest prefix, "roidota/response/"
+  static const size_t TOPIC_SIZE = 17 + ROIDOTA_MAX_DEVICE_ID + 1;
+  char topicStatus[TOPIC_SIZE] = "";
+  char topicResponse[TOPIC_SIZE] = "";
+  char topicCmd[TOPIC_SIZE] = "";
+  char topicAck[TOPIC_SIZE] = "";
+  char topicLogs[TOPIC_SIZE] = "";
+  char topicChunk[TOPIC_SIZE] = "";
+  size_t topicResponseLen = 0;
+  size_t topicCmdLen = 0;
+
+  // Pending log entries, shipped in batches by flushLogs()
+  RoidLog logBuffer;
+  RoidProfiler profiler;
+  RoidScheduler scheduler;
+  RoidRouter router;
+
+  // ACKs and command replies, published ahead of heartbeats and logs
+  enum OutboxTopic : uint8_t {
+    OUTBOX_ACK,
+    OUTBOX_STATUS
+  };
+  RoidOutbox outbox;
+
+  // Binary wire format: offered in the OTA request, in use once accepted
+  bool wireOffered = ROIDOTA_BINARY_WIRE;
+  bool wirePacked = false;
+
+  // OTA engine state, advanced by otaStep() from handle()
+  OtaState otaCurrentState = OtaState::IDLE;
+  RoidHttp otaHttp;
+  char otaUrl[ROIDOTA_MAX_URL_LENGTH + 1] = "";
+  char otaFallbackUrl[ROIDOTA_MAX_URL_LENGTH + 1] = "";
+  char otaPatchBaseMd5[33] = "";
+  OtaSource otaSource = OtaSource::FULL;
+  OtaSource otaFallbackSource = OtaSource::FULL;
+  // Peers are tried before otaUrl, as full images; otaPeer is the one in
+  // use, otaPeerCount once they are all used up.
+  char otaPeerUrls[ROIDOTA_PEER_MAX_OFFERS][ROIDOTA_PEER_URL_SIZE];
+  uint8_t otaPeerCount = 0;
+  uint8_t otaPeer = 0;
+  OtaSource otaOriginSource = OtaSource::FULL;
+  // Firmware broadcast in use, tried before peers and URLs; bcastVerified
+  // is how much of the finished image has been hashed back from flash.
+  RoidBroadcast broadcast;
+  unsigned long bcastLastChunk = 0;
+  unsigned long bcastRepairDue = 0;
+  uint8_t bcastRepairs = 0;
+  size_t bcastVerified = 0;
+  // MQTT transport: otaOverMqtt while the current attempt uses it. The
+  // window ends at otaMqttWindowEnd bytes into the download. A chunk that
+  // came while the buffer was full, or one past a gap once the window has
+  // started (otaMqttSynced), makes otaMqttRewind ask again from where the
+  // download stands.
+  bool mqttTransport = ROIDOTA_OTA_MQTT;
+  uint8_t mqttWindow = ROIDOTA_OTA_MQTT_WINDOW;
+  bool otaMqttOffered = false;
+  bool otaOverMqtt = false;
+  char otaFirmwareId[ROIDOTA_BCAST_ID_SIZE + 1] = "";
+  size_t otaMqttWindowEnd = 0;
+  unsigned long otaMqttRequestedAt = 0;
+  uint8_t otaMqttRetries = 0;
+  bool otaMqttRewind = false;
+  bool otaMqttSynced = false;
+  bool otaMqttRestart = false;
+  const char* otaMqttError = nullptr;
+  int otaFullSize = 0;
+  RoidDelta otaDelta;
+  RoidHeatshrink otaInflate;
+  RoidFlash::ResumeState otaResume;
+  size_t otaResumeOffset = 0;
+  // How much of a resumed image the digest has taken in from flash
+  size_t otaRehashed = 0;
+  size_t otaLastSaved = 0;
+  RoidPipeline otaPipeline;
+  RoidSha256 otaHash;
+  char otaSha256[65] = "";
+  char otaSignature[145] = "";
+  int otaExpected = 0;
+  size_t otaWritten = 0;
+  int otaImageSize = 0;
+  size_t otaOutput = 0;
+  const char* otaEmitError = nullptr;
+  size_t otaBufferPos = 0;
+  size_t otaBufferLen = 0;
+  unsigned long otaStateSince = 0;
+  unsigned long otaLastData = 0;
+  unsigned long otaTickBudgetMs = ROIDOTA_OTA_TICK_BUDGET_MS;
+  size_t otaMaxBytesPerTick = ROIDOTA_OTA_MAX_BYTES_PER_TICK;
+  int otaLastReported = -1;
+  uint8_t otaBuffer[ROIDOTA_OTA_CHUNK_SIZE];
+
+  // Helper methods
+  void setStatus(RoidStatus newStatus);
+  bool connectWiFi();
+  bool connectMQTT();
+  uint8_t subscribeQos();
+  void reconnectMQTT();
+  void scheduleReconnect();
+  void sendAnnounce();
+  uint32_t nextJitter();
+  void callback(char* topic, byte* payload, unsigned int length);
+  bool isVirtual() const;
+  void restart();
+
+  void service();
+  bool sendWakeReport();
+  bool wakeDone();
+  void goToSleep();
+  bool sendHeartbeat();
+  void sendMemStats();
+  bool sendProfile();
+  bool sendTasks();
+  bool publishReport(size_t (*report)(RoidChunkWriter writer));
+  void sendOtaRequest();
+  void startOTA(const OtaOffer& offer);
+  void otaStep();
+  void otaSetState(OtaState next);
+  void otaConnect();
+  void otaWrite();
+  size_t otaConsume(const uint8_t* data, size_t len);
+  bool otaEmit(const uint8_t* data, size_t len);
+  void otaFinalize();
+  void otaCommit();
+  size_t otaFlashPosition();
+  void otaRehash();
+  bool otaVerifyImage();
+  bool otaTakeFallback();
+  bool otaCheckContentRange();
+  void otaSaveResume();
+  void otaFail(const char* logMessage, const char* ackMessage);
+  bool otaJoinBroadcast(const OtaOffer& offer);
+  void otaLeaveBroadcast();
+  void otaBroadcastStep();
+  void handleBroadcast(const byte* payload, unsigned int length);
+  bool sendRepair();
+  void otaMqttBegin();
+  void otaMqttEnd();
+  void otaMqttPump(bool drained);
+  bool otaMqttRequest();
+  size_t otaMqttChunkSize();
+  void handleOtaChunk(const byte* payload, unsigned int length);
+  void handleOtaResponse(const byte* payload, unsigned int length);
+  void handleCommand(const byte* payload, unsigned int length);
+  static bool topicMatches(const char* topic, size_t topicLen, const char* expected, size_t expectedLen);
+  void sendOtaAck(bool success, const char* message);
+  size_t encodeOtaAck(bool success, const char* message, uint16_t seq, uint8_t* payload, size_t size);
+  bool publishQueued(uint8_t topic, const uint8_t* payload, size_t len);
+  bool flushLogs();
+  bool writeChunk(const uint8_t* data, size_t len);
+  unsigned long getUptime();
+  const char* localIp(char* buffer, size_t size);
+
+  // Trampolines for the function-pointer callbacks, onto current
+  static bool publishCurrent(uint8_t topic, const uint8_t* payload, size_t len);
+  static bool writeCurrent(const uint8_t* data, size_t len);
+  static bool emitCurrent(const uint8_t* data, size_t len);
+};
+
+#endif
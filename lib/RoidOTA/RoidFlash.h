@@ -0,0 +1,69 @@
+#ifndef ROIDFLASH_H
+#define ROIDFLASH_H
+
+#include <Arduino.h>
+
+// Read access to the running application image, used as the base for
+// delta updates, and a writer for the inactive OTA partition.
+class RoidFlash {
+public:
+  static const size_t SECTOR_SIZE = 4096;
+  static const size_t HEADER_SIZE = 16;
+
+  static size_t runningSize();
+  static bool readRunning(size_t offset, uint8_t* dst, size_t len);
+
+  // MD5 of the running image, the base a patch names. Reading the whole
+  // image takes a while, so hashRunning() takes in at most len more bytes
+  // through scratch per call and returns true once the digest is kept;
+  // runningMd5Matches() is false until then, or if the image was unreadable.
+  static bool hashRunning(uint8_t* scratch, size_t len);
+  static bool runningHashed();
+  static bool runningMd5Matches(const char* md5Hex);
+
+  // Unlike Update, the writer can start at a sector boundary other than 0,
+  // which is what lets an interrupted download continue. The first
+  // HEADER_SIZE bytes are held back and only written by updateEnd(), so a
+  // partial image is never bootable; a resumed write passes them back in.
+  static bool updateBegin(size_t imageSize, size_t offset = 0, const uint8_t* header = nullptr);
+  static bool updateWrite(const uint8_t* data, size_t len);
+  // For images that arrive out of order: writes at offset instead of the
+  // write position, erasing the sector first if fresh. Each byte must be
+  // written once; updatePosition() then counts the bytes written.
+  static bool updateWriteAt(size_t offset, const uint8_t* data, size_t len, bool fresh);
+  static bool readUpdate(size_t offset, uint8_t* dst, size_t len);
+  static bool updateEnd();
+  static void updateAbort();
+  static bool updateRunning();
+  static size_t updatePosition();
+  static const uint8_t* updateHeader();
+  static const char* updateError();
+
+  // Progress of a partially written full image, kept in NVS.
+  struct ResumeState {
+    uint32_t urlHash;
+    uint32_t imageSize;
+    uint32_t offset;
+    uint8_t header[HEADER_SIZE];
+    char etag[48];
+  };
+
+  static bool loadResume(ResumeState& state);
+  static void saveResume(const ResumeState& state);
+  static void clearResume();
+
+  // Digest and length of the image updateEnd() last activated, kept in NVS
+  // with the partition it went to. The running image only matches once that
+  // partition has booted, so a rolled-back device never claims it.
+  struct ImageRecord {
+    uint32_t address;
+    uint32_t size;
+    char sha256[65];
+  };
+
+  // Call right after updateEnd(); an empty digest clears the record.
+  static void saveImageRecord(const char* sha256Hex, size_t size);
+  static bool runningImageRecord(ImageRecord& record);
+};
+
+#endif
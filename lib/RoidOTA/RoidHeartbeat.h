@@ -0,0 +1,81 @@
+#ifndef ROIDHEARTBEAT_H
+#define ROIDHEARTBEAT_H
+
+#include <Arduino.h>
+
+// Heartbeats carry only what changed since the last one the backend got,
+// with a full keyframe every ROIDOTA_HEARTBEAT_KEYFRAME_EVERY beats. RSSI,
+// free heap and the largest free block count as changed once they move by
+// the given step.
+#ifndef ROIDOTA_HEARTBEAT_KEYFRAME_EVERY
+#define ROIDOTA_HEARTBEAT_KEYFRAME_EVERY 10
+#endif
+#ifndef ROIDOTA_HEARTBEAT_RSSI_STEP
+#define ROIDOTA_HEARTBEAT_RSSI_STEP 4
+#endif
+#ifndef ROIDOTA_HEARTBEAT_HEAP_STEP
+#define ROIDOTA_HEARTBEAT_HEAP_STEP 2048
+#endif
+#ifndef ROIDOTA_HEARTBEAT_MIN_INTERVAL_MS
+#define ROIDOTA_HEARTBEAT_MIN_INTERVAL_MS 1000
+#endif
+
+// Heartbeat schedule and delta selection for one device. Beats land on a
+// per-device phase within the interval, so a fleet that boots together does
+// not beat together, and the values the backend last received are what
+// delta beats are measured against.
+class RoidHeartbeat {
+public:
+  struct Sample {
+    uint32_t ip;
+    int32_t rssi;
+    uint32_t freeHeap;
+    uint32_t largestBlock;
+    uint8_t status;
+  };
+
+  // The fields a beat carries; every one of them in a keyframe
+  struct Fields {
+    bool keyframe;
+    bool ip;
+    bool rssi;
+    bool freeHeap;
+    bool largestBlock;
+    bool status;
+  };
+
+  explicit RoidHeartbeat(unsigned long intervalMs, uint8_t keyframeEvery = ROIDOTA_HEARTBEAT_KEYFRAME_EVERY);
+
+  void setPhase(uint32_t phase);
+  // Also makes the next beat a keyframe, which reports the new interval
+  void configure(unsigned long intervalMs, uint8_t keyframeEvery, unsigned long now);
+  unsigned long interval() const;
+  uint8_t keyframeEvery() const;
+
+  // Next beat strictly after now on this device's phase grid
+  void schedule(unsigned long now);
+  bool due(unsigned long now) const;
+  unsigned long nextBeat() const;
+  // Moves on one interval after a beat; after a long stall the missed
+  // beats are skipped rather than burst.
+  void advance(unsigned long now);
+
+  // E.g. when the backend may have lost its view of the device
+  void requestKeyframe();
+  Fields select(const Sample& sample) const;
+  // The beat with these fields was published. One that was not makes the
+  // next beat a keyframe.
+  void sent(const Fields& fields, const Sample& sample);
+  void failed();
+
+private:
+  unsigned long intervalMs;
+  unsigned long dueAt = 0;
+  uint32_t phase = 0;
+  uint8_t every;
+  uint8_t sinceKeyframe = 0;
+  bool keyframePending = true;
+  Sample last = {};
+};
+
+#endif
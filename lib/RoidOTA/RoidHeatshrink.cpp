@@ -0,0 +1,82 @@
+#include "RoidHeatshrink.h"
+
+void RoidHeatshrink::begin(OutputWriter outputWriter) {
+  writer = outputWriter;
+  state = State::TAG;
+  bits = 0;
+  bitCount = 0;
+  index = 0;
+  head = 0;
+  failed = false;
+  out = 0;
+  pendingLen = 0;
+  memset(window, 0, sizeof(window));
+}
+
+bool RoidHeatshrink::feed(const uint8_t* data, size_t len) {
+  for (size_t i = 0; i < len && !failed; ++i) {
+    bits = (bits << 8) | data[i];
+    bitCount += 8;
+
+    for (;;) {
+      uint8_t need;
+      switch (state) {
+        case State::TAG: need = 1; break;
+        case State::LITERAL: need = 8; break;
+        case State::INDEX: need = ROIDOTA_HS_WINDOW_BITS; break;
+        case State::COUNT:
+        default: need = ROIDOTA_HS_LOOKAHEAD_BITS; break;
+      }
+      if (bitCount < need) break;
+
+      bitCount -= need;
+      uint16_t value = (bits >> bitCount) & ((1u << need) - 1);
+
+      if (state == State::TAG) {
+        state = value ? State::LITERAL : State::INDEX;
+      } else if (state == State::LITERAL) {
+        if (!put((uint8_t)value)) return false;
+        state = State::TAG;
+      } else if (state == State::INDEX) {
+        index = value;
+        state = State::COUNT;
+      } else {
+        uint16_t distance = index + 1;
+        for (uint16_t n = 0; n <= value; ++n) {
+          if (!put(window[(head - distance) & (WINDOW_SIZE - 1)])) return false;
+        }
+        state = State::TAG;
+      }
+    }
+  }
+
+  return !failed;
+}
+
+bool RoidHeatshrink::finish() {
+  // Any bits left over are the encoder's zero padding of the last byte.
+  return !failed && flush();
+}
+
+size_t RoidHeatshrink::produced() const {
+  return out;
+}
+
+bool RoidHeatshrink::put(uint8_t b) {
+  window[head] = b;
+  head = (head + 1) & (WINDOW_SIZE - 1);
+  pending[pendingLen++] = b;
+  out++;
+  if (pendingLen == sizeof(pending)) return flush();
+  return true;
+}
+
+bool RoidHeatshrink::flush() {
+  if (pendingLen == 0) return true;
+  if (!writer(pending, pendingLen)) {
+    failed = true;
+    return false;
+  }
+  pendingLen = 0;
+  return true;
+}
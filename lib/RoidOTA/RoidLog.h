@@ -0,0 +1,97 @@
+#ifndef ROIDLOG_H
+#define ROIDLOG_H
+
+#include <Arduino.h>
+#include "RoidMsgPack.h"
+#include "RoidChunkOut.h"
+
+// Log ring capacity in bytes; each entry takes 6 bytes plus its message.
+#ifndef ROIDOTA_LOG_BUFFER_SIZE
+#define ROIDOTA_LOG_BUFFER_SIZE 2048
+#endif
+// Longer messages are truncated.
+#ifndef ROIDOTA_LOG_MAX_MESSAGE
+#define ROIDOTA_LOG_MAX_MESSAGE 160
+#endif
+// A batch is shipped once this many entry bytes are pending, or once the
+// oldest pending entry is ROIDOTA_LOG_FLUSH_MS old.
+#ifndef ROIDOTA_LOG_FLUSH_BYTES
+#define ROIDOTA_LOG_FLUSH_BYTES 1024
+#endif
+#ifndef ROIDOTA_LOG_FLUSH_MS
+#define ROIDOTA_LOG_FLUSH_MS 2000
+#endif
+// Per-level token bucket: each level may burst ROIDOTA_LOG_BURST entries
+// and then sustain ROIDOTA_LOG_RATE_PER_MIN, so an INFO storm cannot crowd
+// out errors.
+#ifndef ROIDOTA_LOG_RATE_PER_MIN
+#define ROIDOTA_LOG_RATE_PER_MIN 60
+#endif
+#ifndef ROIDOTA_LOG_BURST
+#define ROIDOTA_LOG_BURST 20
+#endif
+
+// Fixed-size ring of pending log entries, kept in a compact binary form
+// until they can be shipped as one batch:
+//
+//   {"device_id":"..","status":"..","logs":[[ms,"LEVEL","message"],..],
+//    "dropped":n,"suppressed":n}
+//
+// When the ring is full the oldest entries are evicted and counted as
+// dropped; entries refused by the rate limit are counted as suppressed.
+class RoidLog {
+public:
+  enum Level : uint8_t {
+    DEBUG,
+    INFO,
+    WARN,
+    ERROR,
+    LEVEL_COUNT
+  };
+
+  typedef RoidChunkWriter ChunkWriter;
+
+  static Level parseLevel(const char* name);
+  static const char* levelName(Level level);
+
+  // Returns false if the entry was rate-limited.
+  bool add(Level level, const char* message, uint32_t now);
+
+  bool empty() const;
+  size_t count() const;
+  bool due(uint32_t now) const;
+
+  // Serializes all pending entries as a batch and returns its length. With
+  // no writer nothing is written, which is how the length is found before a
+  // streamed publish.
+  size_t writeBatch(const char* deviceId, const char* status, ChunkWriter writer) const;
+  // The same batch as a MessagePack map keyed by RoidWireKey, with levels
+  // as their enum value and no device ID.
+  size_t writePackedBatch(const char* status, ChunkWriter writer) const;
+
+  // Forgets the pending entries and counters after a batch went out.
+  void clear();
+
+private:
+  static const size_t HEADER_SIZE = 6;
+
+  uint8_t byteAt(size_t offset) const;
+  void copyOut(size_t offset, uint8_t* dst, size_t len) const;
+  void evictOldest();
+  bool allow(Level level, uint32_t now);
+
+  uint8_t ring[ROIDOTA_LOG_BUFFER_SIZE];
+  size_t head = 0;
+  size_t used = 0;
+  size_t entries = 0;
+  uint32_t dropped = 0;
+  uint32_t suppressed = 0;
+
+  // Tokens are kept in thousandths so refill works at any call rate.
+  uint32_t tokens[LEVEL_COUNT] = {
+    ROIDOTA_LOG_BURST * 1000, ROIDOTA_LOG_BURST * 1000, ROIDOTA_LOG_BURST * 1000, ROIDOTA_LOG_BURST * 1000
+  };
+  uint32_t refilledAt[LEVEL_COUNT] = {0, 0, 0, 0};
+};
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef ROIDMEMSTATS_H
+#define ROIDMEMSTATS_H
+
+#include <Arduino.h>
+
+// Counting the library's own allocations needs the IDF heap hooks
+// (CONFIG_HEAP_USE_HOOKS); without them only the net heap drift across
+// library code is tracked.
+#ifndef ROIDOTA_MEMSTATS_HOOKS
+#if defined(ESP32) && defined(CONFIG_HEAP_USE_HOOKS)
+#define ROIDOTA_MEMSTATS_HOOKS 1
+#else
+#define ROIDOTA_MEMSTATS_HOOKS 0
+#endif
+#endif
+
+// Heap and stack telemetry. Free heap alone hides fragmentation: a device
+// can have plenty free and still fail Update.begin() or a TLS handshake
+// because no single block is large enough, so the largest block is
+// tracked too. sample() is cheap enough to run on every heartbeat.
+class RoidMemStats {
+public:
+  struct Snapshot {
+    uint32_t heapSize;
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;          // lowest since boot, kept by the heap itself
+    uint32_t largestFreeBlock;
+    uint32_t minLargestFreeBlock;  // lowest seen by sample()
+    uint8_t fragmentation;         // percent of free heap outside the largest block
+    uint32_t loopStackFree;        // loop task stack never used, 0 if unknown
+    int32_t libraryAllocs;         // -1 without heap hooks
+    uint32_t libraryAllocBytes;
+    int32_t libraryHeapDrift;      // net bytes kept by library code, approximate
+  };
+
+  // Must run on the loop task, whose stack it measures.
+  static void sample();
+  static Snapshot snapshot();
+
+  // Marks the enclosing block as library code for the allocation counters.
+  // Nested scopes count once.
+  class Scope {
+  public:
+    Scope();
+    ~Scope();
+
+  private:
+    uint32_t freeAtEntry;
+  };
+};
+
+#endif
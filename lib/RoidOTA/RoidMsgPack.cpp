@@ -0,0 +1,106 @@
+#include "RoidMsgPack.h"
+
+static size_t encodeBig(uint8_t* out, uint8_t tag, uint32_t value, size_t bytes) {
+  out[0] = tag;
+  for (size_t i = 0; i < bytes; ++i) out[1 + i] = (uint8_t)(value >> (8 * (bytes - 1 - i)));
+  return 1 + bytes;
+}
+
+size_t RoidMsgPack::encodeMap(uint8_t* out, size_t count) {
+  if (count < 16) {
+    out[0] = 0x80 | count;
+    return 1;
+  }
+  return count <= 0xFFFF ? encodeBig(out, 0xDE, count, 2) : encodeBig(out, 0xDF, count, 4);
+}
+
+size_t RoidMsgPack::encodeArray(uint8_t* out, size_t count) {
+  if (count < 16) {
+    out[0] = 0x90 | count;
+    return 1;
+  }
+  return count <= 0xFFFF ? encodeBig(out, 0xDC, count, 2) : encodeBig(out, 0xDD, count, 4);
+}
+
+size_t RoidMsgPack::encodeStr(uint8_t* out, size_t len) {
+  if (len < 32) {
+    out[0] = 0xA0 | len;
+    return 1;
+  }
+  if (len <= 0xFF) return encodeBig(out, 0xD9, len, 1);
+  return len <= 0xFFFF ? encodeBig(out, 0xDA, len, 2) : encodeBig(out, 0xDB, len, 4);
+}
+
+size_t RoidMsgPack::encodeUint(uint8_t* out, uint32_t value) {
+  if (value < 0x80) {
+    out[0] = value;
+    return 1;
+  }
+  if (value <= 0xFF) return encodeBig(out, 0xCC, value, 1);
+  return value <= 0xFFFF ? encodeBig(out, 0xCD, value, 2) : encodeBig(out, 0xCE, value, 4);
+}
+
+size_t RoidMsgPack::encodeInt(uint8_t* out, int32_t value) {
+  if (value >= 0) return encodeUint(out, value);
+  if (value >= -32) {
+    out[0] = (uint8_t)value;
+    return 1;
+  }
+  if (value >= -128) return encodeBig(out, 0xD0, (uint32_t)value, 1);
+  return value >= -32768 ? encodeBig(out, 0xD1, (uint32_t)value, 2) : encodeBig(out, 0xD2, (uint32_t)value, 4);
+}
+
+RoidMsgPack::RoidMsgPack(uint8_t* buffer, size_t capacity) : buffer(buffer), capacity(capacity) {}
+
+void RoidMsgPack::put(const uint8_t* data, size_t len) {
+  if (overflow || capacity - used < len) {
+    overflow = true;
+    return;
+  }
+  memcpy(buffer + used, data, len);
+  used += len;
+}
+
+void RoidMsgPack::map(size_t count) {
+  uint8_t header[MAX_HEADER];
+  put(header, encodeMap(header, count));
+}
+
+void RoidMsgPack::array(size_t count) {
+  uint8_t header[MAX_HEADER];
+  put(header, encodeArray(header, count));
+}
+
+void RoidMsgPack::key(RoidWireKey key) {
+  uinteger(key);
+}
+
+void RoidMsgPack::uinteger(uint32_t value) {
+  uint8_t header[MAX_HEADER];
+  put(header, encodeUint(header, value));
+}
+
+void RoidMsgPack::integer(int32_t value) {
+  uint8_t header[MAX_HEADER];
+  put(header, encodeInt(header, value));
+}
+
+void RoidMsgPack::boolean(bool value) {
+  uint8_t b = value ? 0xC3 : 0xC2;
+  put(&b, 1);
+}
+
+void RoidMsgPack::str(const char* value) {
+  size_t len = strlen(value);
+  uint8_t header[MAX_HEADER];
+  put(header, encodeStr(header, len));
+  put((const uint8_t*)value, len);
+}
+
+bool RoidMsgPack::ok() const {
+  return !overflow;
+}
+
+size_t RoidMsgPack::length() const {
+  return used;
+}
@@ -0,0 +1,227 @@
+#include "RoidOutbox.h"
+
+// Outside the ESP32 core there is no RTC memory; the mirror then never
+// survives a restart and restore() finds nothing.
+#ifndef RTC_NOINIT_ATTR
+#define RTC_NOINIT_ATTR
+#endif
+
+static const uint32_t RTC_MAGIC = 0x524F4F43;  // "ROOC"
+
+// Not initialized at boot, so it is only trusted when the magic and the
+// checksum match what persist() wrote.
+struct RtcOutbox {
+  uint32_t magic;
+  uint32_t checksum;
+  uint16_t seqCounter;
+  uint8_t count;
+  struct {
+    uint16_t seq;
+    uint16_t len;
+    uint8_t topic;
+    uint8_t attempts;
+    uint8_t payload[ROIDOTA_OUTBOX_MAX_PAYLOAD];
+  } items[ROIDOTA_OUTBOX_SLOTS];
+};
+
+RTC_NOINIT_ATTR static RtcOutbox rtcOutbox;
+
+static uint32_t rtcChecksum(const RtcOutbox& rtc) {
+  // FNV-1a over everything after the checksum
+  const uint8_t* p = (const uint8_t*)&rtc.seqCounter;
+  const uint8_t* end = (const uint8_t*)&rtc + sizeof(rtc);
+  uint32_t hash = 2166136261u;
+  while (p < end) {
+    hash ^= *p++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+void RoidOutbox::seed(uint16_t seq) {
+  seqCounter = seq != 0 ? seq : 1;
+}
+
+uint16_t RoidOutbox::nextSeq() {
+  uint16_t seq = seqCounter++;
+  if (seqCounter == 0) seqCounter = 1;
+  return seq;
+}
+
+bool RoidOutbox::push(Priority priority, uint8_t topic, uint16_t seq, const uint8_t* payload, size_t len, uint32_t now) {
+  if (len > ROIDOTA_OUTBOX_MAX_PAYLOAD) {
+    ++droppedCount;
+    return false;
+  }
+
+  uint8_t slot = NONE;
+  for (uint8_t i = 0; i < ROIDOTA_OUTBOX_SLOTS && slot == NONE; ++i) {
+    if (!items[i].used) slot = i;
+  }
+  if (slot == NONE) {
+    slot = victim(priority);
+    if (slot == NONE) {
+      ++droppedCount;
+      return false;
+    }
+    release(slot);
+    ++droppedCount;
+  }
+
+  Item& item = items[slot];
+  item.order = orderCounter++;
+  item.nextTry = now;
+  item.seq = seq;
+  item.len = len;
+  item.topic = topic;
+  item.attempts = 0;
+  item.priority = priority;
+  item.used = true;
+  memcpy(item.payload, payload, len);
+  if (priority == PRIO_ACK) persist();
+  return true;
+}
+
+bool RoidOutbox::confirm(uint16_t seq) {
+  for (uint8_t i = 0; i < ROIDOTA_OUTBOX_SLOTS; ++i) {
+    if (items[i].used && items[i].priority == PRIO_ACK && items[i].seq == seq) {
+      release(i);
+      persist();
+      return true;
+    }
+  }
+  return false;
+}
+
+// Best priority first, oldest first within a priority
+uint8_t RoidOutbox::next(uint32_t now) const {
+  uint8_t best = NONE;
+  for (uint8_t i = 0; i < ROIDOTA_OUTBOX_SLOTS; ++i) {
+    const Item& item = items[i];
+    if (!item.used || (int32_t)(now - item.nextTry) < 0) continue;
+    if (best == NONE || item.priority < items[best].priority ||
+        (item.priority == items[best].priority && (int32_t)(item.order - items[best].order) < 0)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+// Lowest priority, oldest first; never an item that outranks the newcomer
+uint8_t RoidOutbox::victim(Priority incoming) const {
+  uint8_t worst = NONE;
+  for (uint8_t i = 0; i < ROIDOTA_OUTBOX_SLOTS; ++i) {
+    const Item& item = items[i];
+    if (item.priority < incoming) continue;
+    if (worst == NONE || item.priority > items[worst].priority ||
+        (item.priority == items[worst].priority && (int32_t)(item.order - items[worst].order) < 0)) {
+      worst = i;
+    }
+  }
+  return worst;
+}
+
+void RoidOutbox::release(uint8_t slot) {
+  items[slot].used = false;
+}
+
+bool RoidOutbox::drain(uint32_t now, RoidOutboxPublisher publish) {
+  // Each item gets at most one publish per call
+  for (uint8_t tries = 0; tries < ROIDOTA_OUTBOX_SLOTS; ++tries) {
+    uint8_t slot = next(now);
+    if (slot == NONE) return true;
+    Item& item = items[slot];
+
+    if (!publish(item.topic, item.payload, item.len)) {
+      item.nextTry = now + ROIDOTA_OUTBOX_RETRY_MS;
+      return false;
+    }
+    if (item.priority != PRIO_ACK) {
+      release(slot);
+      continue;
+    }
+
+    // Published, but only the backend's confirmation retires an ACK. The
+    // count is saved too, so ACKs retried once per wake still give up.
+    if (++item.attempts >= ROIDOTA_OUTBOX_MAX_ATTEMPTS) release(slot);
+    persist();
+    if (!item.used) continue;
+    uint8_t shift = item.attempts - 1 < 16 ? item.attempts - 1 : 16;
+    uint32_t wait = (uint32_t)ROIDOTA_OUTBOX_RETRY_MS << shift;
+    item.nextTry = now + (wait < ROIDOTA_OUTBOX_RETRY_CAP_MS ? wait : ROIDOTA_OUTBOX_RETRY_CAP_MS);
+  }
+  return true;
+}
+
+void RoidOutbox::retryNow(uint32_t now) {
+  for (uint8_t i = 0; i < ROIDOTA_OUTBOX_SLOTS; ++i) {
+    if (items[i].used) items[i].nextTry = now;
+  }
+}
+
+// Rewritten whenever a queued ACK changes, which is rare enough that
+// copying a few hundred bytes of RTC memory does not matter.
+void RoidOutbox::persist() const {
+  if (!mirrored) return;
+  rtcOutbox.count = 0;
+  rtcOutbox.seqCounter = seqCounter;
+  for (uint8_t i = 0; i < ROIDOTA_OUTBOX_SLOTS; ++i) {
+    const Item& item = items[i];
+    if (!item.used || item.priority != PRIO_ACK) continue;
+    auto& saved = rtcOutbox.items[rtcOutbox.count++];
+    saved.seq = item.seq;
+    saved.len = item.len;
+    saved.topic = item.topic;
+    saved.attempts = item.attempts;
+    memcpy(saved.payload, item.payload, item.len);
+    memset(saved.payload + item.len, 0, sizeof(saved.payload) - item.len);
+  }
+  for (uint8_t i = rtcOutbox.count; i < ROIDOTA_OUTBOX_SLOTS; ++i) {
+    memset(&rtcOutbox.items[i], 0, sizeof(rtcOutbox.items[i]));
+  }
+  rtcOutbox.magic = RTC_MAGIC;
+  rtcOutbox.checksum = rtcChecksum(rtcOutbox);
+}
+
+size_t RoidOutbox::restore(uint32_t now) {
+  if (!mirrored || count() > 0) return 0;
+  if (rtcOutbox.magic != RTC_MAGIC || rtcOutbox.checksum != rtcChecksum(rtcOutbox) ||
+      rtcOutbox.count > ROIDOTA_OUTBOX_SLOTS) {
+    rtcOutbox.magic = 0;
+    return 0;
+  }
+
+  // Keep numbering after the restored ACKs so confirmations stay unambiguous
+  seed(rtcOutbox.seqCounter);
+  size_t restored = 0;
+  for (uint8_t i = 0; i < rtcOutbox.count; ++i) {
+    const auto& saved = rtcOutbox.items[i];
+    if (saved.len > ROIDOTA_OUTBOX_MAX_PAYLOAD) continue;
+    Item& item = items[restored++];
+    item = Item();
+    item.order = orderCounter++;
+    item.nextTry = now;
+    item.seq = saved.seq;
+    item.len = saved.len;
+    item.topic = saved.topic;
+    item.attempts = saved.attempts;
+    item.priority = PRIO_ACK;
+    item.used = true;
+    memcpy(item.payload, saved.payload, saved.len);
+  }
+  return restored;
+}
+
+void RoidOutbox::setMirrored(bool value) {
+  mirrored = value;
+}
+
+size_t RoidOutbox::count() const {
+  size_t n = 0;
+  for (uint8_t i = 0; i < ROIDOTA_OUTBOX_SLOTS; ++i) n += items[i].used;
+  return n;
+}
+
+uint32_t RoidOutbox::dropped() const {
+  return droppedCount;
+}
@@ -0,0 +1,95 @@
+#ifndef ROIDOUTBOX_H
+#define ROIDOUTBOX_H
+
+#include <Arduino.h>
+
+// Queue capacity and the largest payload a slot holds.
+#ifndef ROIDOTA_OUTBOX_SLOTS
+#define ROIDOTA_OUTBOX_SLOTS 4
+#endif
+#ifndef ROIDOTA_OUTBOX_MAX_PAYLOAD
+#define ROIDOTA_OUTBOX_MAX_PAYLOAD 256
+#endif
+// Unconfirmed ACKs are republished after ROIDOTA_OUTBOX_RETRY_MS, doubling
+// up to ROIDOTA_OUTBOX_RETRY_CAP_MS, and given up after
+// ROIDOTA_OUTBOX_MAX_ATTEMPTS publishes.
+#ifndef ROIDOTA_OUTBOX_RETRY_MS
+#define ROIDOTA_OUTBOX_RETRY_MS 2000
+#endif
+#ifndef ROIDOTA_OUTBOX_RETRY_CAP_MS
+#define ROIDOTA_OUTBOX_RETRY_CAP_MS 60000
+#endif
+#ifndef ROIDOTA_OUTBOX_MAX_ATTEMPTS
+#define ROIDOTA_OUTBOX_MAX_ATTEMPTS 10
+#endif
+
+// Publishes one queued payload; topic is the caller's own topic ID.
+typedef bool (*RoidOutboxPublisher)(uint8_t topic, const uint8_t* payload, size_t len);
+
+// Fixed-slot outbound queue, drained in priority order. ACK items stay
+// queued until the backend confirms their sequence number, and are mirrored
+// into RTC memory so a restart right after queuing (the OTA reboot) does
+// not lose them; a power cycle does. Other items are done once published.
+// When the queue is full the lowest-priority, oldest item makes room.
+class RoidOutbox {
+public:
+  enum Priority : uint8_t {
+    PRIO_ACK,        // OTA results: confirmed, retried, kept across restart
+    PRIO_TELEMETRY   // command replies: published once, evicted first
+  };
+
+  // Sequence numbers carried by ACK payloads
+  void seed(uint16_t seq);
+  uint16_t nextSeq();
+
+  // Returns false if the payload is too large or everything queued
+  // outranks it.
+  bool push(Priority priority, uint8_t topic, uint16_t seq, const uint8_t* payload, size_t len, uint32_t now);
+  // The backend got the ACK with this sequence number.
+  bool confirm(uint16_t seq);
+
+  // Publishes every due item, best priority first. Returns false once a
+  // publish fails: the link is backed up, so lower-priority traffic should
+  // wait for the next call.
+  bool drain(uint32_t now, RoidOutboxPublisher publish);
+  // Makes all waiting items due, e.g. after a reconnect.
+  void retryNow(uint32_t now);
+
+  // Brings back the ACKs saved before a restart, into an empty queue;
+  // returns how many.
+  size_t restore(uint32_t now);
+  // There is one RTC mirror, for the device's own outbox. Other instances,
+  // e.g. the simulated devices in test/bench/fleet_sim.cpp, go without it.
+  void setMirrored(bool mirrored);
+
+  size_t count() const;
+  uint32_t dropped() const;
+
+private:
+  static const uint8_t NONE = 0xFF;
+
+  struct Item {
+    uint32_t order;
+    uint32_t nextTry;
+    uint16_t seq;
+    uint16_t len;
+    uint8_t topic;
+    uint8_t attempts;
+    Priority priority;
+    bool used;
+    uint8_t payload[ROIDOTA_OUTBOX_MAX_PAYLOAD];
+  };
+
+  uint8_t next(uint32_t now) const;
+  uint8_t victim(Priority incoming) const;
+  void release(uint8_t slot);
+  void persist() const;
+
+  Item items[ROIDOTA_OUTBOX_SLOTS] = {};
+  uint32_t orderCounter = 0;
+  uint32_t droppedCount = 0;
+  uint16_t seqCounter = 1;
+  bool mirrored = true;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef ROIDPEER_H
+#define ROIDPEER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include "RoidFlash.h"
+
+// TCP port the running image is served on; 0 turns serving off.
+#ifndef ROIDOTA_PEER_PORT
+#define ROIDOTA_PEER_PORT 8266
+#endif
+// Downloads served at once. Further peers get a 503 and move on to their
+// next source.
+#ifndef ROIDOTA_PEER_MAX_CLIENTS
+#define ROIDOTA_PEER_MAX_CLIENTS 2
+#endif
+// Bytes sent per poll() across all clients, read from flash in chunks of
+// ROIDOTA_PEER_CHUNK_SIZE.
+#ifndef ROIDOTA_PEER_MAX_BYTES_PER_TICK
+#define ROIDOTA_PEER_MAX_BYTES_PER_TICK 4096
+#endif
+#ifndef ROIDOTA_PEER_CHUNK_SIZE
+#define ROIDOTA_PEER_CHUNK_SIZE 1024
+#endif
+// Clients that send no complete request, or stop taking data, for this
+// long are dropped.
+#ifndef ROIDOTA_PEER_IDLE_TIMEOUT_MS
+#define ROIDOTA_PEER_IDLE_TIMEOUT_MS 10000
+#endif
+// Request and header lines are kept up to this length; the rest of a
+// longer line is ignored.
+#ifndef ROIDOTA_PEER_LINE_SIZE
+#define ROIDOTA_PEER_LINE_SIZE 112
+#endif
+
+// Serves the running firmware image to other devices on the LAN, so a site
+// rollout pulls each image over the uplink once and then spreads device to
+// device:
+//
+//   GET /fw/<sha256> HTTP/1.1
+//   Range: bytes=<first>-[<last>]      optional
+//   If-Range: "<sha256>"               optional
+//
+// Only an image this library downloaded and verified is served, under the
+// digest the backend sent with it (see RoidFlash::ImageRecord). The digest
+// is also the ETag, so a download that stops at one peer resumes at the
+// next. Responses are read straight from flash, a bounded slice per poll().
+class RoidPeer {
+public:
+  // Listens if the running image has a record; false if there is nothing
+  // to serve.
+  bool begin(uint16_t port);
+  void end();
+  bool listening() const;
+  void poll(unsigned long now);
+
+  const char* sha256() const;
+  size_t imageSize() const;
+  uint16_t port() const;
+  uint8_t slots() const;
+  // Complete downloads and bytes sent since begin()
+  uint32_t served() const;
+  uint32_t bytesServed() const;
+
+private:
+  enum SlotState : uint8_t {
+    SLOT_FREE,
+    SLOT_REQUEST,
+    SLOT_SEND
+  };
+
+  struct Slot {
+    WiFiClient client;
+    SlotState state = SLOT_FREE;
+    char line[ROIDOTA_PEER_LINE_SIZE];
+    size_t lineLen = 0;
+    bool firstLine = true;
+    bool found = false;
+    bool ranged = false;
+    bool rangeValid = true;
+    bool ifRangeMatches = true;
+    size_t first = 0;
+    size_t last = 0;
+    size_t pos = 0;
+    size_t end = 0;
+    unsigned long activeAt = 0;
+  };
+
+  void accept(unsigned long now);
+  void readRequest(Slot& slot, unsigned long now);
+  void parseLine(Slot& slot);
+  void respond(Slot& slot, unsigned long now);
+  size_t send(Slot& slot, size_t budget, unsigned long now);
+  void reply(WiFiClient& client, const char* status, const char* headers = nullptr);
+  void close(Slot& slot);
+
+  WiFiServer server;
+  bool active = false;
+  uint16_t listenPort = 0;
+  RoidFlash::ImageRecord image;
+  Slot slotTable[ROIDOTA_PEER_MAX_CLIENTS];
+  uint8_t nextSlot = 0;
+  uint32_t downloads = 0;
+  uint32_t bytes = 0;
+  uint8_t chunk[ROIDOTA_PEER_CHUNK_SIZE];
+};
+
+#endif
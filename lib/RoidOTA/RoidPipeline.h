@@ -0,0 +1,96 @@
+#ifndef ROIDPIPELINE_H
+#define ROIDPIPELINE_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#include <thread>
+#endif
+#include <atomic>
+
+// Ring geometry: slots are flash-sector sized, so the writer erases and
+// programs whole sectors while the producer fills the next one.
+#ifndef ROIDOTA_PIPELINE_SLOT_SIZE
+#define ROIDOTA_PIPELINE_SLOT_SIZE 4096
+#endif
+#ifndef ROIDOTA_PIPELINE_SLOTS
+#define ROIDOTA_PIPELINE_SLOTS 4
+#endif
+// ESP32 writer task placement; Arduino's loop task runs on core 1.
+#ifndef ROIDOTA_PIPELINE_CORE
+#define ROIDOTA_PIPELINE_CORE 0
+#endif
+#ifndef ROIDOTA_PIPELINE_TASK_PRIORITY
+#define ROIDOTA_PIPELINE_TASK_PRIORITY 3
+#endif
+#ifndef ROIDOTA_PIPELINE_TASK_STACK
+#define ROIDOTA_PIPELINE_TASK_STACK 4096
+#endif
+// How long write() waits for a free slot before giving up on the writer.
+#ifndef ROIDOTA_PIPELINE_WAIT_MS
+#define ROIDOTA_PIPELINE_WAIT_MS 2000
+#endif
+
+// Hands bytes to a sink (normally the flash writer) running on its own
+// task: a FreeRTOS task on the other core on ESP32, a std::thread on the
+// host. Producer and consumer share a fixed pool of sector-sized buffers in
+// a lock-free single-producer/single-consumer ring.
+class RoidPipeline {
+public:
+  typedef bool (*SinkWriter)(const uint8_t* data, size_t len);
+
+  // Allocates the slots and starts the writer; position is the sink offset
+  // the first byte lands at, used for position().
+  bool begin(SinkWriter writer, size_t position = 0);
+
+  // Producer side. Copies data into slots, waiting for the writer if the
+  // ring is full; false once the sink failed or stalled.
+  bool write(const uint8_t* data, size_t len);
+
+  // Publishes a partially filled slot, at end of stream.
+  bool flush();
+
+  // Stops the writer, dropping unwritten slots, and frees the pool.
+  void end();
+
+  bool active() const;
+  bool idle() const;
+  bool failed() const;
+  size_t freeSlots() const;
+  size_t position() const;
+  const char* error() const;
+
+private:
+  struct Slot {
+    size_t len;
+    uint8_t data[ROIDOTA_PIPELINE_SLOT_SIZE];
+  };
+
+  static void taskEntry(void* arg);
+  void run();
+  bool waitForSlot();
+  void wake();
+
+  SinkWriter sink = nullptr;
+  Slot* slots = nullptr;
+  size_t fill = 0;
+  const char* errorMessage = nullptr;
+
+  // head is only advanced by the producer, tail only by the writer
+  std::atomic<uint32_t> head{0};
+  std::atomic<uint32_t> tail{0};
+  std::atomic<size_t> written{0};
+  std::atomic<bool> stopping{false};
+  std::atomic<bool> running{false};
+  std::atomic<bool> sinkFailed{false};
+
+#ifdef ARDUINO
+  TaskHandle_t task = nullptr;
+#else
+  std::thread thread;
+#endif
+};
+
+#endif
@@ -0,0 +1,146 @@
+#include "RoidRouter.h"
+
+#if ROIDOTA_ROUTER_NODES > 255 || ROIDOTA_MAX_ROUTES > 255
+#error "ROIDOTA_ROUTER_NODES and ROIDOTA_MAX_ROUTES must be at most 255"
+#endif
+
+static size_t levelLength(const char* level) {
+  const char* end = strchr(level, '/');
+  return end ? (size_t)(end - level) : strlen(level);
+}
+
+bool RoidRouter::valid(const char* filter) {
+  if (!filter || filter[0] == '\0') return false;
+  for (const char* level = filter;; ) {
+    size_t len = levelLength(level);
+    if (len > 255) return false;
+    if (memchr(level, '+', len) && len != 1) return false;
+    if (memchr(level, '#', len) && (len != 1 || level[len] != '\0')) return false;
+    if (level[len] == '\0') return true;
+    level += len + 1;
+  }
+}
+
+uint8_t RoidRouter::child(uint8_t node, const char* level, size_t len) const {
+  for (uint8_t c = nodes[node].firstChild; c != NONE; c = nodes[c].nextSibling) {
+    if (nodes[c].levelLen == len && memcmp(pool + nodes[c].level, level, len) == 0) return c;
+  }
+  return NONE;
+}
+
+// Node of a filter, or NONE if it was never added
+uint8_t RoidRouter::find(const char* filter) const {
+  uint8_t node = 0;
+  for (const char* level = filter;; ) {
+    size_t len = levelLength(level);
+    node = child(node, level, len);
+    if (node == NONE || level[len] == '\0') return node;
+    level += len + 1;
+  }
+}
+
+bool RoidRouter::add(const char* filter, RoidTopicHandler handler) {
+  if (!handler || !valid(filter)) return false;
+
+  uint8_t existing = find(filter);
+  if (existing != NONE && nodes[existing].route != NONE) {
+    routes[nodes[existing].route].handler = handler;
+    return true;
+  }
+
+  // Worst case every level is new; check room up front so a failed add
+  // leaves no half-built branch behind.
+  size_t filterLen = strlen(filter);
+  size_t levels = 1;
+  for (const char* p = filter; *p; ++p) levels += *p == '/';
+  if (routeCount >= ROIDOTA_MAX_ROUTES || poolUsed + filterLen + 1 > sizeof(pool) ||
+      nodeCount + levels > ROIDOTA_ROUTER_NODES) {
+    return false;
+  }
+
+  // Levels point into the stored copy of the filter
+  uint16_t stored = poolUsed;
+  memcpy(pool + stored, filter, filterLen + 1);
+  poolUsed += filterLen + 1;
+
+  uint8_t node = 0;
+  for (const char* level = pool + stored;; ) {
+    size_t len = levelLength(level);
+    uint8_t next = child(node, level, len);
+    if (next == NONE) {
+      next = nodeCount++;
+      nodes[next] = {(uint16_t)(level - pool), (uint8_t)len, NONE, nodes[node].firstChild, NONE};
+      nodes[node].firstChild = next;
+    }
+    node = next;
+    if (level[len] == '\0') break;
+    level += len + 1;
+  }
+
+  routes[routeCount] = {stored, node, handler};
+  nodes[node].route = routeCount++;
+  return true;
+}
+
+bool RoidRouter::remove(const char* filter) {
+  if (!valid(filter)) return false;
+  uint8_t node = find(filter);
+  if (node == NONE || nodes[node].route == NONE) return false;
+
+  // Move the last route into the freed slot
+  uint8_t slot = nodes[node].route;
+  nodes[node].route = NONE;
+  if (slot != --routeCount) {
+    routes[slot] = routes[routeCount];
+    nodes[routes[slot].node].route = slot;
+  }
+  return true;
+}
+
+size_t RoidRouter::dispatch(const char* topic, const byte* payload, unsigned int length) const {
+  size_t hits = 0;
+  match(0, topic, topic, payload, length, hits);
+  return hits;
+}
+
+void RoidRouter::call(uint8_t node, const char* topic, const byte* payload, unsigned int length, size_t& hits) const {
+  if (nodes[node].route == NONE) return;
+  routes[nodes[node].route].handler(topic, payload, length);
+  ++hits;
+}
+
+// Recursion depth is the number of topic levels.
+void RoidRouter::match(uint8_t node, const char* level, const char* topic, const byte* payload,
+                       unsigned int length, size_t& hits) const {
+  size_t len = levelLength(level);
+  bool last = level[len] == '\0';
+  bool system = level == topic && topic[0] == '$';
+
+  for (uint8_t c = nodes[node].firstChild; c != NONE; c = nodes[c].nextSibling) {
+    const Node& n = nodes[c];
+    char wildcard = n.levelLen == 1 ? pool[n.level] : '\0';
+    if (wildcard == '#') {
+      if (!system) call(c, topic, payload, length, hits);
+      continue;
+    }
+    bool matches = wildcard == '+' ? !system
+                 : n.levelLen == len && memcmp(pool + n.level, level, len) == 0;
+    if (!matches) continue;
+    if (!last) {
+      match(c, level + len + 1, topic, payload, length, hits);
+      continue;
+    }
+    call(c, topic, payload, length, hits);
+    // "a/#" also matches "a"
+    uint8_t rest = child(c, "#", 1);
+    if (rest != NONE) call(rest, topic, payload, length, hits);
+  }
+}
+
+size_t RoidRouter::count() const {
+  return routeCount;
+}
+
+const char* RoidRouter::filter(size_t index) const {
+  return index < routeCount ? pool + routes[index].filter : nullptr;
+}
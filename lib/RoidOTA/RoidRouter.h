@@ -0,0 +1,73 @@
+#ifndef ROIDROUTER_H
+#define ROIDROUTER_H
+
+#include <Arduino.h>
+
+// Router capacity, fixed at compile time. RoidOTA takes two routes for its
+// own topics. Filters and their levels are copied into the pool, so callers
+// may pass temporary strings.
+#ifndef ROIDOTA_MAX_ROUTES
+#define ROIDOTA_MAX_ROUTES 12
+#endif
+#ifndef ROIDOTA_ROUTER_NODES
+#define ROIDOTA_ROUTER_NODES 48
+#endif
+#ifndef ROIDOTA_ROUTER_POOL
+#define ROIDOTA_ROUTER_POOL 512
+#endif
+
+typedef void (*RoidTopicHandler)(const char* topic, const byte* payload, unsigned int length);
+
+// MQTT topic filters compiled into a trie with one node per filter level,
+// so matching a topic walks its levels once whatever the number of routes;
+// '+' and '#' are ordinary children that match any level. Every matching
+// route is called, as a broker would deliver to every matching subscription.
+// Topics starting with '$' do not match a leading wildcard.
+class RoidRouter {
+public:
+  // Registers or replaces the handler for a filter. Fails on a malformed
+  // filter ('#' not last, wildcards sharing a level) or when full.
+  bool add(const char* filter, RoidTopicHandler handler);
+  // The filter's nodes stay in the trie; the route slot is reused.
+  bool remove(const char* filter);
+
+  // Calls every matching handler and returns how many matched.
+  size_t dispatch(const char* topic, const byte* payload, unsigned int length) const;
+
+  // Registered filters, for subscribing after a (re)connect
+  size_t count() const;
+  const char* filter(size_t index) const;
+
+private:
+  static const uint8_t NONE = 0xFF;
+
+  struct Node {
+    uint16_t level;  // pool offset
+    uint8_t levelLen;
+    uint8_t firstChild;
+    uint8_t nextSibling;
+    uint8_t route;
+  };
+
+  struct Route {
+    uint16_t filter;  // pool offset
+    uint8_t node;
+    RoidTopicHandler handler;
+  };
+
+  static bool valid(const char* filter);
+  uint8_t find(const char* filter) const;
+  uint8_t child(uint8_t node, const char* level, size_t len) const;
+  void match(uint8_t node, const char* level, const char* topic, const byte* payload,
+             unsigned int length, size_t& hits) const;
+  void call(uint8_t node, const char* topic, const byte* payload, unsigned int length, size_t& hits) const;
+
+  Node nodes[ROIDOTA_ROUTER_NODES] = {{0, 0, NONE, NONE, NONE}};
+  uint8_t nodeCount = 1;  // node 0 is the root
+  Route routes[ROIDOTA_MAX_ROUTES] = {};
+  uint8_t routeCount = 0;
+  char pool[ROIDOTA_ROUTER_POOL];
+  size_t poolUsed = 0;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "RoidScheduler.h"
+
+#if ROIDOTA_MAX_TASKS > 255
+#error "ROIDOTA_MAX_TASKS must be at most 255"
+#endif
+
+int RoidScheduler::every(const char* name, uint32_t intervalMs, RoidTaskFunction fn, Priority priority, uint32_t now) {
+  if (intervalMs == 0) return -1;
+  return add(name, intervalMs, intervalMs, fn, priority, now);
+}
+
+int RoidScheduler::after(const char* name, uint32_t delayMs, RoidTaskFunction fn, Priority priority, uint32_t now) {
+  return add(name, 0, delayMs, fn, priority, now);
+}
+
+int RoidScheduler::add(const char* name, uint32_t interval, uint32_t delayMs, RoidTaskFunction fn, Priority priority, uint32_t now) {
+  if (!fn) return -1;
+  for (uint8_t slot = 0; slot < ROIDOTA_MAX_TASKS; ++slot) {
+    if (tasks[slot].used) continue;
+    Task& t = tasks[slot];
+    t = Task();
+    t.fn = fn;
+    t.name = name ? name : "";
+    t.interval = interval;
+    t.due = now + delayMs;
+    t.priority = priority;
+    t.used = true;
+    push(slot);
+    return slot;
+  }
+  return -1;
+}
+
+bool RoidScheduler::cancel(int id) {
+  if (!active(id)) return false;
+  remove(id);
+  tasks[id].used = false;
+  return true;
+}
+
+bool RoidScheduler::reschedule(int id, uint32_t delayMs, uint32_t now) {
+  if (!active(id)) return false;
+  remove(id);
+  tasks[id].due = now + delayMs;
+  push(id);
+  return true;
+}
+
+bool RoidScheduler::active(int id) const {
+  return id >= 0 && id < ROIDOTA_MAX_TASKS && tasks[id].used;
+}
+
+size_t RoidScheduler::count() const {
+  return heapSize;
+}
+
+// Earlier deadline first; equal deadlines go by priority.
+bool RoidScheduler::before(uint8_t a, uint8_t b) const {
+  int32_t diff = (int32_t)(tasks[a].due - tasks[b].due);
+  if (diff != 0) return diff < 0;
+  return tasks[a].priority < tasks[b].priority;
+}
+
+void RoidScheduler::place(uint8_t pos, uint8_t slot) {
+  heap[pos] = slot;
+  tasks[slot].heapPos = pos;
+}
+
+void RoidScheduler::siftUp(uint8_t pos) {
+  uint8_t slot = heap[pos];
+  while (pos > 0) {
+    uint8_t parent = (pos - 1) / 2;
+    if (!before(slot, heap[parent])) break;
+    place(pos, heap[parent]);
+    pos = parent;
+  }
+  place(pos, slot);
+}
+
+void RoidScheduler::siftDown(uint8_t pos) {
+  uint8_t slot = heap[pos];
+  for (;;) {
+    size_t child = 2 * (size_t)pos + 1;
+    if (child >= heapSize) break;
+    if (child + 1 < heapSize && before(heap[child + 1], heap[child])) ++child;
+    if (!before(heap[child], slot)) break;
+    place(pos, heap[child]);
+    pos = child;
+  }
+  place(pos, slot);
+}
+
+void RoidScheduler::push(uint8_t slot) {
+  place(heapSize, slot);
+  siftUp(heapSize++);
+}
+
+void RoidScheduler::remove(uint8_t slot) {
+  uint8_t pos = tasks[slot].heapPos;
+  uint8_t last = heap[--heapSize];
+  if (pos == heapSize) return;
+  place(pos, last);
+  siftUp(pos);
+  siftDown(tasks[last].heapPos);
+}
+
+// Tasks run with the deadline popped, so a task may cancel or reschedule
+// itself (or register others) from inside its function.
+void RoidScheduler::run(uint32_t now) {
+  uint32_t start = micros();
+  while (heapSize > 0) {
+    uint8_t slot = heap[0];
+    Task& t = tasks[slot];
+    if ((int32_t)(now - t.due) < 0) break;
+    bool overBudget = micros() - start >= ROIDOTA_SCHEDULER_BUDGET_MS * 1000UL;
+    if (overBudget && t.priority != PRIO_CRITICAL) break;
+
+    remove(slot);
+    if (t.interval > 0) {
+      // Keep periodic tasks on their grid; after a stall, skip the missed
+      // runs rather than bursting them.
+      t.due += t.interval;
+      if ((int32_t)(now - t.due) >= 0) {
+        uint32_t missed = (now - t.due) / t.interval + 1;
+        t.skipped += missed;
+        t.due += missed * t.interval;
+      }
+      push(slot);
+    } else {
+      t.used = false;
+    }
+
+    uint32_t taskStart = micros();
+    t.fn();
+    uint32_t took = micros() - taskStart;
+    ++t.runs;
+    if (took > t.maxMicros) t.maxMicros = took;
+    if (took >= ROIDOTA_TASK_OVERRUN_MS * 1000UL) {
+      ++t.overruns;
+      ++pendingOverruns;
+      if (took > worstOverrunMicros) {
+        worstOverrunMicros = took;
+        worstOverrunSlot = slot;
+      }
+    }
+  }
+}
+
+bool RoidScheduler::overrunReport(uint32_t now, uint32_t intervalMs, char* message, size_t size) {
+  if (pendingOverruns == 0 || now - lastOverrunReport < intervalMs) return false;
+  snprintf(message, size, "%lu task overrun(s), worst %lu ms in %s",
+           (unsigned long)pendingOverruns, (unsigned long)(worstOverrunMicros / 1000), tasks[worstOverrunSlot].name);
+  pendingOverruns = 0;
+  worstOverrunMicros = 0;
+  lastOverrunReport = now;
+  return true;
+}
+
+size_t RoidScheduler::writeReport(const char* deviceId, RoidChunkWriter writer) const {
+  RoidChunkOut out(writer);
+  out.text("{\"device_id\":");
+  out.quoted(deviceId);
+  out.text(",\"tasks\":[");
+  bool first = true;
+  for (uint8_t slot = 0; slot < ROIDOTA_MAX_TASKS; ++slot) {
+    const Task& t = tasks[slot];
+    if (!t.used) continue;
+    if (!first) out.put(',');
+    first = false;
+    out.text("{\"name\":");
+    out.quoted(t.name);
+    out.text(",\"interval_ms\":");
+    out.number(t.interval);
+    out.text(",\"priority\":");
+    out.number(t.priority);
+    out.text(",\"runs\":");
+    out.number(t.runs);
+    out.text(",\"overruns\":");
+    out.number(t.overruns);
+    out.text(",\"skipped\":");
+    out.number(t.skipped);
+    out.text(",\"max_us\":");
+    out.number(t.maxMicros);
+    out.put('}');
+  }
+  out.text("]}");
+  return out.flush() ? out.total : 0;
+}
@@ -0,0 +1,43 @@
+#ifndef ROIDSHA256_H
+#define ROIDSHA256_H
+
+#ifdef ESP32
+#include <Arduino.h>
+#include <mbedtls/sha256.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+// Incremental SHA-256. On ESP32 this is mbedtls, which uses the SHA
+// peripheral; elsewhere a small software implementation.
+class RoidSha256 {
+public:
+  static const size_t DIGEST_SIZE = 32;
+
+  void begin();
+  void update(const uint8_t* data, size_t len);
+  void finish(uint8_t digest[DIGEST_SIZE]);
+  // Drops a digest that will not be finished
+  void abort();
+
+  // Compares a digest with 64 hex characters, case-insensitively.
+  static bool matchesHex(const uint8_t digest[DIGEST_SIZE], const char* hex);
+  // 0-15, or -1 if c is not a hex digit
+  static int hexValue(char c);
+
+private:
+#ifdef ESP32
+  mbedtls_sha256_context ctx;
+  bool started = false;
+#else
+  void transform(const uint8_t block[64]);
+
+  uint32_t state[8];
+  uint64_t total;
+  uint8_t buffer[64];
+  size_t bufferLen;
+#endif
+};
+
+#endif
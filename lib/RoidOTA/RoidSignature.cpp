@@ -0,0 +1,51 @@
+#include "RoidSignature.h"
+#include "RoidSha256.h"
+#include <string.h>
+
+#ifdef ROIDOTA_SIGNING_KEY
+#include <mbedtls/pk.h>
+#include <mbedtls/md.h>
+
+// A DER ECDSA P-256 signature is at most 72 bytes.
+static const size_t MAX_SIGNATURE = 72;
+
+bool RoidSignature::required() {
+  return true;
+}
+
+bool RoidSignature::verify(const uint8_t digest[32], const char* signatureHex) {
+  size_t hexLen = signatureHex ? strlen(signatureHex) : 0;
+  if (hexLen == 0 || hexLen % 2 != 0 || hexLen / 2 > MAX_SIGNATURE) return false;
+
+  uint8_t signature[MAX_SIGNATURE];
+  size_t signatureLen = hexLen / 2;
+  for (size_t i = 0; i < signatureLen; ++i) {
+    int hi = RoidSha256::hexValue(signatureHex[2 * i]);
+    int lo = RoidSha256::hexValue(signatureHex[2 * i + 1]);
+    if (hi < 0 || lo < 0) return false;
+    signature[i] = (uint8_t)((hi << 4) | lo);
+  }
+
+  static const char key[] = ROIDOTA_SIGNING_KEY;
+  mbedtls_pk_context pk;
+  mbedtls_pk_init(&pk);
+  bool ok = mbedtls_pk_parse_public_key(&pk, (const unsigned char*)key, sizeof(key)) == 0 &&
+            mbedtls_pk_can_do(&pk, MBEDTLS_PK_ECDSA) &&
+            mbedtls_pk_verify(&pk, MBEDTLS_MD_SHA256, digest, 32, signature, signatureLen) == 0;
+  mbedtls_pk_free(&pk);
+  return ok;
+}
+
+#else
+
+bool RoidSignature::required() {
+  return false;
+}
+
+bool RoidSignature::verify(const uint8_t digest[32], const char* signatureHex) {
+  (void)digest;
+  (void)signatureHex;
+  return true;
+}
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef ROIDSIGNATURE_H
+#define ROIDSIGNATURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Define ROIDOTA_SIGNING_KEY as the backend's ECDSA P-256 public key in PEM
+// form to require signed firmware. Without it, signatures are not checked.
+//
+//   -DROIDOTA_SIGNING_KEY="\"-----BEGIN PUBLIC KEY-----\\n...\\n-----END PUBLIC KEY-----\\n\""
+class RoidSignature {
+public:
+  static bool required();
+
+  // Checks a hex-encoded DER ECDSA signature over an image SHA-256 digest.
+  static bool verify(const uint8_t digest[32], const char* signatureHex);
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef ROIDSLEEP_H
+#define ROIDSLEEP_H
+
+#include <Arduino.h>
+
+// How long a wake listens for a pending response or command once its
+// report is out; every message received restarts the window.
+#ifndef ROIDOTA_SLEEP_LISTEN_MS
+#define ROIDOTA_SLEEP_LISTEN_MS 1500
+#endif
+// Longest wake, so an unreachable broker or a chatty backend cannot drain
+// the battery. A running OTA update is exempt.
+#ifndef ROIDOTA_SLEEP_MAX_AWAKE_MS
+#define ROIDOTA_SLEEP_MAX_AWAKE_MS 20000
+#endif
+// Shortest sleep, for wakes that overran their interval.
+#ifndef ROIDOTA_SLEEP_MIN_MS
+#define ROIDOTA_SLEEP_MIN_MS 1000
+#endif
+// After wakes that could not reach the broker, the radio stays off for 1,
+// 3, 7.. wakes, at most ROIDOTA_SLEEP_BACKOFF_MAX_WAKES; user code still
+// runs on every wake.
+#ifndef ROIDOTA_SLEEP_BACKOFF_MAX_WAKES
+#define ROIDOTA_SLEEP_BACKOFF_MAX_WAKES 15
+#endif
+// The broker keeps the MQTT session, subscriptions included, between
+// wakes; they are renewed every this many wakes in case it lost them.
+#ifndef ROIDOTA_SLEEP_RESUBSCRIBE_WAKES
+#define ROIDOTA_SLEEP_RESUBSCRIBE_WAKES 16
+#endif
+
+// What the duty-cycled mode carries from one wake to the next, kept in RTC
+// memory, which deep sleep and restarts preserve. A power-up starts cold:
+// first wake, subscriptions due, no backoff.
+class RoidSleep {
+public:
+  // Loads the state at boot; false on a cold start.
+  static bool wake();
+  // Wakes since power-up, this one included
+  static uint32_t wakes();
+
+  // Whether this wake brings up the radio, given the failure backoff.
+  // Called once per wake.
+  static bool radioDue();
+  // Whether this wake reached the broker and got its report out.
+  static void exchanged(bool ok);
+  static uint8_t failures();
+
+  static bool subscribeDue();
+  static void subscribed();
+
+  // Jitter generator state, so consecutive wakes don't repeat it; 0 if none
+  static uint32_t jitter();
+
+  // The previous wake, in ms; 0 after a cold start
+  static uint32_t lastAwakeMs();
+  static uint32_t lastRadioMs();
+
+  // Saves the state and deep sleeps for ms; the next wake is a fresh boot.
+  static void sleep(uint32_t ms, uint32_t awakeMs, uint32_t radioMs, uint32_t jitter);
+};
+
+#endif
@@ -0,0 +1,149 @@
+#include "RoidWiFi.h"
+
+#ifndef RTC_NOINIT_ATTR
+#define RTC_NOINIT_ATTR
+#endif
+
+static const uint32_t RTC_MAGIC = 0x52574946;  // "RWIF"
+
+// Not initialized at boot; trusted only when magic and checksum match.
+struct RtcWiFi {
+  uint32_t magic;
+  uint32_t checksum;
+  char ssid[33];
+  char psk[65];
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+  uint8_t leaseReuses;
+};
+
+RTC_NOINIT_ATTR static RtcWiFi rtcWiFi;
+
+uint32_t RoidWiFi::staticAddress[4] = {0, 0, 0, 0};
+volatile unsigned long RoidWiFi::associated = 0;
+
+static uint32_t rtcChecksum(const RtcWiFi& rtc) {
+  const uint8_t* p = (const uint8_t*)rtc.ssid;
+  const uint8_t* end = (const uint8_t*)&rtc + sizeof(rtc);
+  uint32_t hash = 2166136261u;
+  while (p < end) {
+    hash ^= *p++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+bool RoidWiFi::fastConnect(uint32_t timeoutMs, bool& leaseReused) {
+  leaseReused = false;
+  if (rtcWiFi.magic != RTC_MAGIC || rtcWiFi.checksum != rtcChecksum(rtcWiFi)) return false;
+
+  // Credentials stay where WiFiManager saved them; don't rewrite NVS on
+  // every boot. Persistence is back on before the portal can run.
+  WiFi.persistent(false);
+  WiFi.mode(WIFI_STA);
+
+  IPAddress ip, gateway, subnet, dns;
+  if (staticIp(ip, gateway, subnet, dns)) {
+    WiFi.config(ip, gateway, subnet, dns);
+    leaseReused = true;
+  } else if (rtcWiFi.ip != 0 && rtcWiFi.leaseReuses < ROIDOTA_WIFI_LEASE_REUSES) {
+    WiFi.config(IPAddress(rtcWiFi.ip), IPAddress(rtcWiFi.gateway), IPAddress(rtcWiFi.subnet), IPAddress(rtcWiFi.dns));
+    leaseReused = true;
+  }
+
+  WiFi.begin(rtcWiFi.ssid, rtcWiFi.psk, rtcWiFi.channel, rtcWiFi.bssid);
+  unsigned long start = millis();
+  bool connected = true;
+  while (WiFi.status() != WL_CONNECTED) {
+    if (millis() - start >= timeoutMs) {
+      connected = false;
+      break;
+    }
+    delay(10);
+  }
+  WiFi.persistent(true);
+  if (connected) return true;
+
+  // The access point moved or the lease is gone; start clean
+  forget();
+  WiFi.disconnect();
+  if (leaseReused) WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+  leaseReused = false;
+  return false;
+}
+
+// With leaseReused, the address is the one reused from the cache, so only
+// the reuse count changes.
+void RoidWiFi::remember(bool leaseReused) {
+  uint8_t reuses = !leaseReused ? 0 : rtcWiFi.leaseReuses < 255 ? rtcWiFi.leaseReuses + 1 : 255;
+  String ssid = WiFi.SSID();
+  String psk = WiFi.psk();
+  const uint8_t* bssid = WiFi.BSSID();
+  if (ssid.length() == 0 || ssid.length() >= sizeof(rtcWiFi.ssid) ||
+      psk.length() >= sizeof(rtcWiFi.psk) || !bssid) {
+    forget();
+    return;
+  }
+
+  memset(&rtcWiFi, 0, sizeof(rtcWiFi));
+  strcpy(rtcWiFi.ssid, ssid.c_str());
+  strcpy(rtcWiFi.psk, psk.c_str());
+  memcpy(rtcWiFi.bssid, bssid, sizeof(rtcWiFi.bssid));
+  rtcWiFi.channel = WiFi.channel();
+  rtcWiFi.ip = WiFi.localIP();
+  rtcWiFi.gateway = WiFi.gatewayIP();
+  rtcWiFi.subnet = WiFi.subnetMask();
+  rtcWiFi.dns = WiFi.dnsIP();
+  rtcWiFi.leaseReuses = reuses;
+  rtcWiFi.magic = RTC_MAGIC;
+  rtcWiFi.checksum = rtcChecksum(rtcWiFi);
+}
+
+void RoidWiFi::forget() {
+  rtcWiFi.magic = 0;
+}
+
+void RoidWiFi::watchAssociation() {
+  associated = 0;
+#ifdef ESP32
+  static bool watching = false;
+  if (watching) return;
+  watching = true;
+  WiFi.onEvent([](arduino_event_id_t, arduino_event_info_t) { associated = millis(); },
+               ARDUINO_EVENT_WIFI_STA_CONNECTED);
+#endif
+}
+
+unsigned long RoidWiFi::associatedAt() {
+  return associated;
+}
+
+uint32_t RoidWiFi::networkId() {
+  String ssid = WiFi.SSID();
+  uint32_t hash = 2166136261u;
+  for (const char* c = ssid.c_str(); *c; ++c) hash = (hash ^ (uint8_t)*c) * 16777619u;
+  uint32_t words[2] = {WiFi.gatewayIP(), WiFi.subnetMask()};
+  const uint8_t* p = (const uint8_t*)words;
+  for (size_t i = 0; i < sizeof(words); ++i) hash = (hash ^ p[i]) * 16777619u;
+  return hash;
+}
+
+void RoidWiFi::setStaticIp(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns) {
+  staticAddress[0] = ip;
+  staticAddress[1] = gateway;
+  staticAddress[2] = subnet;
+  staticAddress[3] = dns;
+}
+
+bool RoidWiFi::staticIp(IPAddress& ip, IPAddress& gateway, IPAddress& subnet, IPAddress& dns) {
+  if (staticAddress[0] == 0) return false;
+  ip = IPAddress(staticAddress[0]);
+  gateway = IPAddress(staticAddress[1]);
+  subnet = IPAddress(staticAddress[2]);
+  dns = IPAddress(staticAddress[3]);
+  return true;
+}
@@ -0,0 +1,61 @@
+#ifndef ROIDWIFI_H
+#define ROIDWIFI_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+// How long a cached connection may take before falling back to the
+// WiFiManager path.
+#ifndef ROIDOTA_WIFI_FAST_TIMEOUT_MS
+#define ROIDOTA_WIFI_FAST_TIMEOUT_MS 3000
+#endif
+// The fast path reuses the cached DHCP lease as a static address for this
+// many boots in a row, then asks DHCP again so the server sees the lease
+// renewed. 0 always uses DHCP.
+#ifndef ROIDOTA_WIFI_LEASE_REUSES
+#define ROIDOTA_WIFI_LEASE_REUSES 4
+#endif
+
+// Fast reconnect after a restart. Once connected, the SSID, passphrase,
+// BSSID, channel and address lease are kept in RTC memory; the next boot
+// joins that access point directly, with no scan and, with a reused lease
+// or a static address, no DHCP. A power cycle clears the cache, and a failed
+// fast attempt drops it, so the regular path always remains.
+class RoidWiFi {
+public:
+  // Boot phases, in ms since begin(); 0 if the phase did not happen
+  struct BootTimes {
+    uint32_t wifiMs;       // associated (ESP32 only, else same as dhcpMs)
+    uint32_t dhcpMs;       // address configured
+    uint32_t mqttMs;       // first broker connection
+    uint32_t subscribeMs;  // subscriptions sent
+    bool fast;             // joined through the cached access point
+    bool leaseReused;      // no DHCP round trip
+  };
+
+  // Tries the cached access point; false if there is none or it failed.
+  static bool fastConnect(uint32_t timeoutMs, bool& leaseReused);
+  // Caches the current connection for the next boot; leaseReused is what
+  // fastConnect() reported.
+  static void remember(bool leaseReused);
+  static void forget();
+
+  // When the station last associated, 0 if not seen. Only tracked on the
+  // ESP32, which reports it as an event.
+  static void watchAssociation();
+  static unsigned long associatedAt();
+
+  // Identifies the LAN the station is on: FNV-1a of the SSID, gateway and
+  // netmask. Devices reporting the same ID can normally reach each other.
+  static uint32_t networkId();
+
+  // Fixed address for both paths; unset by default.
+  static void setStaticIp(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns);
+  static bool staticIp(IPAddress& ip, IPAddress& gateway, IPAddress& subnet, IPAddress& dns);
+
+private:
+  static uint32_t staticAddress[4];
+  static volatile unsigned long associated;
+};
+
+#endif
@@ -0,0 +1,908 @@
+// Fleet simulator: many RoidOTA devices in one process, for load testing the
+// broker and the backend with the traffic a real fleet makes. Built by the
+// fleet environment in ../platformio.ini against the RoidNative fakes:
+//
+//   pio run -e fleet && .pio/build/fleet/program --devices 2000 --api 127.0.0.1:3000
+//       --deploy <firmware id>
+//
+// Every simulated device is a RoidDevice, the same core a sketch runs
+// behind RoidOTA, set up with setVirtual(): its own PubSubClient session,
+// announce, heartbeats, log batches, command handling, outbox and OTA
+// engine, so what the broker and backend see is what the library sends.
+// The simulator calls each device's handle() every --tick-ms, as loop()
+// would, and watches their packets through RoidNative::setMqttTap() to time
+// them. A virtual device has no flash: it downloads the offered image over
+// HTTP (or the MQTT transport, if the backend offers it), checks the
+// sha256, ACKs and "restarts", which here means it is gone for --reboot-ms
+// and then begins again as a fresh RoidDevice. Patches, broadcasts and
+// resuming need flash, so it takes the full or compressed image, and it
+// serves nothing to LAN peers. Nor has it RTC memory, so an ACK the backend
+// has not confirmed by the restart is lost, where a board would repeat it
+// after booting. Firmware URLs must be plain http the host can reach, e.g.
+// a MinIO endpoint the backend signs http URLs for.
+//
+// MQTT and HTTP connects block as they do on a chip, and a device's handle()
+// runs its share of the download, so the fleet is split into --threads
+// shards, every n-th device to each, each ticked by its own thread: a slow
+// CONNACK or firmware server holds up the devices of one shard, not the
+// fleet. With thousands of devices per shard, tick-ms still stretches before
+// the broker or the backend is the limit. The summary's "late_ticks" says
+// how often a device got its handle() more than a tick late.
+//
+// Options (defaults in brackets):
+//   --broker host:port     MQTT broker [127.0.0.1:1883]
+//   --devices n            fleet size [100]; IDs are <prefix><n>
+//   --prefix s             device ID prefix [sim_]
+//   --connect-rate n       devices brought up per second [200]
+//   --duration-ms n        run length [60000]
+//   --tick-ms n            how often each device's handle() runs [20]
+//   --threads n            shards the fleet is ticked on [4 per core]
+//   --heartbeat-ms n       heartbeat interval [HEARTBEAT_INTERVAL]
+//   --logs-per-min n       log entries per device per minute [6]
+//   --churn-ms n           mean time between link drops per device [0, none]
+//   --reboot-ms n          time a device is gone after a restart [2000]
+//   --download-kbps n      per-device download speed limit, through the
+//                          OTA budget per handle() [0, none]
+//   --api host:port        backend HTTP API, needed for the two below
+//   --deploy id            POST /firmware/deploy/<device> with this firmware
+//   --deploy-at-ms n       when the deploys start [10000]
+//   --deploy-count n       how many devices get one [all]
+//   --deploy-spread-ms n   over how long they are issued [1000]
+//   --command-rate n       POST /firmware/device/<device>/heartbeat per second [0]
+//   --report-ms n          report interval [5000]
+//
+// Prints one JSON object per report interval on stdout and a summary at the
+// end. Latencies, in ms, as p50/p90/p99/max over the interval; what reaches
+// a device is seen at its next handle(), so up to a tick is added:
+//   connect_ms     CONNECT sent to CONNACK, read in the same call
+//   ping_ms        PINGREQ to PINGRESP, the broker's turnaround plus a tick
+//   api_ms         backend HTTP request to response
+//   deploy_ms      deploy call to the firmware response reaching the device
+//   deploy_ack_ms  deploy call to the device publishing its ACK
+//   confirm_ms     ACK published to the backend's confirm command arriving,
+//                  from the latest publish if the outbox repeated it
+//   command_ms     heartbeat call to the command reaching the device, which
+//                  answers it with a keyframe on the spot
+// Raising --devices, --connect-rate, --heartbeat-ms or --command-rate until
+// confirm_ms and command_ms keep growing from one report to the next, or
+// acks_unconfirmed never drains, finds what the backend can sustain; ping_ms
+// staying flat meanwhile says the broker is not the bottleneck.
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <RoidOTA.h>
+#include "RoidNative.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const unsigned long NEVER = (unsigned long)-1;
+
+// ========== Options ==========
+struct Options {
+  const char* broker = "127.0.0.1:1883";
+  const char* prefix = "sim_";
+  int devices = 100;
+  double connectRate = 200;
+  unsigned long durationMs = 60000;
+  unsigned long tickMs = 20;
+  int threads = 0;
+  unsigned long heartbeatMs = HEARTBEAT_INTERVAL;
+  double logsPerMin = 6;
+  unsigned long churnMs = 0;
+  unsigned long rebootMs = 2000;
+  double downloadKbps = 0;
+  const char* api = nullptr;
+  const char* deployId = nullptr;
+  unsigned long deployAtMs = 10000;
+  int deployCount = -1;
+  unsigned long deploySpreadMs = 1000;
+  double commandRate = 0;
+  unsigned long reportMs = 5000;
+};
+
+static Options opts;
+
+static const char* option(const char* name) {
+  for (int i = 1; i + 1 < RoidNative::argCount(); ++i) {
+    if (strcmp(RoidNative::arg(i), name) == 0) return RoidNative::arg(i + 1);
+  }
+  return nullptr;
+}
+
+static void numberOption(const char* name, double& value) {
+  const char* text = option(name);
+  if (text) value = strtod(text, nullptr);
+}
+
+static void numberOption(const char* name, unsigned long& value) {
+  const char* text = option(name);
+  if (text) value = strtoul(text, nullptr, 10);
+}
+
+static void numberOption(const char* name, int& value) {
+  const char* text = option(name);
+  if (text) value = atoi(text);
+}
+
+static void parseOptions() {
+  if (option("--broker")) opts.broker = option("--broker");
+  if (option("--prefix")) opts.prefix = option("--prefix");
+  if (option("--api")) opts.api = option("--api");
+  if (option("--deploy")) opts.deployId = option("--deploy");
+  numberOption("--devices", opts.devices);
+  numberOption("--connect-rate", opts.connectRate);
+  numberOption("--duration-ms", opts.durationMs);
+  numberOption("--tick-ms", opts.tickMs);
+  numberOption("--threads", opts.threads);
+  numberOption("--heartbeat-ms", opts.heartbeatMs);
+  numberOption("--logs-per-min", opts.logsPerMin);
+  numberOption("--churn-ms", opts.churnMs);
+  numberOption("--reboot-ms", opts.rebootMs);
+  numberOption("--download-kbps", opts.downloadKbps);
+  numberOption("--deploy-at-ms", opts.deployAtMs);
+  numberOption("--deploy-count", opts.deployCount);
+  numberOption("--deploy-spread-ms", opts.deploySpreadMs);
+  numberOption("--command-rate", opts.commandRate);
+  numberOption("--report-ms", opts.reportMs);
+  if (opts.deployCount < 0 || opts.deployCount > opts.devices) opts.deployCount = opts.devices;
+  if (opts.connectRate <= 0) opts.connectRate = 1e9;
+  if (opts.tickMs == 0) opts.tickMs = 1;
+  if (opts.threads <= 0) opts.threads = (int)std::max(1u, std::thread::hardware_concurrency()) * 4;
+  if (opts.threads > opts.devices) opts.threads = std::max(1, opts.devices);
+  if (opts.reportMs == 0) opts.reportMs = 5000;
+}
+
+// "host:port", or "host" with the given port
+static void splitHostPort(const char* hostPort, uint16_t defaultPort, std::string& host, uint16_t& port) {
+  host = hostPort;
+  port = defaultPort;
+  size_t colon = host.rfind(':');
+  if (colon != std::string::npos) {
+    port = (uint16_t)atoi(host.c_str() + colon + 1);
+    host.resize(colon);
+  }
+}
+
+static bool resolve(const char* hostPort, uint16_t defaultPort, sockaddr_in& addr) {
+  std::string host;
+  uint16_t port;
+  splitHostPort(hostPort, defaultPort, host, port);
+  addrinfo hints = {};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* found = nullptr;
+  if (getaddrinfo(host.c_str(), nullptr, &hints, &found) != 0 || !found) return false;
+  addr = *(sockaddr_in*)found->ai_addr;
+  addr.sin_port = htons(port);
+  freeaddrinfo(found);
+  return true;
+}
+
+// ========== Statistics ==========
+// A shard's samples since it last handed them in
+struct Series {
+  explicit Series(const char* name) : name(name) {}
+
+  const char* name;
+  std::vector<double> samples;
+
+  void add(double ms) { samples.push_back(ms); }
+};
+
+static void printSeries(const char* name, std::vector<double> v) {
+  printf(",\"%s\":", name);
+  if (v.empty()) {
+    printf("null");
+    return;
+  }
+  std::sort(v.begin(), v.end());
+  auto at = [&](double p) { return v[std::min(v.size() - 1, (size_t)(p * v.size()))]; };
+  printf("{\"n\":%zu,\"p50\":%.1f,\"p90\":%.1f,\"p99\":%.1f,\"max\":%.1f}", v.size(), at(0.5), at(0.9), at(0.99),
+         v.back());
+}
+
+struct Counters {
+  uint64_t connects = 0;
+  uint64_t connectFails = 0;
+  uint64_t drops = 0;
+  uint64_t published = 0;
+  uint64_t publishedBytes = 0;
+  uint64_t received = 0;
+  uint64_t receivedBytes = 0;
+  uint64_t heartbeats = 0;
+  uint64_t logBatches = 0;
+  uint64_t acks = 0;
+  uint64_t confirms = 0;
+  uint64_t downloads = 0;
+  uint64_t downloadFails = 0;
+  uint64_t restarts = 0;
+  uint64_t apiCalls = 0;
+  uint64_t apiErrors = 0;
+  uint64_t ticks = 0;
+  uint64_t lateTicks = 0;
+
+  void add(const Counters& o) {
+    connects += o.connects;
+    connectFails += o.connectFails;
+    drops += o.drops;
+    published += o.published;
+    publishedBytes += o.publishedBytes;
+    received += o.received;
+    receivedBytes += o.receivedBytes;
+    heartbeats += o.heartbeats;
+    logBatches += o.logBatches;
+    acks += o.acks;
+    confirms += o.confirms;
+    downloads += o.downloads;
+    downloadFails += o.downloadFails;
+    restarts += o.restarts;
+    apiCalls += o.apiCalls;
+    apiErrors += o.apiErrors;
+    ticks += o.ticks;
+    lateTicks += o.lateTicks;
+  }
+};
+
+// Each shard's thread counts into its own, and hands them in for every
+// report; see handIn().
+static thread_local Counters totals;
+static thread_local Series connectMs{"connect_ms"};
+static thread_local Series pingMs{"ping_ms"};
+static thread_local Series apiMs{"api_ms"};
+static thread_local Series deployMs{"deploy_ms"};
+static thread_local Series deployAckMs{"deploy_ack_ms"};
+static thread_local Series confirmMs{"confirm_ms"};
+static thread_local Series commandMs{"command_ms"};
+static thread_local Series* const SERIES[] = {&connectMs, &pingMs, &apiMs, &deployMs, &deployAckMs, &confirmMs, &commandMs};
+static const size_t SERIES_COUNT = sizeof(SERIES) / sizeof(SERIES[0]);
+
+// ========== Backend API connections ==========
+// One per shard
+static thread_local int epollFd = -1;
+
+// A nonblocking connection with its pending input and output. Output that
+// the kernel does not take at once waits for EPOLLOUT.
+struct Socket {
+  int fd = -1;
+  uint32_t events = 0;
+  bool added = false;
+  std::string in;
+  std::string out;
+  size_t outPos = 0;
+
+  bool open() const { return fd >= 0; }
+
+  bool connect(const sockaddr_in& addr, uint64_t tag) {
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return false;
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    in.clear();
+    out.clear();
+    outPos = 0;
+    events = 0;
+    added = false;
+    if (::connect(fd, (const sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+      close();
+      return false;
+    }
+    watch(tag, EPOLLIN | EPOLLOUT);
+    return true;
+  }
+
+  void watch(uint64_t tag, uint32_t wanted) {
+    if (fd < 0 || (added && wanted == events)) return;
+    epoll_event ev = {};
+    ev.events = wanted;
+    ev.data.u64 = tag;
+    epoll_ctl(epollFd, added ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+    events = wanted;
+    added = true;
+  }
+
+  // Returns false once the connection is broken
+  bool flush(uint64_t tag) {
+    while (outPos < out.size()) {
+      ssize_t n = send(fd, out.data() + outPos, out.size() - outPos, MSG_NOSIGNAL);
+      if (n < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+        watch(tag, events | EPOLLOUT);
+        return true;
+      }
+      outPos += (size_t)n;
+    }
+    out.clear();
+    outPos = 0;
+    watch(tag, events & ~EPOLLOUT);
+    return true;
+  }
+
+  // Appends what is readable; returns false on EOF or error
+  bool receive() {
+    char buf[4096];
+    for (;;) {
+      ssize_t n = recv(fd, buf, sizeof(buf), 0);
+      if (n > 0) {
+        in.append(buf, (size_t)n);
+        if ((size_t)n < sizeof(buf)) return true;
+      } else if (n == 0) {
+        return false;
+      } else {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+    }
+  }
+
+  void close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    events = 0;
+    added = false;
+    in.clear();
+    out.clear();
+    outPos = 0;
+  }
+};
+
+// Returns the fixed header length of an MQTT packet and fills in the
+// remaining length, or 0 if the header is malformed.
+static size_t takeLength(const uint8_t* packet, size_t len, size_t& remaining) {
+  remaining = 0;
+  size_t multiplier = 1;
+  for (size_t i = 1; i < len && i <= 4; ++i) {
+    remaining += (packet[i] & 0x7F) * multiplier;
+    if ((packet[i] & 0x80) == 0) return i + 1;
+    multiplier *= 128;
+  }
+  return 0;
+}
+
+// ========== Devices ==========
+static std::string brokerHost;
+static uint16_t brokerPort = 1883;
+static sockaddr_in apiAddr;
+static unsigned long startedAt = 0;
+
+static const char* LOG_LINES[] = {
+  "Sensor read ok",
+  "Loop tick",
+  "Queue depth nominal",
+  "Reading cached value",
+  "Actuator state unchanged",
+};
+
+class Device {
+public:
+  void setUp(uint32_t index, unsigned long now) {
+    this->index = index;
+    snprintf(id, sizeof(id), "%s%u", opts.prefix, (unsigned)index);
+    snprintf(topicStatus, sizeof(topicStatus), "roidota/status/%s", id);
+    snprintf(topicResponse, sizeof(topicResponse), "roidota/response/%s", id);
+    snprintf(topicCmd, sizeof(topicCmd), "roidota/cmd/%s", id);
+    snprintf(topicAck, sizeof(topicAck), "roidota/ack/%s", id);
+    snprintf(topicLogs, sizeof(topicLogs), "roidota/logs/%s", id);
+    // Log arrivals only; the device seeds its own jitter from its ID
+    random = 2166136261u ^ index;
+    nextTickAt = now;
+  }
+
+  bool up() { return device && device->mqtt().state() == MQTT_CONNECTED; }
+  bool apiBusy() const { return api.open(); }
+  bool unconfirmed() const { return ackPending; }
+  bool downloading() { return device && device->otaInProgress(); }
+  unsigned long dueAt() const { return nextTickAt; }
+
+  // One pass of the device's loop(), or its reboot once that is over
+  void tick(unsigned long now) {
+    current = this;
+    totals.ticks++;
+    if (now - nextTickAt > opts.tickMs) totals.lateTicks++;
+    nextTickAt = now + opts.tickMs;
+
+    if (!device) {
+      if (now >= rebootUntil) boot(now);
+    } else {
+      if (now >= nextLogAt) {
+        device->sendLog("INFO", LOG_LINES[nextRandom() % (sizeof(LOG_LINES) / sizeof(LOG_LINES[0]))]);
+        nextLogAt = now + exponential(60000.0 / opts.logsPerMin);
+      }
+      if (now >= dropAt) {
+        dropAt = NEVER;
+        device->mqtt().disconnect();
+      }
+      device->handle();
+    }
+    if (device) observe(millis());
+    if (restarting) {
+      restarting = false;
+      totals.restarts++;
+      // Without RTC memory an unconfirmed ACK is gone with the device
+      ackPending = false;
+      device.reset();
+      rebootUntil = millis() + opts.rebootMs;
+    }
+    current = nullptr;
+  }
+
+  void onEvent(uint32_t events, unsigned long now) { onApi(events, now); }
+
+  // Every MQTT packet of the device being ticked, as its PubSubClient
+  // sends or receives it
+  static void tap(PubSubClient&, bool inbound, const uint8_t* packet, size_t len) {
+    if (current) current->onPacket(inbound, packet, len, millis());
+  }
+
+  // ========== Backend API ==========
+  bool deploy(const char* firmwareId, unsigned long now) {
+    char path[96];
+    char body[128];
+    snprintf(path, sizeof(path), "/firmware/deploy/%s", id);
+    snprintf(body, sizeof(body), "{\"firmwareId\":\"%s\"}", firmwareId);
+    if (!callApi(path, body, now)) return false;
+    deploySentAt = now;
+    return true;
+  }
+
+  bool requestHeartbeat(unsigned long now) {
+    char path[96];
+    snprintf(path, sizeof(path), "/firmware/device/%s/heartbeat", id);
+    if (!callApi(path, "{}", now)) return false;
+    commandSentAt = now;
+    return true;
+  }
+
+private:
+  // ========== Lifecycle ==========
+  // Power-on, and every restart after it: a new RoidDevice, so nothing of
+  // the last one's RAM carries over.
+  void boot(unsigned long now) {
+    device.reset(new RoidDevice());
+    device->setVirtual(restarted);
+    device->setBroker(brokerHost.c_str(), brokerPort);
+    device->setHeartbeat(opts.heartbeatMs, ROIDOTA_HEARTBEAT_KEYFRAME_EVERY);
+    if (opts.downloadKbps > 0) {
+      size_t perTick = (size_t)(opts.downloadKbps * 0.125 * opts.tickMs);
+      device->setOtaBudget(ROIDOTA_OTA_TICK_BUDGET_MS, perTick > 0 ? perTick : 1);
+    }
+    wasUp = false;
+    wasUpdating = false;
+    dropAt = NEVER;
+    connectSentAt = 0;
+    pingSentAt = 0;
+    nextLogAt = opts.logsPerMin > 0 ? now + exponential(60000.0 / opts.logsPerMin) : NEVER;
+    device->begin(id, nullptr, nullptr);
+  }
+
+  static void restarted(RoidDevice&) {
+    current->restarting = true;
+  }
+
+  // What the device did in its handle(), from the outside
+  void observe(unsigned long now) {
+    bool isUp = device->mqtt().state() == MQTT_CONNECTED;
+    if (isUp && !wasUp) dropAt = opts.churnMs > 0 ? now + exponential((double)opts.churnMs) : NEVER;
+    if (!isUp && wasUp && !restarting) totals.drops++;
+    wasUp = isUp;
+    if (connectSentAt > 0 && !isUp) {
+      totals.connectFails++;
+      connectSentAt = 0;
+    }
+
+    bool updating = device->otaInProgress();
+    if (updating && !wasUpdating) totals.downloads++;
+    if (!updating && wasUpdating) totals.downloadFails++;
+    wasUpdating = updating;
+  }
+
+  uint32_t nextRandom() {
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random;
+  }
+
+  // Exponentially distributed wait with the given mean, so events across
+  // the fleet arrive as a Poisson stream
+  unsigned long exponential(double meanMs) {
+    double u = (nextRandom() + 0.5) / 4294967296.0;
+    return (unsigned long)(-log(u) * meanMs);
+  }
+
+  // ========== Packets ==========
+  void onPacket(bool inbound, const uint8_t* packet, size_t len, unsigned long now) {
+    size_t remaining;
+    size_t header = takeLength(packet, len, remaining);
+    if (header == 0) return;
+    const uint8_t* body = packet + header;
+    size_t bodyLen = len - header;
+
+    switch (packet[0] >> 4) {
+      case 1:  // CONNECT
+        if (!inbound) connectSentAt = now;
+        break;
+      case 2:  // CONNACK
+        if (inbound && bodyLen >= 2 && body[1] == 0) {
+          totals.connects++;
+          if (connectSentAt > 0) connectMs.add(now - connectSentAt);
+          connectSentAt = 0;
+        }
+        break;
+      case 3: {  // PUBLISH; a streamed one ends at its topic here
+        if (bodyLen < 2) break;
+        size_t topicLen = (size_t)body[0] << 8 | body[1];
+        size_t at = 2 + topicLen + (((packet[0] >> 1) & 3) ? 2 : 0);
+        if (at > remaining || 2 + topicLen > bodyLen) break;
+        std::string topic((const char*)body + 2, topicLen);
+        const uint8_t* payload = body + std::min(at, bodyLen);
+        size_t available = bodyLen > at ? bodyLen - at : 0;
+        if (inbound) {
+          received(topic, payload, available, now);
+        } else {
+          published(topic, payload, available, remaining - at, now);
+        }
+        break;
+      }
+      case 12:  // PINGREQ
+        if (!inbound) pingSentAt = now;
+        break;
+      case 13:  // PINGRESP
+        if (inbound && pingSentAt > 0) pingMs.add(now - pingSentAt);
+        pingSentAt = 0;
+        break;
+      default:
+        break;
+    }
+  }
+
+  void published(const std::string& topic, const uint8_t* payload, size_t len, size_t total, unsigned long now) {
+    totals.published++;
+    totals.publishedBytes += total;
+    if (topic == topicStatus) {
+      // Command replies are JSON without an uptime; a binary payload is
+      // always a heartbeat
+      if (len > 0 && (payload[0] != '{' || memmem(payload, len, "\"uptime\"", 8))) totals.heartbeats++;
+    } else if (topic == topicLogs) {
+      totals.logBatches++;
+    } else if (topic == topicAck) {
+      StaticJsonDocument<512> doc;
+      if (deserializeJson(doc, payload, len)) return;
+      totals.acks++;
+      ackSeq = doc["seq"] | 0;
+      ackAt = now;
+      ackPending = true;
+      if (deployStarted > 0) deployAckMs.add(now - deployStarted);
+      deployStarted = 0;
+    }
+  }
+
+  void received(const std::string& topic, const uint8_t* payload, size_t len, unsigned long now) {
+    totals.received++;
+    totals.receivedBytes += len;
+    if (topic == topicResponse) {
+      if (deploySentAt > 0) {
+        deployMs.add(now - deploySentAt);
+        deployStarted = deploySentAt;
+        deploySentAt = 0;
+      }
+    } else if (topic == topicCmd) {
+      StaticJsonDocument<ROIDOTA_COMMAND_DOC_SIZE> doc;
+      if (deserializeJson(doc, payload, len)) return;
+      const char* command = doc["command"] | "";
+      if (strcmp(command, "heartbeat") == 0 || strcmp(command, "status") == 0) {
+        if (commandSentAt > 0) commandMs.add(now - commandSentAt);
+        commandSentAt = 0;
+      } else if (strcmp(command, "confirm") == 0) {
+        uint16_t seq = doc["params"]["seq"] | 0;
+        if (ackPending && seq == ackSeq) {
+          totals.confirms++;
+          confirmMs.add(now - ackAt);
+          ackPending = false;
+        }
+      }
+    }
+  }
+
+  // ========== Backend API calls ==========
+  bool callApi(const char* path, const char* body, unsigned long now) {
+    if (api.open() || !api.connect(apiAddr, index)) return false;
+    char request[512];
+    snprintf(request, sizeof(request),
+             "POST %s HTTP/1.1\r\nHost: %s\r\nContent-Type: application/json\r\nContent-Length: %zu\r\n"
+             "Connection: close\r\n\r\n%s",
+             path, opts.api, strlen(body), body);
+    api.out = request;
+    apiStarted = now;
+    totals.apiCalls++;
+    return true;
+  }
+
+  void onApi(uint32_t events, unsigned long now) {
+    if (!api.open()) return;
+    if ((events & EPOLLOUT) && !api.flush(index)) {
+      apiDone(false, now);
+      return;
+    }
+    if (!(events & (EPOLLIN | EPOLLERR | EPOLLHUP))) return;
+    bool open = api.receive();
+    // The status line is all that matters; the body is left unread
+    size_t eol = api.in.find("\r\n");
+    if (eol != std::string::npos) {
+      int code = 0;
+      sscanf(api.in.c_str(), "HTTP/%*s %d", &code);
+      apiDone(code >= 200 && code < 300, now);
+    } else if (!open) {
+      apiDone(false, now);
+    }
+  }
+
+  void apiDone(bool ok, unsigned long now) {
+    api.close();
+    apiMs.add(now - apiStarted);
+    if (!ok) {
+      totals.apiErrors++;
+      deploySentAt = 0;
+      commandSentAt = 0;
+    }
+  }
+
+  // The device being ticked on this thread, which its tap and restart
+  // callbacks are for
+  static thread_local Device* current;
+
+  uint32_t index = 0;
+  char id[32] = "";
+  char topicStatus[64];
+  char topicResponse[64];
+  char topicCmd[64];
+  char topicAck[64];
+  char topicLogs[64];
+  uint32_t random = 1;
+
+  std::unique_ptr<RoidDevice> device;
+  unsigned long nextTickAt = NEVER;
+  bool restarting = false;
+  unsigned long rebootUntil = 0;
+  bool wasUp = false;
+  bool wasUpdating = false;
+  unsigned long nextLogAt = NEVER;
+  unsigned long dropAt = NEVER;
+  unsigned long connectSentAt = 0;
+  unsigned long pingSentAt = 0;
+
+  Socket api;
+  unsigned long apiStarted = 0;
+  unsigned long deploySentAt = 0;
+  unsigned long deployStarted = 0;
+  unsigned long commandSentAt = 0;
+  uint16_t ackSeq = 0;
+  bool ackPending = false;
+  unsigned long ackAt = 0;
+};
+
+thread_local Device* Device::current = nullptr;
+
+// ========== Fleet ==========
+// Shard s has devices s, s + threads, s + 2 * threads and so on, so bring-up,
+// deploys and commands spread over all of them. How many of the fleet's
+// first `count` devices are in the shard:
+static size_t shardShare(size_t count, uint32_t shard) {
+  return count > shard ? (count - shard - 1) / opts.threads + 1 : 0;
+}
+
+// Periodic reports fall at every --report-ms within --duration-ms; the
+// summary is handed in after them.
+static const unsigned SUMMARY = UINT_MAX;
+
+// One report as the shards hand it in, printed by whichever hands in last.
+// A shard hands in its reports in order, so they complete in order too.
+struct Report {
+  Counters totals;
+  std::vector<double> samples[SERIES_COUNT];
+  size_t devices = 0;
+  size_t up = 0;
+  size_t unconfirmed = 0;
+  size_t downloading = 0;
+  int shards = 0;
+};
+
+static std::mutex reportLock;
+static std::map<unsigned, Report> reports;
+static Counters lastReport;
+static std::vector<double> allSamples[SERIES_COUNT];
+
+static void printReport(const Report& r, bool summary) {
+  unsigned long now = millis();
+  const Counters& sum = r.totals;
+  const Counters& base = summary ? Counters() : lastReport;
+  double seconds = summary ? (now - startedAt) / 1000.0 : opts.reportMs / 1000.0;
+  auto rate = [&](uint64_t total, uint64_t before) { return seconds > 0 ? (total - before) / seconds : 0.0; };
+
+  printf("{\"%s\":%lu,\"devices\":%zu,\"up\":%zu,\"connects\":%llu,\"connect_fails\":%llu,\"drops\":%llu,"
+         "\"pub_per_s\":%.1f,\"pub_kb_per_s\":%.1f,\"recv_per_s\":%.1f,\"recv_kb_per_s\":%.1f,"
+         "\"heartbeats_per_s\":%.1f,\"log_batches_per_s\":%.1f,\"acks\":%llu,\"confirms\":%llu,"
+         "\"acks_unconfirmed\":%zu,\"downloading\":%zu,\"downloads\":%llu,\"download_fails\":%llu,"
+         "\"restarts\":%llu,\"api_calls\":%llu,\"api_errors\":%llu,\"ticks_per_s\":%.0f,\"late_ticks\":%llu",
+         summary ? "summary_ms" : "t_ms", now - startedAt, r.devices, r.up,
+         (unsigned long long)(sum.connects - base.connects),
+         (unsigned long long)(sum.connectFails - base.connectFails),
+         (unsigned long long)(sum.drops - base.drops), rate(sum.published, base.published),
+         rate(sum.publishedBytes, base.publishedBytes) / 1024.0, rate(sum.received, base.received),
+         rate(sum.receivedBytes, base.receivedBytes) / 1024.0, rate(sum.heartbeats, base.heartbeats),
+         rate(sum.logBatches, base.logBatches), (unsigned long long)(sum.acks - base.acks),
+         (unsigned long long)(sum.confirms - base.confirms), r.unconfirmed, r.downloading,
+         (unsigned long long)(sum.downloads - base.downloads),
+         (unsigned long long)(sum.downloadFails - base.downloadFails),
+         (unsigned long long)(sum.restarts - base.restarts),
+         (unsigned long long)(sum.apiCalls - base.apiCalls), (unsigned long long)(sum.apiErrors - base.apiErrors),
+         rate(sum.ticks, base.ticks), (unsigned long long)(sum.lateTicks - base.lateTicks));
+  for (size_t i = 0; i < SERIES_COUNT; ++i) {
+    allSamples[i].insert(allSamples[i].end(), r.samples[i].begin(), r.samples[i].end());
+    printSeries(SERIES[i]->name, summary ? allSamples[i] : r.samples[i]);
+  }
+  printf("}\n");
+  fflush(stdout);
+  lastReport = sum;
+}
+
+// Adds this shard's share to report `number`
+static void handIn(std::vector<Device>& fleet, size_t started, unsigned number) {
+  size_t up = 0;
+  size_t unconfirmed = 0;
+  size_t downloading = 0;
+  for (size_t i = 0; i < started; ++i) {
+    up += fleet[i].up();
+    unconfirmed += fleet[i].unconfirmed();
+    downloading += fleet[i].downloading();
+  }
+
+  std::lock_guard<std::mutex> lock(reportLock);
+  Report& r = reports[number];
+  r.totals.add(totals);
+  for (size_t i = 0; i < SERIES_COUNT; ++i) {
+    r.samples[i].insert(r.samples[i].end(), SERIES[i]->samples.begin(), SERIES[i]->samples.end());
+    SERIES[i]->samples.clear();
+  }
+  r.devices += started;
+  r.up += up;
+  r.unconfirmed += unconfirmed;
+  r.downloading += downloading;
+  if (++r.shards < opts.threads) return;
+  printReport(r, number == SUMMARY);
+  reports.erase(number);
+}
+
+static void runShard(uint32_t shard) {
+  epollFd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<Device> fleet(shardShare((size_t)opts.devices, shard));
+  size_t devicesStarted = 0;
+
+  unsigned reportsDue = opts.durationMs > 0 ? (unsigned)((opts.durationMs - 1) / opts.reportMs) : 0;
+  unsigned reportsDone = 0;
+  unsigned long nextReport = startedAt + opts.reportMs;
+  unsigned long deployStart = startedAt + opts.deployAtMs;
+  size_t deployCount = shardShare((size_t)opts.deployCount, shard);
+  size_t deploysIssued = 0;
+  double commandRate = opts.commandRate / opts.threads;
+  uint64_t commandsIssued = 0;
+  uint32_t commandCursor = 0;
+  std::vector<epoll_event> events(256);
+
+  for (;;) {
+    unsigned long now = millis();
+    if (now - startedAt >= opts.durationMs) break;
+
+    // Bring the fleet up at the connect rate
+    size_t due = std::min((size_t)opts.devices, (size_t)((now - startedAt) * opts.connectRate / 1000.0) + 1);
+    for (size_t started = shardShare(due, shard); devicesStarted < started; ++devicesStarted) {
+      fleet[devicesStarted].setUp(shard + (uint32_t)devicesStarted * opts.threads, now);
+    }
+
+    // Deploys, spread evenly over their window
+    while (opts.deployId && deploysIssued < deployCount && now >= deployStart) {
+      size_t index = shard + deploysIssued * opts.threads;
+      unsigned long at = deployStart + (unsigned long)((double)opts.deploySpreadMs * index / opts.deployCount);
+      if (now < at || deploysIssued >= devicesStarted) break;
+      fleet[deploysIssued].deploy(opts.deployId, now);
+      deploysIssued++;
+    }
+
+    // Heartbeat commands, this shard's share of the rate, round robin over
+    // its connected devices
+    uint64_t commandsDue = (uint64_t)((now - startedAt) * commandRate / 1000.0);
+    for (size_t tries = 0; commandsIssued < commandsDue && devicesStarted > 0 && tries < devicesStarted; ++tries) {
+      Device& d = fleet[commandCursor++ % devicesStarted];
+      if (!d.up() || d.apiBusy()) continue;
+      d.requestHeartbeat(now);
+      commandsIssued++;
+    }
+    if (commandsIssued < commandsDue) commandsIssued = commandsDue;
+
+    // Each device whose tick is due gets its handle(); connects block, so
+    // the clock is read again after each one.
+    unsigned long wake = std::min(nextReport, startedAt + opts.durationMs);
+    for (size_t i = 0; i < devicesStarted; ++i) {
+      if ((long)(now - fleet[i].dueAt()) >= 0) {
+        fleet[i].tick(now);
+        now = millis();
+      }
+      wake = std::min(wake, fleet[i].dueAt());
+    }
+
+    if (now >= nextReport && reportsDone < reportsDue) {
+      handIn(fleet, devicesStarted, ++reportsDone);
+      nextReport += opts.reportMs;
+    }
+
+    if (devicesStarted < fleet.size() || commandRate > 0 || (opts.deployId && deploysIssued < deployCount)) {
+      wake = std::min(wake, now + 10);
+    }
+    int timeout = wake > now ? (int)std::min<unsigned long>(wake - now, 1000) : 0;
+    int n = epoll_wait(epollFd, events.data(), (int)events.size(), timeout);
+    now = millis();
+    for (int i = 0; i < n; ++i) {
+      fleet[(size_t)events[i].data.u64 / opts.threads].onEvent(events[i].events, now);
+    }
+  }
+
+  // A shard held up past the end still hands in every report, so the
+  // others' are printed
+  while (reportsDone < reportsDue) handIn(fleet, devicesStarted, ++reportsDone);
+  handIn(fleet, devicesStarted, SUMMARY);
+  close(epollFd);
+}
+
+static void raiseFileLimit(size_t wanted) {
+  rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) != 0) return;
+  if (limit.rlim_cur < wanted) {
+    limit.rlim_cur = std::min<rlim_t>(wanted, limit.rlim_max);
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+  if (limit.rlim_cur < wanted) {
+    fprintf(stderr, "open file limit %llu is below the %zu this run may need\n",
+            (unsigned long long)limit.rlim_cur, wanted);
+  }
+}
+
+void setup() {
+  RoidNative::setSerialEnabled(false);
+  parseOptions();
+  splitHostPort(opts.broker, 1883, brokerHost, brokerPort);
+  if (opts.api && !resolve(opts.api, 80, apiAddr)) {
+    fprintf(stderr, "cannot resolve API %s\n", opts.api);
+    exit(1);
+  }
+  if ((opts.deployId || opts.commandRate > 0) && !opts.api) {
+    fprintf(stderr, "--deploy and --command-rate need --api\n");
+    exit(1);
+  }
+  // MQTT, download and API connection per device, an epoll per shard, plus
+  // slack
+  raiseFileLimit((size_t)opts.devices * 3 + opts.threads + 64);
+
+  RoidNative::setMqttTap(Device::tap);
+  startedAt = millis();
+
+  std::vector<std::thread> shards;
+  for (int i = 0; i < opts.threads; ++i) shards.emplace_back(runShard, (uint32_t)i);
+  for (std::thread& t : shards) t.join();
+  exit(0);
+}
+
+void loop() {}
@@ -0,0 +1,209 @@
+// Host throughput bench for RoidPipeline: writes a synthetic image through a
+// simulated TCP receive path into a file-backed flash fake, once inline (the
+// way a single loop alternates between socket and flash) and once through
+// the pipeline.
+//
+//   g++ -std=gnu++17 -O2 -pthread -I../../lib/RoidOTA pipeline_bench.cpp ../../lib/RoidOTA/RoidPipeline.cpp -o pipeline_bench
+//   ./pipeline_bench [image_kb] [net_kbps] [erase_ms] [write_ms_per_sector] [recover_ms]
+//
+// The network delivers at net_kbps into a receive window of TCP_WND bytes.
+// Once the window is full the sender stops, and only resumes recover_ms
+// after the reader frees space (window update, persist timer), which is what
+// makes blocking flash writes costly.
+
+#include "RoidPipeline.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static const size_t SECTOR_SIZE = 4096;
+static const size_t TCP_WND = 5744;
+static const size_t CHUNK_SIZE = 1024;
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static void sleepMs(double ms) {
+  if (ms > 0) std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(ms));
+}
+
+// Flash fake: a file the size of the image. Erases fill a sector with 0xFF,
+// writes may only clear bits, and both take the configured time.
+class FileFlash {
+public:
+  bool open(const char* path, size_t size, double eraseMs, double writeMs) {
+    file = fopen(path, "w+b");
+    if (!file) return false;
+    this->size = size;
+    this->eraseMs = eraseMs;
+    this->writeMs = writeMs;
+    std::vector<uint8_t> blank(size, 0x00);
+    fwrite(blank.data(), 1, size, file);
+    position = 0;
+    erasedTo = 0;
+    return true;
+  }
+
+  bool write(const uint8_t* data, size_t len) {
+    if (position + len > size) return false;
+    while (len > 0) {
+      if (position >= erasedTo) {
+        std::vector<uint8_t> ones(SECTOR_SIZE, 0xFF);
+        fseek(file, (long)erasedTo, SEEK_SET);
+        fwrite(ones.data(), 1, std::min(SECTOR_SIZE, size - erasedTo), file);
+        erasedTo += SECTOR_SIZE;
+        sleepMs(eraseMs);
+      }
+      size_t n = std::min(len, erasedTo - position);
+      std::vector<uint8_t> current(n);
+      fseek(file, (long)position, SEEK_SET);
+      if (fread(current.data(), 1, n, file) != n) return false;
+      for (size_t i = 0; i < n; ++i) current[i] &= data[i];
+      fseek(file, (long)position, SEEK_SET);
+      fwrite(current.data(), 1, n, file);
+      sleepMs(writeMs * n / SECTOR_SIZE);
+      position += n;
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  bool matches(const std::vector<uint8_t>& image) {
+    std::vector<uint8_t> contents(image.size());
+    fflush(file);
+    fseek(file, 0, SEEK_SET);
+    return fread(contents.data(), 1, contents.size(), file) == contents.size() && contents == image;
+  }
+
+  void close() {
+    if (file) fclose(file);
+    file = nullptr;
+  }
+
+private:
+  FILE* file = nullptr;
+  size_t size = 0;
+  size_t position = 0;
+  size_t erasedTo = 0;
+  double eraseMs = 0;
+  double writeMs = 0;
+};
+
+// Sender with a bounded receive window, as seen by the reader.
+class SimulatedSocket {
+public:
+  SimulatedSocket(const std::vector<uint8_t>& image, double kbps, double recoverMs)
+    : image(image), bytesPerMs(kbps * 1024.0 / 1000.0), recoverMs(recoverMs) {}
+
+  size_t read(uint8_t* dst, size_t want) {
+    advance();
+    size_t buffered = arrived - consumed;
+    if (buffered < want && arrived < image.size()) {
+      size_t missing = std::min(want, image.size() - consumed) - buffered;
+      sleepMs(missing / bytesPerMs);
+      advance();
+      buffered = arrived - consumed;
+    }
+
+    bool wasFull = buffered >= TCP_WND;
+    size_t n = std::min(want, buffered);
+    memcpy(dst, image.data() + consumed, n);
+    consumed += n;
+    // A zero window stalls the sender until the window update arrives.
+    if (wasFull && n > 0) resumeAt = nowMs() + recoverMs;
+    return n;
+  }
+
+  bool done() const { return consumed >= image.size(); }
+
+private:
+  double nowMs() const {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  }
+
+  void advance() {
+    double now = nowMs();
+    double from = std::max(last, resumeAt);
+    if (now > from) {
+      size_t limit = std::min(image.size(), consumed + TCP_WND);
+      size_t delivered = (size_t)((now - from) * bytesPerMs);
+      arrived = std::min(limit, arrived + delivered);
+    }
+    last = now;
+  }
+
+  const std::vector<uint8_t>& image;
+  double bytesPerMs;
+  double recoverMs;
+  Clock::time_point start = Clock::now();
+  double last = 0;
+  double resumeAt = 0;
+  size_t arrived = 0;
+  size_t consumed = 0;
+};
+
+static FileFlash flash;
+
+static bool flashWrite(const uint8_t* data, size_t len) {
+  return flash.write(data, len);
+}
+
+static double run(bool pipelined, const std::vector<uint8_t>& image, double kbps, double eraseMs,
+                  double writeMs, double recoverMs, bool& ok) {
+  flash.open("pipeline_bench_flash.bin", image.size(), eraseMs, writeMs);
+  SimulatedSocket socket(image, kbps, recoverMs);
+  RoidPipeline pipeline;
+  uint8_t chunk[CHUNK_SIZE];
+
+  Clock::time_point start = Clock::now();
+  ok = !pipelined || pipeline.begin(flashWrite);
+
+  while (ok && !socket.done()) {
+    size_t n = socket.read(chunk, sizeof(chunk));
+    ok = pipelined ? pipeline.write(chunk, n) : flashWrite(chunk, n);
+  }
+  if (ok && pipelined) {
+    ok = pipeline.flush();
+    while (ok && !pipeline.idle() && !pipeline.failed()) {
+      std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    ok = ok && !pipeline.failed();
+    pipeline.end();
+  }
+
+  double elapsed = secondsSince(start);
+  ok = ok && flash.matches(image);
+  flash.close();
+  remove("pipeline_bench_flash.bin");
+  return elapsed;
+}
+
+int main(int argc, char** argv) {
+  size_t imageKb = argc > 1 ? atoi(argv[1]) : 512;
+  double kbps = argc > 2 ? atof(argv[2]) : 300;
+  double eraseMs = argc > 3 ? atof(argv[3]) : 30;
+  double writeMs = argc > 4 ? atof(argv[4]) : 8;
+  double recoverMs = argc > 5 ? atof(argv[5]) : 200;
+
+  std::vector<uint8_t> image(imageKb * 1024);
+  srand(1);
+  for (auto& b : image) b = (uint8_t)rand();
+
+  bool inlineOk = false, pipelinedOk = false;
+  double inlineTime = run(false, image, kbps, eraseMs, writeMs, recoverMs, inlineOk);
+  double pipelinedTime = run(true, image, kbps, eraseMs, writeMs, recoverMs, pipelinedOk);
+
+  printf("image=%zuKB net=%.0fKB/s erase=%.0fms write=%.0fms/sector recover=%.0fms\n",
+         imageKb, kbps, eraseMs, writeMs, recoverMs);
+  printf("inline:    %.2fs  %.1f KB/s  %s\n", inlineTime, imageKb / inlineTime, inlineOk ? "ok" : "FAILED");
+  printf("pipelined: %.2fs  %.1f KB/s  %s\n", pipelinedTime, imageKb / pipelinedTime, pipelinedOk ? "ok" : "FAILED");
+  printf("speedup:   %.2fx\n", inlineTime / pipelinedTime);
+  return inlineOk && pipelinedOk ? 0 : 1;
+}
@@ -0,0 +1,464 @@
+#include "RoidNative.h"
+#include <arpa/inet.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ========== RoidNative ==========
+static std::string nativeDataDir = ".roidota";
+static std::vector<char*> nativeArgs;
+static bool manualClock = false;
+static unsigned long manualMillis = 0;
+static bool nativeWiFiConnected = true;
+static bool radioOn = false;
+static unsigned long radioSince = 0;
+static unsigned long radioTotal = 0;
+static bool serialEnabled = true;
+static RoidNative::MqttTap nativeMqttTap = nullptr;
+static uint8_t pinValues[64];
+
+static const std::chrono::steady_clock::time_point clockStart = std::chrono::steady_clock::now();
+
+// Bounds of the RTC_NOINIT_ATTR section, provided by the linker; weak so
+// binaries without such variables still link.
+extern "C" char __start_roidota_rtc[] __attribute__((weak));
+extern "C" char __stop_roidota_rtc[] __attribute__((weak));
+
+static size_t rtcSize() {
+  return __start_roidota_rtc && __stop_roidota_rtc ? (size_t)(__stop_roidota_rtc - __start_roidota_rtc) : 0;
+}
+
+static void makeDirs(const std::string& path) {
+  for (size_t i = 1; i <= path.size(); ++i) {
+    if (i == path.size() || path[i] == '/') mkdir(path.substr(0, i).c_str(), 0755);
+  }
+}
+
+void RoidNative::init(int argc, char** argv) {
+  nativeArgs.assign(argv, argv + argc);
+  nativeArgs.push_back(nullptr);
+
+  const char* dir = getenv("ROIDOTA_NATIVE_DIR");
+  if (dir && *dir) setDataDir(dir);
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+
+  // RTC memory only survives the restart that wrote it
+  String rtcPath = dataPath("rtc.bin");
+  FILE* rtc = fopen(rtcPath.c_str(), "rb");
+  if (rtc) {
+    if (fread(__start_roidota_rtc, 1, rtcSize(), rtc) != rtcSize()) memset(__start_roidota_rtc, 0, rtcSize());
+    fclose(rtc);
+    remove(rtcPath.c_str());
+  }
+}
+
+int RoidNative::argCount() {
+  return nativeArgs.empty() ? 0 : (int)nativeArgs.size() - 1;
+}
+
+const char* RoidNative::arg(int index) {
+  return index >= 0 && index < argCount() ? nativeArgs[index] : nullptr;
+}
+
+const char* RoidNative::deviceId(const char* fallback) {
+  const char* id = getenv("ROIDOTA_NATIVE_DEVICE_ID");
+  return id && *id ? id : fallback;
+}
+
+uint32_t RoidNative::localAddress() {
+  static uint32_t address = 0;
+  if (address == 0) {
+    const char* ip = getenv("ROIDOTA_NATIVE_IP");
+    struct in_addr parsed;
+    if (!ip || inet_pton(AF_INET, ip, &parsed) != 1) inet_pton(AF_INET, "127.0.0.1", &parsed);
+    memcpy(&address, &parsed, sizeof(address));
+  }
+  return address;
+}
+
+const char* RoidNative::dataDir() {
+  return nativeDataDir.c_str();
+}
+
+void RoidNative::setDataDir(const char* dir) {
+  nativeDataDir = dir;
+  while (nativeDataDir.size() > 1 && nativeDataDir.back() == '/') nativeDataDir.pop_back();
+}
+
+String RoidNative::dataPath(const char* name) {
+  std::string path = nativeDataDir + "/" + name;
+  makeDirs(path.substr(0, path.rfind('/')));
+  return String(path);
+}
+
+void RoidNative::useManualClock(bool manual) {
+  if (manual && !manualClock) manualMillis = millis();
+  manualClock = manual;
+}
+
+void RoidNative::advance(unsigned long ms) {
+  manualMillis += ms;
+}
+
+void RoidNative::setWiFiConnected(bool connected) {
+  nativeWiFiConnected = connected;
+}
+
+bool RoidNative::wifiConnected() {
+  return nativeWiFiConnected;
+}
+
+void RoidNative::setRadioOn(bool on) {
+  if (on == radioOn) return;
+  if (on) radioSince = millis();
+  else radioTotal += millis() - radioSince;
+  radioOn = on;
+}
+
+unsigned long RoidNative::radioOnMs() {
+  return radioTotal + (radioOn ? millis() - radioSince : 0);
+}
+
+uint8_t RoidNative::pinValue(uint8_t pin) {
+  return pin < sizeof(pinValues) ? pinValues[pin] : 0;
+}
+
+void RoidNative::setSerialEnabled(bool enabled) {
+  serialEnabled = enabled;
+}
+
+void RoidNative::setMqttTap(MqttTap tap) {
+  nativeMqttTap = tap;
+}
+
+RoidNative::MqttTap RoidNative::mqttTap() {
+  return nativeMqttTap;
+}
+
+static void saveRtc() {
+  if (rtcSize() == 0) return;
+  FILE* rtc = fopen(RoidNative::dataPath("rtc.bin").c_str(), "wb");
+  if (rtc) {
+    fwrite(__start_roidota_rtc, 1, rtcSize(), rtc);
+    fclose(rtc);
+  }
+}
+
+[[noreturn]] static void reboot() {
+  const char* mode = getenv("ROIDOTA_NATIVE_REBOOT");
+  if (mode && strcmp(mode, "exec") == 0 && nativeArgs.size() > 1) {
+    execv("/proc/self/exe", nativeArgs.data());
+    execvp(nativeArgs[0], nativeArgs.data());
+    perror("[RoidNative] exec failed");
+  }
+  exit(0);
+}
+
+void RoidNative::restart() {
+  fflush(stdout);
+  saveRtc();
+  reboot();
+}
+
+void RoidNative::deepSleep(uint64_t us) {
+  fflush(stdout);
+  String logPath = dataPath("wakes.jsonl");
+  unsigned long wakes = 1;
+  FILE* log = fopen(logPath.c_str(), "r");
+  if (log) {
+    for (int c; (c = fgetc(log)) != EOF;) wakes += c == '\n';
+    fclose(log);
+  }
+  log = fopen(logPath.c_str(), "a");
+  if (log) {
+    fprintf(log, "{\"wake\":%lu,\"awake_ms\":%lu,\"radio_ms\":%lu,\"sleep_ms\":%llu}\n", wakes, millis(),
+            radioOnMs(), (unsigned long long)(us / 1000));
+    fclose(log);
+  }
+
+  saveRtc();
+  const char* limit = getenv("ROIDOTA_NATIVE_WAKES");
+  if (limit && wakes >= strtoul(limit, nullptr, 10)) exit(0);
+  reboot();
+}
+
+// ========== Time & pins ==========
+unsigned long millis() {
+  if (manualClock) return manualMillis;
+  return (unsigned long)std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - clockStart).count();
+}
+
+unsigned long micros() {
+  if (manualClock) return manualMillis * 1000UL;
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - clockStart).count();
+}
+
+void delay(unsigned long ms) {
+  if (manualClock) {
+    manualMillis += ms;
+    return;
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us) {
+  if (manualClock) return;
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void yield() {
+  std::this_thread::yield();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  (void)pin;
+  (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < sizeof(pinValues)) pinValues[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+  return RoidNative::pinValue(pin);
+}
+
+static std::mt19937 randomEngine(1);
+
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  return (long)(randomEngine() % (unsigned long)howbig);
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) randomEngine.seed((std::mt19937::result_type)seed);
+}
+
+uint32_t esp_random() {
+  static thread_local std::random_device device;
+  return device();
+}
+
+// ========== String ==========
+static std::string formatUnsigned(unsigned long long value, unsigned char base) {
+  if (base < 2 || base > 36) base = 10;
+  char buf[66];
+  char* p = buf + sizeof(buf) - 1;
+  *p = '\0';
+  do {
+    unsigned digit = (unsigned)(value % base);
+    *--p = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  } while (value);
+  return p;
+}
+
+static std::string formatSigned(long long value, unsigned char base) {
+  if (value < 0 && base == 10) return "-" + formatUnsigned(0ULL - (unsigned long long)value, base);
+  return formatUnsigned((unsigned long long)value, base);
+}
+
+String::String(int value, unsigned char base) : str(formatSigned(value, base)) {}
+String::String(unsigned int value, unsigned char base) : str(formatUnsigned(value, base)) {}
+String::String(long value, unsigned char base) : str(formatSigned(value, base)) {}
+String::String(unsigned long value, unsigned char base) : str(formatUnsigned(value, base)) {}
+String::String(long long value, unsigned char base) : str(formatSigned(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : str(formatUnsigned(value, base)) {}
+
+String::String(double value, unsigned int decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", (int)decimals, value);
+  str = buf;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t i = str.find(c, from);
+  return i == std::string::npos ? -1 : (int)i;
+}
+
+int String::indexOf(const String& s, unsigned int from) const {
+  size_t i = str.find(s.str, from);
+  return i == std::string::npos ? -1 : (int)i;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t i = str.rfind(c);
+  return i == std::string::npos ? -1 : (int)i;
+}
+
+bool String::endsWith(const String& suffix) const {
+  return str.size() >= suffix.str.size() &&
+         str.compare(str.size() - suffix.str.size(), suffix.str.size(), suffix.str) == 0;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) std::swap(from, to);
+  if (from >= str.size()) return String();
+  return String(str.substr(from, min((size_t)to, str.size()) - from));
+}
+
+void String::replace(const String& from, const String& to) {
+  if (from.str.empty()) return;
+  size_t i = 0;
+  while ((i = str.find(from.str, i)) != std::string::npos) {
+    str.replace(i, from.str.size(), to.str);
+    i += to.str.size();
+  }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+  if (index < str.size()) str.erase(index, count);
+}
+
+void String::trim() {
+  size_t begin = str.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos) {
+    str.clear();
+    return;
+  }
+  str = str.substr(begin, str.find_last_not_of(" \t\r\n") - begin + 1);
+}
+
+void String::toLowerCase() {
+  for (char& c : str) c = (char)tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+  for (char& c : str) c = (char)toupper((unsigned char)c);
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, const String& rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, const char* rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, char rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, int rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+StringSumHelper operator+(const StringSumHelper& lhs, unsigned long rhs) {
+  StringSumHelper out(lhs);
+  out.concat(rhs);
+  return out;
+}
+
+// ========== Print / Stream / Serial ==========
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char small[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len < sizeof(small)) return write((const uint8_t*)small, len);
+
+  std::string large(len + 1, '\0');
+  va_start(args, format);
+  vsnprintf(&large[0], large.size(), format, args);
+  va_end(args);
+  return write((const uint8_t*)large.data(), len);
+}
+
+size_t Stream::readBytes(uint8_t* buffer, size_t length) {
+  size_t count = 0;
+  unsigned long start = millis();
+  while (count < length) {
+    int c = read();
+    if (c < 0) {
+      if (millis() - start >= timeoutMs) break;
+      yield();
+      continue;
+    }
+    buffer[count++] = (uint8_t)c;
+  }
+  return count;
+}
+
+HardwareSerial Serial;
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (!serialEnabled) return 1;
+  return fputc(c, stdout) == EOF ? 0 : 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (!serialEnabled) return size;
+  return fwrite(buffer, 1, size, stdout);
+}
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
+
+// ========== ESP ==========
+// Heap figures are those of a typical ESP32 sketch, so reported telemetry
+// looks plausible; the host allocator is not tracked.
+static const uint32_t FAKE_HEAP_SIZE = 327680;
+static const uint32_t FAKE_FREE_HEAP = 245760;
+
+EspClass ESP;
+
+void EspClass::restart() {
+  Serial.println("[RoidNative] ESP.restart()");
+  RoidNative::restart();
+}
+
+void EspClass::deepSleep(uint64_t timeUs) {
+  Serial.println("[RoidNative] ESP.deepSleep()");
+  RoidNative::deepSleep(timeUs);
+}
+
+uint32_t EspClass::getHeapSize() {
+  return FAKE_HEAP_SIZE;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  return FAKE_FREE_HEAP;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  return FAKE_FREE_HEAP;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+  return FAKE_FREE_HEAP / 2;
+}
+
+uint64_t EspClass::getEfuseMac() {
+  // Stable per data directory, so several simulated devices differ.
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (const char* p = RoidNative::dataDir(); *p; ++p) hash = (hash ^ (uint8_t)*p) * 0x100000001b3ULL;
+  return hash & 0xFFFFFFFFFFFFULL;
+}
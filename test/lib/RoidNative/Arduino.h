@@ -0,0 +1,210 @@
+#ifndef ROIDNATIVE_ARDUINO_H
+#define ROIDNATIVE_ARDUINO_H
+
+// Host stand-in for the parts of the Arduino-ESP32 core that RoidOTA and the
+// sample sketch use. Only built in the native environment.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <algorithm>
+#include <string>
+
+using std::max;
+using std::min;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+// RTC slow memory: left alone by a software restart or deep sleep, lost on
+// power-up. The fake keeps these variables in one section and carries it
+// across ESP.restart() and ESP.deepSleep() through <data dir>/rtc.bin; a
+// run that ends any other way is a power cycle.
+#define RTC_NOINIT_ATTR __attribute__((section("roidota_rtc")))
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+// Hardware RNG: differs on every boot, unlike random() before randomSeed()
+uint32_t esp_random();
+
+class String {
+public:
+  String(const char* s = "") : str(s ? s : "") {}
+  String(const std::string& s) : str(s) {}
+  explicit String(char c) : str(1, c) {}
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(long long value, unsigned char base = 10);
+  explicit String(unsigned long long value, unsigned char base = 10);
+  explicit String(double value, unsigned int decimals = 2);
+
+  const char* c_str() const { return str.c_str(); }
+  unsigned int length() const { return (unsigned int)str.length(); }
+  bool isEmpty() const { return str.empty(); }
+  bool reserve(unsigned int size) { str.reserve(size); return true; }
+
+  bool concat(const String& s) { str += s.str; return true; }
+  bool concat(const char* s) { if (s) str += s; return s != nullptr; }
+  bool concat(const char* s, unsigned int len) { if (s) str.append(s, len); return s != nullptr; }
+  bool concat(char c) { str += c; return true; }
+  bool concat(int value) { return concat(String(value)); }
+  bool concat(unsigned int value) { return concat(String(value)); }
+  bool concat(long value) { return concat(String(value)); }
+  bool concat(unsigned long value) { return concat(String(value)); }
+
+  String& operator+=(const String& s) { concat(s); return *this; }
+  String& operator+=(const char* s) { concat(s); return *this; }
+  String& operator+=(char c) { concat(c); return *this; }
+  String& operator+=(int value) { concat(value); return *this; }
+  String& operator+=(unsigned int value) { concat(value); return *this; }
+  String& operator+=(long value) { concat(value); return *this; }
+  String& operator+=(unsigned long value) { concat(value); return *this; }
+
+  bool equals(const String& s) const { return str == s.str; }
+  bool equals(const char* s) const { return str == (s ? s : ""); }
+  bool equalsIgnoreCase(const String& s) const { return strcasecmp(c_str(), s.c_str()) == 0; }
+  bool operator==(const String& s) const { return equals(s); }
+  bool operator==(const char* s) const { return equals(s); }
+  bool operator!=(const String& s) const { return !equals(s); }
+  bool operator!=(const char* s) const { return !equals(s); }
+  bool operator<(const String& s) const { return str < s.str; }
+
+  char charAt(unsigned int index) const { return index < str.size() ? str[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char& operator[](unsigned int index) { return str[index]; }
+
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String& s, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  bool startsWith(const String& prefix) const { return str.compare(0, prefix.str.size(), prefix.str) == 0; }
+  bool endsWith(const String& suffix) const;
+  String substring(unsigned int from) const { return substring(from, length()); }
+  String substring(unsigned int from, unsigned int to) const;
+
+  void replace(const String& from, const String& to);
+  void remove(unsigned int index, unsigned int count = (unsigned int)-1);
+  void trim();
+  void toLowerCase();
+  void toUpperCase();
+  long toInt() const { return atol(c_str()); }
+  float toFloat() const { return (float)atof(c_str()); }
+
+private:
+  std::string str;
+};
+
+// Real Arduino cores return this from operator+; ArduinoJson knows it by name.
+class StringSumHelper : public String {
+public:
+  StringSumHelper(const String& s) : String(s) {}
+  StringSumHelper(const char* s) : String(s) {}
+};
+
+StringSumHelper operator+(const StringSumHelper& lhs, const String& rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, const char* rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, char rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, int rhs);
+StringSumHelper operator+(const StringSumHelper& lhs, unsigned long rhs);
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* s) { return s ? write((const uint8_t*)s, strlen(s)) : 0; }
+  virtual void flush() {}
+
+  size_t print(const char* s) { return write(s); }
+  size_t print(const String& s) { return write(s.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value, int base = 10) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned int value, int base = 10) { return print(String(value, (unsigned char)base)); }
+  size_t print(long value, int base = 10) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned long value, int base = 10) { return print(String(value, (unsigned char)base)); }
+  size_t print(double value, int decimals = 2) { return print(String(value, (unsigned int)decimals)); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& value) { return print(value) + println(); }
+  template <typename T>
+  size_t println(const T& value, int format) { return print(value, format) + println(); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+  void setTimeout(unsigned long ms) { timeoutMs = ms; }
+  size_t readBytes(uint8_t* buffer, size_t length);
+  size_t readBytes(char* buffer, size_t length) { return readBytes((uint8_t*)buffer, length); }
+
+protected:
+  unsigned long timeoutMs = 1000;
+};
+
+// Writes to stdout; there is no input.
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void end() {}
+  using Print::write;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  void flush() override;
+  int available() override { return 0; }
+  int read() override { return -1; }
+  operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+class EspClass {
+public:
+  // Exits the process, or re-executes it when ROIDOTA_NATIVE_REBOOT=exec,
+  // so the next "boot" runs from the partition an update selected.
+  [[noreturn]] void restart();
+  // Wakes at once as a fresh boot, the same way restart() reboots; see
+  // RoidNative::deepSleep().
+  [[noreturn]] void deepSleep(uint64_t timeUs);
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getSketchSize();
+  String getSketchMD5();
+  uint32_t getFreeSketchSpace();
+  uint64_t getEfuseMac();
+  const char* getChipModel() { return "native"; }
+  uint32_t getCpuFreqMHz() { return 240; }
+};
+
+extern EspClass ESP;
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef ROIDNATIVE_MD5BUILDER_H
+#define ROIDNATIVE_MD5BUILDER_H
+
+#include <Arduino.h>
+
+// The core's incremental MD5: begin(), add() as often as needed, then
+// calculate() and read the digest out.
+class MD5Builder {
+public:
+  void begin();
+  void add(const uint8_t* data, size_t len);
+  void calculate();
+  void getBytes(uint8_t* output);
+  // 32 hex characters and a terminator
+  void getChars(char* output);
+
+private:
+  void transform(const uint8_t block[64]);
+
+  uint32_t state[4];
+  uint64_t total = 0;
+  uint8_t buffer[64];
+  size_t bufferLen = 0;
+  uint8_t digest[16];
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "Preferences.h"
+#include "RoidNative.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// NVS namespace and key names are limited to 15 characters.
+static const size_t MAX_NAME = 15;
+
+static bool validName(const char* name) {
+  return name && *name && strlen(name) <= MAX_NAME && !strchr(name, '/');
+}
+
+bool Preferences::begin(const char* name, bool readOnly) {
+  if (started || !validName(name)) return false;
+
+  String dir = String(RoidNative::dataDir()) + "/nvs/" + name;
+  struct stat st;
+  if (stat(dir.c_str(), &st) != 0) {
+    if (readOnly) return false;
+    RoidNative::dataPath((String("nvs/") + name + "/.keep").c_str());
+  }
+
+  ns = name;
+  this->readOnly = readOnly;
+  started = true;
+  return true;
+}
+
+void Preferences::end() {
+  started = false;
+}
+
+String Preferences::keyPath(const char* key) {
+  return String(RoidNative::dataDir()) + "/nvs/" + ns + "/" + key;
+}
+
+bool Preferences::clear() {
+  if (!started || readOnly) return false;
+  String dir = String(RoidNative::dataDir()) + "/nvs/" + ns;
+  DIR* d = opendir(dir.c_str());
+  if (!d) return false;
+  while (struct dirent* entry = readdir(d)) {
+    if (entry->d_name[0] != '.') unlink((dir + "/" + entry->d_name).c_str());
+  }
+  closedir(d);
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!started || readOnly || !validName(key)) return false;
+  return unlink(keyPath(key).c_str()) == 0;
+}
+
+bool Preferences::isKey(const char* key) {
+  if (!started || !validName(key)) return false;
+  struct stat st;
+  return stat(keyPath(key).c_str(), &st) == 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  if (!started || readOnly || !validName(key) || !value || len == 0) return 0;
+
+  // Write-then-rename, so a crash never leaves a torn value behind.
+  String path = keyPath(key);
+  String tmp = path + ".tmp";
+  FILE* f = fopen(tmp.c_str(), "wb");
+  if (!f) return 0;
+  bool ok = fwrite(value, 1, len, f) == len;
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return 0;
+  }
+  return len;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  if (!started || !validName(key)) return 0;
+  struct stat st;
+  return stat(keyPath(key).c_str(), &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  size_t len = getBytesLength(key);
+  if (len == 0 || !buf || len > maxLen) return 0;
+  FILE* f = fopen(keyPath(key).c_str(), "rb");
+  if (!f) return 0;
+  size_t n = fread(buf, 1, len, f);
+  fclose(f);
+  return n == len ? len : 0;
+}
+
+String Preferences::getString(const char* key, const String& defaultValue) {
+  size_t len = getBytesLength(key);
+  if (len == 0) return defaultValue;
+  std::string value(len, '\0');
+  if (getBytes(key, &value[0], len) != len) return defaultValue;
+  return String(value.c_str());
+}
@@ -0,0 +1,51 @@
+#ifndef ROIDNATIVE_PREFERENCES_H
+#define ROIDNATIVE_PREFERENCES_H
+
+#include <Arduino.h>
+
+// NVS stand-in: one file per key under <data dir>/nvs/<namespace>/. Keeps
+// the NVS limits callers can trip over (15-character names, read-only
+// begin() failing on a namespace that does not exist yet).
+class Preferences {
+public:
+  bool begin(const char* name, bool readOnly = false);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putBytes(const char* key, const void* value, size_t len);
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+
+  size_t putBool(const char* key, bool value) { return putBytes(key, &value, sizeof(value)); }
+  size_t putUChar(const char* key, uint8_t value) { return putBytes(key, &value, sizeof(value)); }
+  size_t putUShort(const char* key, uint16_t value) { return putBytes(key, &value, sizeof(value)); }
+  size_t putInt(const char* key, int32_t value) { return putBytes(key, &value, sizeof(value)); }
+  size_t putUInt(const char* key, uint32_t value) { return putBytes(key, &value, sizeof(value)); }
+  size_t putULong64(const char* key, uint64_t value) { return putBytes(key, &value, sizeof(value)); }
+  size_t putString(const char* key, const char* value) { return putBytes(key, value, strlen(value) + 1) ? strlen(value) : 0; }
+  size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+
+  bool getBool(const char* key, bool defaultValue = false) { return getValue(key, defaultValue); }
+  uint8_t getUChar(const char* key, uint8_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint16_t getUShort(const char* key, uint16_t defaultValue = 0) { return getValue(key, defaultValue); }
+  int32_t getInt(const char* key, int32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) { return getValue(key, defaultValue); }
+  uint64_t getULong64(const char* key, uint64_t defaultValue = 0) { return getValue(key, defaultValue); }
+  String getString(const char* key, const String& defaultValue = String());
+
+private:
+  template <typename T>
+  T getValue(const char* key, T defaultValue) {
+    T value;
+    return getBytesLength(key) == sizeof(T) && getBytes(key, &value, sizeof(T)) == sizeof(T) ? value : defaultValue;
+  }
+  String keyPath(const char* key);
+
+  String ns;
+  bool started = false;
+  bool readOnly = false;
+};
+
+#endif
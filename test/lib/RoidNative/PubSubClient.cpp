@@ -0,0 +1,376 @@
+#include "PubSubClient.h"
+#include "RoidNative.h"
+
+// Room for the fixed header (type byte + up to four length bytes) in front
+// of the variable header, so packets are built in place.
+static const size_t MAX_HEADER_SIZE = 5;
+
+PubSubClient::PubSubClient() : buffer(MQTT_MAX_PACKET_SIZE) {}
+
+PubSubClient::PubSubClient(WiFiClient& client) : client(&client), buffer(MQTT_MAX_PACKET_SIZE) {}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+  this->domain = domain;
+  this->port = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+  this->callback = callback;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setClient(WiFiClient& client) {
+  this->client = &client;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setKeepAlive(uint16_t keepAlive) {
+  this->keepAlive = keepAlive;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t timeout) {
+  socketTimeout = timeout;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  if (size == 0) return false;
+  buffer.assign(size, 0);
+  return true;
+}
+
+bool PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass) {
+  return connect(id, user, pass, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain,
+                           const char* willMessage) {
+  return connect(id, nullptr, nullptr, willTopic, willQos, willRetain, willMessage, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass, const char* willTopic,
+                           uint8_t willQos, bool willRetain, const char* willMessage, bool cleanSession) {
+  if (!client) return false;
+  if (connected()) return true;
+
+  if (!client->connect(domain.c_str(), port)) {
+    clientState = MQTT_CONNECT_FAILED;
+    return false;
+  }
+
+  nextMsgId = 1;
+  size_t length = MAX_HEADER_SIZE;
+  static const uint8_t protocol[] = {0x00, 0x04, 'M', 'Q', 'T', 'T', MQTT_VERSION};
+  memcpy(buffer.data() + length, protocol, sizeof(protocol));
+  length += sizeof(protocol);
+
+  uint8_t flags = 0;
+  if (willTopic) flags = 0x04 | (uint8_t)(willQos << 3) | (uint8_t)(willRetain << 5);
+  if (cleanSession) flags |= 0x02;
+  if (user) {
+    flags |= 0x80;
+    if (pass) flags |= 0x40;
+  }
+  buffer[length++] = flags;
+  buffer[length++] = (uint8_t)(keepAlive >> 8);
+  buffer[length++] = (uint8_t)keepAlive;
+
+  length = writeString(id, length);
+  if (willTopic) {
+    length = writeString(willTopic, length);
+    length = writeString(willMessage, length);
+  }
+  if (user) {
+    length = writeString(user, length);
+    if (pass) length = writeString(pass, length);
+  }
+  if (length == 0 || !writePacket(MQTTCONNECT, length - MAX_HEADER_SIZE)) {
+    client->stop();
+    clientState = MQTT_CONNECT_FAILED;
+    return false;
+  }
+
+  lastInActivity = lastOutActivity = millis();
+  while (!client->available()) {
+    if (millis() - lastInActivity >= socketTimeout * 1000UL) {
+      client->stop();
+      clientState = MQTT_CONNECTION_TIMEOUT;
+      return false;
+    }
+    delay(1);
+  }
+
+  uint8_t lengthLength;
+  uint32_t len = readPacket(&lengthLength);
+  if (len > 0 && RoidNative::mqttTap()) RoidNative::mqttTap()(*this, true, buffer.data(), len);
+  if (len == 4 && (buffer[0] & 0xF0) == MQTTCONNACK) {
+    if (buffer[3] == 0) {
+      lastInActivity = millis();
+      pingOutstanding = false;
+      clientState = MQTT_CONNECTED;
+      return true;
+    }
+    clientState = buffer[3];
+  } else {
+    clientState = MQTT_CONNECT_FAILED;
+  }
+  client->stop();
+  return false;
+}
+
+void PubSubClient::disconnect() {
+  if (client && client->connected()) {
+    buffer[0] = MQTTDISCONNECT;
+    buffer[1] = 0;
+    client->write(buffer.data(), 2);
+    if (RoidNative::mqttTap()) RoidNative::mqttTap()(*this, false, buffer.data(), 2);
+  }
+  if (client) client->stop();
+  clientState = MQTT_DISCONNECTED;
+  lastInActivity = lastOutActivity = millis();
+}
+
+bool PubSubClient::connected() {
+  if (!client) return false;
+  if (clientState != MQTT_CONNECTED) return false;
+  if (!client->connected()) {
+    clientState = MQTT_CONNECTION_LOST;
+    client->stop();
+    pingOutstanding = false;
+    return false;
+  }
+  return true;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+  return publish(topic, (const uint8_t*)payload, payload ? (unsigned int)strlen(payload) : 0, false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+  return publish(topic, (const uint8_t*)payload, payload ? (unsigned int)strlen(payload) : 0, retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength) {
+  return publish(topic, payload, plength, false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int plength, bool retained) {
+  if (!connected() || !topic) return false;
+  // Same limit as the real client: the whole packet must fit the buffer.
+  if (buffer.size() < MAX_HEADER_SIZE + 2 + strlen(topic) + plength) return false;
+
+  size_t length = writeString(topic, MAX_HEADER_SIZE);
+  if (plength) memcpy(buffer.data() + length, payload, plength);
+  length += plength;
+  return writePacket(MQTTPUBLISH | (retained ? 1 : 0), length - MAX_HEADER_SIZE);
+}
+
+bool PubSubClient::beginPublish(const char* topic, unsigned int plength, bool retained) {
+  if (!connected() || !topic) return false;
+  size_t topicLength = strlen(topic);
+  uint8_t header[MAX_HEADER_SIZE];
+  size_t headerLength = buildHeader(MQTTPUBLISH | (retained ? 1 : 0), header, 2 + topicLength + plength);
+  uint8_t prefix[2] = {(uint8_t)(topicLength >> 8), (uint8_t)topicLength};
+  bool ok = client->write(header, headerLength) == headerLength && client->write(prefix, 2) == 2 &&
+            client->write((const uint8_t*)topic, topicLength) == topicLength;
+  lastOutActivity = millis();
+  if (ok && RoidNative::mqttTap()) {
+    std::vector<uint8_t> packet(header, header + headerLength);
+    packet.insert(packet.end(), prefix, prefix + 2);
+    packet.insert(packet.end(), topic, topic + topicLength);
+    RoidNative::mqttTap()(*this, false, packet.data(), packet.size());
+  }
+  return ok;
+}
+
+int PubSubClient::endPublish() {
+  return 1;
+}
+
+size_t PubSubClient::write(uint8_t c) {
+  lastOutActivity = millis();
+  return client ? client->write(c) : 0;
+}
+
+size_t PubSubClient::write(const uint8_t* buf, size_t size) {
+  lastOutActivity = millis();
+  return client ? client->write(buf, size) : 0;
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+  return subscribe(topic, 0);
+}
+
+bool PubSubClient::subscribe(const char* topic, uint8_t qos) {
+  if (!topic || qos > 1 || !connected()) return false;
+  if (buffer.size() < MAX_HEADER_SIZE + 2 + 2 + strlen(topic) + 1) return false;
+
+  size_t length = MAX_HEADER_SIZE;
+  if (++nextMsgId == 0) nextMsgId = 1;
+  buffer[length++] = (uint8_t)(nextMsgId >> 8);
+  buffer[length++] = (uint8_t)nextMsgId;
+  length = writeString(topic, length);
+  buffer[length++] = qos;
+  return writePacket(MQTTSUBSCRIBE | MQTTQOS1, length - MAX_HEADER_SIZE);
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+  if (!topic || !connected()) return false;
+  if (buffer.size() < MAX_HEADER_SIZE + 2 + 2 + strlen(topic)) return false;
+
+  size_t length = MAX_HEADER_SIZE;
+  if (++nextMsgId == 0) nextMsgId = 1;
+  buffer[length++] = (uint8_t)(nextMsgId >> 8);
+  buffer[length++] = (uint8_t)nextMsgId;
+  length = writeString(topic, length);
+  return writePacket(MQTTUNSUBSCRIBE | MQTTQOS1, length - MAX_HEADER_SIZE);
+}
+
+bool PubSubClient::loop() {
+  if (!connected()) return false;
+
+  unsigned long now = millis();
+  unsigned long keepAliveMs = keepAlive * 1000UL;
+  if (keepAliveMs > 0 && (now - lastInActivity > keepAliveMs || now - lastOutActivity > keepAliveMs)) {
+    if (pingOutstanding) {
+      clientState = MQTT_CONNECTION_TIMEOUT;
+      client->stop();
+      return false;
+    }
+    buffer[0] = MQTTPINGREQ;
+    buffer[1] = 0;
+    client->write(buffer.data(), 2);
+    if (RoidNative::mqttTap()) RoidNative::mqttTap()(*this, false, buffer.data(), 2);
+    lastOutActivity = lastInActivity = now;
+    pingOutstanding = true;
+  }
+
+  // One packet per call, like the real client.
+  if (!client->available()) return true;
+
+  uint8_t lengthLength;
+  uint32_t len = readPacket(&lengthLength);
+  if (len == 0) return connected();
+  lastInActivity = millis();
+  if (RoidNative::mqttTap()) RoidNative::mqttTap()(*this, true, buffer.data(), len);
+
+  uint8_t type = buffer[0] & 0xF0;
+  if (type == MQTTPUBLISH) {
+    if (!callback) return true;
+    size_t topicStart = 1 + lengthLength;
+    uint16_t topicLength = (uint16_t)(buffer[topicStart] << 8 | buffer[topicStart + 1]);
+    size_t payloadStart = topicStart + 2 + topicLength;
+    bool qos1 = (buffer[0] & 0x06) == MQTTQOS1;
+    uint16_t msgId = 0;
+    if (qos1) {
+      msgId = (uint16_t)(buffer[payloadStart] << 8 | buffer[payloadStart + 1]);
+      payloadStart += 2;
+    }
+    if (payloadStart > len) return true;
+
+    // Shift the topic down one byte to make room for its terminator.
+    memmove(buffer.data() + topicStart, buffer.data() + topicStart + 2, topicLength);
+    buffer[topicStart + topicLength] = '\0';
+    callback((char*)buffer.data() + topicStart, buffer.data() + payloadStart, (unsigned int)(len - payloadStart));
+
+    if (qos1 && client->connected()) {
+      uint8_t ack[4] = {MQTTPUBACK, 2, (uint8_t)(msgId >> 8), (uint8_t)msgId};
+      client->write(ack, sizeof(ack));
+      if (RoidNative::mqttTap()) RoidNative::mqttTap()(*this, false, ack, sizeof(ack));
+      lastOutActivity = millis();
+    }
+  } else if (type == MQTTPINGREQ) {
+    uint8_t resp[2] = {MQTTPINGRESP, 0};
+    client->write(resp, sizeof(resp));
+    if (RoidNative::mqttTap()) RoidNative::mqttTap()(*this, false, resp, sizeof(resp));
+  } else if (type == MQTTPINGRESP) {
+    pingOutstanding = false;
+  }
+  return true;
+}
+
+// Waits up to the socket timeout for each byte, as the real client does.
+bool PubSubClient::readByte(uint8_t* result) {
+  unsigned long start = millis();
+  while (!client->available()) {
+    if (!client->connected() || millis() - start >= socketTimeout * 1000UL) return false;
+    delay(1);
+  }
+  int c = client->read();
+  if (c < 0) return false;
+  *result = (uint8_t)c;
+  return true;
+}
+
+// Reads one packet into the buffer and returns its total length, or 0 if
+// it was incomplete or did not fit (the excess is read and dropped).
+uint32_t PubSubClient::readPacket(uint8_t* lengthLength) {
+  uint8_t c;
+  if (!readByte(&c)) return 0;
+  buffer[0] = c;
+
+  uint32_t remaining = 0;
+  uint32_t multiplier = 1;
+  uint8_t count = 0;
+  do {
+    if (count == 4 || !readByte(&c)) return 0;
+    buffer[1 + count++] = c;
+    remaining += (c & 0x7F) * multiplier;
+    multiplier <<= 7;
+  } while (c & 0x80);
+  *lengthLength = count;
+
+  uint32_t length = 1 + count;
+  for (uint32_t i = 0; i < remaining; ++i) {
+    if (!readByte(&c)) return 0;
+    if (length < buffer.size()) buffer[length] = c;
+    ++length;
+  }
+  return length <= buffer.size() ? length : 0;
+}
+
+size_t PubSubClient::buildHeader(uint8_t header, uint8_t* out, size_t length) {
+  uint8_t lengthBytes[4];
+  size_t count = 0;
+  do {
+    uint8_t digit = length & 0x7F;
+    length >>= 7;
+    if (length > 0) digit |= 0x80;
+    lengthBytes[count++] = digit;
+  } while (length > 0 && count < 4);
+
+  out[0] = header;
+  memcpy(out + 1, lengthBytes, count);
+  return 1 + count;
+}
+
+// Sends the packet whose variable part starts at MAX_HEADER_SIZE.
+bool PubSubClient::writePacket(uint8_t header, size_t length) {
+  uint8_t fixed[MAX_HEADER_SIZE];
+  size_t headerLength = buildHeader(header, fixed, length);
+  uint8_t* start = buffer.data() + MAX_HEADER_SIZE - headerLength;
+  memcpy(start, fixed, headerLength);
+
+  size_t total = headerLength + length;
+  size_t written = client->write(start, total);
+  lastOutActivity = millis();
+  if (written == total && RoidNative::mqttTap()) RoidNative::mqttTap()(*this, false, start, total);
+  return written == total;
+}
+
+// Appends a length-prefixed string; returns 0 if it does not fit.
+size_t PubSubClient::writeString(const char* s, size_t pos) {
+  if (pos == 0) return 0;
+  size_t length = s ? strlen(s) : 0;
+  if (pos + 2 + length > buffer.size()) return 0;
+  buffer[pos++] = (uint8_t)(length >> 8);
+  buffer[pos++] = (uint8_t)length;
+  if (length) memcpy(buffer.data() + pos, s, length);
+  return pos + length;
+}
@@ -0,0 +1,113 @@
+#ifndef ROIDNATIVE_PUBSUBCLIENT_H
+#define ROIDNATIVE_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <functional>
+#include <vector>
+
+// Same limits and defaults as knolleary/PubSubClient 2.8, which this mirrors:
+// MQTT 3.1.1, QoS 0 publishes, QoS 0/1 subscriptions, one packet buffer
+// shared by both directions.
+#define MQTT_VERSION_3_1_1 4
+#define MQTT_VERSION MQTT_VERSION_3_1_1
+
+#ifndef MQTT_MAX_PACKET_SIZE
+#define MQTT_MAX_PACKET_SIZE 256
+#endif
+#ifndef MQTT_KEEPALIVE
+#define MQTT_KEEPALIVE 15
+#endif
+#ifndef MQTT_SOCKET_TIMEOUT
+#define MQTT_SOCKET_TIMEOUT 15
+#endif
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+#define MQTT_CONNECT_BAD_PROTOCOL 1
+#define MQTT_CONNECT_BAD_CLIENT_ID 2
+#define MQTT_CONNECT_UNAVAILABLE 3
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED 5
+
+#define MQTTCONNECT (1 << 4)
+#define MQTTCONNACK (2 << 4)
+#define MQTTPUBLISH (3 << 4)
+#define MQTTPUBACK (4 << 4)
+#define MQTTSUBSCRIBE (8 << 4)
+#define MQTTSUBACK (9 << 4)
+#define MQTTUNSUBSCRIBE (10 << 4)
+#define MQTTUNSUBACK (11 << 4)
+#define MQTTPINGREQ (12 << 4)
+#define MQTTPINGRESP (13 << 4)
+#define MQTTDISCONNECT (14 << 4)
+
+#define MQTTQOS0 (0 << 1)
+#define MQTTQOS1 (1 << 1)
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient {
+public:
+  PubSubClient();
+  explicit PubSubClient(WiFiClient& client);
+
+  PubSubClient& setServer(const char* domain, uint16_t port);
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+  PubSubClient& setClient(WiFiClient& client);
+  PubSubClient& setKeepAlive(uint16_t keepAlive);
+  PubSubClient& setSocketTimeout(uint16_t timeout);
+  bool setBufferSize(uint16_t size);
+  uint16_t getBufferSize() { return (uint16_t)buffer.size(); }
+
+  bool connect(const char* id);
+  bool connect(const char* id, const char* user, const char* pass);
+  bool connect(const char* id, const char* willTopic, uint8_t willQos, bool willRetain, const char* willMessage);
+  bool connect(const char* id, const char* user, const char* pass, const char* willTopic, uint8_t willQos,
+               bool willRetain, const char* willMessage, bool cleanSession = true);
+  void disconnect();
+
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const char* payload, bool retained);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int plength);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int plength, bool retained);
+
+  // Streams a payload too large for the buffer straight to the socket.
+  bool beginPublish(const char* topic, unsigned int plength, bool retained);
+  int endPublish();
+  size_t write(uint8_t c);
+  size_t write(const uint8_t* buf, size_t size);
+
+  bool subscribe(const char* topic);
+  bool subscribe(const char* topic, uint8_t qos);
+  bool unsubscribe(const char* topic);
+
+  bool loop();
+  bool connected();
+  int state() { return clientState; }
+
+private:
+  bool readByte(uint8_t* result);
+  uint32_t readPacket(uint8_t* lengthLength);
+  bool writePacket(uint8_t header, size_t length);
+  size_t buildHeader(uint8_t header, uint8_t* out, size_t length);
+  size_t writeString(const char* s, size_t pos);
+
+  WiFiClient* client = nullptr;
+  std::vector<uint8_t> buffer;
+  uint16_t nextMsgId = 0;
+  unsigned long lastOutActivity = 0;
+  unsigned long lastInActivity = 0;
+  bool pingOutstanding = false;
+  uint16_t keepAlive = MQTT_KEEPALIVE;
+  uint16_t socketTimeout = MQTT_SOCKET_TIMEOUT;
+  String domain;
+  uint16_t port = 1883;
+  int clientState = MQTT_DISCONNECTED;
+  MQTT_CALLBACK_SIGNATURE;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#ifndef ROIDNATIVE_H
+#define ROIDNATIVE_H
+
+#include <Arduino.h>
+
+class PubSubClient;
+
+// Knobs for the host fakes. Everything the fakes persist (flash partitions,
+// boot selection, NVS) lives under one data directory, so a run can be
+// reset by deleting it or resumed by keeping it.
+//
+// Environment variables read at startup:
+//   ROIDOTA_NATIVE_DIR     data directory (default ".roidota")
+//   ROIDOTA_NATIVE_REBOOT  "exec" to re-run the binary on ESP.restart()
+//   ROIDOTA_NATIVE_RUN_MS  stop after this long, for scripted runs
+//   ROIDOTA_NATIVE_WAKES   stop at the deep sleep after this many wakes
+//   ROIDOTA_NATIVE_DEVICE_ID  device ID for sketches that ask deviceId()
+//   ROIDOTA_NATIVE_IP      station address (default 127.0.0.1); any of
+//                          127.0.0.0/8 works on Linux, which gives each
+//                          host device its own address on one machine
+class RoidNative {
+public:
+  static void init(int argc, char** argv);
+  // Command-line arguments of the host binary, argv[0] included.
+  static int argCount();
+  static const char* arg(int index);
+
+  // ROIDOTA_NATIVE_DEVICE_ID, or fallback if unset. The native build
+  // defines DEVICE_ID through this, so one binary can run as many devices.
+  static const char* deviceId(const char* fallback);
+  // Station address, first octet in the low byte like IPAddress
+  static uint32_t localAddress();
+
+  static const char* dataDir();
+  static void setDataDir(const char* dir);
+  // Path of a file inside the data directory; parent directories are created.
+  static String dataPath(const char* name);
+
+  // With a manual clock, millis() only moves through advance() and delay(),
+  // which makes timing-dependent paths deterministic.
+  static void useManualClock(bool manual);
+  static void advance(unsigned long ms);
+
+  static void setWiFiConnected(bool connected);
+  static bool wifiConnected();
+  // Radio-on time since boot: from WiFi.begin() to WiFi.disconnect(true)
+  // or WiFi.mode(WIFI_OFF).
+  static void setRadioOn(bool on);
+  static unsigned long radioOnMs();
+
+  static uint8_t pinValue(uint8_t pin);
+
+  // Serial output goes to stdout unless disabled, e.g. while benchmarking.
+  static void setSerialEnabled(bool enabled);
+
+  // Sees every MQTT packet a PubSubClient sends or receives, fixed header
+  // included; a streamed publish only up to its topic. Lets host tools
+  // time clients they do not modify, like the fleet simulator's devices.
+  typedef void (*MqttTap)(PubSubClient& client, bool inbound, const uint8_t* packet, size_t len);
+  static void setMqttTap(MqttTap tap);
+  static MqttTap mqttTap();
+
+  // Process-level restart used by ESP.restart(). RTC_NOINIT_ATTR variables
+  // are carried over to the next run.
+  [[noreturn]] static void restart();
+  // ESP.deepSleep(): appends {"wake","awake_ms","radio_ms","sleep_ms"} to
+  // <data dir>/wakes.jsonl, then restarts. The sleep itself takes no time,
+  // so a long duty cycle runs at full speed and is summed up from the log.
+  [[noreturn]] static void deepSleep(uint64_t us);
+};
+
+#endif
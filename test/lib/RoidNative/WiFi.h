@@ -0,0 +1,106 @@
+#ifndef ROIDNATIVE_WIFI_H
+#define ROIDNATIVE_WIFI_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <WiFiServer.h>
+#include "RoidNative.h"
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+
+class IPAddress {
+public:
+  IPAddress() : bytes{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : bytes{a, b, c, d} {}
+  IPAddress(uint32_t address)
+      : bytes{(uint8_t)address, (uint8_t)(address >> 8), (uint8_t)(address >> 16), (uint8_t)(address >> 24)} {}
+  uint8_t operator[](int index) const { return bytes[index & 3]; }
+  // First octet in the low byte, as on the ESP32
+  operator uint32_t() const {
+    return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+  }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+    return String(buf);
+  }
+
+private:
+  uint8_t bytes[4];
+};
+
+// The host is always "on the network"; RoidNative::setWiFiConnected()
+// simulates losing the access point.
+class WiFiClass {
+public:
+  wl_status_t status() { return RoidNative::wifiConnected() ? WL_CONNECTED : WL_DISCONNECTED; }
+  bool isConnected() { return status() == WL_CONNECTED; }
+  wl_status_t begin(const char* ssid = nullptr, const char* passphrase = nullptr) {
+    (void)ssid;
+    (void)passphrase;
+    RoidNative::setRadioOn(true);
+    RoidNative::setWiFiConnected(true);
+    return status();
+  }
+  wl_status_t begin(const char* ssid, const char* passphrase, int32_t channel, const uint8_t* bssid,
+                    bool connect = true) {
+    (void)channel;
+    (void)bssid;
+    if (!connect) return status();
+    return begin(ssid, passphrase);
+  }
+  bool config(IPAddress local, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress()) {
+    (void)local;
+    (void)gateway;
+    (void)subnet;
+    (void)dns1;
+    return true;
+  }
+  void persistent(bool persistent) { (void)persistent; }
+  bool disconnect(bool wifiOff = false) {
+    if (wifiOff) RoidNative::setRadioOn(false);
+    RoidNative::setWiFiConnected(false);
+    return true;
+  }
+  bool reconnect() { return begin() == WL_CONNECTED; }
+  bool mode(wifi_mode_t m) {
+    if (m == WIFI_OFF) RoidNative::setRadioOn(false);
+    return true;
+  }
+  bool setAutoReconnect(bool enable) { (void)enable; return true; }
+  bool setSleep(bool enable) { (void)enable; return true; }
+  IPAddress localIP() { return IPAddress(RoidNative::localAddress()); }
+  int8_t RSSI() { return isConnected() ? -55 : 0; }
+  IPAddress gatewayIP() { return IPAddress(127, 0, 0, 1); }
+  IPAddress subnetMask() { return IPAddress(255, 0, 0, 0); }
+  IPAddress dnsIP(uint8_t index = 0) { (void)index; return IPAddress(127, 0, 0, 1); }
+  String SSID() { return String("native"); }
+  String psk() { return String(""); }
+  uint8_t* BSSID() {
+    static uint8_t bssid[6] = {0x02, 0, 0, 0, 0, 0x01};
+    return bssid;
+  }
+  uint8_t channel() { return 1; }
+  String macAddress() {
+    uint64_t mac = ESP.getEfuseMac();
+    char buf[18];
+    snprintf(buf, sizeof(buf), "%02X:%02X:%02X:%02X:%02X:%02X", (unsigned)(mac & 0xFF),
+             (unsigned)(mac >> 8 & 0xFF), (unsigned)(mac >> 16 & 0xFF), (unsigned)(mac >> 24 & 0xFF),
+             (unsigned)(mac >> 32 & 0xFF), (unsigned)(mac >> 40 & 0xFF));
+    return String(buf);
+  }
+};
+
+extern WiFiClass WiFi;
+
+#endif
@@ -0,0 +1,153 @@
+#include <WiFi.h>
+#include <WiFiClient.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static const int32_t DEFAULT_CONNECT_TIMEOUT_MS = 3000;
+
+WiFiClass WiFi;
+
+WiFiClient::WiFiClient(int fd) : sock(fd) {
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+WiFiClient& WiFiClient::operator=(WiFiClient&& other) noexcept {
+  if (this != &other) {
+    stop();
+    sock = other.sock;
+    peeked = other.peeked;
+    other.sock = -1;
+    other.peeked = -1;
+  }
+  return *this;
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  return connect(host, port, DEFAULT_CONNECT_TIMEOUT_MS);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port, int32_t timeoutMs) {
+  stop();
+  if (!RoidNative::wifiConnected()) return 0;
+
+  char service[8];
+  snprintf(service, sizeof(service), "%u", port);
+  struct addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* result = nullptr;
+  if (getaddrinfo(host, service, &hints, &result) != 0) return 0;
+
+  for (struct addrinfo* ai = result; ai && sock < 0; ai = ai->ai_next) {
+    int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+
+    // Non-blocking connect so the timeout is ours, then back to blocking
+    // for writes; reads stay non-blocking through MSG_DONTWAIT.
+    int flags = fcntl(fd, F_GETFL, 0);
+    fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    int rc = ::connect(fd, ai->ai_addr, ai->ai_addrlen);
+    if (rc < 0 && errno == EINPROGRESS) {
+      struct pollfd pfd = {fd, POLLOUT, 0};
+      int err = 0;
+      socklen_t len = sizeof(err);
+      if (poll(&pfd, 1, timeoutMs) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0) {
+        rc = 0;
+      }
+    }
+    if (rc != 0) {
+      close(fd);
+      continue;
+    }
+    fcntl(fd, F_SETFL, flags);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    sock = fd;
+  }
+
+  freeaddrinfo(result);
+  return sock >= 0 ? 1 : 0;
+}
+
+uint8_t WiFiClient::connected() {
+  if (sock < 0) return 0;
+  if (peeked >= 0) return 1;
+
+  uint8_t probe;
+  ssize_t n = recv(sock, &probe, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n > 0) return 1;
+  if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 1;
+  return 0;
+}
+
+int WiFiClient::available() {
+  if (sock < 0) return 0;
+  int extra = peeked >= 0 ? 1 : 0;
+
+  int pending = 0;
+  if (ioctl(sock, FIONREAD, &pending) < 0) pending = 0;
+  return pending + extra;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+  if (sock < 0 || size == 0) return -1;
+
+  size_t got = 0;
+  if (peeked >= 0) {
+    buf[got++] = (uint8_t)peeked;
+    peeked = -1;
+    if (got == size) return (int)got;
+  }
+
+  ssize_t n = recv(sock, buf + got, size - got, MSG_DONTWAIT);
+  if (n > 0) got += (size_t)n;
+  return got > 0 ? (int)got : -1;
+}
+
+int WiFiClient::peek() {
+  if (peeked < 0) {
+    uint8_t c;
+    if (read(&c, 1) == 1) peeked = c;
+  }
+  return peeked;
+}
+
+size_t WiFiClient::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+  if (sock < 0) return 0;
+
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t n = send(sock, buf + sent, size - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      stop();
+      break;
+    }
+    sent += (size_t)n;
+  }
+  return sent;
+}
+
+void WiFiClient::stop() {
+  if (sock >= 0) close(sock);
+  sock = -1;
+  peeked = -1;
+}
@@ -0,0 +1,42 @@
+#ifndef ROIDNATIVE_WIFICLIENT_H
+#define ROIDNATIVE_WIFICLIENT_H
+
+#include <Arduino.h>
+
+// TCP client over a POSIX socket. Reads never block, as on ESP32, so
+// available()/read() can be polled from loop(). Clients own their socket,
+// so they move rather than copy; WiFiServer::accept() hands them out by
+// value.
+class WiFiClient : public Stream {
+public:
+  WiFiClient() {}
+  explicit WiFiClient(int fd);
+  ~WiFiClient() { stop(); }
+  WiFiClient(const WiFiClient&) = delete;
+  WiFiClient& operator=(const WiFiClient&) = delete;
+  WiFiClient(WiFiClient&& other) noexcept { *this = static_cast<WiFiClient&&>(other); }
+  WiFiClient& operator=(WiFiClient&& other) noexcept;
+
+  int connect(const char* host, uint16_t port);
+  int connect(const char* host, uint16_t port, int32_t timeoutMs);
+
+  uint8_t connected();
+  operator bool() { return connected(); }
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size);
+  int peek() override;
+  using Print::write;
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buf, size_t size) override;
+  void flush() override {}
+  void stop();
+
+  int fd() const { return sock; }
+
+private:
+  int sock = -1;
+  int peeked = -1;
+};
+
+#endif
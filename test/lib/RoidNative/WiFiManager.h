@@ -0,0 +1,27 @@
+#ifndef ROIDNATIVE_WIFIMANAGER_H
+#define ROIDNATIVE_WIFIMANAGER_H
+
+#include <WiFi.h>
+
+// No captive portal on the host: autoConnect() reports the fake link state.
+class WiFiManager {
+public:
+  void setTitle(String title) { (void)title; }
+  void setConfigPortalTimeout(unsigned long seconds) { (void)seconds; }
+  void setConnectTimeout(unsigned long seconds) { (void)seconds; }
+  void setEnableConfigPortal(bool enable) { (void)enable; }
+  void setSTAStaticIPConfig(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns = IPAddress()) {
+    (void)ip;
+    (void)gateway;
+    (void)subnet;
+    (void)dns;
+  }
+  void resetSettings() {}
+  bool autoConnect(const char* apName = nullptr, const char* apPassword = nullptr) {
+    (void)apName;
+    (void)apPassword;
+    return WiFi.begin() == WL_CONNECTED;
+  }
+};
+
+#endif
@@ -0,0 +1,52 @@
+#include <WiFiServer.h>
+#include "RoidNative.h"
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+void WiFiServer::begin(uint16_t port) {
+  end();
+  if (port != 0) serverPort = port;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(serverPort);
+  // RoidNative keeps the address in ESP32 order, first octet in the low
+  // byte, which is network order in memory on a little-endian host.
+  uint32_t address = RoidNative::localAddress();
+  memcpy(&addr.sin_addr, &address, sizeof(address));
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, backlog) != 0) {
+    close(fd);
+    return;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+  sock = fd;
+}
+
+void WiFiServer::end() {
+  if (sock >= 0) close(sock);
+  sock = -1;
+}
+
+bool WiFiServer::hasClient() {
+  if (sock < 0) return false;
+  struct pollfd pfd = {sock, POLLIN, 0};
+  return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
+
+WiFiClient WiFiServer::accept() {
+  if (sock < 0) return WiFiClient();
+  int fd = ::accept(sock, nullptr, nullptr);
+  if (fd < 0) return WiFiClient();
+  // Accepted sockets inherit O_NONBLOCK on some systems; writes block as
+  // they do for outgoing clients.
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK);
+  return WiFiClient(fd);
+}
@@ -0,0 +1,32 @@
+#ifndef ROIDNATIVE_WIFISERVER_H
+#define ROIDNATIVE_WIFISERVER_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+
+// Listening TCP socket on the station address (see ROIDOTA_NATIVE_IP), so
+// host devices given different loopback addresses can each serve the same
+// port. hasClient() and accept() never block.
+class WiFiServer {
+public:
+  explicit WiFiServer(uint16_t port = 80, uint8_t maxClients = 4) : serverPort(port), backlog(maxClients) {}
+  ~WiFiServer() { end(); }
+  WiFiServer(const WiFiServer&) = delete;
+  WiFiServer& operator=(const WiFiServer&) = delete;
+
+  void begin(uint16_t port = 0);
+  void end();
+  void stop() { end(); }
+  bool hasClient();
+  WiFiClient accept();
+  WiFiClient available() { return accept(); }
+  void setNoDelay(bool noDelay) { (void)noDelay; }
+  explicit operator bool() const { return sock >= 0; }
+
+private:
+  uint16_t serverPort;
+  uint8_t backlog;
+  int sock = -1;
+};
+
+#endif
@@ -0,0 +1,206 @@
+#include "esp_ota_ops.h"
+#include "MD5Builder.h"
+#include "RoidNative.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const size_t SECTOR_SIZE = 4096;
+static const uint8_t IMAGE_MAGIC = 0xE9;
+
+static const esp_partition_t partitions[2] = {
+  {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x10000, 0x140000, "ota_0", false},
+  {ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x150000, 0x140000, "ota_1", false},
+};
+
+// Highest byte written to each slot by this process, i.e. the image length
+// once an update completes.
+static size_t imageEnd[2];
+static int runningIndex = -1;
+
+static int indexOf(const esp_partition_t* partition) {
+  if (partition == &partitions[0]) return 0;
+  if (partition == &partitions[1]) return 1;
+  return -1;
+}
+
+static String slotPath(int index, const char* suffix) {
+  return RoidNative::dataPath((String("flash/") + partitions[index].label + suffix).c_str());
+}
+
+static size_t fileSize(const char* path) {
+  struct stat st;
+  return stat(path, &st) == 0 ? (size_t)st.st_size : 0;
+}
+
+static int bootIndex() {
+  FILE* f = fopen(RoidNative::dataPath("flash/otadata").c_str(), "r");
+  if (!f) return 0;
+  char label[17] = {0};
+  bool ok = fgets(label, sizeof(label), f) != nullptr;
+  fclose(f);
+  return ok && strncmp(label, partitions[1].label, strlen(partitions[1].label)) == 0 ? 1 : 0;
+}
+
+static bool inBounds(const esp_partition_t* partition, size_t offset, size_t size) {
+  return indexOf(partition) >= 0 && offset <= partition->size && size <= partition->size - offset;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size) {
+  if (!dst || !inBounds(partition, src_offset, size)) return ESP_ERR_INVALID_ARG;
+
+  memset(dst, 0xFF, size);
+  int fd = open(slotPath(indexOf(partition), ".bin").c_str(), O_RDONLY);
+  if (fd < 0) return ESP_OK;
+  ssize_t n = pread(fd, dst, size, (off_t)src_offset);
+  close(fd);
+  if (n < 0) return ESP_FAIL;
+  if ((size_t)n < size) memset((uint8_t*)dst + n, 0xFF, size - (size_t)n);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* partition, size_t dst_offset, const void* src, size_t size) {
+  if (!src || !inBounds(partition, dst_offset, size)) return ESP_ERR_INVALID_ARG;
+  if (size == 0) return ESP_OK;
+
+  // NOR flash: programming can only turn 1 bits into 0 bits.
+  std::string merged(size, '\0');
+  esp_err_t err = esp_partition_read(partition, dst_offset, &merged[0], size);
+  if (err != ESP_OK) return err;
+  for (size_t i = 0; i < size; ++i) merged[i] &= ((const char*)src)[i];
+
+  int index = indexOf(partition);
+  String path = slotPath(index, ".bin");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) return ESP_FAIL;
+
+  // Pad any gap with erased bytes rather than the zeros a sparse file gives.
+  size_t length = fileSize(path.c_str());
+  bool ok = true;
+  if (length < dst_offset) {
+    std::string pad(dst_offset - length, '\xFF');
+    ok = pwrite(fd, pad.data(), pad.size(), (off_t)length) == (ssize_t)pad.size();
+  }
+  ok = ok && pwrite(fd, merged.data(), size, (off_t)dst_offset) == (ssize_t)size;
+  close(fd);
+  if (!ok) return ESP_FAIL;
+
+  imageEnd[index] = max(imageEnd[index], dst_offset + size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* partition, size_t offset, size_t size) {
+  if (!inBounds(partition, offset, size)) return ESP_ERR_INVALID_ARG;
+  if (offset % SECTOR_SIZE != 0 || size % SECTOR_SIZE != 0) return ESP_ERR_INVALID_SIZE;
+
+  String path = slotPath(indexOf(partition), ".bin");
+  size_t length = fileSize(path.c_str());
+  if (offset >= length) return ESP_OK;
+
+  int fd = open(path.c_str(), O_WRONLY);
+  if (fd < 0) return ESP_FAIL;
+  size_t count = min(size, length - offset);
+  std::string erased(count, '\xFF');
+  bool ok = pwrite(fd, erased.data(), count, (off_t)offset) == (ssize_t)count;
+  close(fd);
+  return ok ? ESP_OK : ESP_FAIL;
+}
+
+const esp_partition_t* esp_ota_get_running_partition() {
+  if (runningIndex < 0) runningIndex = bootIndex();
+  return &partitions[runningIndex];
+}
+
+const esp_partition_t* esp_ota_get_boot_partition() {
+  return &partitions[bootIndex()];
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from) {
+  int index = indexOf(start_from ? start_from : esp_ota_get_running_partition());
+  return index < 0 ? nullptr : &partitions[1 - index];
+}
+
+// The bootloader's image check is reduced to the magic byte; the image
+// length is recorded next to the slot so getSketchSize() knows it on the
+// next boot.
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition) {
+  int index = indexOf(partition);
+  if (index < 0) return ESP_ERR_INVALID_ARG;
+
+  uint8_t magic;
+  if (esp_partition_read(partition, 0, &magic, 1) != ESP_OK || magic != IMAGE_MAGIC) {
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+  }
+
+  size_t length = imageEnd[index] ? imageEnd[index] : fileSize(slotPath(index, ".bin").c_str());
+  FILE* f = fopen(slotPath(index, ".size").c_str(), "w");
+  if (!f) return ESP_FAIL;
+  fprintf(f, "%zu\n", length);
+  fclose(f);
+
+  f = fopen(RoidNative::dataPath("flash/otadata").c_str(), "w");
+  if (!f) return ESP_FAIL;
+  fprintf(f, "%s\n", partition->label);
+  fclose(f);
+  return ESP_OK;
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK: return "ESP_OK";
+    case ESP_FAIL: return "ESP_FAIL";
+    case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_OTA_VALIDATE_FAILED: return "ESP_ERR_OTA_VALIDATE_FAILED";
+    default: return "UNKNOWN ERROR";
+  }
+}
+
+// ========== Running image ==========
+// The running slot's recorded image length, or the whole file when a
+// firmware was dropped in by hand.
+uint32_t EspClass::getSketchSize() {
+  int index = indexOf(esp_ota_get_running_partition());
+  FILE* f = fopen(slotPath(index, ".size").c_str(), "r");
+  if (f) {
+    unsigned long length = 0;
+    bool ok = fscanf(f, "%lu", &length) == 1;
+    fclose(f);
+    if (ok) return (uint32_t)length;
+  }
+  return (uint32_t)min(fileSize(slotPath(index, ".bin").c_str()), (size_t)partitions[index].size);
+}
+
+uint32_t EspClass::getFreeSketchSpace() {
+  const esp_partition_t* next = esp_ota_get_next_update_partition(nullptr);
+  return next ? next->size : 0;
+}
+
+// Hashed once per process, like the cached value on ESP32.
+String EspClass::getSketchMD5() {
+  static String cached;
+  if (cached.length() > 0) return cached;
+
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  size_t remaining = getSketchSize();
+  size_t offset = 0;
+  uint8_t chunk[SECTOR_SIZE];
+  MD5Builder md5;
+  md5.begin();
+  while (remaining > 0) {
+    size_t n = min(remaining, sizeof(chunk));
+    if (esp_partition_read(running, offset, chunk, n) != ESP_OK) return String();
+    md5.add(chunk, n);
+    offset += n;
+    remaining -= n;
+  }
+
+  char hex[33];
+  md5.calculate();
+  md5.getChars(hex);
+  cached = hex;
+  return cached;
+}
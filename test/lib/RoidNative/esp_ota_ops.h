@@ -0,0 +1,14 @@
+#ifndef ROIDNATIVE_ESP_OTA_OPS_H
+#define ROIDNATIVE_ESP_OTA_OPS_H
+
+#include "esp_partition.h"
+
+// Two app slots, ota_0 and ota_1, laid out as in the default ESP32
+// partition table. The boot selection is a file, read once per process, so
+// the slot picked by esp_ota_set_boot_partition() runs after a restart.
+const esp_partition_t* esp_ota_get_running_partition();
+const esp_partition_t* esp_ota_get_boot_partition();
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+
+#endif
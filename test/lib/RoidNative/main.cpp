@@ -0,0 +1,21 @@
+#include "RoidNative.h"
+
+// Arduino's entry point, for the host: setup() once, then loop() forever,
+// or until ROIDOTA_NATIVE_RUN_MS has elapsed.
+void setup();
+void loop();
+
+int main(int argc, char** argv) {
+  RoidNative::init(argc, argv);
+
+  const char* runMs = getenv("ROIDOTA_NATIVE_RUN_MS");
+  unsigned long limit = runMs ? strtoul(runMs, nullptr, 10) : 0;
+
+  setup();
+  unsigned long start = millis();
+  while (limit == 0 || millis() - start < limit) {
+    loop();
+  }
+  Serial.flush();
+  return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef ROIDBACKOFF_H
+#define ROIDBACKOFF_H
+
+#include <Arduino.h>
+
+// MQTT reconnect backoff. Retries wait a jittered, exponentially growing
+// delay between ROIDOTA_RECONNECT_BASE_MS and ROIDOTA_RECONNECT_CAP_MS.
+#ifndef ROIDOTA_RECONNECT_BASE_MS
+#define ROIDOTA_RECONNECT_BASE_MS 1000
+#endif
+#ifndef ROIDOTA_RECONNECT_CAP_MS
+#define ROIDOTA_RECONNECT_CAP_MS 60000
+#endif
+
+// Reconnect pacing for one connection, and the jitter source behind it.
+// The generator is xorshift32 seeded per device, so devices that boot or
+// lose the broker together still spread their retries.
+class RoidBackoff {
+public:
+  // A zero state would stay zero, so it is taken as 1
+  void seed(uint32_t state);
+  uint32_t state() const;
+  uint32_t jitter();
+
+  void configure(unsigned long baseMs, unsigned long capMs);
+
+  // First retry after the link drops, somewhere in [0, base), so a broker
+  // restart does not see the whole fleet come back in the same instant.
+  unsigned long first();
+  // Wait after a failed attempt, which it counts.
+  unsigned long next();
+  // Connected again
+  void reset();
+  uint8_t attempts() const;
+
+private:
+  uint32_t jitterState = 1;
+  unsigned long baseMs = ROIDOTA_RECONNECT_BASE_MS;
+  unsigned long capMs = ROIDOTA_RECONNECT_CAP_MS;
+  uint8_t attemptCount = 0;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include "RoidBroadcast.h"
+
+bool RoidBroadcast::begin(const char* firmwareId, size_t imageSize, size_t chunk, uint8_t* chunkBuffer, size_t chunkBufferSize) {
+  end();
+  if (!firmwareId || firmwareId[0] == '\0' || strlen(firmwareId) > ROIDOTA_BCAST_ID_SIZE) return false;
+  if (strchr(firmwareId, '/') || strchr(firmwareId, '+') || strchr(firmwareId, '#')) return false;
+  if (chunk == 0 || chunk > chunkBufferSize || RoidFlash::SECTOR_SIZE % chunk != 0) return false;
+  if (imageSize <= RoidFlash::HEADER_SIZE || (imageSize + chunk - 1) / chunk > ROIDOTA_BCAST_MAX_CHUNKS) return false;
+
+  strcpy(id, firmwareId);
+  snprintf(topicName, sizeof(topicName), "roidota/fw/%s", firmwareId);
+  size = imageSize;
+  chunkSize = chunk;
+  chunkCount = (imageSize + chunk - 1) / chunk;
+  receivedCount = 0;
+  buffer = chunkBuffer;
+  bufferSize = chunkBufferSize;
+  hasPending = false;
+  memset(bitmap, 0, sizeof(bitmap));
+  running = true;
+  return true;
+}
+
+void RoidBroadcast::end() {
+  running = false;
+  hasPending = false;
+}
+
+bool RoidBroadcast::active() const {
+  return running;
+}
+
+const char* RoidBroadcast::firmwareId() const {
+  return id;
+}
+
+const char* RoidBroadcast::topic() const {
+  return topicName;
+}
+
+RoidBroadcast::Packet RoidBroadcast::accept(const uint8_t* payload, size_t length) {
+  if (!running || length < HEADER_SIZE) return INVALID;
+  uint32_t index = ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) | ((uint32_t)payload[2] << 8) | payload[3];
+  if (index == END_OF_PASS) return length == HEADER_SIZE ? END : INVALID;
+  if (index >= chunkCount || length - HEADER_SIZE != chunkLength(index)) return INVALID;
+  if (has(index)) return DUPLICATE;
+  // One chunk in hand at a time; another one arriving before it reaches
+  // flash is simply repaired later.
+  if (hasPending) return BUSY;
+
+  memcpy(buffer, payload + HEADER_SIZE, length - HEADER_SIZE);
+  pendingIndex = index;
+  hasPending = true;
+  return CHUNK;
+}
+
+bool RoidBroadcast::pending(size_t& offset, const uint8_t*& data, size_t& length, bool& fresh) const {
+  if (!hasPending) return false;
+  offset = (size_t)pendingIndex * chunkSize;
+  data = buffer;
+  length = chunkLength(pendingIndex);
+
+  // Chunks are written once each, so a sector is still unerased as long as
+  // none of its chunks has arrived.
+  uint32_t perSector = RoidFlash::SECTOR_SIZE / chunkSize;
+  uint32_t first = pendingIndex - pendingIndex % perSector;
+  fresh = true;
+  for (uint32_t i = first; i < first + perSector && i < chunkCount && fresh; ++i) {
+    if (has(i)) fresh = false;
+  }
+  return true;
+}
+
+void RoidBroadcast::written() {
+  if (!hasPending) return;
+  bitmap[pendingIndex / 8] |= 1 << (pendingIndex % 8);
+  ++receivedCount;
+  hasPending = false;
+}
+
+void RoidBroadcast::discard() {
+  hasPending = false;
+}
+
+bool RoidBroadcast::complete() const {
+  return running && receivedCount == chunkCount;
+}
+
+uint32_t RoidBroadcast::chunks() const {
+  return chunkCount;
+}
+
+uint32_t RoidBroadcast::received() const {
+  return receivedCount;
+}
+
+size_t RoidBroadcast::imageSize() const {
+  return size;
+}
+
+size_t RoidBroadcast::missingRanges(uint32_t (*ranges)[2], size_t maxRanges) const {
+  size_t count = 0;
+  for (uint32_t i = 0; i < chunkCount && count < maxRanges; ++i) {
+    if (has(i)) continue;
+    uint32_t last = i;
+    while (last + 1 < chunkCount && !has(last + 1)) ++last;
+    ranges[count][0] = i;
+    ranges[count][1] = last;
+    ++count;
+    i = last;
+  }
+  return count;
+}
+
+bool RoidBroadcast::has(uint32_t index) const {
+  return bitmap[index / 8] & (1 << (index % 8));
+}
+
+size_t RoidBroadcast::chunkLength(uint32_t index) const {
+  return index + 1 < chunkCount ? chunkSize : size - (size_t)index * chunkSize;
+}
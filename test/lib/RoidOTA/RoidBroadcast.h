@@ -0,0 +1,93 @@
+#ifndef ROIDBROADCAST_H
+#define ROIDBROADCAST_H
+
+#include <Arduino.h>
+#include "RoidFlash.h"
+
+// Largest image a broadcast can carry is ROIDOTA_BCAST_MAX_CHUNKS chunks;
+// the bitmap takes one bit per chunk. Larger offers are downloaded instead.
+#ifndef ROIDOTA_BCAST_MAX_CHUNKS
+#define ROIDOTA_BCAST_MAX_CHUNKS 4096
+#endif
+// Firmware IDs longer than this are not joined
+#ifndef ROIDOTA_BCAST_ID_SIZE
+#define ROIDOTA_BCAST_ID_SIZE 48
+#endif
+// Missing chunks are asked for as [first, last] ranges, at most this many
+// per repair request; the rest go in the next round.
+#ifndef ROIDOTA_BCAST_REPAIR_RANGES
+#define ROIDOTA_BCAST_REPAIR_RANGES 16
+#endif
+
+// Receive side of a firmware broadcast: the backend publishes an image once
+// on roidota/fw/<firmwareId> for every device updating to it, as
+//
+//   <index: uint32 big-endian><chunkSize bytes, the last chunk shorter>
+//
+// and a bare 0xFFFFFFFF index when a pass (the first, or a repair) ends.
+// Chunks may come in any order and more than once. Each is written where it
+// belongs in the update partition and ticked off in a bitmap; what is still
+// missing after a pass is asked for again. State is the bitmap and one
+// pending chunk, whatever the image size.
+class RoidBroadcast {
+public:
+  static const uint32_t END_OF_PASS = 0xFFFFFFFF;
+  static const size_t HEADER_SIZE = 4;
+
+  enum Packet : uint8_t {
+    CHUNK,      // new chunk, now pending
+    DUPLICATE,  // already have it
+    BUSY,       // the pending chunk is not written yet; dropped
+    END,        // end of a pass
+    INVALID
+  };
+
+  // chunkSize must divide RoidFlash::SECTOR_SIZE and fit buffer, which
+  // holds the pending chunk. False if the image does not fit.
+  bool begin(const char* firmwareId, size_t imageSize, size_t chunkSize, uint8_t* buffer, size_t bufferSize);
+  void end();
+  bool active() const;
+
+  const char* firmwareId() const;
+  // roidota/fw/<firmwareId>
+  const char* topic() const;
+
+  // Checks a message from the topic and copies a new chunk into the buffer.
+  Packet accept(const uint8_t* payload, size_t length);
+
+  // The pending chunk, to be written at offset. fresh is true if it is the
+  // first chunk of its flash sector, which must be erased first.
+  bool pending(size_t& offset, const uint8_t*& data, size_t& length, bool& fresh) const;
+  // The pending chunk is on flash
+  void written();
+  // The pending chunk could not be written; it stays missing
+  void discard();
+
+  bool complete() const;
+  uint32_t chunks() const;
+  uint32_t received() const;
+  size_t imageSize() const;
+
+  // Missing chunks as up to maxRanges [first, last] pairs, lowest first;
+  // returns the number of pairs.
+  size_t missingRanges(uint32_t (*ranges)[2], size_t maxRanges) const;
+
+private:
+  bool has(uint32_t index) const;
+  size_t chunkLength(uint32_t index) const;
+
+  bool running = false;
+  char id[ROIDOTA_BCAST_ID_SIZE + 1] = "";
+  char topicName[11 + ROIDOTA_BCAST_ID_SIZE + 1] = "";
+  size_t size = 0;
+  size_t chunkSize = 0;
+  uint32_t chunkCount = 0;
+  uint32_t receivedCount = 0;
+  uint8_t* buffer = nullptr;
+  size_t bufferSize = 0;
+  bool hasPending = false;
+  uint32_t pendingIndex = 0;
+  uint8_t bitmap[(ROIDOTA_BCAST_MAX_CHUNKS + 7) / 8];
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "RoidDelta.h"
+
+static const uint8_t RDP_OP_END = 0x00;
+static const uint8_t RDP_OP_COPY = 0x01;
+static const uint8_t RDP_OP_LITERAL = 0x02;
+
+static uint32_t readLe32(const uint8_t* p) {
+  return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void RoidDelta::begin(SourceReader sourceReader, size_t size, OutputWriter outputWriter) {
+  reader = sourceReader;
+  writer = outputWriter;
+  sourceSize = size;
+  state = State::HEADER;
+  headerLen = 0;
+  target = 0;
+  out = 0;
+  varValue = 0;
+  varShift = 0;
+  copyOffset = 0;
+  copyRemaining = 0;
+  lastSourceEnd = 0;
+  literalRemaining = 0;
+  errorMessage = nullptr;
+}
+
+size_t RoidDelta::feed(const uint8_t* data, size_t len) {
+  size_t i = 0;
+
+  while (i < len) {
+    switch (state) {
+      case State::HEADER:
+        header[headerLen++] = data[i++];
+        if (headerLen == sizeof(header)) {
+          if (memcmp(header, "RDP1", 4) != 0) {
+            fail("Bad patch magic");
+            return i;
+          }
+          if (readLe32(header + 4) != sourceSize) {
+            fail("Patch base size mismatch");
+            return i;
+          }
+          target = readLe32(header + 8);
+          state = State::OP;
+        }
+        break;
+
+      case State::OP: {
+        uint8_t op = data[i++];
+        varValue = 0;
+        varShift = 0;
+        if (op == RDP_OP_END) {
+          if (out != target) {
+            fail("Patch output size mismatch");
+            return i;
+          }
+          state = State::DONE;
+        } else if (op == RDP_OP_COPY) {
+          state = State::COPY_OFFSET;
+        } else if (op == RDP_OP_LITERAL) {
+          state = State::LITERAL_LENGTH;
+        } else {
+          fail("Unknown patch op");
+          return i;
+        }
+        break;
+      }
+
+      case State::COPY_OFFSET:
+        if (takeVarint(data[i++])) {
+          // zigzag-decoded signed distance from the end of the last copy
+          int64_t delta = (int64_t)(varValue >> 1) ^ -(int64_t)(varValue & 1);
+          int64_t offset = (int64_t)lastSourceEnd + delta;
+          if (offset < 0 || (uint64_t)offset > sourceSize) {
+            fail("Patch copy offset out of range");
+            return i;
+          }
+          copyOffset = (size_t)offset;
+          varValue = 0;
+          varShift = 0;
+          state = State::COPY_LENGTH;
+        }
+        if (state == State::FAILED) return i;
+        break;
+
+      case State::COPY_LENGTH:
+        if (takeVarint(data[i++])) {
+          if (copyOffset + varValue > sourceSize || out + varValue > target) {
+            fail("Patch copy length out of range");
+            return i;
+          }
+          copyRemaining = (size_t)varValue;
+          lastSourceEnd = copyOffset + copyRemaining;
+          state = copyRemaining > 0 ? State::COPYING : State::OP;
+          if (state == State::COPYING) return i;
+        }
+        if (state == State::FAILED) return i;
+        break;
+
+      case State::LITERAL_LENGTH:
+        if (takeVarint(data[i++])) {
+          if (out + varValue > target) {
+            fail("Patch literal length out of range");
+            return i;
+          }
+          literalRemaining = (size_t)varValue;
+          state = literalRemaining > 0 ? State::LITERAL : State::OP;
+        }
+        if (state == State::FAILED) return i;
+        break;
+
+      case State::LITERAL: {
+        size_t n = min(literalRemaining, len - i);
+        if (!writer(data + i, n)) {
+          fail("Patch output write failed");
+          return i;
+        }
+        i += n;
+        out += n;
+        literalRemaining -= n;
+        if (literalRemaining == 0) state = State::OP;
+        break;
+      }
+
+      case State::COPYING:
+        return i;
+
+      case State::DONE:
+        fail("Trailing data after patch end");
+        return i;
+
+      case State::FAILED:
+      default:
+        return i;
+    }
+  }
+
+  return i;
+}
+
+size_t RoidDelta::pump(size_t maxBytes) {
+  size_t emitted = 0;
+
+  while (state == State::COPYING && emitted < maxBytes) {
+    size_t n = min(copyRemaining, sizeof(copyBuffer));
+    n = min(n, maxBytes - emitted);
+
+    if (!reader(copyOffset, copyBuffer, n)) {
+      fail("Patch source read failed");
+      break;
+    }
+    if (!writer(copyBuffer, n)) {
+      fail("Patch output write failed");
+      break;
+    }
+
+    copyOffset += n;
+    copyRemaining -= n;
+    out += n;
+    emitted += n;
+    if (copyRemaining == 0) state = State::OP;
+  }
+
+  return emitted;
+}
+
+bool RoidDelta::takeVarint(uint8_t b) {
+  if (varShift > 56) {
+    fail("Patch varint too long");
+    return false;
+  }
+  varValue |= (uint64_t)(b & 0x7F) << varShift;
+  varShift += 7;
+  return (b & 0x80) == 0;
+}
+
+void RoidDelta::fail(const char* message) {
+  state = State::FAILED;
+  errorMessage = message;
+}
+
+bool RoidDelta::copyPending() const {
+  return state == State::COPYING;
+}
+
+bool RoidDelta::headerParsed() const {
+  return headerLen == sizeof(header) && state != State::HEADER;
+}
+
+bool RoidDelta::finished() const {
+  return state == State::DONE;
+}
+
+bool RoidDelta::failed() const {
+  return state == State::FAILED;
+}
+
+const char* RoidDelta::error() const {
+  return errorMessage ? errorMessage : "";
+}
+
+uint32_t RoidDelta::targetSize() const {
+  return target;
+}
+
+size_t RoidDelta::produced() const {
+  return out;
+}
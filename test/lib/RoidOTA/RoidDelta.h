@@ -0,0 +1,81 @@
+#ifndef ROIDDELTA_H
+#define ROIDDELTA_H
+
+#include <Arduino.h>
+
+#ifndef ROIDOTA_DELTA_COPY_BUFFER
+#define ROIDOTA_DELTA_COPY_BUFFER 512
+#endif
+
+// Streaming applier for RDP1 binary patches produced by the backend.
+//
+// Patch layout (little-endian):
+//   "RDP1" | u32 sourceSize | u32 targetSize | ops... | 0x00
+//   0x01 COPY    zigzag-varint offset delta from the end of the previous copy,
+//                varint length; bytes come from the source image
+//   0x02 LITERAL varint length, followed by that many bytes
+//
+// Patch bytes are pushed through feed() in whatever chunks the transport
+// delivers. A COPY is never emitted in one go: feed() stops consuming and
+// the caller drains it with pump(), so output per call stays bounded.
+class RoidDelta {
+public:
+  typedef bool (*SourceReader)(size_t offset, uint8_t* dst, size_t len);
+  typedef bool (*OutputWriter)(const uint8_t* data, size_t len);
+
+  void begin(SourceReader reader, size_t sourceSize, OutputWriter writer);
+
+  // Returns the number of patch bytes consumed; fewer than len when a copy
+  // is pending or the patch failed.
+  size_t feed(const uint8_t* data, size_t len);
+
+  // Emits up to maxBytes of a pending copy; returns the bytes emitted.
+  size_t pump(size_t maxBytes);
+
+  bool copyPending() const;
+  bool headerParsed() const;
+  bool finished() const;
+  bool failed() const;
+  const char* error() const;
+  uint32_t targetSize() const;
+  size_t produced() const;
+
+private:
+  enum class State : uint8_t {
+    HEADER,
+    OP,
+    COPY_OFFSET,
+    COPY_LENGTH,
+    COPYING,
+    LITERAL_LENGTH,
+    LITERAL,
+    DONE,
+    FAILED
+  };
+
+  bool takeVarint(uint8_t b);
+  void fail(const char* message);
+
+  SourceReader reader = nullptr;
+  OutputWriter writer = nullptr;
+  size_t sourceSize = 0;
+
+  State state = State::HEADER;
+  uint8_t header[12];
+  uint8_t headerLen = 0;
+  uint32_t target = 0;
+  size_t out = 0;
+
+  uint64_t varValue = 0;
+  uint8_t varShift = 0;
+
+  size_t copyOffset = 0;
+  size_t copyRemaining = 0;
+  size_t lastSourceEnd = 0;
+  size_t literalRemaining = 0;
+  const char* errorMessage = nullptr;
+
+  uint8_t copyBuffer[ROIDOTA_DELTA_COPY_BUFFER];
+};
+
+#endif
@@ -0,0 +1,2059 @@
+#include "RoidDevice.h"
+
+// FNV-1a over s, up to NUL or stop
+static uint32_t fnv1a(const char* s, char stop = '\0') {
+  uint32_t hash = 2166136261u;
+  for (; *s && *s != stop; ++s) {
+    hash = (hash ^ (uint8_t)*s) * 16777619u;
+  }
+  return hash;
+}
+
+thread_local RoidDevice* RoidDevice::current = nullptr;
+
+RoidDevice::RoidDevice() : mqttClient(espClient), brokerHost(MQTT_SERVER), heartbeat(HEARTBEAT_INTERVAL) {}
+
+RoidStatus RoidDevice::status() {
+  return currentStatus;
+}
+
+const char* RoidDevice::statusStr() {
+  switch (currentStatus) {
+    case RoidStatus::BOOTING: return "BOOTING";
+    case RoidStatus::WIFI_CONNECTED: return "WIFI_CONNECTED";
+    case RoidStatus::MqTT_CONNECTED: return "MQTT_CONNECTED";
+    case RoidStatus::UPDATING: return "UPDATING";
+    case RoidStatus::ERROR: return "ERROR";
+    default: return "UNKNOWN";
+  }
+}
+
+void RoidDevice::setStatus(RoidStatus newStatus) {
+  if (newStatus == currentStatus) return;
+  RoidStatus oldStatus = currentStatus;
+  currentStatus = newStatus;
+
+  char buf[128];
+  snprintf(buf, sizeof(buf), "Status changed: %s -> %s", getStatusStr(oldStatus), statusStr());
+  sendLog("INFO", buf);
+  Serial.println(buf);
+}
+
+const char* RoidDevice::getStatusStr(RoidStatus s) {
+  switch (s) {
+    case RoidStatus::BOOTING: return "BOOTING";
+    case RoidStatus::WIFI_CONNECTED: return "WIFI_CONNECTED";
+    case RoidStatus::MqTT_CONNECTED: return "MQTT_CONNECTED";
+    case RoidStatus::UPDATING: return "UPDATING";
+    case RoidStatus::ERROR: return "ERROR";
+    default: return "UNKNOWN";
+  }
+}
+
+PubSubClient& RoidDevice::mqtt() {
+  return mqttClient;
+}
+
+// ========== begin() ==========
+void RoidDevice::begin(const char* id, UserFunction setupFn, UserFunction loopFn) {
+  begin(id, "", "", setupFn, loopFn);
+}
+
+void RoidDevice::begin(const char* id, const char* username, const char* password, UserFunction setupFn, UserFunction loopFn) {
+  current = this;
+  deviceId = id;
+  mqttUsername = username;
+  mqttPassword = password;
+  userSetup = setupFn;
+  userLoop = loopFn;
+  bootTime = millis();
+
+  if (strlen(deviceId) > ROIDOTA_MAX_DEVICE_ID) {
+    Serial.begin(115200);
+    Serial.printf("[RoidOTA] Device ID '%s' is longer than ROIDOTA_MAX_DEVICE_ID (%d)\n",
+                  deviceId, ROIDOTA_MAX_DEVICE_ID);
+    setStatus(RoidStatus::ERROR);
+    return;
+  }
+
+  snprintf(topicStatus, sizeof(topicStatus), "roidota/status/%s", deviceId);
+  snprintf(topicResponse, sizeof(topicResponse), "roidota/response/%s", deviceId);
+  snprintf(topicCmd, sizeof(topicCmd), "roidota/cmd/%s", deviceId);
+  snprintf(topicAck, sizeof(topicAck), "roidota/ack/%s", deviceId);
+  snprintf(topicLogs, sizeof(topicLogs), "roidota/logs/%s", deviceId);
+  snprintf(topicChunk, sizeof(topicChunk), "roidota/chunk/%s", deviceId);
+  topicResponseLen = strlen(topicResponse);
+  topicCmdLen = strlen(topicCmd);
+  router.add(topicResponse, [](const char*, const byte* payload, unsigned int length) {
+    current->handleOtaResponse(payload, length);
+  });
+  router.add(topicCmd, [](const char*, const byte* payload, unsigned int length) {
+    current->handleCommand(payload, length);
+  });
+
+  // FNV-1a of the device id seeds the jitter generator, so devices that
+  // boot or lose the broker together still spread their retries.
+  backoff.seed(fnv1a(deviceId));
+  heartbeat.setPhase(backoff.state());
+  bool warm = sleepInterval > 0 && RoidSleep::wake();
+  if (warm && RoidSleep::jitter() != 0) backoff.seed(RoidSleep::jitter());
+
+  // ACKs queued right before a restart, e.g. the OTA success ACK, go out
+  // once the broker is back, numbered on from before it. After a cold boot
+  // numbering starts somewhere random, as a fixed start would repeat the
+  // sequence numbers the backend saw before the power cycle.
+  outbox.seed((uint16_t)esp_random());
+  size_t restored = outbox.restore(millis());
+
+  Serial.begin(115200);
+  Serial.printf("[RoidOTA] Booting device: %s\n", deviceId);
+  if (restored > 0) Serial.printf("[RoidOTA] %u ACK(s) from before the restart queued\n", (unsigned)restored);
+
+  if (sleepInterval > 0) {
+    sleepRadio = RoidSleep::radioDue();
+    Serial.printf("[RoidOTA] Wake %lu%s\n", (unsigned long)RoidSleep::wakes(),
+                  sleepRadio ? "" : ", radio off after failed wakes");
+    if (!sleepRadio) {
+      if (userSetup) userSetup();
+      return;
+    }
+  }
+
+  if (isVirtual()) {
+    // The host has the network up. Every virtual device is its own site,
+    // so the backend never holds a rollout back for LAN peers.
+    lanId = fnv1a(deviceId);
+    setStatus(RoidStatus::WIFI_CONNECTED);
+  } else if (!connectWiFi()) {
+    // A wake that cannot get on the network just goes back to sleep
+    if (userSetup) userSetup();
+    return;
+  }
+  // Only an always-on device is around to serve its image
+  if (sleepInterval == 0 && peer.begin(peerPort)) {
+    Serial.printf("[RoidOTA] Serving firmware %.8s to LAN peers on port %u\n", peer.sha256(), peer.port());
+  }
+  Serial.println(brokerHost);
+  mqttClient.setServer(brokerHost, brokerPort);
+  mqttClient.setCallback([this](char* topic, byte* payload, unsigned int length) {
+    callback(topic, payload, length);
+  });
+  mqttClient.setBufferSize(ROIDOTA_MQTT_BUFFER_SIZE);
+  mqttClient.setSocketTimeout(ROIDOTA_MQTT_SOCKET_TIMEOUT_S);
+
+  // One attempt only; if the broker is down, handle() keeps retrying
+  // with backoff instead of blocking here.
+  lastReconnect = millis();
+  if (!connectMQTT()) {
+    scheduleReconnect();
+  }
+
+  if (userSetup) userSetup();
+}
+
+
+void RoidDevice::handle() {
+  // begin() refused the device ID, or a virtual device has restarted
+  if (topicStatus[0] == '\0' || stopped) return;
+  current = this;
+
+  uint32_t start = micros();
+  {
+    RoidMemStats::Scope scope;
+    service();
+  }
+
+  uint32_t userStart = micros();
+  if (userLoop) userLoop();
+  scheduler.run(millis());
+  profiler.record(RoidProfiler::USER, micros() - userStart);
+  profiler.record(RoidProfiler::TOTAL, micros() - start);
+
+  if (sleepInterval > 0 && wakeDone()) goToSleep();
+}
+
+// Each phase is timed into its own histogram; the cost is a micros() call
+// and a bucket increment per phase, cheap enough to leave on.
+void RoidDevice::service() {
+  uint32_t start = micros();
+  // A sleeping device does not chase the broker; the wake just ends
+  if (!mqttClient.connected() && sleepInterval == 0) {
+    if (currentStatus == RoidStatus::MqTT_CONNECTED) {
+      setStatus(RoidStatus::WIFI_CONNECTED); 
+      lastReconnect = millis();
+      reconnectWait = backoff.first();
+    }
+    reconnectMQTT();
+  }
+  mqttClient.loop();
+  uint32_t now = micros();
+  profiler.record(RoidProfiler::MQTT, now - start);
+
+  // Serving peers counts as OTA work too
+  if (otaCurrentState != OtaState::IDLE || peer.listening()) {
+    start = now;
+    if (otaCurrentState != OtaState::IDLE) otaStep();
+    peer.poll(millis());
+    now = micros();
+    profiler.record(RoidProfiler::OTA, now - start);
+  }
+
+  start = now;
+  char stall[64];
+  if (profiler.stallReport(millis(), stall, sizeof(stall))) {
+    sendLog("WARN", stall);
+  }
+  if (scheduler.overrunReport(millis(), ROIDOTA_PROFILE_STALL_REPORT_MS, stall, sizeof(stall))) {
+    sendLog("WARN", stall);
+  }
+
+  // Outbound traffic goes in priority order: queued ACKs and command
+  // replies, then heartbeats, then logs. Once a publish fails the socket is
+  // backed up, and the lower priorities wait for the next call.
+  bool clear = !mqttClient.connected() || outbox.drain(millis(), publishCurrent);
+
+  // A wake's report stands in for the announce and the heartbeats
+  if (sleepInterval > 0) {
+    if (clear && !wakeReported && mqttClient.connected()) {
+      clear = wakeReported = sendWakeReport();
+      wakeListenFrom = millis();
+    }
+  } else if (clear && announcePending && millis() - connectedAt >= announceDelay) {
+    sendAnnounce();
+  }
+
+  if (clear && sleepInterval == 0 && !announcePending && heartbeat.due(millis())) {
+    clear = sendHeartbeat();
+    heartbeat.advance(millis());
+  }
+
+  if (clear && logBuffer.due(millis())) {
+    flushLogs();
+  }
+  profiler.record(RoidProfiler::TELEMETRY, micros() - start);
+}
+
+// ========== WiFi ==========
+// A restart rejoins the access point it was on, straight to its channel
+// and BSSID; the portal only comes up once that has failed and WiFiManager's
+// own attempt with the saved credentials has too. A sleeping device only
+// opens the portal on its first wake after power-up, and otherwise gives
+// up until the next one.
+bool RoidDevice::connectWiFi() {
+  radioOnAt = millis();
+  RoidWiFi::watchAssociation();
+  bool leaseReused = false;
+  bootPhases.fast = RoidWiFi::fastConnect(ROIDOTA_WIFI_FAST_TIMEOUT_MS, leaseReused);
+
+  if (!bootPhases.fast) {
+    WiFiManager wm;
+    wm.setTitle(deviceId);
+    char apName[8 + ROIDOTA_MAX_DEVICE_ID + 1];
+    snprintf(apName, sizeof(apName), "RoidOTA-%s", deviceId);
+    IPAddress ip, gateway, subnet, dns;
+    if (RoidWiFi::staticIp(ip, gateway, subnet, dns)) {
+      wm.setSTAStaticIPConfig(ip, gateway, subnet, dns);
+    }
+    bool portal = sleepInterval == 0 || RoidSleep::wakes() <= 1;
+    wm.setEnableConfigPortal(portal);
+
+    if (!wm.autoConnect(apName)) {
+      if (!portal) {
+        Serial.println("[RoidOTA] WiFi connection failed, sleeping");
+        return false;
+      }
+      Serial.println("[RoidOTA] WiFi connection failed. Restarting...");
+      setStatus(RoidStatus::ERROR);
+      delay(3000);
+      ESP.restart();
+    }
+  }
+
+  RoidWiFi::remember(leaseReused);
+  lanId = RoidWiFi::networkId();
+  bootPhases.leaseReused = leaseReused;
+  bootPhases.dhcpMs = millis() - bootTime;
+  unsigned long associated = RoidWiFi::associatedAt();
+  bootPhases.wifiMs = associated != 0 ? associated - bootTime : bootPhases.dhcpMs;
+
+  Serial.printf("[RoidOTA] WiFi connected%s in %lu ms.\n", bootPhases.fast ? " (cached AP)" : "",
+                (unsigned long)bootPhases.dhcpMs);
+  char ip[16];
+  Serial.printf("[RoidOTA] IP: %s\n", localIp(ip, sizeof(ip)));
+  
+  setStatus(RoidStatus::WIFI_CONNECTED);
+  return true;
+}
+
+void RoidDevice::setStaticIp(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns) {
+  RoidWiFi::setStaticIp(ip, gateway, subnet, dns);
+}
+
+const RoidWiFi::BootTimes& RoidDevice::bootTimes() {
+  return bootPhases;
+}
+
+// ========== MQTT ==========
+void RoidDevice::setPeerPort(uint16_t port) {
+  peerPort = port;
+}
+
+void RoidDevice::setBroker(const char* host, uint16_t port) {
+  brokerHost = host;
+  brokerPort = port;
+}
+
+// Nothing of it outlives a restart on the host: RTC memory is one per
+// process, and so is the peer port.
+void RoidDevice::setVirtual(RoidRestartHandler onRestart) {
+  virtualRestart = onRestart;
+  peerPort = 0;
+  outbox.setMirrored(false);
+}
+
+bool RoidDevice::isVirtual() const {
+  return virtualRestart != nullptr;
+}
+
+// A virtual device stops as a chip would, dropping its connection without
+// a DISCONNECT, and leaves the rest to the host.
+void RoidDevice::restart() {
+  if (!isVirtual()) ESP.restart();
+  espClient.stop();
+  otaHttp.end();
+  stopped = true;
+  virtualRestart(*this);
+}
+
+void RoidDevice::setReconnectBackoff(unsigned long baseMs, unsigned long capMs) {
+  backoff.configure(baseMs, capMs);
+}
+
+void RoidDevice::setBinaryWire(bool offer) {
+  wireOffered = offer;
+  if (!offer) wirePacked = false;
+}
+
+bool RoidDevice::binaryWire() {
+  return wirePacked;
+}
+
+// Single connection attempt. Blocking is bounded by the TCP connect and
+// ROIDOTA_MQTT_SOCKET_TIMEOUT_S; retries are paced by reconnectMQTT().
+bool RoidDevice::connectMQTT() {
+  Serial.println("[RoidOTA] Attempting MQTT connection...");
+
+  // Connect with credentials if available, otherwise without. A sleeping
+  // device keeps its session, so the broker holds QoS 1 messages for it
+  // between wakes.
+  bool cleanSession = sleepInterval == 0;
+  bool connected = false;
+  if (strlen(mqttUsername) > 0 && strlen(mqttPassword) > 0) {
+    Serial.println("[RoidOTA] Connecting with authentication...");
+    connected = mqttClient.connect(deviceId, mqttUsername, mqttPassword, nullptr, 0, false, nullptr, cleanSession);
+  } else {
+    Serial.println("[RoidOTA] Connecting without authentication...");
+    connected = mqttClient.connect(deviceId, nullptr, nullptr, nullptr, 0, false, nullptr, cleanSession);
+  }
+
+  Serial.printf("[RoidOTA] Connection attempt result: %s\n", connected ? "SUCCESS" : "FAILED");
+
+  if (!connected) {
+    int state = mqttClient.state();
+    Serial.printf("[RoidOTA] MQTT connect failed, client state: %d\n", state);
+
+    // Decode MQTT client state
+    switch(state) {
+      case -4: Serial.println("[RoidOTA] MQTT_CONNECTION_TIMEOUT"); break;
+      case -3: Serial.println("[RoidOTA] MQTT_CONNECTION_LOST"); break;
+      case -2: Serial.println("[RoidOTA] MQTT_CONNECT_FAILED"); break;
+      case -1: Serial.println("[RoidOTA] MQTT_DISCONNECTED"); break;
+      case 1: Serial.println("[RoidOTA] MQTT_CONNECT_BAD_PROTOCOL"); break;
+      case 2: Serial.println("[RoidOTA] MQTT_CONNECT_BAD_CLIENT_ID"); break;
+      case 3: Serial.println("[RoidOTA] MQTT_CONNECT_UNAVAILABLE"); break;
+      case 4: Serial.println("[RoidOTA] MQTT_CONNECT_BAD_CREDENTIALS"); break;
+      case 5: Serial.println("[RoidOTA] MQTT_CONNECT_UNAUTHORIZED"); break;
+      default: Serial.printf("[RoidOTA] Unknown state: %d\n", state); break;
+    }
+
+    if (currentStatus != RoidStatus::UPDATING) {
+      setStatus(RoidStatus::ERROR);
+    }
+    return false;
+  }
+
+  Serial.printf("[RoidOTA] MQTT connected successfully as %s\n", deviceId);
+  if (bootPhases.mqttMs == 0) bootPhases.mqttMs = millis() - bootTime;
+  wirePacked = false;
+  Serial.printf("[RoidOTA] Client state: %d\n", mqttClient.state());
+
+  // Our own topics and every filter registered with on(), so user
+  // subscriptions survive a reconnect too. A kept session has them already.
+  if (sleepInterval == 0 || RoidSleep::subscribeDue()) {
+    for (size_t i = 0; i < router.count(); ++i) {
+      bool subscribed = mqttClient.subscribe(router.filter(i), subscribeQos());
+      Serial.printf("[RoidOTA] Subscribing to '%s': %s\n", router.filter(i), subscribed ? "SUCCESS" : "FAILED");
+    }
+    if (sleepInterval > 0) RoidSleep::subscribed();
+  }
+  if (bootPhases.subscribeMs == 0) bootPhases.subscribeMs = millis() - bootTime;
+
+  backoff.reset();
+  reconnectWait = 0;
+  outbox.retryNow(millis());
+
+  // Defer the OTA request + heartbeat burst to a per-device offset
+  connectedAt = millis();
+  announceDelay = nextJitter() % ROIDOTA_ANNOUNCE_SPREAD_MS;
+  announcePending = true;
+
+  if (currentStatus != RoidStatus::UPDATING) {
+    setStatus(RoidStatus::MqTT_CONNECTED);
+  }
+
+  if (sleepInterval > 0) {
+    Serial.printf("[RoidOTA] MQTT setup complete for device %s, reporting wake\n", deviceId);
+  } else {
+    Serial.printf("[RoidOTA] MQTT setup complete for device %s, announcing in %lu ms\n", deviceId, announceDelay);
+  }
+  return true;
+}
+
+void RoidDevice::reconnectMQTT() {
+  if (millis() - lastReconnect < reconnectWait) return;
+  lastReconnect = millis();
+
+  if (WiFi.status() != WL_CONNECTED) {
+    Serial.println("[RoidOTA] WiFi not connected, postponing MQTT reconnect");
+    scheduleReconnect();
+    return;
+  }
+
+  if (!connectMQTT()) {
+    scheduleReconnect();
+  }
+}
+
+void RoidDevice::scheduleReconnect() {
+  reconnectWait = backoff.next();
+  Serial.printf("[RoidOTA] Retrying MQTT connection in %lu ms (attempt %u)\n", reconnectWait, backoff.attempts());
+}
+
+void RoidDevice::sendAnnounce() {
+  announcePending = false;
+
+  // A flapping link would otherwise re-request the firmware on every
+  // reconnect; the regular heartbeat schedule still applies.
+  if (!announcedOnce || millis() - lastAnnounce >= ROIDOTA_ANNOUNCE_MIN_INTERVAL_MS) {
+    Serial.println("[RoidOTA] Sending OTA request...");
+    sendOtaRequest();
+    announcedOnce = true;
+    lastAnnounce = millis();
+  }
+
+  // The backend may have lost its view of us; start with a keyframe
+  Serial.println("[RoidOTA] Sending heartbeat...");
+  heartbeat.requestKeyframe();
+  sendHeartbeat();
+  heartbeat.schedule(millis());
+}
+
+void RoidDevice::setHeartbeat(unsigned long intervalMs, uint8_t keyframeEvery) {
+  heartbeat.configure(intervalMs, keyframeEvery, millis());
+}
+
+uint32_t RoidDevice::nextJitter() {
+  return backoff.jitter();
+}
+
+// ========== MQTT Callback ==========
+void RoidDevice::callback(char* topic, byte* payload, unsigned int length) {
+  RoidMemStats::Scope scope;
+  current = this;
+  // Anything arriving during a wake may be the start of a conversation
+  wakeListenFrom = millis();
+  if (router.dispatch(topic, payload, length) == 0) {
+    Serial.printf("[RoidOTA] No handler for '%s' (%u bytes)\n", topic, length);
+  }
+}
+
+bool RoidDevice::on(const char* filter, RoidTopicHandler handler) {
+  if (!router.add(filter, handler)) {
+    Serial.printf("[RoidOTA] Cannot route '%s'\n", filter);
+    return false;
+  }
+  if (mqttClient.connected()) mqttClient.subscribe(filter, subscribeQos());
+  return true;
+}
+
+bool RoidDevice::off(const char* filter) {
+  if (!router.remove(filter)) return false;
+  if (mqttClient.connected()) mqttClient.unsubscribe(filter);
+  return true;
+}
+
+bool RoidDevice::isRoidTopic(const char* topic) {
+  return strncmp(topic, "roidota/", 8) == 0;
+}
+
+// For sketches that install their own PubSubClient callback; with on()
+// this is not needed. Dispatch works directly on the topic and payload
+// PubSubClient hands us: topics are matched by precomputed length first,
+// and payloads are parsed into stack documents, so no message touches the
+// heap.
+void RoidDevice::handleInternalMessage(const char* topic, const byte* payload, unsigned int len) {
+  current = this;
+  size_t topicLen = strlen(topic);
+
+  if (topicMatches(topic, topicLen, topicResponse, topicResponseLen)) {
+    handleOtaResponse(payload, len);
+  } else if (topicMatches(topic, topicLen, topicCmd, topicCmdLen)) {
+    handleCommand(payload, len);
+  } else {
+    Serial.printf("[RoidOTA] No handler for topic: %s\n", topic);
+  }
+}
+
+bool RoidDevice::topicMatches(const char* topic, size_t topicLen, const char* expected, size_t expectedLen) {
+  return topicLen == expectedLen && memcmp(topic, expected, expectedLen) == 0;
+}
+
+// ========== OTA ==========
+void RoidDevice::sendOtaRequest() {
+  char ip[16];
+  char lan[9];
+  StaticJsonDocument<384> doc;
+  doc["device_id"] = deviceId; 
+  doc["ip"] = localIp(ip, sizeof(ip));
+  doc["timestamp"] = millis();
+  doc["status"] = statusStr();
+  // The request topic is shared, so it stays JSON and carries the offer.
+  if (wireOffered) doc["wire"] = "msgpack";
+  // Devices with the same "lan" can fetch firmware from each other; a
+  // "peer" serves the image with this digest.
+  snprintf(lan, sizeof(lan), "%08lx", (unsigned long)lanId);
+  doc["lan"] = lan;
+  if (peer.listening()) {
+    JsonObject serving = doc.createNestedObject("peer");
+    serving["port"] = peer.port();
+    serving["sha256"] = peer.sha256();
+    serving["size"] = peer.imageSize();
+    serving["slots"] = peer.slots();
+  }
+
+  char buffer[384];
+  if (measureJson(doc) >= sizeof(buffer)) {
+    Serial.println("[RoidOTA] OTA request too large, not sent");
+    return;
+  }
+  serializeJson(doc, buffer);
+  mqttClient.publish("roidota/request", buffer);
+}
+
+void RoidDevice::handleOtaResponse(const byte* payload, unsigned int length) {
+  StaticJsonDocument<ROIDOTA_RESPONSE_DOC_SIZE> doc;
+  
+  DeserializationError error = deserializeJson(doc, payload, length);
+  
+  Serial.printf("[RoidOTA] OTA response received: %.*s\n", (int)length, (const char*)payload);
+  if (error) {
+    Serial.printf("[RoidOTA] JSON parse failed: %s\n", error.c_str());
+    sendLog("ERROR", "Failed to parse OTA response");
+    sendOtaAck(false, "JSON parse error");
+    setStatus(RoidStatus::ERROR);
+    return;
+  }
+  
+  if (doc.containsKey("firmware_url")) {
+    const char* firmwareUrl = doc["firmware_url"];
+    
+    if (firmwareUrl && strcmp(firmwareUrl, "null") != 0 && firmwareUrl[0] != '\0') {
+      OtaOffer offer;
+      offer.firmwareUrl = firmwareUrl;
+      // A patch is only offered when the backend knows our current firmware;
+      // the full image URL always stays available as the fallback.
+      offer.patchUrl = doc["patch_url"] | "";
+      offer.patchBaseMd5 = doc["patch_base_md5"] | "";
+      offer.compressedUrl = doc["compressed_url"] | "";
+      offer.firmwareSize = doc["firmware_size"] | 0;
+      offer.sha256 = doc["sha256"] | "";
+      offer.signature = doc["signature"] | "";
+      offer.peerCount = 0;
+      for (JsonVariant url : doc["peer_urls"].as<JsonArray>()) {
+        if (offer.peerCount == ROIDOTA_PEER_MAX_OFFERS) break;
+        if (url.is<const char*>()) offer.peerUrls[offer.peerCount++] = url.as<const char*>();
+      }
+      offer.broadcastId = doc["broadcast"]["id"] | "";
+      offer.broadcastChunkSize = doc["broadcast"]["chunk_size"] | 0;
+      offer.broadcastSize = doc["broadcast"]["size"] | 0;
+      offer.firmwareId = doc["firmware_id"] | "";
+      offer.mqttTransport = doc["mqtt_transport"] | false;
+
+      // The compressed image is only usable if it was encoded with the same
+      // window the decoder was built with.
+      const char* compression = doc["compression"] | "";
+      int window = doc["compression_window"] | 0;
+      int lookahead = doc["compression_lookahead"] | 0;
+      if (strcmp(compression, "heatshrink") != 0 ||
+          window != ROIDOTA_HS_WINDOW_BITS || lookahead != ROIDOTA_HS_LOOKAHEAD_BITS) {
+        offer.compressedUrl = "";
+      }
+
+      startOTA(offer);
+    } else {
+      Serial.println("[RoidOTA] Invalid firmware URL received");
+      sendLog("ERROR", "Invalid firmware URL");
+      sendOtaAck(false, "Invalid firmware URL");
+      setStatus(RoidStatus::ERROR);
+    }
+  } else {
+    Serial.println("[RoidOTA] No firmware_url in response");
+    sendLog("ERROR", "No firmware URL in response");
+    sendOtaAck(false, "No firmware URL");
+    setStatus(RoidStatus::ERROR);
+  }
+}
+
+void RoidDevice::setOtaBudget(unsigned long tickBudgetMs, size_t maxBytesPerTick) {
+  otaTickBudgetMs = tickBudgetMs > 0 ? tickBudgetMs : 1;
+  otaMaxBytesPerTick = maxBytesPerTick > 0 ? maxBytesPerTick : ROIDOTA_OTA_CHUNK_SIZE;
+}
+
+void RoidDevice::setOtaTransport(bool overMqtt, uint8_t window) {
+  mqttTransport = overMqtt;
+  mqttWindow = window > 0 ? window : 1;
+}
+
+bool RoidDevice::otaInProgress() {
+  return otaCurrentState != OtaState::IDLE;
+}
+
+OtaState RoidDevice::otaState() {
+  return otaCurrentState;
+}
+
+// Queues an update; the download itself is driven by otaStep() from handle(),
+// so this returns immediately and never blocks the MQTT callback.
+void RoidDevice::startOTA(const OtaOffer& offer) {
+  if (otaInProgress()) {
+    Serial.println("[RoidOTA] OTA already in progress, ignoring new request");
+    sendLog("WARN", "OTA already in progress");
+    return;
+  }
+
+  if (RoidSignature::required() && offer.signature[0] == '\0') {
+    Serial.println("[RoidOTA] Rejecting unsigned firmware");
+    sendLog("ERROR", "Unsigned firmware rejected");
+    sendOtaAck(false, "Unsigned firmware");
+    setStatus(RoidStatus::ERROR);
+    return;
+  }
+
+  const char* firmwareUrl = offer.firmwareUrl;
+  const char* patchUrl = offer.patchUrl;
+  const char* compressedUrl = offer.compressedUrl;
+
+  if (strlen(firmwareUrl) > ROIDOTA_MAX_URL_LENGTH || strlen(patchUrl) > ROIDOTA_MAX_URL_LENGTH ||
+      strlen(compressedUrl) > ROIDOTA_MAX_URL_LENGTH) {
+    Serial.println("[RoidOTA] Rejecting OTA, URL longer than ROIDOTA_MAX_URL_LENGTH");
+    sendLog("ERROR", "Firmware URL too long");
+    sendOtaAck(false, "Firmware URL too long");
+    setStatus(RoidStatus::ERROR);
+    return;
+  }
+
+  // Prefer the smallest download; each source keeps one fallback. A
+  // virtual device has no running image to patch.
+  bool compressed = compressedUrl[0] != '\0';
+  bool delta = !isVirtual() && patchUrl[0] != '\0' && strlen(offer.patchBaseMd5) == 32;
+  otaFullSize = offer.firmwareSize > 0 ? offer.firmwareSize : 0;
+  otaFallbackUrl[0] = '\0';
+  otaPatchBaseMd5[0] = '\0';
+
+  // The digest is checked whatever the source, since it covers the image
+  // as written to flash.
+  strncpy(otaSha256, offer.sha256, sizeof(otaSha256) - 1);
+  otaSha256[sizeof(otaSha256) - 1] = '\0';
+  strncpy(otaSignature, offer.signature, sizeof(otaSignature) - 1);
+  otaSignature[sizeof(otaSignature) - 1] = '\0';
+
+  // The backend names the images it serves over MQTT by firmware id, and
+  // tells the ACKs of different updates apart by it.
+  bool idFits = strlen(offer.firmwareId) < sizeof(otaFirmwareId);
+  strcpy(otaFirmwareId, idFits ? offer.firmwareId : "");
+  otaMqttOffered = mqttTransport && offer.mqttTransport && otaFirmwareId[0] != '\0';
+
+  // Presigned URLs change per request, so the image is identified by the
+  // URL path; If-Range and Content-Range catch a changed object.
+  uint32_t urlHash = fnv1a(firmwareUrl, '?');
+  bool resume = !isVirtual() && RoidFlash::loadResume(otaResume) && otaResume.urlHash == urlHash;
+  if (!resume) {
+    if (!isVirtual()) RoidFlash::clearResume();
+    memset(&otaResume, 0, sizeof(otaResume));
+    otaResume.urlHash = urlHash;
+  }
+  otaResumeOffset = resume ? otaResume.offset : 0;
+  otaRehashed = 0;
+
+  if (resume) {
+    // Finishing an interrupted download beats starting a smaller one
+    Serial.printf("[RoidOTA] Resuming OTA at %u/%u from: %s\n",
+                  (unsigned)otaResume.offset, (unsigned)otaResume.imageSize, firmwareUrl);
+    otaSource = OtaSource::FULL;
+    strcpy(otaUrl, firmwareUrl);
+  } else if (delta) {
+    Serial.printf("[RoidOTA] Starting delta OTA from: %s\n", patchUrl);
+    otaSource = OtaSource::PATCH;
+    strcpy(otaUrl, patchUrl);
+    otaFallbackSource = compressed ? OtaSource::COMPRESSED : OtaSource::FULL;
+    strcpy(otaFallbackUrl, compressed ? compressedUrl : firmwareUrl);
+    strncpy(otaPatchBaseMd5, offer.patchBaseMd5, sizeof(otaPatchBaseMd5) - 1);
+    otaPatchBaseMd5[sizeof(otaPatchBaseMd5) - 1] = '\0';
+  } else if (compressed) {
+    Serial.printf("[RoidOTA] Starting compressed OTA from: %s\n", compressedUrl);
+    otaSource = OtaSource::COMPRESSED;
+    strcpy(otaUrl, compressedUrl);
+    otaFallbackSource = OtaSource::FULL;
+    strcpy(otaFallbackUrl, firmwareUrl);
+  } else {
+    Serial.printf("[RoidOTA] Starting OTA from: %s\n", firmwareUrl);
+    otaSource = OtaSource::FULL;
+    strcpy(otaUrl, firmwareUrl);
+  }
+
+  // LAN peers go first, as full images; the digest is what makes an image
+  // from another device trustworthy, so without one they are not used.
+  otaOriginSource = otaSource;
+  otaPeerCount = 0;
+  for (uint8_t i = 0; i < offer.peerCount && otaSha256[0] != '\0'; ++i) {
+    const char* url = offer.peerUrls[i];
+    if (strncmp(url, "http://", 7) != 0 || strlen(url) >= ROIDOTA_PEER_URL_SIZE) continue;
+    strcpy(otaPeerUrls[otaPeerCount++], url);
+  }
+  otaPeer = 0;
+  if (otaPeerCount > 0) {
+    Serial.printf("[RoidOTA] Trying %u LAN peer(s) first: %s\n", otaPeerCount, otaPeerUrls[0]);
+    otaSource = OtaSource::FULL;
+  }
+
+  // A broadcast goes before everything else, as the image is on its way to
+  // the fleet anyway; the digest is what lets the device trust what it
+  // assembled. Its chunks land all over the partition, so an interrupted
+  // download is resumed instead.
+  bool joined = !resume && !isVirtual() && otaSha256[0] != '\0' && offer.broadcastId[0] != '\0' &&
+                otaJoinBroadcast(offer);
+
+  setStatus(RoidStatus::UPDATING);
+  sendLog("INFO", joined ? "Joining firmware broadcast..."
+                  : resume ? "Resuming OTA..."
+                  : delta ? "Starting delta OTA..."
+                  : compressed ? "Starting compressed OTA..." : "Starting OTA...");
+  otaSetState(joined ? OtaState::BROADCAST : OtaState::CONNECT);
+}
+
+// The chunk and its MQTT packet must fit PubSubClient's buffer, and the
+// partition writer is opened up front, since chunks come in any order.
+bool RoidDevice::otaJoinBroadcast(const OtaOffer& offer) {
+  size_t chunkSize = offer.broadcastChunkSize > 0 ? offer.broadcastChunkSize : 0;
+  size_t imageSize = offer.broadcastSize > 0 ? offer.broadcastSize : 0;
+  if (!broadcast.begin(offer.broadcastId, imageSize, chunkSize, otaBuffer, sizeof(otaBuffer))) {
+    Serial.println("[RoidOTA] Broadcast offer not usable, downloading instead");
+    return false;
+  }
+  size_t packet = 5 + 2 + strlen(broadcast.topic()) + RoidBroadcast::HEADER_SIZE + chunkSize;
+  if (packet > mqttClient.getBufferSize() || !RoidFlash::updateBegin(imageSize)) {
+    Serial.printf("[RoidOTA] Cannot take broadcast chunks: %s\n",
+                  RoidFlash::updateError()[0] ? RoidFlash::updateError() : "MQTT buffer too small");
+    RoidFlash::updateAbort();
+    broadcast.end();
+    return false;
+  }
+
+  bcastLastChunk = millis();
+  bcastRepairDue = 0;
+  bcastRepairs = 0;
+  bcastVerified = 0;
+  otaExpected = imageSize;
+  otaWritten = 0;
+  otaOutput = 0;
+  otaLastReported = -1;
+
+  router.add(broadcast.topic(), [](const char*, const byte* payload, unsigned int length) {
+    current->handleBroadcast(payload, length);
+  });
+  // QoS 0: a lost chunk is repaired like a missed one
+  mqttClient.subscribe(broadcast.topic(), 0);
+  Serial.printf("[RoidOTA] Joining broadcast %s: %u chunks of %u bytes\n", broadcast.firmwareId(),
+                (unsigned)broadcast.chunks(), (unsigned)chunkSize);
+  return true;
+}
+
+void RoidDevice::otaLeaveBroadcast() {
+  if (router.remove(broadcast.topic()) && mqttClient.connected()) {
+    mqttClient.unsubscribe(broadcast.topic());
+  }
+}
+
+// Runs in the MQTT callback, so it only copies the chunk; otaBroadcastStep()
+// writes it on the same handle() call.
+void RoidDevice::handleBroadcast(const byte* payload, unsigned int length) {
+  switch (broadcast.accept(payload, length)) {
+    case RoidBroadcast::CHUNK:
+      // Chunks we lack are being sent, maybe repaired for another device;
+      // asking for them too would only repeat them.
+      bcastLastChunk = millis();
+      bcastRepairDue = 0;
+      break;
+    case RoidBroadcast::END:
+      if (!broadcast.complete() && bcastRepairDue == 0) {
+        bcastRepairDue = millis() + 1 + nextJitter() % ROIDOTA_BCAST_REPAIR_SPREAD_MS;
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+void RoidDevice::otaBroadcastStep() {
+  size_t offset, length;
+  const uint8_t* data;
+  bool fresh;
+  if (broadcast.pending(offset, data, length, fresh)) {
+    if (!RoidFlash::updateWriteAt(offset, data, length, fresh)) {
+      broadcast.discard();
+      otaFail(RoidFlash::updateError(), "OTA failed");
+      return;
+    }
+    broadcast.written();
+    bcastRepairs = 0;
+    otaWritten += length;
+    otaLastData = millis();
+
+    int percent = (int)((uint64_t)broadcast.received() * 100 / broadcast.chunks());
+    if (percent / 10 != otaLastReported / 10) {
+      otaLastReported = percent;
+      Serial.printf("[RoidOTA] Broadcast Progress: %d%% (%u/%u chunks)\n", percent,
+                    (unsigned)broadcast.received(), (unsigned)broadcast.chunks());
+    }
+  }
+
+  // The digest is taken over the finished image, read back a slice per
+  // call, as the chunks did not come in order.
+  if (broadcast.complete()) {
+    size_t size = broadcast.imageSize();
+    if (bcastVerified == 0) {
+      otaLeaveBroadcast();
+      otaHash.begin();
+      otaHash.update(RoidFlash::updateHeader(), RoidFlash::HEADER_SIZE);
+      bcastVerified = RoidFlash::HEADER_SIZE;
+    }
+    for (size_t budget = otaMaxBytesPerTick; budget > 0 && bcastVerified < size; ) {
+      size_t n = min(min(sizeof(otaBuffer), size - bcastVerified), budget);
+      if (!RoidFlash::readUpdate(bcastVerified, otaBuffer, n)) {
+        otaFail("Flash read failed", "OTA failed");
+        return;
+      }
+      otaHash.update(otaBuffer, n);
+      bcastVerified += n;
+      budget -= n;
+    }
+    if (bcastVerified >= size) {
+      otaOutput = size;
+      otaSetState(OtaState::COMMIT);
+    }
+    return;
+  }
+
+  unsigned long now = millis();
+  if (bcastRepairDue == 0 && now - bcastLastChunk >= ROIDOTA_BCAST_IDLE_MS) {
+    bcastRepairDue = now + 1 + nextJitter() % ROIDOTA_BCAST_REPAIR_SPREAD_MS;
+  }
+  if (bcastRepairDue == 0 || (long)(now - bcastRepairDue) < 0) return;
+
+  if (bcastRepairs >= ROIDOTA_BCAST_MAX_REPAIRS) {
+    otaFail("Broadcast stalled", "OTA failed");
+    return;
+  }
+  if (sendRepair()) {
+    ++bcastRepairs;
+    bcastRepairDue = 0;
+    bcastLastChunk = now;
+  }
+}
+
+// {"device_id","firmware_id","received","missing":[[first,last],...]}, on
+// the shared request side like the OTA request itself
+bool RoidDevice::sendRepair() {
+  if (!mqttClient.connected()) return false;
+  uint32_t ranges[ROIDOTA_BCAST_REPAIR_RANGES][2];
+  size_t count = broadcast.missingRanges(ranges, ROIDOTA_BCAST_REPAIR_RANGES);
+
+  StaticJsonDocument<1024> doc;
+  doc["device_id"] = deviceId;
+  doc["firmware_id"] = broadcast.firmwareId();
+  doc["received"] = broadcast.received();
+  JsonArray missing = doc.createNestedArray("missing");
+  for (size_t i = 0; i < count; ++i) {
+    JsonArray range = missing.createNestedArray();
+    range.add(ranges[i][0]);
+    range.add(ranges[i][1]);
+  }
+
+  // serializeJson() truncates to fit, so the size is checked first
+  char buffer[128 + ROIDOTA_BCAST_REPAIR_RANGES * 24];
+  if (measureJson(doc) >= sizeof(buffer)) return false;
+  serializeJson(doc, buffer);
+  Serial.printf("[RoidOTA] Requesting repair: %u chunk(s) in %u range(s) missing\n",
+                (unsigned)(broadcast.chunks() - broadcast.received()), (unsigned)count);
+  return mqttClient.publish("roidota/repair", buffer);
+}
+
+void RoidDevice::otaSetState(OtaState next) {
+  otaCurrentState = next;
+  otaStateSince = millis();
+}
+
+void RoidDevice::otaStep() {
+  switch (otaCurrentState) {
+    case OtaState::REHASH:
+      otaRehash();
+      break;
+
+    case OtaState::CONNECT:
+      otaConnect();
+      break;
+
+    case OtaState::HEADERS: {
+      // The status line and headers are taken in as they arrive; the body
+      // is pulled chunk by chunk in the WRITE state.
+      RoidHttp::Status headers = otaHttp.poll();
+      if (headers == RoidHttp::PENDING) {
+        if ((long)(millis() - otaStateSince) >= (long)ROIDOTA_OTA_HTTP_TIMEOUT_MS) {
+          otaFail("HTTP response timeout", "Failed to fetch update");
+        }
+        return;
+      }
+      int httpCode = headers == RoidHttp::READY ? otaHttp.code() : -1;
+      if (httpCode < 200 || httpCode >= 300) {
+        Serial.printf("[RoidOTA] HTTP GET failed, code: %d\n", httpCode);
+        otaFail("HTTP GET failed", "Failed to fetch update");
+        return;
+      }
+
+      if (otaResumeOffset > 0) {
+        if (httpCode == 206 && !otaCheckContentRange()) {
+          // Some other image is behind this path now; start it from scratch.
+          Serial.println("[RoidOTA] Resume range mismatch, restarting download");
+          sendLog("WARN", "Resume rejected, restarting download");
+          otaHttp.end();
+          RoidFlash::clearResume();
+          otaResume.offset = 0;
+          otaResumeOffset = 0;
+          otaSetState(OtaState::CONNECT);
+          return;
+        }
+        if (httpCode != 206) {
+          // If-Range did not match or ranges are unsupported. The saved
+          // progress goes too, as the sectors behind it get rewritten.
+          Serial.println("[RoidOTA] Server sent the whole image, restarting download");
+          RoidFlash::clearResume();
+          otaResume.offset = 0;
+          otaResumeOffset = 0;
+        }
+      }
+
+      otaExpected = otaHttp.contentLength();
+      // Delta images learn their output size from the patch header; for a
+      // compressed image the backend reports it, if known.
+      if (otaSource == OtaSource::PATCH) {
+        otaImageSize = 0;
+      } else if (otaSource == OtaSource::COMPRESSED) {
+        otaImageSize = otaFullSize;
+      } else if (otaResumeOffset > 0) {
+        otaImageSize = otaResume.imageSize;
+      } else {
+        otaImageSize = otaExpected;
+        strncpy(otaResume.etag, otaHttp.etag(), sizeof(otaResume.etag) - 1);
+        otaResume.etag[sizeof(otaResume.etag) - 1] = '\0';
+      }
+
+      Serial.printf("[RoidOTA] OTA download started, expected=%d bytes\n", otaExpected);
+      otaLastData = millis();
+      otaSetState(OtaState::WRITE);
+      break;
+    }
+
+    case OtaState::WRITE:
+      otaWrite();
+      break;
+
+    case OtaState::BROADCAST:
+      otaBroadcastStep();
+      break;
+
+    case OtaState::FINALIZE:
+      otaFinalize();
+      break;
+
+    case OtaState::COMMIT:
+      otaCommit();
+      break;
+
+    case OtaState::REBOOT:
+      // The ACK survives the restart in the outbox; an optional delay
+      // only gives it a chance to be confirmed before we go.
+      if ((long)(millis() - otaStateSince) >= (long)ROIDOTA_OTA_REBOOT_DELAY_MS) {
+        Serial.println("[RoidOTA] Restarting now");
+        flushLogs();
+        restart();
+      }
+      break;
+
+    case OtaState::IDLE:
+    default:
+      break;
+  }
+}
+
+void RoidDevice::otaConnect() {
+  // A patch needs the running image's digest, a resumed image the digest
+  // of its part on flash; both are read back before the download opens.
+  bool rehash = otaSource == OtaSource::PATCH ? !RoidFlash::runningHashed()
+                : otaSource == OtaSource::FULL && otaResumeOffset > 0 && otaRehashed != otaResumeOffset;
+  if (rehash) {
+    otaSetState(OtaState::REHASH);
+    return;
+  }
+
+  otaExpected = 0;
+  otaWritten = 0;
+  otaImageSize = 0;
+  otaOutput = 0;
+  otaEmitError = nullptr;
+  otaBufferPos = 0;
+  otaBufferLen = 0;
+  otaLastReported = -1;
+  otaLastData = millis();
+
+  if (otaSource == OtaSource::PATCH && !RoidFlash::runningMd5Matches(otaPatchBaseMd5)) {
+    Serial.println("[RoidOTA] Running image does not match patch base, using full image");
+    sendLog("WARN", "Patch base mismatch, using full image");
+    otaTakeFallback();
+  }
+
+  if (otaSource == OtaSource::PATCH) {
+    otaDelta.begin(RoidFlash::readRunning, RoidFlash::runningSize(), emitCurrent);
+  } else if (otaSource == OtaSource::COMPRESSED) {
+    otaInflate.begin(emitCurrent);
+  }
+
+  // Peers are on the LAN; the backend's own images come over the MQTT
+  // session when it serves them there.
+  otaOverMqtt = otaMqttOffered && otaPeer >= otaPeerCount;
+  if (otaOverMqtt) {
+    otaMqttBegin();
+    return;
+  }
+
+  if (!otaHttp.begin(otaPeer < otaPeerCount ? otaPeerUrls[otaPeer] : otaUrl)) {
+    otaFail("HTTP begin failed", "Failed to fetch update");
+    return;
+  }
+  if (otaSource == OtaSource::FULL && otaResumeOffset > 0) {
+    otaHttp.setRange(otaResumeOffset, otaResume.etag);
+  }
+  // Connecting is the one step that blocks, for at most
+  // ROIDOTA_HTTP_CONNECT_TIMEOUT_MS; the response is polled for after.
+  if (!otaHttp.connect(ROIDOTA_HTTP_CONNECT_TIMEOUT_MS)) {
+    otaFail("HTTP connect failed", "Failed to fetch update");
+    return;
+  }
+  otaSetState(OtaState::HEADERS);
+}
+
+void RoidDevice::otaWrite() {
+  WiFiClient* stream = otaOverMqtt ? nullptr : otaHttp.stream();
+  if (!otaOverMqtt && !stream) {
+    otaFail("HTTP stream unavailable", "OTA failed");
+    return;
+  }
+
+  unsigned long tickStart = millis();
+  size_t moved = 0;
+
+  while (moved < otaMaxBytesPerTick && millis() - tickStart < otaTickBudgetMs) {
+    // Leave room for one step of decoder output; the flash task frees
+    // slots while we yield to the rest of the loop.
+    if (otaPipeline.active()) {
+      if (otaPipeline.failed()) {
+        otaFail(otaPipeline.error(), "OTA failed");
+        return;
+      }
+      if (otaPipeline.freeSlots() < 2) break;
+    }
+
+    // Drain a pending patch copy before accepting more input
+    if (otaSource == OtaSource::PATCH && otaDelta.copyPending()) {
+      moved += otaDelta.pump(otaMaxBytesPerTick - moved);
+      if (otaDelta.failed()) {
+        otaFail(otaEmitError ? otaEmitError : otaDelta.error(), "OTA failed");
+        return;
+      }
+      continue;
+    }
+
+    if (otaBufferPos < otaBufferLen) {
+      size_t used = otaConsume(otaBuffer + otaBufferPos, otaBufferLen - otaBufferPos);
+      if (otaCurrentState != OtaState::WRITE) return;
+      otaBufferPos += used;
+      moved += used;
+      continue;
+    }
+
+    // Over MQTT the next chunk comes with the next mqttClient.loop()
+    if (otaOverMqtt) break;
+
+    int avail = stream->available();
+    if (avail <= 0) break;
+
+    size_t want = min((size_t)avail, sizeof(otaBuffer));
+    if (otaExpected > 0) want = min(want, (size_t)otaExpected - otaWritten);
+    if (want == 0) break;
+
+    int got = stream->read(otaBuffer, want);
+    if (got <= 0) break;
+
+    otaBufferPos = 0;
+    otaBufferLen = got;
+    otaWritten += got;
+    otaLastData = millis();
+  }
+
+  bool drained = otaBufferPos >= otaBufferLen && !(otaSource == OtaSource::PATCH && otaDelta.copyPending());
+
+  if (otaExpected > 0) {
+    int percent = (int)((uint64_t)otaWritten * 100 / otaExpected);
+    if (percent / 10 != otaLastReported / 10) {
+      otaLastReported = percent;
+      Serial.printf("[RoidOTA] OTA Progress: %d%% (%zu/%d)\n", percent, otaWritten, otaExpected);
+    }
+    if (otaWritten >= (size_t)otaExpected && drained) {
+      otaSetState(OtaState::FINALIZE);
+      return;
+    }
+  }
+
+  if (otaOverMqtt) {
+    otaMqttPump(drained);
+    return;
+  }
+
+  if (drained && !otaHttp.connected() && stream->available() <= 0) {
+    if (otaExpected <= 0) {
+      // Unknown length: the server closing the connection marks the end.
+      otaSetState(OtaState::FINALIZE);
+    } else {
+      otaFail("Connection lost during download", "OTA failed");
+    }
+    return;
+  }
+
+  if (millis() - otaLastData >= ROIDOTA_OTA_STALL_TIMEOUT_MS) {
+    otaFail("OTA download stalled", "OTA failed");
+  }
+}
+
+// Subscribing ahead of the first request is enough: the broker handles
+// both in order, so no chunk goes out before the subscription is in place.
+void RoidDevice::otaMqttBegin() {
+  otaMqttWindowEnd = 0;
+  otaMqttRetries = 0;
+  otaMqttRewind = false;
+  otaMqttRestart = false;
+  otaMqttError = nullptr;
+  router.add(topicChunk, [](const char*, const byte* payload, unsigned int length) {
+    current->handleOtaChunk(payload, length);
+  });
+  // QoS 0: a lost chunk is asked for again
+  mqttClient.subscribe(topicChunk, 0);
+  Serial.printf("[RoidOTA] Downloading over MQTT, %u chunk(s) of %u bytes per window\n",
+                mqttWindow, (unsigned)otaMqttChunkSize());
+  otaSetState(OtaState::WRITE);
+}
+
+void RoidDevice::otaMqttEnd() {
+  if (!otaOverMqtt) return;
+  otaOverMqtt = false;
+  if (router.remove(topicChunk) && mqttClient.connected()) {
+    mqttClient.unsubscribe(topicChunk);
+  }
+}
+
+// Asks for the next window once the last one is written, and for the
+// current one again if it stops coming in or a chunk had to be dropped.
+void RoidDevice::otaMqttPump(bool drained) {
+  if (otaMqttError) {
+    otaFail(otaMqttError, "Failed to fetch update");
+    return;
+  }
+  if (otaMqttRestart) {
+    // Some other image is behind this firmware id now; start it from scratch.
+    Serial.println("[RoidOTA] Resume size mismatch, restarting download");
+    sendLog("WARN", "Resume rejected, restarting download");
+    RoidFlash::clearResume();
+    otaResume.offset = 0;
+    otaResumeOffset = 0;
+    otaSetState(OtaState::CONNECT);
+    return;
+  }
+  if (!drained) return;
+
+  if (otaWritten < otaMqttWindowEnd && !otaMqttRewind) {
+    if (millis() - otaMqttRequestedAt < ROIDOTA_OTA_MQTT_TIMEOUT_MS) return;
+    if (otaMqttRetries++ >= ROIDOTA_OTA_MQTT_RETRIES) {
+      otaFail("MQTT download stalled", "OTA failed");
+      return;
+    }
+    Serial.printf("[RoidOTA] No chunks for %d ms, asking again at %u\n", ROIDOTA_OTA_MQTT_TIMEOUT_MS,
+                  (unsigned)(otaResumeOffset + otaWritten));
+  }
+  otaMqttRequest();
+}
+
+// {"device_id","firmware_id","source","offset","chunk","count"}; the
+// backend answers on roidota/chunk/<device_id>.
+bool RoidDevice::otaMqttRequest() {
+  size_t chunk = otaMqttChunkSize();
+  otaMqttRequestedAt = millis();
+  otaMqttWindowEnd = otaWritten + (size_t)mqttWindow * chunk;
+  otaMqttRewind = false;
+  otaMqttSynced = false;
+  if (!mqttClient.connected()) return false;
+
+  StaticJsonDocument<384> doc;
+  doc["device_id"] = deviceId;
+  doc["firmware_id"] = otaFirmwareId;
+  doc["source"] = otaSource == OtaSource::PATCH ? "patch"
+                  : otaSource == OtaSource::COMPRESSED ? "compressed" : "full";
+  doc["offset"] = otaResumeOffset + otaWritten;
+  doc["chunk"] = chunk;
+  doc["count"] = mqttWindow;
+
+  char buffer[256];
+  if (measureJson(doc) >= sizeof(buffer)) return false;
+  serializeJson(doc, buffer);
+  return mqttClient.publish("roidota/fetch", buffer);
+}
+
+// A chunk and its MQTT packet must fit both otaBuffer and PubSubClient's
+size_t RoidDevice::otaMqttChunkSize() {
+  size_t overhead = 5 + 2 + strlen(topicChunk) + 8;
+  size_t room = mqttClient.getBufferSize() > overhead ? mqttClient.getBufferSize() - overhead : 0;
+  return min(sizeof(otaBuffer), room);
+}
+
+// Runs in the MQTT callback: <offset: uint32 big-endian><total: uint32
+// big-endian><bytes>, where total is the size of the whole object and 0 if
+// the backend cannot serve it. Only the chunk the download is waiting for
+// is taken; it goes through otaConsume() like bytes read from HTTP.
+void RoidDevice::handleOtaChunk(const byte* payload, unsigned int length) {
+  if (!otaOverMqtt || otaCurrentState != OtaState::WRITE || length < 8) return;
+  uint32_t offset = ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) |
+                    ((uint32_t)payload[2] << 8) | payload[3];
+  uint32_t total = ((uint32_t)payload[4] << 24) | ((uint32_t)payload[5] << 16) |
+                   ((uint32_t)payload[6] << 8) | payload[7];
+  size_t n = length - 8;
+
+  if (total == 0) {
+    otaMqttError = "Firmware not available over MQTT";
+    return;
+  }
+  // Chunks come in order, so one past the position means the chunk at it
+  // was lost; the rest of an earlier window is only stale.
+  size_t position = otaResumeOffset + otaWritten;
+  if (offset > position && otaMqttSynced) otaMqttRewind = true;
+  if (offset != position || n == 0) return;
+  if (n > sizeof(otaBuffer) || offset + n > total) {
+    otaMqttError = "Invalid firmware chunk";
+    return;
+  }
+  // The last chunk is still being consumed; ask again once it is.
+  if (otaBufferPos < otaBufferLen) {
+    otaMqttRewind = true;
+    return;
+  }
+
+  if (otaWritten == 0 && otaExpected == 0) {
+    if (otaResumeOffset > 0 && total != otaResume.imageSize) {
+      otaMqttRestart = true;
+      return;
+    }
+    otaExpected = total - offset;
+    // Same sizes as the HEADERS state takes from the HTTP response
+    if (otaSource == OtaSource::PATCH) {
+      otaImageSize = 0;
+    } else if (otaSource == OtaSource::COMPRESSED) {
+      otaImageSize = otaFullSize;
+    } else if (otaResumeOffset > 0) {
+      otaImageSize = otaResume.imageSize;
+    } else {
+      otaImageSize = total;
+      otaResume.etag[0] = '\0';
+    }
+    Serial.printf("[RoidOTA] OTA download started over MQTT, expected=%d bytes\n", otaExpected);
+  }
+
+  memcpy(otaBuffer, payload + 8, n);
+  otaBufferPos = 0;
+  otaBufferLen = n;
+  otaWritten += n;
+  otaMqttRetries = 0;
+  otaMqttSynced = true;
+  otaLastData = millis();
+}
+
+// Routes downloaded bytes straight to flash, through the decompressor, or
+// through the patcher.
+size_t RoidDevice::otaConsume(const uint8_t* data, size_t len) {
+  if (otaSource == OtaSource::COMPRESSED) {
+    if (!otaInflate.feed(data, len)) {
+      otaFail(otaEmitError, RoidFlash::updateRunning() ? "OTA failed" : "Not enough space");
+      return 0;
+    }
+    return len;
+  }
+
+  if (otaSource == OtaSource::PATCH) {
+    size_t used = otaDelta.feed(data, len);
+    if (otaDelta.failed()) {
+      otaFail(otaEmitError ? otaEmitError : otaDelta.error(), "OTA failed");
+      return 0;
+    }
+    return used;
+  }
+
+  if (!otaEmit(data, len)) {
+    otaFail(otaEmitError, RoidFlash::updateRunning() ? "OTA failed" : "Not enough space");
+    return 0;
+  }
+  return len;
+}
+
+// Final stage of the pipeline: opens the partition writer lazily, once the
+// image size is known, and writes decoded bytes to the inactive partition.
+bool RoidDevice::otaEmit(const uint8_t* data, size_t len) {
+  // A virtual device only takes the digest
+  if (isVirtual()) {
+    if (otaOutput == 0) otaHash.begin();
+    otaHash.update(data, len);
+    otaOutput += len;
+    return true;
+  }
+
+  if (!RoidFlash::updateRunning()) {
+    if (otaSource == OtaSource::PATCH) otaImageSize = otaDelta.targetSize();
+    size_t offset = otaSource == OtaSource::FULL ? otaResumeOffset : 0;
+    if (!RoidFlash::updateBegin(otaImageSize > 0 ? (size_t)otaImageSize : 0, offset,
+                                offset > 0 ? otaResume.header : nullptr)) {
+      otaEmitError = RoidFlash::updateError();
+      return false;
+    }
+    otaLastSaved = offset;
+
+    // A resumed digest was brought up to the offset in otaRehash()
+    if (offset == 0) {
+      otaHash.begin();
+    } else if (otaRehashed != offset) {
+      otaEmitError = "Resume digest out of step";
+      return false;
+    }
+#if ROIDOTA_OTA_PIPELINE
+    if (!otaPipeline.begin(RoidFlash::updateWrite, offset)) {
+      Serial.printf("[RoidOTA] %s, writing flash inline\n", otaPipeline.error());
+    }
+#endif
+  }
+
+  // Hashing as bytes go to flash means no read-back pass afterwards.
+  otaHash.update(data, len);
+  bool ok = otaPipeline.active() ? otaPipeline.write(data, len) : RoidFlash::updateWrite(data, len);
+  if (!ok) {
+    otaEmitError = otaPipeline.active() ? otaPipeline.error() : RoidFlash::updateError();
+    return false;
+  }
+
+  otaOutput += len;
+  if (otaFlashPosition() - otaLastSaved >= ROIDOTA_OTA_RESUME_SAVE_BYTES) {
+    otaSaveResume();
+  }
+  return true;
+}
+
+// A patch is checked against the running image's MD5, and a resumed image
+// was partly written in an earlier session, so that part is read back to
+// bring the digest up to the resume offset. Either can be most of a
+// partition, so it goes a slice per call within the OTA budget, like a
+// broadcast image's check, and the download is opened after.
+void RoidDevice::otaRehash() {
+  unsigned long tickStart = millis();
+  if (otaSource == OtaSource::PATCH) {
+    for (size_t budget = otaMaxBytesPerTick;
+         budget > 0 && !RoidFlash::runningHashed() && millis() - tickStart < otaTickBudgetMs; ) {
+      size_t n = min(sizeof(otaBuffer), budget);
+      RoidFlash::hashRunning(otaBuffer, n);
+      budget -= n;
+    }
+    if (RoidFlash::runningHashed()) otaSetState(OtaState::CONNECT);
+    return;
+  }
+
+  if (otaRehashed == 0 || otaRehashed > otaResumeOffset) {
+    otaHash.begin();
+    otaHash.update(otaResume.header, RoidFlash::HEADER_SIZE);
+    otaRehashed = RoidFlash::HEADER_SIZE;
+  }
+
+  for (size_t budget = otaMaxBytesPerTick;
+       budget > 0 && otaRehashed < otaResumeOffset && millis() - tickStart < otaTickBudgetMs; ) {
+    size_t n = min(min(sizeof(otaBuffer), otaResumeOffset - otaRehashed), budget);
+    if (!RoidFlash::readUpdate(otaRehashed, otaBuffer, n)) {
+      otaFail("Flash read failed", "OTA failed");
+      return;
+    }
+    otaHash.update(otaBuffer, n);
+    otaRehashed += n;
+    budget -= n;
+  }
+  if (otaRehashed >= otaResumeOffset) otaSetState(OtaState::CONNECT);
+}
+
+// Checks the streamed digest against the backend's sha256 and, if this
+// build requires it, the signature over that digest. Runs before the image
+// header is written, so a bad image never becomes bootable.
+bool RoidDevice::otaVerifyImage() {
+  uint8_t digest[RoidSha256::DIGEST_SIZE];
+  otaHash.finish(digest);
+
+  if (otaSha256[0] != '\0' && !RoidSha256::matchesHex(digest, otaSha256)) {
+    otaEmitError = "Image SHA-256 mismatch";
+    return false;
+  }
+  if (RoidSignature::required() && !RoidSignature::verify(digest, otaSignature)) {
+    otaEmitError = "Image signature invalid";
+    return false;
+  }
+  return true;
+}
+
+// Bytes actually on flash; with the pipeline running, RoidFlash's own
+// position belongs to the flash task.
+size_t RoidDevice::otaFlashPosition() {
+  return otaPipeline.active() ? otaPipeline.position() : RoidFlash::updatePosition();
+}
+
+// Only plain full images of known size can be resumed: the decompressor and
+// patcher carry state that a byte offset alone cannot restore.
+void RoidDevice::otaSaveResume() {
+  if (broadcast.active() || otaSource != OtaSource::FULL || otaImageSize <= 0 || !RoidFlash::updateRunning()) return;
+
+  size_t position = otaFlashPosition();
+  size_t offset = position - position % RoidFlash::SECTOR_SIZE;
+  if (offset == 0 || offset == otaLastSaved) return;
+
+  otaResume.imageSize = otaImageSize;
+  otaResume.offset = offset;
+  memcpy(otaResume.header, RoidFlash::updateHeader(), RoidFlash::HEADER_SIZE);
+  RoidFlash::saveResume(otaResume);
+  otaLastSaved = offset;
+}
+
+bool RoidDevice::otaCheckContentRange() {
+  // "bytes <first>-<last>/<total>"
+  unsigned long first = 0, last = 0, total = 0;
+  if (sscanf(otaHttp.contentRange(), "bytes %lu-%lu/%lu", &first, &last, &total) != 3) return false;
+  return first == otaResumeOffset && total == otaResume.imageSize && last + 1 == total;
+}
+
+void RoidDevice::otaFinalize() {
+  Serial.printf("[RoidOTA] OTA Progress: written=%zu, expected=%d, image=%zu\n", otaWritten, otaExpected, otaOutput);
+
+  if (otaSource == OtaSource::PATCH && !otaDelta.finished()) {
+    otaFail("Patch ended early", "OTA failed");
+    return;
+  }
+  if (otaSource == OtaSource::COMPRESSED && !otaInflate.finish()) {
+    otaFail(otaEmitError, "OTA failed");
+    return;
+  }
+
+  otaHttp.end();
+  otaMqttEnd();
+
+  if (otaExpected > 0 && otaWritten != (size_t)otaExpected) {
+    otaFail("Download size mismatch", "OTA failed");
+    return;
+  }
+
+  if (otaPipeline.active() && !otaPipeline.flush()) {
+    otaFail(otaPipeline.error(), "OTA failed");
+    return;
+  }
+  otaSetState(OtaState::COMMIT);
+}
+
+// Waits, one tick at a time, for the flash task to drain before the image
+// is closed and verified.
+void RoidDevice::otaCommit() {
+  if (otaPipeline.active()) {
+    if (otaPipeline.failed()) {
+      otaFail(otaPipeline.error(), "OTA failed");
+      return;
+    }
+    if (!otaPipeline.idle()) return;
+    otaPipeline.end();
+  }
+
+  if (!otaVerifyImage()) {
+    // Content is wrong, so nothing of it is worth resuming
+    if (!isVirtual()) {
+      RoidFlash::updateAbort();
+      RoidFlash::clearResume();
+    }
+    otaResume.offset = 0;
+    otaFail(otaEmitError, "Image verification failed");
+    return;
+  }
+
+  // A finished image is never resumed, whether or not it verifies.
+  if (!isVirtual()) {
+    bool imageOk = RoidFlash::updateEnd();
+    RoidFlash::clearResume();
+    otaResume.offset = 0;
+    Serial.printf("[RoidOTA] Image end: %s\n", imageOk ? "ok" : RoidFlash::updateError());
+    if (!imageOk) {
+      otaFail(RoidFlash::updateError(), "OTA failed");
+      return;
+    }
+    // Lets the new image serve itself to peers once it runs
+    RoidFlash::saveImageRecord(otaSha256, otaOutput);
+  }
+
+  bool fromBroadcast = broadcast.active();
+  bool fromPeer = !fromBroadcast && otaPeer < otaPeerCount;
+  broadcast.end();
+  Serial.printf("[RoidOTA] OTA SUCCESS%s - sending ACK before restart\n",
+                fromBroadcast ? " (broadcast)" : fromPeer ? " (LAN peer)" : "");
+  sendOtaAck(true, fromBroadcast ? "Update success from broadcast. Rebooting..."
+                   : fromPeer ? "Update success from LAN peer. Rebooting..." : "Update success. Rebooting...");
+  sendLog("INFO", "OTA success - restarting now");
+  otaSetState(OtaState::REBOOT);
+}
+
+bool RoidDevice::otaTakeFallback() {
+  if (otaFallbackUrl[0] == '\0') return false;
+  otaSource = otaFallbackSource;
+  strcpy(otaUrl, otaFallbackUrl);
+  otaFallbackUrl[0] = '\0';
+  return true;
+}
+
+void RoidDevice::otaFail(const char* logMessage, const char* ackMessage) {
+  Serial.printf("[RoidOTA] OTA FAILED - %s (written=%zu, expected=%d)\n",
+                logMessage, otaWritten, otaExpected);
+
+  // Stop the flash task first so the saved position is final, then keep
+  // what made it to flash for the next attempt.
+  otaPipeline.end();
+  if (!isVirtual()) {
+    otaSaveResume();
+    RoidFlash::updateAbort();
+  }
+  otaHash.abort();
+  otaRehashed = 0;
+  otaHttp.end();
+  otaMqttEnd();
+
+  // A broadcast that stalls, or assembles the wrong image, leaves the
+  // ordinary downloads as if it had not been offered.
+  if (broadcast.active()) {
+    otaLeaveBroadcast();
+    broadcast.end();
+    sendLog("WARN", "Broadcast OTA failed, downloading instead");
+    otaResumeOffset = 0;
+    otaSetState(OtaState::CONNECT);
+    return;
+  }
+
+  // A peer that is busy, gone or serving something else only moves the
+  // download on: to the next peer, after the last one to the backend's
+  // URLs. A full image picks up where the peer stopped.
+  if (otaPeer < otaPeerCount) {
+    Serial.printf("[RoidOTA] Peer %s failed\n", otaPeerUrls[otaPeer]);
+    if (++otaPeer == otaPeerCount) {
+      sendLog("WARN", "LAN peers failed, downloading from the backend");
+      otaSource = otaOriginSource;
+    }
+    otaResumeOffset = otaSource == OtaSource::FULL ? otaResume.offset : 0;
+    otaSetState(OtaState::CONNECT);
+    return;
+  }
+
+  // A failed patch or compressed download is retried once from its
+  // fallback before giving up.
+  if (otaFallbackUrl[0] != '\0') {
+    sendLog("WARN", otaSource == OtaSource::PATCH ? "Delta OTA failed, falling back to full image"
+                                                  : "Compressed OTA failed, falling back to raw image");
+    otaTakeFallback();
+    otaSetState(OtaState::CONNECT);
+    return;
+  }
+
+  setStatus(RoidStatus::ERROR);
+  sendLog("ERROR", logMessage);
+  sendOtaAck(false, ackMessage);
+  otaSetState(OtaState::IDLE);
+}
+
+// ========== Command Handling ==========
+void RoidDevice::handleCommand(const byte* payload, unsigned int length) {
+  StaticJsonDocument<ROIDOTA_COMMAND_DOC_SIZE> doc;
+  DeserializationError error = deserializeJson(doc, payload, length);
+  
+  if (error) {
+    Serial.printf("[RoidOTA] Command JSON parse failed: %s\n", error.c_str());
+    return;
+  }
+
+  const char* command = doc["command"] | "";
+  if (strcmp(command, "restart") == 0) {
+    sendLog("INFO", "Device restarting...");
+    flushLogs();
+    restart();
+  } else if (strcmp(command, "heartbeat") == 0 || strcmp(command, "status") == 0) {
+    heartbeat.requestKeyframe();
+    sendHeartbeat();
+  } else if (strcmp(command, "heartbeat_config") == 0) {
+    setHeartbeat(doc["params"]["interval"] | heartbeat.interval(),
+                 doc["params"]["keyframe_every"] | heartbeat.keyframeEvery());
+    Serial.printf("[RoidOTA] Heartbeat every %lu ms, keyframe every %u\n",
+                  heartbeat.interval(), heartbeat.keyframeEvery());
+    sendHeartbeat();
+  } else if (strcmp(command, "memstats") == 0) {
+    sendMemStats();
+  } else if (strcmp(command, "profile") == 0) {
+    sendProfile();
+    if (doc["params"]["reset"] | false) profiler.reset();
+  } else if (strcmp(command, "confirm") == 0) {
+    outbox.confirm(doc["params"]["seq"] | 0);
+  } else if (strcmp(command, "tasks") == 0) {
+    sendTasks();
+  } else if (strcmp(command, "wire") == 0) {
+    const char* format = doc["params"]["format"] | "json";
+    wirePacked = wireOffered && strcmp(format, "msgpack") == 0;
+    Serial.printf("[RoidOTA] Wire format: %s\n", wirePacked ? "msgpack" : "json");
+  }
+}
+// ========== Heartbeat ==========
+// Deltas always carry uptime, so every beat still proves liveness; the
+// other fields only when they changed enough. Keyframes carry everything
+// plus the schedule, and are resent after a failed publish. The first
+// keyframe to get through also carries the boot phase timings.
+bool RoidDevice::sendHeartbeat() {
+  char ipText[16];
+  RoidHeartbeat::Sample sample;
+  sample.ip = WiFi.localIP();
+  sample.rssi = WiFi.RSSI();
+  sample.freeHeap = ESP.getFreeHeap();
+  sample.largestBlock = ESP.getMaxAllocHeap();
+  sample.status = (uint8_t)currentStatus;
+  RoidMemStats::sample();
+  RoidHeartbeat::Fields send = heartbeat.select(sample);
+  bool keyframe = send.keyframe;
+  bool sendBoot = keyframe && !bootReported;
+
+  bool published = false;
+  if (wirePacked) {
+    uint8_t packed[128];
+    RoidMsgPack msg(packed, sizeof(packed));
+    msg.map(1 + send.ip + send.rssi + send.freeHeap + send.largestBlock + send.status + (keyframe ? 4 : 0) + sendBoot);
+    msg.key(WIRE_UPTIME);
+    msg.uinteger(getUptime());
+    if (send.ip) {
+      msg.key(WIRE_IP);
+      msg.str(localIp(ipText, sizeof(ipText)));
+    }
+    if (send.rssi) {
+      msg.key(WIRE_RSSI);
+      msg.integer(sample.rssi);
+    }
+    if (send.freeHeap) {
+      msg.key(WIRE_FREE_HEAP);
+      msg.uinteger(sample.freeHeap);
+    }
+    if (send.largestBlock) {
+      msg.key(WIRE_LARGEST_BLOCK);
+      msg.uinteger(sample.largestBlock);
+    }
+    if (send.status) {
+      msg.key(WIRE_STATUS);
+      msg.str(statusStr());
+    }
+    if (keyframe) {
+      msg.key(WIRE_TIMESTAMP);
+      msg.uinteger(millis());
+      msg.key(WIRE_KEYFRAME);
+      msg.boolean(true);
+      msg.key(WIRE_INTERVAL);
+      msg.uinteger(heartbeat.interval());
+      msg.key(WIRE_MIN_FREE_HEAP);
+      msg.uinteger(ESP.getMinFreeHeap());
+    }
+    if (sendBoot) {
+      // [wifi, dhcp, mqtt, subscribe, fast, lease_reused]
+      msg.key(WIRE_BOOT);
+      msg.array(6);
+      msg.uinteger(bootPhases.wifiMs);
+      msg.uinteger(bootPhases.dhcpMs);
+      msg.uinteger(bootPhases.mqttMs);
+      msg.uinteger(bootPhases.subscribeMs);
+      msg.boolean(bootPhases.fast);
+      msg.boolean(bootPhases.leaseReused);
+    }
+    published = msg.ok() && mqttClient.publish(topicStatus, packed, msg.length());
+  } else {
+    StaticJsonDocument<768> doc;
+    doc["device_id"] = deviceId;
+    doc["uptime"] = getUptime();
+    if (send.ip) doc["ip"] = localIp(ipText, sizeof(ipText));
+    if (send.rssi) doc["rssi"] = sample.rssi;
+    if (send.freeHeap) doc["free_heap"] = sample.freeHeap;
+    if (send.largestBlock) doc["largest_block"] = sample.largestBlock;
+    if (send.status) doc["status"] = statusStr();
+    if (keyframe) {
+      doc["timestamp"] = millis();
+      doc["keyframe"] = true;
+      doc["interval"] = heartbeat.interval();
+      doc["min_free_heap"] = ESP.getMinFreeHeap();
+    }
+    if (sendBoot) {
+      JsonObject boot = doc.createNestedObject("boot");
+      boot["wifi_ms"] = bootPhases.wifiMs;
+      boot["dhcp_ms"] = bootPhases.dhcpMs;
+      boot["mqtt_ms"] = bootPhases.mqttMs;
+      boot["subscribe_ms"] = bootPhases.subscribeMs;
+      boot["fast"] = bootPhases.fast;
+      boot["lease_reused"] = bootPhases.leaseReused;
+    }
+
+    char buffer[512];
+    if (measureJson(doc) < sizeof(buffer)) {
+      serializeJson(doc, buffer);
+      published = mqttClient.publish(topicStatus, buffer);
+    }
+  }
+
+  if (!published) {
+    heartbeat.failed();
+    return false;
+  }
+  heartbeat.sent(send, sample);
+  if (sendBoot) bootReported = true;
+  return true;
+}
+// Full memory telemetry on demand, on the status topic; always JSON since
+// it is rare and the backend merges it like any other status field. Queued
+// as a command reply, so a busy socket delays it instead of losing it.
+void RoidDevice::sendMemStats() {
+  RoidMemStats::Snapshot m = RoidMemStats::snapshot();
+  StaticJsonDocument<512> doc;
+  doc["device_id"] = deviceId;
+  JsonObject stats = doc.createNestedObject("memstats");
+  stats["heap_size"] = m.heapSize;
+  stats["free_heap"] = m.freeHeap;
+  stats["min_free_heap"] = m.minFreeHeap;
+  stats["largest_block"] = m.largestFreeBlock;
+  stats["min_largest_block"] = m.minLargestFreeBlock;
+  stats["fragmentation"] = m.fragmentation;
+  stats["loop_stack_free"] = m.loopStackFree;
+  stats["lib_allocs"] = m.libraryAllocs;
+  stats["lib_alloc_bytes"] = m.libraryAllocBytes;
+  stats["lib_heap_drift"] = m.libraryHeapDrift;
+
+  char buffer[ROIDOTA_OUTBOX_MAX_PAYLOAD];
+  if (measureJson(doc) >= sizeof(buffer)) return;
+  size_t len = serializeJson(doc, buffer);
+  if (outbox.push(RoidOutbox::PRIO_TELEMETRY, OUTBOX_STATUS, 0, (const uint8_t*)buffer, len, millis()) &&
+      mqttClient.connected()) {
+    outbox.drain(millis(), publishCurrent);
+  }
+}
+
+RoidMemStats::Snapshot RoidDevice::memStats() {
+  return RoidMemStats::snapshot();
+}
+
+// ========== Profiling ==========
+// Reports are streamed like a log batch, so they need no buffer however
+// many buckets or tasks there are. report() is called twice: once with no
+// writer for the length, then to write.
+bool RoidDevice::publishReport(size_t (*report)(RoidChunkWriter writer)) {
+  if (!mqttClient.connected()) return false;
+  size_t len = report(nullptr);
+  if (!mqttClient.beginPublish(topicStatus, len, false)) return false;
+  if (report(writeCurrent) != len) {
+    espClient.stop();
+    return false;
+  }
+  return mqttClient.endPublish();
+}
+
+bool RoidDevice::sendProfile() {
+  return publishReport([](RoidChunkWriter writer) { return current->profiler.writeReport(current->deviceId, writer); });
+}
+
+bool RoidDevice::sendTasks() {
+  return publishReport([](RoidChunkWriter writer) { return current->scheduler.writeReport(current->deviceId, writer); });
+}
+
+const RoidProfiler& RoidDevice::loopProfile() {
+  return profiler;
+}
+
+// ========== Tasks ==========
+int RoidDevice::every(const char* name, unsigned long intervalMs, UserFunction fn, RoidScheduler::Priority priority) {
+  return scheduler.every(name, intervalMs, fn, priority, millis());
+}
+
+int RoidDevice::after(const char* name, unsigned long delayMs, UserFunction fn, RoidScheduler::Priority priority) {
+  return scheduler.after(name, delayMs, fn, priority, millis());
+}
+
+bool RoidDevice::cancelTask(int id) {
+  return scheduler.cancel(id);
+}
+
+bool RoidDevice::rescheduleTask(int id, unsigned long delayMs) {
+  return scheduler.reschedule(id, delayMs, millis());
+}
+
+// ========== Sleep ==========
+void RoidDevice::setSleepCycle(unsigned long intervalMs, unsigned long listenMs) {
+  sleepInterval = intervalMs;
+  sleepListenMs = listenMs;
+}
+
+void RoidDevice::stayAwake(bool awake) {
+  sleepHold = awake;
+}
+
+uint32_t RoidDevice::wakeCount() {
+  return sleepInterval > 0 ? RoidSleep::wakes() : 0;
+}
+
+// QoS 1 lets a kept session queue messages while the device sleeps
+uint8_t RoidDevice::subscribeQos() {
+  return sleepInterval > 0 ? 1 : 0;
+}
+
+// The announce and a heartbeat keyframe in one publish on the request
+// topic, plus what the previous wake cost. Always JSON: every wake starts a
+// new MQTT session, and negotiating the binary format would cost a round
+// trip per wake.
+bool RoidDevice::sendWakeReport() {
+  char ip[16];
+  char lan[9];
+  StaticJsonDocument<1024> doc;
+  doc["device_id"] = deviceId;
+  doc["ip"] = localIp(ip, sizeof(ip));
+  doc["timestamp"] = millis();
+  doc["status"] = statusStr();
+  // Sleeping devices fetch from LAN peers but never serve
+  snprintf(lan, sizeof(lan), "%08lx", (unsigned long)lanId);
+  doc["lan"] = lan;
+  doc["rssi"] = WiFi.RSSI();
+  doc["free_heap"] = ESP.getFreeHeap();
+  doc["min_free_heap"] = ESP.getMinFreeHeap();
+  doc["largest_block"] = ESP.getMaxAllocHeap();
+
+  JsonObject cycle = doc.createNestedObject("sleep");
+  cycle["interval"] = sleepInterval;
+  cycle["wake"] = RoidSleep::wakes();
+  cycle["failures"] = RoidSleep::failures();
+  cycle["last_awake_ms"] = RoidSleep::lastAwakeMs();
+  cycle["last_radio_ms"] = RoidSleep::lastRadioMs();
+
+  JsonObject boot = doc.createNestedObject("boot");
+  boot["wifi_ms"] = bootPhases.wifiMs;
+  boot["dhcp_ms"] = bootPhases.dhcpMs;
+  boot["mqtt_ms"] = bootPhases.mqttMs;
+  boot["subscribe_ms"] = bootPhases.subscribeMs;
+  boot["fast"] = bootPhases.fast;
+  boot["lease_reused"] = bootPhases.leaseReused;
+
+  char buffer[512];
+  if (measureJson(doc) >= sizeof(buffer)) return false;
+  serializeJson(doc, buffer);
+  return mqttClient.publish("roidota/request", buffer);
+}
+
+// A wake ends once its report is out and nothing has arrived for a listen
+// window, or when there was nothing to report it with. An OTA update and
+// stayAwake() keep it going regardless.
+bool RoidDevice::wakeDone() {
+  if (sleepHold || otaCurrentState != OtaState::IDLE) return false;
+  if (!sleepRadio || !mqttClient.connected()) return true;
+  if (millis() - bootTime >= ROIDOTA_SLEEP_MAX_AWAKE_MS) return true;
+  return wakeReported && millis() - wakeListenFrom >= sleepListenMs;
+}
+
+// Sleeps until intervalMs after this wake began, so wakes keep their
+// period however long each one took.
+void RoidDevice::goToSleep() {
+  unsigned long radioMs = 0;
+  if (sleepRadio) {
+    if (mqttClient.connected()) {
+      flushLogs();
+      mqttClient.disconnect();
+    }
+    WiFi.disconnect(true);
+    radioMs = millis() - radioOnAt;
+    RoidSleep::exchanged(wakeReported);
+  }
+
+  unsigned long awakeMs = millis() - bootTime;
+  unsigned long sleepMs = sleepInterval > awakeMs + ROIDOTA_SLEEP_MIN_MS ? sleepInterval - awakeMs : ROIDOTA_SLEEP_MIN_MS;
+  Serial.printf("[RoidOTA] Awake %lu ms, radio %lu ms; sleeping %lu ms\n", awakeMs, radioMs, sleepMs);
+  Serial.flush();
+  RoidSleep::sleep(sleepMs, awakeMs, radioMs, backoff.state());
+}
+
+// ========== Logging ==========
+// Entries are only queued here; handle() ships them in one publish once
+// enough are pending or the oldest has waited long enough. While the broker
+// is unreachable they stay in the ring and go out after reconnect.
+void RoidDevice::sendLog(const char* level, const char* message) {
+  logBuffer.add(RoidLog::parseLevel(level), message, millis());
+}
+
+bool RoidDevice::flushLogs() {
+  if (logBuffer.empty() || !mqttClient.connected()) return false;
+
+  // Sized first so the batch streams straight into the socket without
+  // needing a buffer as large as the ring.
+  size_t len = wirePacked ? logBuffer.writePackedBatch(statusStr(), nullptr)
+                          : logBuffer.writeBatch(deviceId, statusStr(), nullptr);
+  if (!mqttClient.beginPublish(topicLogs, len, false)) return false;
+  size_t written = wirePacked ? logBuffer.writePackedBatch(statusStr(), writeCurrent)
+                              : logBuffer.writeBatch(deviceId, statusStr(), writeCurrent);
+  if (written != len) {
+    // A half-written packet leaves the session unusable; drop it and let
+    // reconnectMQTT() start over. The entries are kept for the next try.
+    espClient.stop();
+    return false;
+  }
+  if (!mqttClient.endPublish()) return false;
+
+  logBuffer.clear();
+  return true;
+}
+
+bool RoidDevice::writeChunk(const uint8_t* data, size_t len) {
+  return mqttClient.write(data, len) == len;
+}
+
+void RoidDevice::sendOtaAck(bool success, const char* msg) {
+  uint16_t seq = outbox.nextSeq();
+  Serial.printf("[RoidOTA] Sending OTA ACK %u: success=%s, message=%s\n",
+                seq, success ? "true" : "false", msg);
+
+  // A message too long for the outbox is cut rather than the ACK dropped,
+  // so a failure is always reported.
+  uint8_t payload[ROIDOTA_OUTBOX_MAX_PAYLOAD];
+  char message[ROIDOTA_OUTBOX_MAX_PAYLOAD];
+  size_t keep = min(strlen(msg), sizeof(message) - 1);
+  size_t len;
+  for (;;) {
+    memcpy(message, msg, keep);
+    message[keep] = '\0';
+    len = encodeOtaAck(success, message, seq, payload, sizeof(payload));
+    if (len <= sizeof(payload) || keep == 0) break;
+    keep -= min(keep, max(len - sizeof(payload), (size_t)8));
+  }
+
+  // Kept until the backend confirms the sequence number, across a restart
+  // too, so the OTA reboot need not wait for the socket to drain.
+  if (!outbox.push(RoidOutbox::PRIO_ACK, OUTBOX_ACK, seq, payload, len, millis())) {
+    Serial.println("[RoidOTA] ACK could not be queued");
+    return;
+  }
+  bool sent = mqttClient.connected() && outbox.drain(millis(), publishCurrent);
+  Serial.printf("[RoidOTA] ACK %s\n", sent ? "published, awaiting confirmation" : "queued");
+}
+
+// Returns the ACK's length, or more than size if it did not fit; payload
+// holds the ACK only if it fit.
+size_t RoidDevice::encodeOtaAck(bool success, const char* msg, uint16_t seq, uint8_t* payload, size_t size) {
+  if (wirePacked) {
+    RoidMsgPack ack(payload, size);
+    ack.map(otaFirmwareId[0] != '\0' ? 6 : 5);
+    ack.key(WIRE_SUCCESS);
+    ack.boolean(success);
+    ack.key(WIRE_MESSAGE);
+    ack.str(msg);
+    ack.key(WIRE_TIMESTAMP);
+    ack.uinteger(millis());
+    ack.key(WIRE_STATUS);
+    ack.str(statusStr());
+    ack.key(WIRE_SEQ);
+    ack.uinteger(seq);
+    if (otaFirmwareId[0] != '\0') {
+      ack.key(WIRE_FIRMWARE_ID);
+      ack.str(otaFirmwareId);
+    }
+    return ack.ok() ? ack.length() : size + 1;
+  }
+
+  StaticJsonDocument<384> doc;
+  doc["device_id"] = deviceId;
+  doc["success"] = success;
+  doc["message"] = msg;
+  doc["timestamp"] = millis();
+  doc["status"] = statusStr();
+  doc["seq"] = seq;
+  if (otaFirmwareId[0] != '\0') doc["firmware_id"] = otaFirmwareId;
+  // serializeJson() truncates to fit, and needs room for its terminator
+  size_t len = measureJson(doc);
+  if (len >= size) return len + 1;
+  serializeJson(doc, (char*)payload, size);
+  return len;
+}
+
+bool RoidDevice::publishQueued(uint8_t topic, const uint8_t* payload, size_t len) {
+  const char* name = topic == OUTBOX_ACK ? topicAck : topicStatus;
+  return mqttClient.connected() && mqttClient.publish(name, payload, len);
+}
+
+// ========== Utilities ==========
+// IPAddress::toString() allocates a String
+const char* RoidDevice::localIp(char* buffer, size_t size) {
+  IPAddress ip = WiFi.localIP();
+  snprintf(buffer, size, "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+  return buffer;
+}
+
+unsigned long RoidDevice::getUptime() {
+  return millis() - bootTime;
+}
+
+// ========== Trampolines ==========
+bool RoidDevice::publishCurrent(uint8_t topic, const uint8_t* payload, size_t len) {
+  return current->publishQueued(topic, payload, len);
+}
+
+bool RoidDevice::writeCurrent(const uint8_t* data, size_t len) {
+  return current->writeChunk(data, len);
+}
+
+bool RoidDevice::emitCurrent(const uint8_t* data, size_t len) {
+  return current->otaEmit(data, len);
+}
@@ -0,0 +1,278 @@
+#include "RoidFlash.h"
+#include <MD5Builder.h>
+#include <Preferences.h>
+#include <esp_ota_ops.h>
+#include <esp_partition.h>
+
+static const uint8_t IMAGE_MAGIC = 0xE9;
+static const char* RESUME_NAMESPACE = "roidota";
+static const char* RESUME_KEY = "resume";
+static const char* IMAGE_KEY = "image";
+
+static const esp_partition_t* updatePartition = nullptr;
+static size_t updateSize = 0;
+static size_t updatePos = 0;
+static size_t updateErasedTo = 0;
+static uint8_t updateHeaderBytes[RoidFlash::HEADER_SIZE];
+static const char* updateErrorMessage = nullptr;
+
+// The running image never changes, so its size and digest are taken once.
+static size_t runningImageSize = 0;
+static MD5Builder runningMd5;
+static size_t runningMd5Pos = 0;
+static bool runningMd5Done = false;
+static char runningMd5Hex[33] = "";
+
+// ESP.getSketchSize() walks the image again on every call
+size_t RoidFlash::runningSize() {
+  if (runningImageSize == 0) runningImageSize = ESP.getSketchSize();
+  return runningImageSize;
+}
+
+bool RoidFlash::hashRunning(uint8_t* scratch, size_t len) {
+  if (runningMd5Done) return true;
+  size_t size = runningSize();
+  if (runningMd5Pos == 0) runningMd5.begin();
+
+  size_t n = min(len, size - runningMd5Pos);
+  if (size == 0 || !readRunning(runningMd5Pos, scratch, n)) {
+    // An empty digest matches no patch base, so updates go full-image
+    runningMd5Done = true;
+    return true;
+  }
+  runningMd5.add(scratch, n);
+  runningMd5Pos += n;
+  if (runningMd5Pos >= size) {
+    runningMd5.calculate();
+    runningMd5.getChars(runningMd5Hex);
+    runningMd5Done = true;
+  }
+  return runningMd5Done;
+}
+
+bool RoidFlash::runningHashed() {
+  return runningMd5Done;
+}
+
+bool RoidFlash::runningMd5Matches(const char* md5Hex) {
+  if (!runningMd5Done || runningMd5Hex[0] == '\0' || !md5Hex || strlen(md5Hex) != 32) return false;
+  return strcasecmp(runningMd5Hex, md5Hex) == 0;
+}
+
+bool RoidFlash::readRunning(size_t offset, uint8_t* dst, size_t len) {
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  if (!running || offset + len > running->size) return false;
+  return esp_partition_read(running, offset, dst, len) == ESP_OK;
+}
+
+bool RoidFlash::updateBegin(size_t imageSize, size_t offset, const uint8_t* header) {
+  updateAbort();
+  updateErrorMessage = nullptr;
+
+  const esp_partition_t* partition = esp_ota_get_next_update_partition(nullptr);
+  if (!partition) {
+    updateErrorMessage = "No OTA partition";
+    return false;
+  }
+  if (imageSize > partition->size || offset > partition->size) {
+    updateErrorMessage = "Not enough space for OTA";
+    return false;
+  }
+  if (offset % SECTOR_SIZE != 0 || (offset > 0 && !header)) {
+    updateErrorMessage = "Invalid resume offset";
+    return false;
+  }
+
+  memset(updateHeaderBytes, 0xFF, sizeof(updateHeaderBytes));
+  if (offset > 0) memcpy(updateHeaderBytes, header, HEADER_SIZE);
+
+  updatePartition = partition;
+  updateSize = imageSize;
+  updatePos = offset;
+  updateErasedTo = offset;
+  return true;
+}
+
+bool RoidFlash::updateWrite(const uint8_t* data, size_t len) {
+  if (!updatePartition) {
+    updateErrorMessage = "OTA not started";
+    return false;
+  }
+  if (updatePos + len > updatePartition->size || (updateSize > 0 && updatePos + len > updateSize)) {
+    updateErrorMessage = "Image larger than expected";
+    return false;
+  }
+
+  while (len > 0) {
+    // Sectors are erased as the write position enters them; a resumed write
+    // starts on a fresh sector, so nothing half-written is reused.
+    if (updatePos >= updateErasedTo) {
+      size_t sector = updatePos - updatePos % SECTOR_SIZE;
+      if (esp_partition_erase_range(updatePartition, sector, SECTOR_SIZE) != ESP_OK) {
+        updateErrorMessage = "Flash erase failed";
+        return false;
+      }
+      updateErasedTo = sector + SECTOR_SIZE;
+    }
+
+    size_t n = min(len, updateErasedTo - updatePos);
+    size_t held = 0;
+    if (updatePos < HEADER_SIZE) {
+      held = min(n, HEADER_SIZE - updatePos);
+      memcpy(updateHeaderBytes + updatePos, data, held);
+    }
+    if (n > held && esp_partition_write(updatePartition, updatePos + held, data + held, n - held) != ESP_OK) {
+      updateErrorMessage = "Flash write failed";
+      return false;
+    }
+
+    updatePos += n;
+    data += n;
+    len -= n;
+  }
+
+  return true;
+}
+
+bool RoidFlash::updateWriteAt(size_t offset, const uint8_t* data, size_t len, bool fresh) {
+  if (!updatePartition) {
+    updateErrorMessage = "OTA not started";
+    return false;
+  }
+  size_t sector = offset - offset % SECTOR_SIZE;
+  if (offset + len > updatePartition->size || (updateSize > 0 && offset + len > updateSize) ||
+      offset + len > sector + SECTOR_SIZE) {
+    updateErrorMessage = "Chunk outside the image";
+    return false;
+  }
+  if (fresh && esp_partition_erase_range(updatePartition, sector, SECTOR_SIZE) != ESP_OK) {
+    updateErrorMessage = "Flash erase failed";
+    return false;
+  }
+
+  size_t held = 0;
+  if (offset < HEADER_SIZE) {
+    held = min(len, HEADER_SIZE - offset);
+    memcpy(updateHeaderBytes + offset, data, held);
+  }
+  if (len > held && esp_partition_write(updatePartition, offset + held, data + held, len - held) != ESP_OK) {
+    updateErrorMessage = "Flash write failed";
+    return false;
+  }
+
+  updatePos += len;
+  return true;
+}
+
+// Reads back what this or an earlier session wrote to the update partition.
+bool RoidFlash::readUpdate(size_t offset, uint8_t* dst, size_t len) {
+  const esp_partition_t* partition = esp_ota_get_next_update_partition(nullptr);
+  if (!partition || offset + len > partition->size) return false;
+  return esp_partition_read(partition, offset, dst, len) == ESP_OK;
+}
+
+// Writes the held-back header last. esp_ota_set_boot_partition() verifies
+// the whole image (segments, checksum and appended hash) before switching.
+bool RoidFlash::updateEnd() {
+  if (!updatePartition) {
+    updateErrorMessage = "OTA not started";
+    return false;
+  }
+
+  const esp_partition_t* partition = updatePartition;
+  updatePartition = nullptr;
+
+  if ((updateSize > 0 && updatePos != updateSize) || updatePos < HEADER_SIZE) {
+    updateErrorMessage = "Image size mismatch";
+    return false;
+  }
+  if (updateHeaderBytes[0] != IMAGE_MAGIC) {
+    updateErrorMessage = "Invalid image header";
+    return false;
+  }
+  if (esp_partition_write(partition, 0, updateHeaderBytes, HEADER_SIZE) != ESP_OK) {
+    updateErrorMessage = "Flash write failed";
+    return false;
+  }
+  if (esp_ota_set_boot_partition(partition) != ESP_OK) {
+    updateErrorMessage = "Image verification failed";
+    return false;
+  }
+  return true;
+}
+
+void RoidFlash::updateAbort() {
+  updatePartition = nullptr;
+}
+
+bool RoidFlash::updateRunning() {
+  return updatePartition != nullptr;
+}
+
+size_t RoidFlash::updatePosition() {
+  return updatePos;
+}
+
+const uint8_t* RoidFlash::updateHeader() {
+  return updateHeaderBytes;
+}
+
+const char* RoidFlash::updateError() {
+  return updateErrorMessage ? updateErrorMessage : "";
+}
+
+bool RoidFlash::loadResume(ResumeState& state) {
+  Preferences prefs;
+  if (!prefs.begin(RESUME_NAMESPACE, true)) return false;
+  bool ok = prefs.getBytesLength(RESUME_KEY) == sizeof(state) &&
+            prefs.getBytes(RESUME_KEY, &state, sizeof(state)) == sizeof(state);
+  prefs.end();
+  return ok && state.offset > 0 && state.offset % SECTOR_SIZE == 0;
+}
+
+void RoidFlash::saveResume(const ResumeState& state) {
+  Preferences prefs;
+  if (!prefs.begin(RESUME_NAMESPACE, false)) return;
+  prefs.putBytes(RESUME_KEY, &state, sizeof(state));
+  prefs.end();
+}
+
+void RoidFlash::clearResume() {
+  Preferences prefs;
+  if (!prefs.begin(RESUME_NAMESPACE, false)) return;
+  if (prefs.isKey(RESUME_KEY)) prefs.remove(RESUME_KEY);
+  prefs.end();
+}
+
+void RoidFlash::saveImageRecord(const char* sha256Hex, size_t size) {
+  Preferences prefs;
+  if (!prefs.begin(RESUME_NAMESPACE, false)) return;
+
+  const esp_partition_t* partition = esp_ota_get_boot_partition();
+  if (!partition || !sha256Hex || strlen(sha256Hex) != 64) {
+    if (prefs.isKey(IMAGE_KEY)) prefs.remove(IMAGE_KEY);
+    prefs.end();
+    return;
+  }
+
+  ImageRecord record;
+  memset(&record, 0, sizeof(record));
+  record.address = partition->address;
+  record.size = size;
+  strcpy(record.sha256, sha256Hex);
+  prefs.putBytes(IMAGE_KEY, &record, sizeof(record));
+  prefs.end();
+}
+
+bool RoidFlash::runningImageRecord(ImageRecord& record) {
+  const esp_partition_t* running = esp_ota_get_running_partition();
+  if (!running) return false;
+
+  Preferences prefs;
+  if (!prefs.begin(RESUME_NAMESPACE, true)) return false;
+  bool ok = prefs.getBytesLength(IMAGE_KEY) == sizeof(record) &&
+            prefs.getBytes(IMAGE_KEY, &record, sizeof(record)) == sizeof(record);
+  prefs.end();
+  return ok && record.address == running->address && record.size > 0 && record.size <= running->size &&
+         record.sha256[64] == '\0' && strlen(record.sha256) == 64;
+}
@@ -0,0 +1,75 @@
+#include "RoidHeartbeat.h"
+
+static uint32_t distance(uint32_t a, uint32_t b) {
+  return a > b ? a - b : b - a;
+}
+
+RoidHeartbeat::RoidHeartbeat(unsigned long interval, uint8_t keyframeEvery)
+    : intervalMs(interval > ROIDOTA_HEARTBEAT_MIN_INTERVAL_MS ? interval : ROIDOTA_HEARTBEAT_MIN_INTERVAL_MS),
+      every(keyframeEvery > 0 ? keyframeEvery : 1) {}
+
+void RoidHeartbeat::setPhase(uint32_t value) {
+  phase = value;
+}
+
+void RoidHeartbeat::configure(unsigned long interval, uint8_t keyframeEvery, unsigned long now) {
+  intervalMs = interval > ROIDOTA_HEARTBEAT_MIN_INTERVAL_MS ? interval : ROIDOTA_HEARTBEAT_MIN_INTERVAL_MS;
+  every = keyframeEvery > 0 ? keyframeEvery : 1;
+  keyframePending = true;
+  schedule(now);
+}
+
+unsigned long RoidHeartbeat::interval() const {
+  return intervalMs;
+}
+
+uint8_t RoidHeartbeat::keyframeEvery() const {
+  return every;
+}
+
+void RoidHeartbeat::schedule(unsigned long now) {
+  unsigned long offset = (phase % intervalMs + intervalMs - now % intervalMs) % intervalMs;
+  dueAt = now + (offset > 0 ? offset : intervalMs);
+}
+
+bool RoidHeartbeat::due(unsigned long now) const {
+  return (long)(now - dueAt) >= 0;
+}
+
+unsigned long RoidHeartbeat::nextBeat() const {
+  return dueAt;
+}
+
+void RoidHeartbeat::advance(unsigned long now) {
+  dueAt += intervalMs;
+  if (due(now)) schedule(now);
+}
+
+void RoidHeartbeat::requestKeyframe() {
+  keyframePending = true;
+}
+
+RoidHeartbeat::Fields RoidHeartbeat::select(const Sample& sample) const {
+  Fields fields;
+  fields.keyframe = keyframePending || sinceKeyframe + 1 >= every;
+  fields.ip = fields.keyframe || sample.ip != last.ip;
+  fields.rssi = fields.keyframe || abs(sample.rssi - last.rssi) >= ROIDOTA_HEARTBEAT_RSSI_STEP;
+  fields.freeHeap = fields.keyframe || distance(sample.freeHeap, last.freeHeap) >= ROIDOTA_HEARTBEAT_HEAP_STEP;
+  fields.largestBlock = fields.keyframe || distance(sample.largestBlock, last.largestBlock) >= ROIDOTA_HEARTBEAT_HEAP_STEP;
+  fields.status = fields.keyframe || sample.status != last.status;
+  return fields;
+}
+
+void RoidHeartbeat::sent(const Fields& fields, const Sample& sample) {
+  keyframePending = false;
+  sinceKeyframe = fields.keyframe ? 0 : sinceKeyframe + 1;
+  if (fields.ip) last.ip = sample.ip;
+  if (fields.rssi) last.rssi = sample.rssi;
+  if (fields.freeHeap) last.freeHeap = sample.freeHeap;
+  if (fields.largestBlock) last.largestBlock = sample.largestBlock;
+  if (fields.status) last.status = sample.status;
+}
+
+void RoidHeartbeat::failed() {
+  keyframePending = true;
+}
@@ -0,0 +1,64 @@
+#ifndef ROIDHEATSHRINK_H
+#define ROIDHEATSHRINK_H
+
+#include <Arduino.h>
+
+// Window and lookahead must match what the backend encodes with; a response
+// advertising other parameters falls back to the uncompressed image.
+#ifndef ROIDOTA_HS_WINDOW_BITS
+#define ROIDOTA_HS_WINDOW_BITS 10
+#endif
+#ifndef ROIDOTA_HS_LOOKAHEAD_BITS
+#define ROIDOTA_HS_LOOKAHEAD_BITS 4
+#endif
+#ifndef ROIDOTA_HS_OUTPUT_BUFFER
+#define ROIDOTA_HS_OUTPUT_BUFFER 256
+#endif
+
+// Streaming heatshrink (LZSS) decoder with a fixed 2^W byte window.
+//
+// The bitstream is MSB-first: a 1 tag is followed by an 8-bit literal, a 0
+// tag by a W-bit back-reference index (distance - 1) and an L-bit count
+// (length - 1). Decoded bytes are batched and handed to the writer.
+class RoidHeatshrink {
+public:
+  typedef bool (*OutputWriter)(const uint8_t* data, size_t len);
+
+  void begin(OutputWriter writer);
+
+  // Decodes all of data; returns false once the writer has failed.
+  bool feed(const uint8_t* data, size_t len);
+
+  // Flushes buffered output at end of stream.
+  bool finish();
+
+  size_t produced() const;
+
+private:
+  enum class State : uint8_t {
+    TAG,
+    LITERAL,
+    INDEX,
+    COUNT
+  };
+
+  static const uint16_t WINDOW_SIZE = 1 << ROIDOTA_HS_WINDOW_BITS;
+
+  bool put(uint8_t b);
+  bool flush();
+
+  OutputWriter writer = nullptr;
+  State state = State::TAG;
+  uint32_t bits = 0;
+  uint8_t bitCount = 0;
+  uint16_t index = 0;
+  uint16_t head = 0;
+  bool failed = false;
+  size_t out = 0;
+
+  uint8_t window[WINDOW_SIZE];
+  uint8_t pending[ROIDOTA_HS_OUTPUT_BUFFER];
+  uint16_t pendingLen = 0;
+};
+
+#endif
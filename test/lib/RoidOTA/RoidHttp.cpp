@@ -0,0 +1,163 @@
+#include "RoidHttp.h"
+
+// Value of "Name: value" if the line is that header, else nullptr
+static const char* headerValue(const char* line, const char* name) {
+  size_t len = strlen(name);
+  if (strncasecmp(line, name, len) != 0 || line[len] != ':') return nullptr;
+  const char* value = line + len + 1;
+  while (*value == ' ' || *value == '\t') ++value;
+  return value;
+}
+
+static void copyValue(char* dst, size_t size, const char* value) {
+  strncpy(dst, value, size - 1);
+  dst[size - 1] = '\0';
+}
+
+bool RoidHttp::begin(const char* url) {
+  end();
+  const char* rest;
+  if (strncmp(url, "http://", 7) == 0) {
+    tls = false;
+    port = 80;
+    rest = url + 7;
+  } else if (strncmp(url, "https://", 8) == 0) {
+#ifdef ESP32
+    tls = true;
+    port = 443;
+    rest = url + 8;
+#else
+    return false;
+#endif
+  } else {
+    return false;
+  }
+
+  const char* slash = strchr(rest, '/');
+  size_t authority = slash ? (size_t)(slash - rest) : strlen(rest);
+  path = slash ? slash : "/";
+  const char* colon = (const char*)memchr(rest, ':', authority);
+  size_t hostLen = colon ? (size_t)(colon - rest) : authority;
+  if (hostLen == 0 || hostLen >= sizeof(host)) return false;
+  memcpy(host, rest, hostLen);
+  host[hostLen] = '\0';
+  if (colon) port = (uint16_t)strtoul(colon + 1, nullptr, 10);
+
+  rangeFrom = 0;
+  rangeIf = "";
+  return port != 0;
+}
+
+void RoidHttp::setRange(size_t offset, const char* ifRange) {
+  rangeFrom = offset;
+  rangeIf = ifRange ? ifRange : "";
+}
+
+bool RoidHttp::connect(uint32_t timeoutMs) {
+  lineLen = 0;
+  statusSeen = false;
+  chunked = false;
+  status = 0;
+  length = -1;
+  etagValue[0] = '\0';
+  rangeValue[0] = '\0';
+
+#ifdef ESP32
+  if (tls) {
+    secure.setInsecure();
+    secure.setHandshakeTimeout((timeoutMs + 999) / 1000);
+    client = &secure;
+  } else {
+    client = &plain;
+  }
+#else
+  client = &plain;
+#endif
+  if (!client->connect(host, port, (int32_t)timeoutMs)) {
+    client = nullptr;
+    return false;
+  }
+
+  // Small enough to go out in one segment without waiting for the window
+  client->print("GET ");
+  client->print(path);
+  client->print(" HTTP/1.1\r\nHost: ");
+  client->print(host);
+  client->print("\r\nUser-Agent: RoidOTA\r\nConnection: close\r\n");
+  if (rangeFrom > 0) {
+    client->printf("Range: bytes=%u-\r\n", (unsigned)rangeFrom);
+    if (rangeIf[0] != '\0') client->printf("If-Range: %s\r\n", rangeIf);
+  }
+  client->print("\r\n");
+  return true;
+}
+
+// Reads only what is already buffered, byte by byte so the body stays in
+// the socket for stream().
+RoidHttp::Status RoidHttp::poll() {
+  if (!client) return FAILED;
+  while (client->available() > 0) {
+    int c = client->read();
+    if (c < 0) break;
+    if (c == '\r') continue;
+    if (c != '\n') {
+      if (lineLen + 1 < sizeof(line)) line[lineLen++] = (char)c;
+      continue;
+    }
+    line[lineLen] = '\0';
+    // The body goes straight to the writer, so it cannot be chunked
+    if (lineLen == 0) return statusSeen && !chunked ? READY : FAILED;
+    headerLine();
+    lineLen = 0;
+  }
+  return client->connected() ? PENDING : FAILED;
+}
+
+void RoidHttp::headerLine() {
+  if (!statusSeen) {
+    // "HTTP/1.1 206 Partial Content"
+    statusSeen = true;
+    const char* space = strchr(line, ' ');
+    status = strncmp(line, "HTTP/", 5) == 0 && space ? atoi(space + 1) : 0;
+    return;
+  }
+  const char* value;
+  if ((value = headerValue(line, "Content-Length"))) {
+    length = strtol(value, nullptr, 10);
+  } else if ((value = headerValue(line, "ETag"))) {
+    copyValue(etagValue, sizeof(etagValue), value);
+  } else if ((value = headerValue(line, "Content-Range"))) {
+    copyValue(rangeValue, sizeof(rangeValue), value);
+  } else if ((value = headerValue(line, "Transfer-Encoding"))) {
+    chunked = strncasecmp(value, "chunked", 7) == 0;
+  }
+}
+
+int RoidHttp::code() const {
+  return status;
+}
+
+long RoidHttp::contentLength() const {
+  return length;
+}
+
+const char* RoidHttp::etag() const {
+  return etagValue;
+}
+
+const char* RoidHttp::contentRange() const {
+  return rangeValue;
+}
+
+WiFiClient* RoidHttp::stream() {
+  return client;
+}
+
+bool RoidHttp::connected() {
+  return client && (client->connected() || client->available() > 0);
+}
+
+void RoidHttp::end() {
+  if (client) client->stop();
+  client = nullptr;
+}
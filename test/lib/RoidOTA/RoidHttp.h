@@ -0,0 +1,81 @@
+#ifndef ROIDHTTP_H
+#define ROIDHTTP_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClient.h>
+#ifdef ESP32
+#include <WiFiClientSecure.h>
+#endif
+
+// The only blocking step of a download: DNS, the TCP connect and, for
+// https, the TLS handshake, each bounded by this timeout.
+#ifndef ROIDOTA_HTTP_CONNECT_TIMEOUT_MS
+#define ROIDOTA_HTTP_CONNECT_TIMEOUT_MS 2000
+#endif
+// Host names up to this length; header lines are kept up to
+// ROIDOTA_HTTP_LINE_SIZE and the rest of a longer line is ignored.
+#ifndef ROIDOTA_HTTP_HOST_SIZE
+#define ROIDOTA_HTTP_HOST_SIZE 128
+#endif
+#ifndef ROIDOTA_HTTP_LINE_SIZE
+#define ROIDOTA_HTTP_LINE_SIZE 160
+#endif
+
+// HTTP GET for OTA downloads, driven a step at a time from handle(). After
+// connect() sends the request, poll() takes in the status line and headers
+// as they arrive and never waits for more; the body is then read from
+// stream(). https is accepted without checking the server certificate:
+// what arrives is verified against the digest (and signature) instead.
+class RoidHttp {
+public:
+  enum Status : uint8_t {
+    PENDING,
+    READY,
+    FAILED
+  };
+
+  // Parses an http:// or https:// URL, which must outlive the request
+  bool begin(const char* url);
+  // Asks for the image from offset on, if it is still the one with this
+  // ETag (may be empty).
+  void setRange(size_t offset, const char* ifRange);
+  bool connect(uint32_t timeoutMs);
+  Status poll();
+
+  int code() const;
+  // -1 if the server did not say
+  long contentLength() const;
+  const char* etag() const;
+  const char* contentRange() const;
+
+  WiFiClient* stream();
+  bool connected();
+  void end();
+
+private:
+  void headerLine();
+
+  WiFiClient plain;
+#ifdef ESP32
+  WiFiClientSecure secure;
+#endif
+  WiFiClient* client = nullptr;
+  bool tls = false;
+  char host[ROIDOTA_HTTP_HOST_SIZE];
+  uint16_t port = 80;
+  const char* path = "/";
+  size_t rangeFrom = 0;
+  const char* rangeIf = "";
+
+  char line[ROIDOTA_HTTP_LINE_SIZE];
+  size_t lineLen = 0;
+  bool statusSeen = false;
+  bool chunked = false;
+  int status = 0;
+  long length = -1;
+  char etagValue[72];
+  char rangeValue[64];
+};
+
+#endif
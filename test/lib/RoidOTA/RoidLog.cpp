@@ -0,0 +1,162 @@
+#include "RoidLog.h"
+
+#if ROIDOTA_LOG_MAX_MESSAGE > 255 || ROIDOTA_LOG_BUFFER_SIZE < ROIDOTA_LOG_MAX_MESSAGE + 6
+#error "ROIDOTA_LOG_MAX_MESSAGE must be at most 255 and fit ROIDOTA_LOG_BUFFER_SIZE"
+#endif
+
+static const char* const LEVEL_NAMES[RoidLog::LEVEL_COUNT] = {"DEBUG", "INFO", "WARN", "ERROR"};
+static const uint32_t TOKEN = 1000;
+static const uint32_t MAX_TOKENS = ROIDOTA_LOG_BURST * TOKEN;
+
+RoidLog::Level RoidLog::parseLevel(const char* name) {
+  for (uint8_t i = 0; i < LEVEL_COUNT; ++i) {
+    if (strcmp(name, LEVEL_NAMES[i]) == 0) return (Level)i;
+  }
+  return INFO;
+}
+
+const char* RoidLog::levelName(Level level) {
+  return level < LEVEL_COUNT ? LEVEL_NAMES[level] : "INFO";
+}
+
+bool RoidLog::allow(Level level, uint32_t now) {
+  uint32_t gain = (uint32_t)((uint64_t)(now - refilledAt[level]) * ROIDOTA_LOG_RATE_PER_MIN / 60);
+  if (gain > 0) {
+    tokens[level] = gain >= MAX_TOKENS - tokens[level] ? MAX_TOKENS : tokens[level] + gain;
+    refilledAt[level] = now;
+  }
+  if (tokens[level] < TOKEN) return false;
+  tokens[level] -= TOKEN;
+  return true;
+}
+
+// Entry layout: level, timestamp (4 bytes, little-endian), message length,
+// then the message without its terminator. Entries wrap around the ring.
+bool RoidLog::add(Level level, const char* message, uint32_t now) {
+  if (level >= LEVEL_COUNT) level = INFO;
+  if (!allow(level, now)) {
+    ++suppressed;
+    return false;
+  }
+
+  size_t len = strnlen(message, ROIDOTA_LOG_MAX_MESSAGE);
+  size_t need = HEADER_SIZE + len;
+  while (ROIDOTA_LOG_BUFFER_SIZE - used < need) evictOldest();
+
+  uint8_t header[HEADER_SIZE] = {
+    level, (uint8_t)now, (uint8_t)(now >> 8), (uint8_t)(now >> 16), (uint8_t)(now >> 24), (uint8_t)len
+  };
+  size_t tail = (head + used) % ROIDOTA_LOG_BUFFER_SIZE;
+  for (size_t i = 0; i < need; ++i) {
+    ring[(tail + i) % ROIDOTA_LOG_BUFFER_SIZE] = i < HEADER_SIZE ? header[i] : (uint8_t)message[i - HEADER_SIZE];
+  }
+  used += need;
+  ++entries;
+  return true;
+}
+
+bool RoidLog::empty() const {
+  return entries == 0;
+}
+
+size_t RoidLog::count() const {
+  return entries;
+}
+
+bool RoidLog::due(uint32_t now) const {
+  if (entries == 0) return false;
+  if (used >= ROIDOTA_LOG_FLUSH_BYTES) return true;
+  uint8_t ts[4];
+  copyOut(head + 1, ts, 4);
+  uint32_t oldest = ts[0] | (ts[1] << 8) | (ts[2] << 16) | ((uint32_t)ts[3] << 24);
+  return now - oldest >= ROIDOTA_LOG_FLUSH_MS;
+}
+
+void RoidLog::clear() {
+  head = 0;
+  used = 0;
+  entries = 0;
+  dropped = 0;
+  suppressed = 0;
+}
+
+uint8_t RoidLog::byteAt(size_t offset) const {
+  return ring[offset % ROIDOTA_LOG_BUFFER_SIZE];
+}
+
+void RoidLog::copyOut(size_t offset, uint8_t* dst, size_t len) const {
+  for (size_t i = 0; i < len; ++i) dst[i] = byteAt(offset + i);
+}
+
+void RoidLog::evictOldest() {
+  size_t size = HEADER_SIZE + byteAt(head + 5);
+  head = (head + size) % ROIDOTA_LOG_BUFFER_SIZE;
+  used -= size;
+  --entries;
+  ++dropped;
+}
+
+size_t RoidLog::writeBatch(const char* deviceId, const char* status, ChunkWriter writer) const {
+  RoidChunkOut out(writer);
+  out.text("{\"device_id\":");
+  out.quoted(deviceId);
+  out.text(",\"status\":");
+  out.quoted(status);
+  out.text(",\"logs\":[");
+
+  size_t offset = head;
+  for (size_t i = 0; i < entries; ++i) {
+    uint8_t header[HEADER_SIZE];
+    copyOut(offset, header, HEADER_SIZE);
+    uint32_t timestamp = header[1] | (header[2] << 8) | (header[3] << 16) | ((uint32_t)header[4] << 24);
+
+    if (i > 0) out.put(',');
+    out.put('[');
+    out.number(timestamp);
+    out.put(',');
+    out.quoted(levelName((Level)header[0]));
+    out.text(",\"");
+    for (size_t j = 0; j < header[5]; ++j) out.escaped((char)byteAt(offset + HEADER_SIZE + j));
+    out.text("\"]");
+    offset += HEADER_SIZE + header[5];
+  }
+
+  out.text("],\"dropped\":");
+  out.number(dropped);
+  out.text(",\"suppressed\":");
+  out.number(suppressed);
+  out.put('}');
+  return out.flush() ? out.total : 0;
+}
+
+size_t RoidLog::writePackedBatch(const char* status, ChunkWriter writer) const {
+  RoidChunkOut out(writer);
+  uint8_t header[RoidMsgPack::MAX_HEADER];
+  size_t statusLen = strlen(status);
+  out.raw(header, RoidMsgPack::encodeMap(header, 4));
+  out.raw(header, RoidMsgPack::encodeUint(header, WIRE_STATUS));
+  out.raw(header, RoidMsgPack::encodeStr(header, statusLen));
+  out.raw((const uint8_t*)status, statusLen);
+  out.raw(header, RoidMsgPack::encodeUint(header, WIRE_LOGS));
+  out.raw(header, RoidMsgPack::encodeArray(header, entries));
+
+  size_t offset = head;
+  for (size_t i = 0; i < entries; ++i) {
+    uint8_t entry[HEADER_SIZE];
+    copyOut(offset, entry, HEADER_SIZE);
+    uint32_t timestamp = entry[1] | (entry[2] << 8) | (entry[3] << 16) | ((uint32_t)entry[4] << 24);
+
+    out.raw(header, RoidMsgPack::encodeArray(header, 3));
+    out.raw(header, RoidMsgPack::encodeUint(header, timestamp));
+    out.raw(header, RoidMsgPack::encodeUint(header, entry[0]));
+    out.raw(header, RoidMsgPack::encodeStr(header, entry[5]));
+    for (size_t j = 0; j < entry[5]; ++j) out.put((char)byteAt(offset + HEADER_SIZE + j));
+    offset += HEADER_SIZE + entry[5];
+  }
+
+  out.raw(header, RoidMsgPack::encodeUint(header, WIRE_DROPPED));
+  out.raw(header, RoidMsgPack::encodeUint(header, dropped));
+  out.raw(header, RoidMsgPack::encodeUint(header, WIRE_SUPPRESSED));
+  out.raw(header, RoidMsgPack::encodeUint(header, suppressed));
+  return out.flush() ? out.total : 0;
+}
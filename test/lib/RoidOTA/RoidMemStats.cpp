@@ -0,0 +1,73 @@
+#include "RoidMemStats.h"
+
+// Per thread: on a board only the loop task runs the library, but a host
+// may run devices on several (test/bench/fleet_sim.cpp).
+static thread_local uint32_t minLargestBlock = UINT32_MAX;
+static thread_local uint32_t loopStackFree = 0;
+static thread_local uint8_t scopeDepth = 0;
+static thread_local int32_t heapDrift = 0;
+
+#if ROIDOTA_MEMSTATS_HOOKS
+static TaskHandle_t scopeTask = nullptr;
+static volatile uint32_t libraryAllocs = 0;
+static volatile uint32_t libraryAllocBytes = 0;
+
+// Called by the IDF allocator for every allocation on every task; only the
+// task inside a Scope is counted.
+extern "C" void esp_heap_trace_alloc_hook(void*, size_t size, uint32_t) {
+  if (scopeDepth > 0 && xTaskGetCurrentTaskHandle() == scopeTask) {
+    libraryAllocs = libraryAllocs + 1;
+    libraryAllocBytes = libraryAllocBytes + size;
+  }
+}
+
+extern "C" void esp_heap_trace_free_hook(void*) {}
+#endif
+
+void RoidMemStats::sample() {
+  uint32_t largest = ESP.getMaxAllocHeap();
+  if (largest < minLargestBlock) minLargestBlock = largest;
+#ifdef ESP32
+  // In bytes on the ESP32, whose stack type is one byte wide
+  loopStackFree = uxTaskGetStackHighWaterMark(nullptr);
+#endif
+}
+
+RoidMemStats::Snapshot RoidMemStats::snapshot() {
+  sample();
+
+  Snapshot s;
+  s.heapSize = ESP.getHeapSize();
+  s.freeHeap = ESP.getFreeHeap();
+  s.minFreeHeap = ESP.getMinFreeHeap();
+  s.largestFreeBlock = ESP.getMaxAllocHeap();
+  s.minLargestFreeBlock = minLargestBlock < s.largestFreeBlock ? minLargestBlock : s.largestFreeBlock;
+  s.fragmentation = s.freeHeap > 0 && s.largestFreeBlock < s.freeHeap
+                        ? 100 - (uint8_t)((uint64_t)s.largestFreeBlock * 100 / s.freeHeap) : 0;
+  s.loopStackFree = loopStackFree;
+#if ROIDOTA_MEMSTATS_HOOKS
+  s.libraryAllocs = libraryAllocs;
+  s.libraryAllocBytes = libraryAllocBytes;
+#else
+  s.libraryAllocs = -1;
+  s.libraryAllocBytes = 0;
+#endif
+  s.libraryHeapDrift = heapDrift;
+  return s;
+}
+
+// The drift is free heap on entry minus free heap on exit, so it also picks
+// up whatever other tasks allocated meanwhile; over time that noise averages
+// out and a steady climb points at the library.
+RoidMemStats::Scope::Scope() : freeAtEntry(0) {
+  if (scopeDepth++ > 0) return;
+  freeAtEntry = ESP.getFreeHeap();
+#if ROIDOTA_MEMSTATS_HOOKS
+  scopeTask = xTaskGetCurrentTaskHandle();
+#endif
+}
+
+RoidMemStats::Scope::~Scope() {
+  if (--scopeDepth > 0) return;
+  heapDrift += (int32_t)(freeAtEntry - ESP.getFreeHeap());
+}
@@ -0,0 +1,68 @@
+#ifndef ROIDMSGPACK_H
+#define ROIDMSGPACK_H
+
+#include <Arduino.h>
+
+// Integer map keys of the binary (MessagePack) device messages. The device
+// ID is not sent; the backend takes it from the topic. Keep in sync with
+// WIRE_KEYS in backend/src/mqtt/msgpack.ts.
+enum RoidWireKey : uint8_t {
+  WIRE_TIMESTAMP = 1,
+  WIRE_STATUS = 2,
+  WIRE_IP = 3,
+  WIRE_UPTIME = 4,
+  WIRE_RSSI = 5,
+  WIRE_FREE_HEAP = 6,
+  WIRE_SUCCESS = 7,
+  WIRE_MESSAGE = 8,
+  WIRE_LOGS = 9,
+  WIRE_DROPPED = 10,
+  WIRE_SUPPRESSED = 11,
+  WIRE_KEYFRAME = 12,
+  WIRE_INTERVAL = 13,
+  WIRE_LARGEST_BLOCK = 14,
+  WIRE_MIN_FREE_HEAP = 15,
+  WIRE_SEQ = 16,
+  WIRE_BOOT = 17,
+  WIRE_FIRMWARE_ID = 18
+};
+
+// Minimal MessagePack writer into a caller-owned buffer. Only what the
+// device sends is supported: maps, arrays, integers, booleans and strings.
+// Once the buffer is full further writes are ignored and ok() turns false.
+class RoidMsgPack {
+public:
+  // Largest header any of the encoders below produce.
+  static const size_t MAX_HEADER = 9;
+
+  // Stand-alone encoders for callers that stream their output; each
+  // returns the number of bytes written to out.
+  static size_t encodeMap(uint8_t* out, size_t count);
+  static size_t encodeArray(uint8_t* out, size_t count);
+  static size_t encodeStr(uint8_t* out, size_t len);
+  static size_t encodeUint(uint8_t* out, uint32_t value);
+  static size_t encodeInt(uint8_t* out, int32_t value);
+
+  RoidMsgPack(uint8_t* buffer, size_t capacity);
+
+  void map(size_t count);
+  void array(size_t count);
+  void key(RoidWireKey key);
+  void uinteger(uint32_t value);
+  void integer(int32_t value);
+  void boolean(bool value);
+  void str(const char* value);
+
+  bool ok() const;
+  size_t length() const;
+
+private:
+  void put(const uint8_t* data, size_t len);
+
+  uint8_t* buffer;
+  size_t capacity;
+  size_t used = 0;
+  bool overflow = false;
+};
+
+#endif
@@ -1,76 +1,78 @@
 #ifndef ROIDOTA_H
 #define ROIDOTA_H
 
-#include <WiFiManager.h>
-#include <PubSubClient.h>
-#include <HTTPClient.h>
-#include <Update.h>
-#include <ArduinoJson.h>
-#include <WiFiClient.h>
-
-typedef void (*UserFunction)();
-
-enum class RoidStatus {
-  BOOTING,
-  WIFI_CONNECTED,
-  MqTT_CONNECTED,
-  UPDATING,
-  ERROR
-};
+#include "RoidDevice.h"
 
+// The sketch's interface: the board is one device, and these forward to
+// the RoidDevice that runs it. See RoidDevice for what each one does.
 class RoidOTA {
 public:
   // Core methods
   static void begin(const char* id, UserFunction setupFn, UserFunction loopFn);
   static void begin(const char* id, const char* username, const char* password, UserFunction setupFn, UserFunction loopFn);
   static void handle();
-  
+
+  // The device behind these methods
+  static RoidDevice& device();
+
   // MQTT access method
   static PubSubClient& mqtt();
-  
+  static void setBroker(const char* host, uint16_t port = 1883);
+
+  // Topic routing, '+' and '#' allowed
+  static bool on(const char* filter, RoidTopicHandler handler);
+  static bool off(const char* filter);
+
   // Topic handling methods
   static bool isRoidTopic(const char* topic);
   static void handleInternalMessage(const char* topic, const byte* payload, unsigned int length);
-  
+
   // Status tracking methods
   static RoidStatus status();
   static const char* statusStr();
-
-private:
-  static RoidStatus currentStatus;
-  static WiFiClient espClient;
-  static PubSubClient mqttClient;
-  static const char* deviceId;
-  static const char* mqttUsername;
-  static const char* mqttPassword;
-  static UserFunction userSetup;
-  static UserFunction userLoop;
-  static unsigned long bootTime;
-  static unsigned long lastHeartbeat;
-  static unsigned long lastReconnect;
-
-  static String topicStatus;
-  static String topicResponse;
-  static String topicCmd;
-  static String topicAck;
-  static String topicLogs;  
-  
-  // Helper methods
-  static void setStatus(RoidStatus newStatus);
   static const char* getStatusStr(RoidStatus status);
-  static void connectWiFi();
-  static void connectMQTT();
-  static void reconnectMQTT();
-  static void callback(char* topic, byte* payload, unsigned int length);
-
-  static void sendHeartbeat();
-  static void sendOtaRequest();
-  static void performOTA(const String& firmwareUrl);
-  static void handleOtaResponse(const String& message);
-  static void handleCommand(const String& message);
-  static void sendOtaAck(bool success, const char* message);
   static void sendLog(const char* level, const char* message);
-  static unsigned long getUptime();
+
+  // OTA engine methods
+  static void setOtaBudget(unsigned long tickBudgetMs, size_t maxBytesPerTick);
+  static void setOtaTransport(bool overMqtt, uint8_t window = ROIDOTA_OTA_MQTT_WINDOW);
+  static bool otaInProgress();
+  static OtaState otaState();
+
+  // Network and boot
+  static void setStaticIp(IPAddress ip, IPAddress gateway, IPAddress subnet, IPAddress dns);
+  static const RoidWiFi::BootTimes& bootTimes();
+
+  // Duty-cycled mode for battery devices
+  static void setSleepCycle(unsigned long intervalMs, unsigned long listenMs = ROIDOTA_SLEEP_LISTEN_MS);
+  static void stayAwake(bool awake);
+  static uint32_t wakeCount();
+
+  // LAN peer serving
+  static void setPeerPort(uint16_t port);
+
+  // MQTT reconnect and heartbeat tuning
+  static void setReconnectBackoff(unsigned long baseMs, unsigned long capMs);
+  static void setHeartbeat(unsigned long intervalMs, uint8_t keyframeEvery);
+
+  // Telemetry
+  static RoidMemStats::Snapshot memStats();
+  static const RoidProfiler& loopProfile();
+
+  // Cooperative tasks
+  static int every(const char* name, unsigned long intervalMs, UserFunction fn,
+                   RoidScheduler::Priority priority = RoidScheduler::PRIO_NORMAL);
+  static int after(const char* name, unsigned long delayMs, UserFunction fn,
+                   RoidScheduler::Priority priority = RoidScheduler::PRIO_NORMAL);
+  static bool cancelTask(int id);
+  static bool rescheduleTask(int id, unsigned long delayMs);
+
+  // Wire format negotiation, see ROIDOTA_BINARY_WIRE
+  static void setBinaryWire(bool offer);
+  static bool binaryWire();
+
+private:
+  static RoidDevice instance;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,251 @@
+#include "RoidPeer.h"
+
+static const size_t MAX_REQUEST_BYTES = 2048;
+
+bool RoidPeer::begin(uint16_t port) {
+  end();
+  if (port == 0 || !RoidFlash::runningImageRecord(image)) return false;
+
+  server.begin(port);
+  server.setNoDelay(true);
+  active = (bool)server;
+  listenPort = active ? port : 0;
+  downloads = 0;
+  bytes = 0;
+  return active;
+}
+
+void RoidPeer::end() {
+  for (uint8_t i = 0; i < ROIDOTA_PEER_MAX_CLIENTS; ++i) close(slotTable[i]);
+  if (active) server.end();
+  active = false;
+  listenPort = 0;
+}
+
+bool RoidPeer::listening() const {
+  return active;
+}
+
+const char* RoidPeer::sha256() const {
+  return active ? image.sha256 : "";
+}
+
+size_t RoidPeer::imageSize() const {
+  return active ? image.size : 0;
+}
+
+uint16_t RoidPeer::port() const {
+  return listenPort;
+}
+
+uint8_t RoidPeer::slots() const {
+  return ROIDOTA_PEER_MAX_CLIENTS;
+}
+
+uint32_t RoidPeer::served() const {
+  return downloads;
+}
+
+uint32_t RoidPeer::bytesServed() const {
+  return bytes;
+}
+
+// Slots take turns at the byte budget, starting one further each call, so
+// two downloads progress at the same rate.
+void RoidPeer::poll(unsigned long now) {
+  if (!active) return;
+  accept(now);
+
+  for (uint8_t i = 0; i < ROIDOTA_PEER_MAX_CLIENTS; ++i) {
+    Slot& slot = slotTable[i];
+    if (slot.state == SLOT_FREE) continue;
+    if (now - slot.activeAt >= ROIDOTA_PEER_IDLE_TIMEOUT_MS) {
+      close(slot);
+      continue;
+    }
+    if (slot.state == SLOT_REQUEST) readRequest(slot, now);
+  }
+
+  size_t budget = ROIDOTA_PEER_MAX_BYTES_PER_TICK;
+  bool progress = true;
+  while (budget > 0 && progress) {
+    progress = false;
+    for (uint8_t i = 0; i < ROIDOTA_PEER_MAX_CLIENTS && budget > 0; ++i) {
+      Slot& slot = slotTable[(nextSlot + i) % ROIDOTA_PEER_MAX_CLIENTS];
+      if (slot.state != SLOT_SEND) continue;
+      size_t sent = send(slot, budget, now);
+      budget -= sent;
+      if (sent > 0) progress = true;
+    }
+  }
+  nextSlot = (nextSlot + 1) % ROIDOTA_PEER_MAX_CLIENTS;
+}
+
+// A peer turned away here tries its next source at once, which spreads a
+// rollout over the devices that already have the image.
+void RoidPeer::accept(unsigned long now) {
+  while (server.hasClient()) {
+    Slot* free = nullptr;
+    for (uint8_t i = 0; i < ROIDOTA_PEER_MAX_CLIENTS && !free; ++i) {
+      if (slotTable[i].state == SLOT_FREE) free = &slotTable[i];
+    }
+    if (!free) {
+      WiFiClient busy = server.accept();
+      reply(busy, "503 Service Unavailable");
+      busy.stop();
+      continue;
+    }
+
+    free->client = server.accept();
+    free->state = SLOT_REQUEST;
+    free->lineLen = 0;
+    free->firstLine = true;
+    free->found = false;
+    free->ranged = false;
+    free->rangeValid = true;
+    free->ifRangeMatches = true;
+    free->pos = 0;
+    free->activeAt = now;
+  }
+}
+
+// Reads the request a line at a time; pos counts request bytes until the
+// response starts.
+void RoidPeer::readRequest(Slot& slot, unsigned long now) {
+  while (slot.client.available() > 0) {
+    int c = slot.client.read();
+    if (c < 0) break;
+    slot.activeAt = now;
+    if (++slot.pos > MAX_REQUEST_BYTES) {
+      reply(slot.client, "431 Request Header Fields Too Large");
+      close(slot);
+      return;
+    }
+
+    if (c != '\n') {
+      if (slot.lineLen < sizeof(slot.line) - 1) slot.line[slot.lineLen++] = (char)c;
+      continue;
+    }
+
+    if (slot.lineLen > 0 && slot.line[slot.lineLen - 1] == '\r') --slot.lineLen;
+    slot.line[slot.lineLen] = '\0';
+    if (slot.lineLen == 0 && !slot.firstLine) {
+      respond(slot, now);
+      return;
+    }
+    if (slot.lineLen > 0) parseLine(slot);
+    slot.lineLen = 0;
+  }
+
+  if (!slot.client.connected()) close(slot);
+}
+
+void RoidPeer::parseLine(Slot& slot) {
+  const char* line = slot.line;
+  if (slot.firstLine) {
+    slot.firstLine = false;
+    slot.found = strncmp(line, "GET /fw/", 8) == 0 && slot.lineLen >= 8 + 64 &&
+                 strncasecmp(line + 8, image.sha256, 64) == 0 && (line[72] == ' ' || line[72] == '\0');
+    return;
+  }
+
+  if (strncasecmp(line, "Range:", 6) == 0) {
+    const char* p = line + 6;
+    while (*p == ' ') ++p;
+    // One range only; anything else is answered with the whole image
+    if (strncmp(p, "bytes=", 6) != 0 || strchr(p, ',')) return;
+    p += 6;
+    if (*p < '0' || *p > '9') return;
+    char* rest;
+    slot.first = strtoul(p, &rest, 10);
+    if (*rest != '-') return;
+    ++rest;
+    slot.last = *rest >= '0' && *rest <= '9' ? strtoul(rest, nullptr, 10) : image.size - 1;
+    slot.ranged = true;
+    slot.rangeValid = slot.first <= slot.last && slot.first < image.size;
+  } else if (strncasecmp(line, "If-Range:", 9) == 0) {
+    const char* p = line + 9;
+    while (*p == ' ') ++p;
+    slot.ifRangeMatches = p[0] == '"' && strncasecmp(p + 1, image.sha256, 64) == 0 && p[65] == '"';
+  }
+}
+
+void RoidPeer::respond(Slot& slot, unsigned long now) {
+  if (!slot.found) {
+    reply(slot.client, "404 Not Found");
+    close(slot);
+    return;
+  }
+
+  // If-Range naming some other image means "send it all"
+  bool partial = slot.ranged && slot.ifRangeMatches;
+  if (partial && !slot.rangeValid) {
+    char range[40];
+    snprintf(range, sizeof(range), "Content-Range: bytes */%u\r\n", (unsigned)image.size);
+    reply(slot.client, "416 Range Not Satisfiable", range);
+    close(slot);
+    return;
+  }
+
+  size_t first = partial ? slot.first : 0;
+  size_t last = partial && slot.last < image.size ? slot.last : image.size - 1;
+
+  char header[320];
+  int len = snprintf(header, sizeof(header),
+                     "HTTP/1.1 %s\r\n"
+                     "Content-Type: application/octet-stream\r\n"
+                     "Content-Length: %u\r\n"
+                     "ETag: \"%s\"\r\n"
+                     "Accept-Ranges: bytes\r\n",
+                     partial ? "206 Partial Content" : "200 OK", (unsigned)(last + 1 - first), image.sha256);
+  if (partial) {
+    len += snprintf(header + len, sizeof(header) - len, "Content-Range: bytes %u-%u/%u\r\n",
+                    (unsigned)first, (unsigned)last, (unsigned)image.size);
+  }
+  len += snprintf(header + len, sizeof(header) - len, "Connection: close\r\n\r\n");
+  if (slot.client.write((const uint8_t*)header, len) != (size_t)len) {
+    close(slot);
+    return;
+  }
+
+  slot.state = SLOT_SEND;
+  slot.pos = first;
+  slot.end = last + 1;
+  slot.activeAt = now;
+}
+
+size_t RoidPeer::send(Slot& slot, size_t budget, unsigned long now) {
+  size_t n = min(min(sizeof(chunk), slot.end - slot.pos), budget);
+  if (!RoidFlash::readRunning(slot.pos, chunk, n)) {
+    close(slot);
+    return 0;
+  }
+
+  size_t written = slot.client.write(chunk, n);
+  if (written == 0) {
+    close(slot);
+    return 0;
+  }
+
+  slot.pos += written;
+  slot.activeAt = now;
+  bytes += written;
+  if (slot.pos >= slot.end) {
+    ++downloads;
+    close(slot);
+  }
+  return written;
+}
+
+void RoidPeer::reply(WiFiClient& client, const char* status, const char* headers) {
+  char response[160];
+  int len = snprintf(response, sizeof(response), "HTTP/1.1 %s\r\n%sContent-Length: 0\r\nConnection: close\r\n\r\n",
+                     status, headers ? headers : "");
+  client.write((const uint8_t*)response, len);
+}
+
+void RoidPeer::close(Slot& slot) {
+  if (slot.state == SLOT_FREE) return;
+  slot.client.stop();
+  slot.state = SLOT_FREE;
+}
@@ -0,0 +1,182 @@
+#include "RoidPipeline.h"
+#include <stdlib.h>
+#include <string.h>
+#ifndef ARDUINO
+#include <chrono>
+#endif
+
+static const uint32_t SLOT_COUNT = ROIDOTA_PIPELINE_SLOTS;
+
+static unsigned long pipelineMillis() {
+#ifdef ARDUINO
+  return millis();
+#else
+  using namespace std::chrono;
+  return (unsigned long)duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+bool RoidPipeline::begin(SinkWriter writer, size_t position) {
+  end();
+
+  slots = (Slot*)malloc(sizeof(Slot) * SLOT_COUNT);
+  if (!slots) {
+    errorMessage = "Pipeline allocation failed";
+    return false;
+  }
+
+  sink = writer;
+  fill = 0;
+  errorMessage = nullptr;
+  head.store(0);
+  tail.store(0);
+  written.store(position);
+  stopping.store(false);
+  sinkFailed.store(false);
+  running.store(true);
+
+#ifdef ARDUINO
+  if (xTaskCreatePinnedToCore(taskEntry, "roidota_flash", ROIDOTA_PIPELINE_TASK_STACK, this,
+                              ROIDOTA_PIPELINE_TASK_PRIORITY, &task, ROIDOTA_PIPELINE_CORE) != pdPASS) {
+    running.store(false);
+    free(slots);
+    slots = nullptr;
+    errorMessage = "Pipeline task creation failed";
+    return false;
+  }
+#else
+  thread = std::thread(taskEntry, this);
+#endif
+  return true;
+}
+
+bool RoidPipeline::write(const uint8_t* data, size_t len) {
+  while (len > 0) {
+    if (fill == 0 && !waitForSlot()) return false;
+
+    Slot& slot = slots[head.load(std::memory_order_relaxed) % SLOT_COUNT];
+    size_t n = ROIDOTA_PIPELINE_SLOT_SIZE - fill;
+    if (n > len) n = len;
+    memcpy(slot.data + fill, data, n);
+    fill += n;
+    data += n;
+    len -= n;
+
+    if (fill == ROIDOTA_PIPELINE_SLOT_SIZE && !flush()) return false;
+  }
+  return true;
+}
+
+bool RoidPipeline::flush() {
+  if (failed()) return false;
+  if (fill == 0) return true;
+
+  uint32_t h = head.load(std::memory_order_relaxed);
+  slots[h % SLOT_COUNT].len = fill;
+  fill = 0;
+  // Release: the slot contents become visible before the new head.
+  head.store(h + 1, std::memory_order_release);
+  wake();
+  return true;
+}
+
+void RoidPipeline::end() {
+  if (running.load()) {
+    stopping.store(true);
+    wake();
+#ifdef ARDUINO
+    while (running.load()) {
+      vTaskDelay(1);
+    }
+    task = nullptr;
+#endif
+  }
+#ifndef ARDUINO
+  if (thread.joinable()) thread.join();
+#endif
+
+  free(slots);
+  slots = nullptr;
+  fill = 0;
+}
+
+bool RoidPipeline::active() const {
+  return slots != nullptr;
+}
+
+bool RoidPipeline::idle() const {
+  return tail.load(std::memory_order_acquire) == head.load(std::memory_order_relaxed);
+}
+
+bool RoidPipeline::failed() const {
+  return sinkFailed.load(std::memory_order_acquire) || errorMessage != nullptr;
+}
+
+size_t RoidPipeline::freeSlots() const {
+  uint32_t used = head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire);
+  return SLOT_COUNT - used;
+}
+
+size_t RoidPipeline::position() const {
+  return written.load(std::memory_order_acquire);
+}
+
+const char* RoidPipeline::error() const {
+  if (errorMessage) return errorMessage;
+  return sinkFailed.load(std::memory_order_acquire) ? "Flash write failed" : "";
+}
+
+void RoidPipeline::taskEntry(void* arg) {
+  static_cast<RoidPipeline*>(arg)->run();
+#ifdef ARDUINO
+  vTaskDelete(nullptr);
+#endif
+}
+
+// The writer only exits when end() asks it to, so the producer can always
+// notify it; after a sink failure it just stops taking slots.
+void RoidPipeline::run() {
+  while (!stopping.load(std::memory_order_relaxed)) {
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire) || sinkFailed.load(std::memory_order_relaxed)) {
+#ifdef ARDUINO
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10));
+#else
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+#endif
+      continue;
+    }
+
+    Slot& slot = slots[t % SLOT_COUNT];
+    if (!sink(slot.data, slot.len)) {
+      sinkFailed.store(true, std::memory_order_release);
+      continue;
+    }
+    written.fetch_add(slot.len, std::memory_order_release);
+    tail.store(t + 1, std::memory_order_release);
+  }
+  running.store(false);
+}
+
+bool RoidPipeline::waitForSlot() {
+  unsigned long start = pipelineMillis();
+  while (freeSlots() == 0) {
+    if (failed()) return false;
+    if (pipelineMillis() - start >= ROIDOTA_PIPELINE_WAIT_MS) {
+      errorMessage = "Flash writer stalled";
+      return false;
+    }
+#ifdef ARDUINO
+    vTaskDelay(1);
+#else
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+#endif
+  }
+  return !failed();
+}
+
+void RoidPipeline::wake() {
+#ifdef ARDUINO
+  if (task) xTaskNotifyGive(task);
+#endif
+}
@@ -0,0 +1,111 @@
+#include "RoidProfiler.h"
+
+static const char* const PHASE_NAMES[RoidProfiler::PHASE_COUNT] = {"mqtt", "ota", "telemetry", "user", "total"};
+
+const char* RoidProfiler::phaseName(Phase phase) {
+  return phase < PHASE_COUNT ? PHASE_NAMES[phase] : "total";
+}
+
+static uint8_t bucketOf(uint32_t micros) {
+  if (micros == 0) return 0;
+  uint8_t log2 = 31 - __builtin_clz(micros);
+  return log2 < RoidProfiler::BUCKETS ? log2 : RoidProfiler::BUCKETS - 1;
+}
+
+void RoidProfiler::record(Phase phase, uint32_t micros) {
+  Histogram& h = phases[phase];
+  ++h.buckets[bucketOf(micros)];
+  ++h.count;
+  h.totalMicros += micros;
+  if (micros > h.maxMicros) h.maxMicros = micros;
+
+  // TOTAL always contains the phase that stalled; only blame the phase.
+  if (micros < ROIDOTA_PROFILE_STALL_MS * 1000UL) return;
+  ++h.stalls;
+  if (phase == TOTAL) return;
+  ++pendingStalls;
+  if (micros > worstStallMicros) {
+    worstStallMicros = micros;
+    worstStallPhase = phase;
+  }
+}
+
+uint32_t RoidProfiler::count(Phase phase) const {
+  return phases[phase].count;
+}
+
+uint32_t RoidProfiler::maxMicros(Phase phase) const {
+  return phases[phase].maxMicros;
+}
+
+uint32_t RoidProfiler::percentileMicros(Phase phase, uint8_t percent) const {
+  const Histogram& h = phases[phase];
+  if (h.count == 0) return 0;
+  uint64_t rank = ((uint64_t)h.count * percent + 99) / 100;
+  uint64_t seen = 0;
+  for (uint8_t i = 0; i < BUCKETS; ++i) {
+    seen += h.buckets[i];
+    if (seen >= rank) {
+      // The top bucket has no upper bound; the max is the honest answer.
+      uint32_t upper = i + 1 < BUCKETS ? (2UL << i) - 1 : h.maxMicros;
+      return upper < h.maxMicros ? upper : h.maxMicros;
+    }
+  }
+  return h.maxMicros;
+}
+
+uint32_t RoidProfiler::stalls(Phase phase) const {
+  return phases[phase].stalls;
+}
+
+bool RoidProfiler::stallReport(uint32_t nowMs, char* message, size_t size) {
+  if (pendingStalls == 0 || nowMs - lastStallReport < ROIDOTA_PROFILE_STALL_REPORT_MS) return false;
+  snprintf(message, size, "%lu loop stall(s), worst %lu ms in %s",
+           (unsigned long)pendingStalls, (unsigned long)(worstStallMicros / 1000), phaseName(worstStallPhase));
+  pendingStalls = 0;
+  worstStallMicros = 0;
+  lastStallReport = nowMs;
+  return true;
+}
+
+size_t RoidProfiler::writeReport(const char* deviceId, RoidChunkWriter writer) const {
+  RoidChunkOut out(writer);
+  out.text("{\"device_id\":");
+  out.quoted(deviceId);
+  out.text(",\"profile\":{");
+
+  for (uint8_t p = 0; p < PHASE_COUNT; ++p) {
+    const Histogram& h = phases[p];
+    if (p > 0) out.put(',');
+    out.quoted(PHASE_NAMES[p]);
+    out.text(":{\"count\":");
+    out.number(h.count);
+    out.text(",\"mean_us\":");
+    out.number(h.count > 0 ? (uint32_t)(h.totalMicros / h.count) : 0);
+    out.text(",\"p50_us\":");
+    out.number(percentileMicros((Phase)p, 50));
+    out.text(",\"p99_us\":");
+    out.number(percentileMicros((Phase)p, 99));
+    out.text(",\"max_us\":");
+    out.number(h.maxMicros);
+    out.text(",\"stalls\":");
+    out.number(h.stalls);
+    out.text(",\"buckets\":[");
+    uint8_t used = BUCKETS;
+    while (used > 0 && h.buckets[used - 1] == 0) --used;
+    for (uint8_t i = 0; i < used; ++i) {
+      if (i > 0) out.put(',');
+      out.number(h.buckets[i]);
+    }
+    out.text("]}");
+  }
+
+  out.text("}}");
+  return out.flush() ? out.total : 0;
+}
+
+void RoidProfiler::reset() {
+  memset(phases, 0, sizeof(phases));
+  pendingStalls = 0;
+  worstStallMicros = 0;
+}
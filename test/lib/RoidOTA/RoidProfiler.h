@@ -0,0 +1,71 @@
+#ifndef ROIDPROFILER_H
+#define ROIDPROFILER_H
+
+#include <Arduino.h>
+#include "RoidChunkOut.h"
+
+// A handle() phase taking this long counts as a stall. Stalls are logged
+// at most once per ROIDOTA_PROFILE_STALL_REPORT_MS, as a summary.
+#ifndef ROIDOTA_PROFILE_STALL_MS
+#define ROIDOTA_PROFILE_STALL_MS 200
+#endif
+#ifndef ROIDOTA_PROFILE_STALL_REPORT_MS
+#define ROIDOTA_PROFILE_STALL_REPORT_MS 10000
+#endif
+
+// Latency histograms for the phases of RoidOTA::handle(). Each phase keeps
+// log2 buckets of microseconds (bucket i holds [2^i, 2^(i+1)) us, the last
+// one everything above), so recording is a count-leading-zeros and an
+// increment, and percentiles come out as bucket upper bounds.
+class RoidProfiler {
+public:
+  enum Phase : uint8_t {
+    MQTT,       // reconnect and mqttClient.loop(), including message handling
+    OTA,        // otaStep()
+    TELEMETRY,  // announce, heartbeat and log flush
+    USER,       // the user's loop function and scheduled tasks
+    TOTAL,      // the whole handle() call
+    PHASE_COUNT
+  };
+
+  static const uint8_t BUCKETS = 24;
+
+  static const char* phaseName(Phase phase);
+
+  void record(Phase phase, uint32_t micros);
+
+  uint32_t count(Phase phase) const;
+  uint32_t maxMicros(Phase phase) const;
+  // Upper bound of the bucket holding the given percentile
+  uint32_t percentileMicros(Phase phase, uint8_t percent) const;
+  uint32_t stalls(Phase phase) const;
+
+  // Fills message with a summary of the stalls since the last report and
+  // returns true, at most once per ROIDOTA_PROFILE_STALL_REPORT_MS.
+  bool stallReport(uint32_t nowMs, char* message, size_t size);
+
+  // {"device_id":"..","profile":{"mqtt":{"count":n,"mean_us":n,"p50_us":n,
+  //  "p99_us":n,"max_us":n,"stalls":n,"buckets":[..]},..}}
+  // Trailing empty buckets are left out. Returns the length; with no
+  // writer nothing is written.
+  size_t writeReport(const char* deviceId, RoidChunkWriter writer) const;
+
+  void reset();
+
+private:
+  struct Histogram {
+    uint32_t buckets[BUCKETS];
+    uint32_t count;
+    uint32_t maxMicros;
+    uint64_t totalMicros;
+    uint32_t stalls;
+  };
+
+  Histogram phases[PHASE_COUNT] = {};
+  uint32_t pendingStalls = 0;
+  uint32_t worstStallMicros = 0;
+  Phase worstStallPhase = TOTAL;
+  uint32_t lastStallReport = 0;
+};
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef ROIDSCHEDULER_H
+#define ROIDSCHEDULER_H
+
+#include <Arduino.h>
+#include "RoidChunkOut.h"
+
+// Task slots, fixed at compile time; registering more fails.
+#ifndef ROIDOTA_MAX_TASKS
+#define ROIDOTA_MAX_TASKS 16
+#endif
+// A task run taking longer than this counts as an overrun.
+#ifndef ROIDOTA_TASK_OVERRUN_MS
+#define ROIDOTA_TASK_OVERRUN_MS 50
+#endif
+// Due tasks are run until this much of one handle() call is used up; the
+// rest wait for the next call, so MQTT is serviced in between. CRITICAL
+// tasks ignore the budget.
+#ifndef ROIDOTA_SCHEDULER_BUDGET_MS
+#define ROIDOTA_SCHEDULER_BUDGET_MS 20
+#endif
+
+typedef void (*RoidTaskFunction)();
+
+// Cooperative timer queue for user tasks. Tasks sit in a binary min-heap
+// ordered by deadline, then priority, so finding the next due task is O(1)
+// and rescheduling O(log n). Everything lives in fixed arrays: registering
+// and running tasks never allocates.
+class RoidScheduler {
+public:
+  enum Priority : uint8_t {
+    PRIO_CRITICAL,  // runs even when the handle() budget is used up
+    PRIO_HIGH,
+    PRIO_NORMAL,
+    PRIO_LOW
+  };
+
+  // Returns the task ID, or -1 if every slot is taken. Periodic tasks first
+  // run one interval from now; a zero delay runs a one-shot on the next
+  // handle().
+  int every(const char* name, uint32_t intervalMs, RoidTaskFunction fn, Priority priority, uint32_t now);
+  int after(const char* name, uint32_t delayMs, RoidTaskFunction fn, Priority priority, uint32_t now);
+  bool cancel(int id);
+  // Moves the deadline of a task, e.g. to restart a one-shot timer.
+  bool reschedule(int id, uint32_t delayMs, uint32_t now);
+  bool active(int id) const;
+  size_t count() const;
+
+  // Runs due tasks in deadline order until the budget is spent.
+  void run(uint32_t now);
+
+  // Fills message with a summary of the overruns since the last report and
+  // returns true, at most once per intervalMs.
+  bool overrunReport(uint32_t now, uint32_t intervalMs, char* message, size_t size);
+
+  // {"device_id":"..","tasks":[{"name":"..","interval_ms":n,"priority":n,
+  //  "runs":n,"overruns":n,"skipped":n,"max_us":n},..]}
+  size_t writeReport(const char* deviceId, RoidChunkWriter writer) const;
+
+private:
+  struct Task {
+    RoidTaskFunction fn;
+    const char* name;
+    uint32_t due;
+    uint32_t interval;  // 0 for one-shots
+    uint32_t runs;
+    uint32_t overruns;
+    uint32_t skipped;
+    uint32_t maxMicros;
+    uint8_t heapPos;
+    Priority priority;
+    bool used;
+  };
+
+  int add(const char* name, uint32_t interval, uint32_t delayMs, RoidTaskFunction fn, Priority priority, uint32_t now);
+  bool before(uint8_t a, uint8_t b) const;
+  void place(uint8_t pos, uint8_t slot);
+  void siftUp(uint8_t pos);
+  void siftDown(uint8_t pos);
+  void push(uint8_t slot);
+  void remove(uint8_t slot);
+
+  Task tasks[ROIDOTA_MAX_TASKS] = {};
+  uint8_t heap[ROIDOTA_MAX_TASKS];
+  uint8_t heapSize = 0;
+  uint32_t pendingOverruns = 0;
+  uint8_t worstOverrunSlot = 0;
+  uint32_t worstOverrunMicros = 0;
+  uint32_t lastOverrunReport = 0;
+};
+
+#endif
@@ -0,0 +1,111 @@
+#include "RoidSleep.h"
+
+#ifndef RTC_NOINIT_ATTR
+#define RTC_NOINIT_ATTR
+#endif
+
+static const uint32_t RTC_MAGIC = 0x52534C50;  // "RSLP"
+static const uint16_t NEVER = 0xFFFF;
+
+// Not initialized at boot; trusted only when magic and checksum match.
+struct RtcSleep {
+  uint32_t magic;
+  uint32_t checksum;
+  uint32_t wakes;
+  uint32_t jitter;
+  uint32_t lastAwakeMs;
+  uint32_t lastRadioMs;
+  uint16_t sinceSubscribe;
+  uint8_t failures;
+  uint8_t skip;
+};
+
+RTC_NOINIT_ATTR static RtcSleep rtcSleep;
+
+static uint32_t rtcChecksum(const RtcSleep& rtc) {
+  const uint8_t* p = (const uint8_t*)&rtc.wakes;
+  const uint8_t* end = (const uint8_t*)&rtc + sizeof(rtc);
+  uint32_t hash = 2166136261u;
+  while (p < end) {
+    hash ^= *p++;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Every change is sealed at once, so a crash or brownout mid-wake still
+// leaves a state the next boot can trust.
+static void seal() {
+  rtcSleep.magic = RTC_MAGIC;
+  rtcSleep.checksum = rtcChecksum(rtcSleep);
+}
+
+bool RoidSleep::wake() {
+  bool warm = rtcSleep.magic == RTC_MAGIC && rtcSleep.checksum == rtcChecksum(rtcSleep);
+  if (!warm) {
+    memset(&rtcSleep, 0, sizeof(rtcSleep));
+    rtcSleep.sinceSubscribe = NEVER;
+  } else if (rtcSleep.sinceSubscribe != NEVER) {
+    ++rtcSleep.sinceSubscribe;
+  }
+  ++rtcSleep.wakes;
+  seal();
+  return warm;
+}
+
+uint32_t RoidSleep::wakes() {
+  return rtcSleep.wakes;
+}
+
+bool RoidSleep::radioDue() {
+  if (rtcSleep.skip == 0) return true;
+  --rtcSleep.skip;
+  seal();
+  return false;
+}
+
+void RoidSleep::exchanged(bool ok) {
+  if (ok) {
+    rtcSleep.failures = 0;
+  } else {
+    if (rtcSleep.failures < 16) ++rtcSleep.failures;
+    uint32_t skip = (1UL << rtcSleep.failures) - 1;
+    rtcSleep.skip = skip < ROIDOTA_SLEEP_BACKOFF_MAX_WAKES ? skip : ROIDOTA_SLEEP_BACKOFF_MAX_WAKES;
+    // The broker may have restarted and lost the session
+    rtcSleep.sinceSubscribe = NEVER;
+  }
+  seal();
+}
+
+uint8_t RoidSleep::failures() {
+  return rtcSleep.failures;
+}
+
+bool RoidSleep::subscribeDue() {
+  return rtcSleep.sinceSubscribe == NEVER || rtcSleep.sinceSubscribe >= ROIDOTA_SLEEP_RESUBSCRIBE_WAKES;
+}
+
+void RoidSleep::subscribed() {
+  rtcSleep.sinceSubscribe = 0;
+  seal();
+}
+
+uint32_t RoidSleep::jitter() {
+  return rtcSleep.jitter;
+}
+
+uint32_t RoidSleep::lastAwakeMs() {
+  return rtcSleep.lastAwakeMs;
+}
+
+uint32_t RoidSleep::lastRadioMs() {
+  return rtcSleep.lastRadioMs;
+}
+
+void RoidSleep::sleep(uint32_t ms, uint32_t awakeMs, uint32_t radioMs, uint32_t jitter) {
+  rtcSleep.lastAwakeMs = awakeMs;
+  rtcSleep.lastRadioMs = radioMs;
+  rtcSleep.jitter = jitter;
+  seal();
+  ESP.deepSleep((uint64_t)ms * 1000);
+}
@@ -7,9 +7,22 @@
 
 PubSubClient& mqttClient = RoidOTA::mqtt();
 
+// LED timing runs as scheduled tasks; never delay() in user code, it
+// stalls MQTT and the OTA engine along with it.
+bool ledOn = false;
+
+void toggleLed() {
+  ledOn = !ledOn;
+  digitalWrite(2, ledOn ? HIGH : LOW);
+}
+
+void restoreLed() {
+  digitalWrite(2, ledOn ? HIGH : LOW);
+}
+
 
 // ======= User Callback for Custom Topic =======
-void handleCustomMessage(char* topic, byte* payload, unsigned int length) {
+void handleCustomMessage(const char* topic, const byte* payload, unsigned int length) {
   String message;
   for (unsigned int i = 0; i < length; i++) {
     message += (char)payload[i];
@@ -18,9 +31,8 @@ void handleCustomMessage(char* topic, byte* payload, unsigned int length) {
   Serial.printf("[USER] Received message on %s: %s\n", topic, message.c_str());
 
   if (message == "blink") {
-    digitalWrite(2, HIGH);
-    delay(300);
-    digitalWrite(2, LOW);
+    digitalWrite(2, !ledOn ? HIGH : LOW);
+    RoidOTA::after("blink", 300, restoreLed);
   }
 }
 
@@ -29,38 +41,23 @@ void userSetup() {
   Serial.println("userSetup(): Setting up LED pin...");
   pinMode(2, OUTPUT);
 
-  // Custom topic subscription
-  mqttClient.subscribe(CUSTOM_SUB_TOPIC);
-  mqttClient.setCallback([](char* topic, byte* payload, unsigned int length) {
-    // Let RoidOTA handle its topics
-    if (RoidOTA::isRoidTopic(topic)) {
-      RoidOTA::handleInternalMessage(topic, payload, length);
-    } else {
-      handleCustomMessage(topic, payload, length);
-    }
-  });
+  // Custom topic subscription; RoidOTA keeps it across reconnects
+  RoidOTA::on(CUSTOM_SUB_TOPIC, handleCustomMessage);
 
   // Initial custom publish
   mqttClient.publish(CUSTOM_PUB_TOPIC, "Hello from ESP32 with RoidOTA!");
-}
 
-// ======= USER LOOP =======
-void userLoop() {
-  static unsigned long lastPub = 0;
-  if (millis() - lastPub >= 1000) {
-    digitalWrite(2, HIGH);
-    delay(1000);
-    digitalWrite(2, LOW);
-    delay(1000);
-
-    lastPub = millis();
-  }
+  RoidOTA::every("led", 1000, toggleLed);
 }
 
 // ======= CORE SETUP & LOOP =======
 void setup() {
   Serial.begin(115200);
-  RoidOTA::begin(DEVICE_ID, "admin", "admin", userSetup, userLoop);
+#ifdef SLEEP_INTERVAL
+  // Battery build: report, listen briefly, deep sleep until the next wake
+  RoidOTA::setSleepCycle(SLEEP_INTERVAL);
+#endif
+  RoidOTA::begin(DEVICE_ID, "admin", "admin", userSetup, nullptr);
 }
 
 void loop() {
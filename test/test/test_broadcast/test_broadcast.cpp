@@ -0,0 +1,171 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "RoidBroadcast.h"
+
+static const size_t CHUNK = 512;
+// Nine chunks, the last one 100 bytes: the final bit is alone in the
+// bitmap's second byte.
+static const size_t IMAGE = 8 * CHUNK + 100;
+
+static uint8_t buffer[CHUNK];
+static uint8_t packet[RoidBroadcast::HEADER_SIZE + CHUNK];
+
+// <index><length bytes of (index & 0xFF)>
+static size_t makePacket(uint32_t index, size_t length) {
+  packet[0] = index >> 24;
+  packet[1] = index >> 16;
+  packet[2] = index >> 8;
+  packet[3] = index;
+  memset(packet + RoidBroadcast::HEADER_SIZE, index & 0xFF, length);
+  return RoidBroadcast::HEADER_SIZE + length;
+}
+
+static RoidBroadcast::Packet receive(RoidBroadcast& b, uint32_t index, size_t length) {
+  RoidBroadcast::Packet result = b.accept(packet, makePacket(index, length));
+  if (result == RoidBroadcast::CHUNK) b.written();
+  return result;
+}
+
+static size_t chunkLength(uint32_t index) {
+  return index < 8 ? CHUNK : 100;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_final_partial_chunk() {
+  RoidBroadcast b;
+  TEST_ASSERT_TRUE(b.begin("fw-1", IMAGE, CHUNK, buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL_STRING("roidota/fw/fw-1", b.topic());
+  TEST_ASSERT_EQUAL(9, b.chunks());
+
+  // The last chunk only comes at its own length
+  TEST_ASSERT_EQUAL(RoidBroadcast::INVALID, b.accept(packet, makePacket(8, CHUNK)));
+  TEST_ASSERT_EQUAL(RoidBroadcast::INVALID, b.accept(packet, makePacket(8, 99)));
+  TEST_ASSERT_EQUAL(RoidBroadcast::INVALID, b.accept(packet, makePacket(9, 100)));
+  TEST_ASSERT_EQUAL(RoidBroadcast::CHUNK, b.accept(packet, makePacket(8, 100)));
+
+  size_t offset = 0, length = 0;
+  const uint8_t* data = nullptr;
+  bool fresh = false;
+  TEST_ASSERT_TRUE(b.pending(offset, data, length, fresh));
+  TEST_ASSERT_EQUAL(8 * CHUNK, offset);
+  TEST_ASSERT_EQUAL(100, length);
+  TEST_ASSERT_EQUAL(8, data[99]);
+  TEST_ASSERT_TRUE(fresh);
+  b.written();
+  TEST_ASSERT_EQUAL(1, b.received());
+  TEST_ASSERT_EQUAL(RoidBroadcast::DUPLICATE, b.accept(packet, makePacket(8, 100)));
+
+  uint32_t ranges[4][2];
+  TEST_ASSERT_EQUAL(1, b.missingRanges(ranges, 4));
+  TEST_ASSERT_EQUAL(0, ranges[0][0]);
+  TEST_ASSERT_EQUAL(7, ranges[0][1]);
+
+  for (uint32_t i = 0; i < 8; ++i) TEST_ASSERT_EQUAL(RoidBroadcast::CHUNK, receive(b, i, CHUNK));
+  TEST_ASSERT_TRUE(b.complete());
+  TEST_ASSERT_EQUAL(0, b.missingRanges(ranges, 4));
+}
+
+void test_final_chunk_missing() {
+  RoidBroadcast b;
+  TEST_ASSERT_TRUE(b.begin("fw-1", IMAGE, CHUNK, buffer, sizeof(buffer)));
+  for (uint32_t i = 0; i < 8; ++i) receive(b, i, CHUNK);
+  TEST_ASSERT_FALSE(b.complete());
+
+  uint32_t ranges[4][2];
+  TEST_ASSERT_EQUAL(1, b.missingRanges(ranges, 4));
+  TEST_ASSERT_EQUAL(8, ranges[0][0]);
+  TEST_ASSERT_EQUAL(8, ranges[0][1]);
+}
+
+void test_repair_ranges() {
+  RoidBroadcast b;
+  TEST_ASSERT_TRUE(b.begin("fw-1", IMAGE, CHUNK, buffer, sizeof(buffer)));
+  const uint32_t got[] = {1, 2, 5, 7};
+  for (uint32_t i : got) receive(b, i, chunkLength(i));
+  TEST_ASSERT_EQUAL(RoidBroadcast::END, b.accept(packet, makePacket(RoidBroadcast::END_OF_PASS, 0)));
+
+  uint32_t ranges[8][2];
+  TEST_ASSERT_EQUAL(4, b.missingRanges(ranges, 8));
+  const uint32_t expected[4][2] = {{0, 0}, {3, 4}, {6, 6}, {8, 8}};
+  for (size_t r = 0; r < 4; ++r) {
+    TEST_ASSERT_EQUAL(expected[r][0], ranges[r][0]);
+    TEST_ASSERT_EQUAL(expected[r][1], ranges[r][1]);
+  }
+
+  // Capped, lowest first; the rest go in the next round
+  TEST_ASSERT_EQUAL(2, b.missingRanges(ranges, 2));
+  TEST_ASSERT_EQUAL(0, ranges[0][0]);
+  TEST_ASSERT_EQUAL(4, ranges[1][1]);
+
+  receive(b, 0, CHUNK);
+  receive(b, 3, CHUNK);
+  TEST_ASSERT_EQUAL(3, b.missingRanges(ranges, 8));
+  TEST_ASSERT_EQUAL(4, ranges[0][0]);
+  TEST_ASSERT_EQUAL(4, ranges[0][1]);
+}
+
+void test_one_pending_chunk_at_a_time() {
+  RoidBroadcast b;
+  TEST_ASSERT_TRUE(b.begin("fw-1", IMAGE, CHUNK, buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL(RoidBroadcast::CHUNK, b.accept(packet, makePacket(3, CHUNK)));
+  TEST_ASSERT_EQUAL(RoidBroadcast::BUSY, b.accept(packet, makePacket(4, CHUNK)));
+  b.discard();
+  TEST_ASSERT_EQUAL(0, b.received());
+
+  uint32_t ranges[2][2];
+  TEST_ASSERT_EQUAL(1, b.missingRanges(ranges, 2));
+  TEST_ASSERT_EQUAL(0, ranges[0][0]);
+  TEST_ASSERT_EQUAL(8, ranges[0][1]);
+}
+
+// 1 KiB chunks: four to a 4 KiB sector, and only the first to arrive
+// erases it.
+void test_sector_erased_once() {
+  static uint8_t big[1024];
+  RoidBroadcast b;
+  TEST_ASSERT_TRUE(b.begin("fw-1", 6 * 1024 + 10, 1024, big, sizeof(big)));
+  TEST_ASSERT_EQUAL(7, b.chunks());
+
+  size_t offset, length;
+  const uint8_t* data;
+  bool fresh;
+  const uint32_t order[] = {2, 0, 6, 5, 4};
+  const bool expectFresh[] = {true, false, true, false, false};
+  for (size_t i = 0; i < 5; ++i) {
+    uint32_t index = order[i];
+    TEST_ASSERT_EQUAL(RoidBroadcast::CHUNK, b.accept(packet, makePacket(index, index == 6 ? 10 : 1024)));
+    TEST_ASSERT_TRUE(b.pending(offset, data, length, fresh));
+    TEST_ASSERT_EQUAL(expectFresh[i], fresh);
+    b.written();
+  }
+}
+
+void test_begin_refuses() {
+  RoidBroadcast b;
+  TEST_ASSERT_FALSE(b.begin("", IMAGE, CHUNK, buffer, sizeof(buffer)));
+  TEST_ASSERT_FALSE(b.begin("a/b", IMAGE, CHUNK, buffer, sizeof(buffer)));
+  TEST_ASSERT_FALSE(b.begin("a+", IMAGE, CHUNK, buffer, sizeof(buffer)));
+  TEST_ASSERT_FALSE(b.begin("fw", IMAGE, 1000, buffer, sizeof(buffer)));  // does not divide a sector
+  TEST_ASSERT_FALSE(b.begin("fw", IMAGE, CHUNK, buffer, CHUNK - 1));
+  TEST_ASSERT_FALSE(b.begin("fw", (size_t)CHUNK * ROIDOTA_BCAST_MAX_CHUNKS + 1, CHUNK, buffer, sizeof(buffer)));
+  TEST_ASSERT_TRUE(b.begin("fw", (size_t)CHUNK * ROIDOTA_BCAST_MAX_CHUNKS, CHUNK, buffer, sizeof(buffer)));
+  TEST_ASSERT_EQUAL(ROIDOTA_BCAST_MAX_CHUNKS, b.chunks());
+  TEST_ASSERT_TRUE(b.active());
+  TEST_ASSERT_FALSE(b.complete());
+}
+
+void setup() {
+  UNITY_BEGIN();
+  RUN_TEST(test_final_partial_chunk);
+  RUN_TEST(test_final_chunk_missing);
+  RUN_TEST(test_repair_ranges);
+  RUN_TEST(test_one_pending_chunk_at_a_time);
+  RUN_TEST(test_sector_erased_once);
+  RUN_TEST(test_begin_refuses);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,114 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "RoidMsgPack.h"
+
+// Encodes with fn and compares against the expected bytes
+#define CHECK_ENCODING(fn, value, ...)                                  \
+  do {                                                                  \
+    const uint8_t expected[] = {__VA_ARGS__};                           \
+    uint8_t out[RoidMsgPack::MAX_HEADER];                               \
+    TEST_ASSERT_EQUAL(sizeof(expected), RoidMsgPack::fn(out, value));   \
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, out, sizeof(expected));      \
+  } while (0)
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_uint_boundaries() {
+  CHECK_ENCODING(encodeUint, 0, 0x00);
+  CHECK_ENCODING(encodeUint, 0x7F, 0x7F);
+  CHECK_ENCODING(encodeUint, 0x80, 0xCC, 0x80);
+  CHECK_ENCODING(encodeUint, 0xFF, 0xCC, 0xFF);
+  CHECK_ENCODING(encodeUint, 0x100, 0xCD, 0x01, 0x00);
+  CHECK_ENCODING(encodeUint, 0xFFFF, 0xCD, 0xFF, 0xFF);
+  CHECK_ENCODING(encodeUint, 0x10000, 0xCE, 0x00, 0x01, 0x00, 0x00);
+  CHECK_ENCODING(encodeUint, 0xFFFFFFFF, 0xCE, 0xFF, 0xFF, 0xFF, 0xFF);
+}
+
+void test_int_boundaries() {
+  CHECK_ENCODING(encodeInt, 5, 0x05);
+  CHECK_ENCODING(encodeInt, 300, 0xCD, 0x01, 0x2C);
+  CHECK_ENCODING(encodeInt, -1, 0xFF);
+  CHECK_ENCODING(encodeInt, -32, 0xE0);
+  CHECK_ENCODING(encodeInt, -33, 0xD0, 0xDF);
+  CHECK_ENCODING(encodeInt, -128, 0xD0, 0x80);
+  CHECK_ENCODING(encodeInt, -129, 0xD1, 0xFF, 0x7F);
+  CHECK_ENCODING(encodeInt, -32768, 0xD1, 0x80, 0x00);
+  CHECK_ENCODING(encodeInt, -32769, 0xD2, 0xFF, 0xFF, 0x7F, 0xFF);
+  CHECK_ENCODING(encodeInt, INT32_MIN, 0xD2, 0x80, 0x00, 0x00, 0x00);
+}
+
+void test_container_and_str_headers() {
+  CHECK_ENCODING(encodeMap, 0, 0x80);
+  CHECK_ENCODING(encodeMap, 15, 0x8F);
+  CHECK_ENCODING(encodeMap, 16, 0xDE, 0x00, 0x10);
+  CHECK_ENCODING(encodeMap, 0x10000, 0xDF, 0x00, 0x01, 0x00, 0x00);
+  CHECK_ENCODING(encodeArray, 15, 0x9F);
+  CHECK_ENCODING(encodeArray, 16, 0xDC, 0x00, 0x10);
+  CHECK_ENCODING(encodeArray, 0xFFFF, 0xDC, 0xFF, 0xFF);
+  CHECK_ENCODING(encodeArray, 0x10000, 0xDD, 0x00, 0x01, 0x00, 0x00);
+  CHECK_ENCODING(encodeStr, 0, 0xA0);
+  CHECK_ENCODING(encodeStr, 31, 0xBF);
+  CHECK_ENCODING(encodeStr, 32, 0xD9, 0x20);
+  CHECK_ENCODING(encodeStr, 0xFF, 0xD9, 0xFF);
+  CHECK_ENCODING(encodeStr, 0x100, 0xDA, 0x01, 0x00);
+  CHECK_ENCODING(encodeStr, 0x10000, 0xDB, 0x00, 0x01, 0x00, 0x00);
+}
+
+// A small ACK-like message, byte for byte
+void test_writer_builds_ack() {
+  uint8_t buffer[64];
+  RoidMsgPack mp(buffer, sizeof(buffer));
+  mp.map(4);
+  mp.key(WIRE_SUCCESS);
+  mp.boolean(true);
+  mp.key(WIRE_MESSAGE);
+  mp.str("ok");
+  mp.key(WIRE_SEQ);
+  mp.uinteger(40000);
+  mp.key(WIRE_TIMESTAMP);
+  mp.integer(-1);
+
+  const uint8_t expected[] = {0x84, 0x07, 0xC3, 0x08, 0xA2, 'o', 'k', 0x10, 0xCD, 0x9C, 0x40, 0x01, 0xFF};
+  TEST_ASSERT_TRUE(mp.ok());
+  TEST_ASSERT_EQUAL(sizeof(expected), mp.length());
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+void test_writer_stops_when_full() {
+  uint8_t buffer[8];
+  memset(buffer, 0xAA, sizeof(buffer));
+  RoidMsgPack mp(buffer, 6);
+  mp.array(2);
+  mp.boolean(false);
+  mp.str("toolong");  // header fits, string does not
+  TEST_ASSERT_FALSE(mp.ok());
+  // Nothing after the first failed write, even if it would fit
+  mp.boolean(true);
+  TEST_ASSERT_FALSE(mp.ok());
+  TEST_ASSERT_EQUAL(3, mp.length());
+  const uint8_t expected[] = {0x92, 0xC2, 0xA7, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA};
+  TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, buffer, sizeof(expected));
+}
+
+void test_writer_fills_exactly() {
+  uint8_t buffer[4];
+  RoidMsgPack mp(buffer, sizeof(buffer));
+  mp.str("abc");
+  TEST_ASSERT_TRUE(mp.ok());
+  TEST_ASSERT_EQUAL(4, mp.length());
+}
+
+void setup() {
+  UNITY_BEGIN();
+  RUN_TEST(test_uint_boundaries);
+  RUN_TEST(test_int_boundaries);
+  RUN_TEST(test_container_and_str_headers);
+  RUN_TEST(test_writer_builds_ack);
+  RUN_TEST(test_writer_stops_when_full);
+  RUN_TEST(test_writer_fills_exactly);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,120 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "RoidOutbox.h"
+
+// The fake's RTC memory, where RoidOutbox keeps its mirror
+extern "C" char __start_roidota_rtc[];
+extern "C" char __stop_roidota_rtc[];
+
+static const char ACK[] = "{\"success\":true,\"seq\":7}";
+
+static uint8_t published[ROIDOTA_OUTBOX_MAX_PAYLOAD];
+static size_t publishedLen = 0;
+static size_t publishCount = 0;
+
+static bool publish(uint8_t, const uint8_t* payload, size_t len) {
+  memcpy(published, payload, len);
+  publishedLen = len;
+  ++publishCount;
+  return true;
+}
+
+// The mirrored copy of ACK, found by content
+static char* mirroredAck() {
+  size_t size = __stop_roidota_rtc - __start_roidota_rtc;
+  return (char*)memmem(__start_roidota_rtc, size, ACK, sizeof(ACK) - 1);
+}
+
+void setUp() {
+  publishedLen = 0;
+  publishCount = 0;
+  memset(__start_roidota_rtc, 0, __stop_roidota_rtc - __start_roidota_rtc);
+}
+
+void tearDown() {}
+
+void test_seq_skips_zero_on_wrap() {
+  RoidOutbox outbox;
+  outbox.seed(65534);
+  TEST_ASSERT_EQUAL(65534, outbox.nextSeq());
+  TEST_ASSERT_EQUAL(65535, outbox.nextSeq());
+  // 0 is never handed out, so it can mean "no seq"
+  TEST_ASSERT_EQUAL(1, outbox.nextSeq());
+  TEST_ASSERT_EQUAL(2, outbox.nextSeq());
+
+  outbox.seed(0);
+  TEST_ASSERT_EQUAL(1, outbox.nextSeq());
+}
+
+void test_restore_after_restart() {
+  {
+    RoidOutbox before;
+    before.seed(65535);
+    uint16_t seq = before.nextSeq();
+    TEST_ASSERT_TRUE(before.push(RoidOutbox::PRIO_ACK, 1, seq, (const uint8_t*)ACK, sizeof(ACK) - 1, 0));
+    // Telemetry is not mirrored
+    TEST_ASSERT_TRUE(before.push(RoidOutbox::PRIO_TELEMETRY, 2, 0, (const uint8_t*)"t", 1, 0));
+  }
+  TEST_ASSERT_NOT_NULL(mirroredAck());
+
+  RoidOutbox after;
+  TEST_ASSERT_EQUAL(1, after.restore(100));
+  // Numbering carries on past the wrap, after the restored ACK
+  TEST_ASSERT_EQUAL(1, after.nextSeq());
+  TEST_ASSERT_TRUE(after.drain(100, publish));
+  TEST_ASSERT_EQUAL(1, publishCount);
+  TEST_ASSERT_EQUAL(sizeof(ACK) - 1, publishedLen);
+  TEST_ASSERT_EQUAL_MEMORY(ACK, published, publishedLen);
+  TEST_ASSERT_TRUE(after.confirm(65535));
+  TEST_ASSERT_EQUAL(0, after.count());
+
+  // Confirmed ACKs are gone from the mirror too
+  RoidOutbox again;
+  TEST_ASSERT_EQUAL(0, again.restore(200));
+}
+
+void test_corrupt_checksum_is_ignored() {
+  {
+    RoidOutbox before;
+    TEST_ASSERT_TRUE(before.push(RoidOutbox::PRIO_ACK, 1, before.nextSeq(), (const uint8_t*)ACK, sizeof(ACK) - 1, 0));
+  }
+  char* saved = mirroredAck();
+  TEST_ASSERT_NOT_NULL(saved);
+  saved[0] ^= 0x01;
+
+  RoidOutbox after;
+  TEST_ASSERT_EQUAL(0, after.restore(100));
+  TEST_ASSERT_EQUAL(0, after.count());
+  TEST_ASSERT_EQUAL(1, after.nextSeq());
+
+  // The mirror is invalidated, so undoing the damage does not bring it back
+  saved[0] ^= 0x01;
+  RoidOutbox again;
+  TEST_ASSERT_EQUAL(0, again.restore(200));
+}
+
+void test_uninitialized_memory_is_ignored() {
+  memset(__start_roidota_rtc, 0xA5, __stop_roidota_rtc - __start_roidota_rtc);
+  RoidOutbox outbox;
+  TEST_ASSERT_EQUAL(0, outbox.restore(0));
+  TEST_ASSERT_EQUAL(0, outbox.count());
+}
+
+void test_unmirrored_outbox_leaves_rtc_alone() {
+  RoidOutbox other;
+  other.setMirrored(false);
+  TEST_ASSERT_TRUE(other.push(RoidOutbox::PRIO_ACK, 1, other.nextSeq(), (const uint8_t*)ACK, sizeof(ACK) - 1, 0));
+  TEST_ASSERT_NULL(mirroredAck());
+}
+
+void setup() {
+  UNITY_BEGIN();
+  RUN_TEST(test_seq_skips_zero_on_wrap);
+  RUN_TEST(test_restore_after_restart);
+  RUN_TEST(test_corrupt_checksum_is_ignored);
+  RUN_TEST(test_uninitialized_memory_is_ignored);
+  RUN_TEST(test_unmirrored_outbox_leaves_rtc_alone);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,142 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "RoidRouter.h"
+
+// One bit per handler that was called
+static uint32_t calls = 0;
+
+static void h0(const char*, const byte*, unsigned int) { calls |= 1 << 0; }
+static void h1(const char*, const byte*, unsigned int) { calls |= 1 << 1; }
+static void h2(const char*, const byte*, unsigned int) { calls |= 1 << 2; }
+static void h3(const char*, const byte*, unsigned int) { calls |= 1 << 3; }
+static void h4(const char*, const byte*, unsigned int) { calls |= 1 << 4; }
+
+static uint32_t route(const RoidRouter& router, const char* topic) {
+  calls = 0;
+  router.dispatch(topic, (const byte*)"", 0);
+  return calls;
+}
+
+void setUp() {
+  calls = 0;
+}
+
+void tearDown() {}
+
+void test_exact_match() {
+  RoidRouter r;
+  TEST_ASSERT_TRUE(r.add("roidota/response/dev", h0));
+  TEST_ASSERT_EQUAL(1, route(r, "roidota/response/dev"));
+  TEST_ASSERT_EQUAL(0, route(r, "roidota/response/dev2"));
+  TEST_ASSERT_EQUAL(0, route(r, "roidota/response"));
+  TEST_ASSERT_EQUAL(0, route(r, "roidota/response/dev/x"));
+}
+
+void test_plus_matches_one_level() {
+  RoidRouter r;
+  TEST_ASSERT_TRUE(r.add("a/+/c", h0));
+  TEST_ASSERT_TRUE(r.add("+/+", h1));
+  TEST_ASSERT_EQUAL(1, route(r, "a/b/c"));
+  TEST_ASSERT_EQUAL(0, route(r, "a/b/x"));
+  TEST_ASSERT_EQUAL(0, route(r, "a/b/c/d"));
+  TEST_ASSERT_EQUAL(2, route(r, "a/b"));
+  // Empty levels are levels too
+  TEST_ASSERT_EQUAL(1, route(r, "a//c"));
+  TEST_ASSERT_EQUAL(2, route(r, "/b"));
+  TEST_ASSERT_EQUAL(0, route(r, "a"));
+}
+
+void test_hash_matches_rest_and_parent() {
+  RoidRouter r;
+  TEST_ASSERT_TRUE(r.add("a/#", h0));
+  TEST_ASSERT_TRUE(r.add("#", h1));
+  TEST_ASSERT_EQUAL(3, route(r, "a"));
+  TEST_ASSERT_EQUAL(3, route(r, "a/b"));
+  TEST_ASSERT_EQUAL(3, route(r, "a/b/c"));
+  TEST_ASSERT_EQUAL(2, route(r, "b/a"));
+}
+
+void test_every_matching_route_is_called() {
+  RoidRouter r;
+  TEST_ASSERT_TRUE(r.add("roidota/fw/abc", h0));
+  TEST_ASSERT_TRUE(r.add("roidota/fw/+", h1));
+  TEST_ASSERT_TRUE(r.add("roidota/#", h2));
+  TEST_ASSERT_TRUE(r.add("+/fw/#", h3));
+  TEST_ASSERT_TRUE(r.add("roidota/cmd/+", h4));
+  TEST_ASSERT_EQUAL(0x0F, route(r, "roidota/fw/abc"));
+  TEST_ASSERT_EQUAL(0x0E, route(r, "roidota/fw/xyz"));
+  TEST_ASSERT_EQUAL(0x0C, route(r, "roidota/fw"));
+  TEST_ASSERT_EQUAL(0x14, route(r, "roidota/cmd/reboot"));
+  TEST_ASSERT_EQUAL(4, r.dispatch("roidota/fw/abc", (const byte*)"", 0));
+}
+
+void test_system_topics_skip_leading_wildcards() {
+  RoidRouter r;
+  TEST_ASSERT_TRUE(r.add("#", h0));
+  TEST_ASSERT_TRUE(r.add("+/status", h1));
+  TEST_ASSERT_TRUE(r.add("$SYS/#", h2));
+  TEST_ASSERT_TRUE(r.add("$SYS/+", h3));
+  TEST_ASSERT_EQUAL(0x0C, route(r, "$SYS/status"));
+  TEST_ASSERT_EQUAL(0x03, route(r, "dev/status"));
+  // Only the first level is special
+  TEST_ASSERT_EQUAL(0x01, route(r, "dev/$SYS"));
+}
+
+void test_malformed_filters_are_refused() {
+  RoidRouter r;
+  TEST_ASSERT_FALSE(r.add("a/#/c", h0));
+  TEST_ASSERT_FALSE(r.add("a/b#", h0));
+  TEST_ASSERT_FALSE(r.add("a/b+/c", h0));
+  TEST_ASSERT_FALSE(r.add("a/++", h0));
+  TEST_ASSERT_FALSE(r.add("", h0));
+  TEST_ASSERT_FALSE(r.add("a", nullptr));
+  TEST_ASSERT_EQUAL(0, r.count());
+}
+
+void test_replace_and_remove() {
+  RoidRouter r;
+  TEST_ASSERT_TRUE(r.add("a/+", h0));
+  TEST_ASSERT_TRUE(r.add("a/b", h1));
+  TEST_ASSERT_TRUE(r.add("a/+", h2));
+  TEST_ASSERT_EQUAL(2, r.count());
+  TEST_ASSERT_EQUAL(0x06, route(r, "a/b"));
+
+  TEST_ASSERT_TRUE(r.remove("a/+"));
+  TEST_ASSERT_FALSE(r.remove("a/+"));
+  TEST_ASSERT_EQUAL(1, r.count());
+  TEST_ASSERT_EQUAL_STRING("a/b", r.filter(0));
+  TEST_ASSERT_EQUAL(0x02, route(r, "a/b"));
+  TEST_ASSERT_EQUAL(0, route(r, "a/c"));
+
+  // The kept nodes are reused
+  TEST_ASSERT_TRUE(r.add("a/+", h3));
+  TEST_ASSERT_EQUAL(0x0A, route(r, "a/b"));
+}
+
+void test_full_router_refuses() {
+  RoidRouter r;
+  char filter[16];
+  for (int i = 0; i < ROIDOTA_MAX_ROUTES; ++i) {
+    snprintf(filter, sizeof(filter), "t/%d", i);
+    TEST_ASSERT_TRUE(r.add(filter, h0));
+  }
+  TEST_ASSERT_FALSE(r.add("t/more", h1));
+  // Replacing a handler needs no room
+  TEST_ASSERT_TRUE(r.add("t/0", h1));
+  TEST_ASSERT_EQUAL(0x02, route(r, "t/0"));
+}
+
+void setup() {
+  UNITY_BEGIN();
+  RUN_TEST(test_exact_match);
+  RUN_TEST(test_plus_matches_one_level);
+  RUN_TEST(test_hash_matches_rest_and_parent);
+  RUN_TEST(test_every_matching_route_is_called);
+  RUN_TEST(test_system_topics_skip_leading_wildcards);
+  RUN_TEST(test_malformed_filters_are_refused);
+  RUN_TEST(test_replace_and_remove);
+  RUN_TEST(test_full_router_refuses);
+  exit(UNITY_END());
+}
+
+void loop() {}
@@ -0,0 +1,142 @@
+#include <Arduino.h>
+#include <unity.h>
+#include "RoidScheduler.h"
+
+// Run order of the tasks below, by letter
+static char ran[32];
+static size_t ranCount = 0;
+
+static void note(char c) {
+  if (ranCount < sizeof(ran) - 1) ran[ranCount++] = c;
+  ran[ranCount] = '\0';
+}
+
+static void taskA() { note('A'); }
+static void taskB() { note('B'); }
+static void taskC() { note('C'); }
+static void taskD() { note('D'); }
+static void taskE() { note('E'); }
+static void taskF() { note('F'); }
+static void taskG() { note('G'); }
+
+static RoidScheduler* current = nullptr;
+static int selfId = -1;
+
+static void cancelSelf() {
+  note('S');
+  current->cancel(selfId);
+}
+
+void setUp() {
+  ranCount = 0;
+  ran[0] = '\0';
+}
+
+void tearDown() {}
+
+// Seven one-shots make a three-level heap; run them all at once so the
+// order is the heap's.
+static void addSeven(RoidScheduler& s, int* ids) {
+  const RoidTaskFunction fns[] = {taskA, taskB, taskC, taskD, taskE, taskF, taskG};
+  // Registered out of order so the heap has to sift
+  const uint32_t delays[] = {70, 10, 50, 30, 20, 60, 40};
+  for (int i = 0; i < 7; ++i) {
+    ids[i] = s.after("t", delays[i], fns[i], RoidScheduler::PRIO_NORMAL, 0);
+    TEST_ASSERT_TRUE(ids[i] >= 0);
+  }
+}
+
+void test_runs_in_deadline_order() {
+  RoidScheduler s;
+  int ids[7];
+  addSeven(s, ids);
+  s.run(100);
+  TEST_ASSERT_EQUAL_STRING("BEDGCFA", ran);
+  TEST_ASSERT_EQUAL(0, s.count());
+}
+
+void test_cancel_root_reorders() {
+  RoidScheduler s;
+  int ids[7];
+  addSeven(s, ids);
+  TEST_ASSERT_TRUE(s.cancel(ids[1]));  // B, the earliest
+  TEST_ASSERT_FALSE(s.cancel(ids[1]));
+  TEST_ASSERT_EQUAL(6, s.count());
+  s.run(100);
+  TEST_ASSERT_EQUAL_STRING("EDGCFA", ran);
+}
+
+void test_cancel_inner_and_last_reorders() {
+  RoidScheduler s;
+  int ids[7];
+  addSeven(s, ids);
+  // Each removal moves the last heap entry into the hole, which may then
+  // have to go up or down.
+  TEST_ASSERT_TRUE(s.cancel(ids[3]));  // D
+  TEST_ASSERT_TRUE(s.cancel(ids[0]));  // A, the latest
+  TEST_ASSERT_TRUE(s.cancel(ids[6]));  // G
+  s.run(100);
+  TEST_ASSERT_EQUAL_STRING("BECF", ran);
+}
+
+void test_cancel_then_reuse_slot() {
+  RoidScheduler s;
+  int ids[7];
+  addSeven(s, ids);
+  TEST_ASSERT_TRUE(s.cancel(ids[2]));  // C
+  TEST_ASSERT_FALSE(s.active(ids[2]));
+  int again = s.after("t", 5, taskC, RoidScheduler::PRIO_NORMAL, 0);
+  TEST_ASSERT_EQUAL(ids[2], again);
+  s.run(100);
+  TEST_ASSERT_EQUAL_STRING("CBEDGFA", ran);
+}
+
+void test_runs_only_due_tasks_after_cancel() {
+  RoidScheduler s;
+  int ids[7];
+  addSeven(s, ids);
+  TEST_ASSERT_TRUE(s.cancel(ids[4]));  // E
+  s.run(35);
+  TEST_ASSERT_EQUAL_STRING("BD", ran);
+  TEST_ASSERT_TRUE(s.reschedule(ids[0], 0, 35));  // A now
+  s.run(45);
+  TEST_ASSERT_EQUAL_STRING("BDAG", ran);
+  TEST_ASSERT_EQUAL(2, s.count());
+}
+
+void test_equal_deadlines_go_by_priority() {
+  RoidScheduler s;
+  s.after("low", 10, taskA, RoidScheduler::PRIO_LOW, 0);
+  int high = s.after("high", 10, taskB, RoidScheduler::PRIO_HIGH, 0);
+  s.after("critical", 10, taskC, RoidScheduler::PRIO_CRITICAL, 0);
+  s.after("normal", 10, taskD, RoidScheduler::PRIO_NORMAL, 0);
+  TEST_ASSERT_TRUE(s.cancel(high));
+  s.run(10);
+  TEST_ASSERT_EQUAL_STRING("CDA", ran);
+}
+
+void test_periodic_task_cancels_itself() {
+  RoidScheduler s;
+  current = &s;
+  selfId = s.every("self", 10, cancelSelf, RoidScheduler::PRIO_NORMAL, 0);
+  s.every("other", 10, taskA, RoidScheduler::PRIO_LOW, 0);
+  s.run(10);
+  s.run(20);
+  TEST_ASSERT_EQUAL_STRING("SAA", ran);
+  TEST_ASSERT_EQUAL(1, s.count());
+  current = nullptr;
+}
+
+void setup() {
+  UNITY_BEGIN();
+  RUN_TEST(test_runs_in_deadline_order);
+  RUN_TEST(test_cancel_root_reorders);
+  RUN_TEST(test_cancel_inner_and_last_reorders);
+  RUN_TEST(test_cancel_then_reuse_slot);
+  RUN_TEST(test_runs_only_due_tasks_after_cancel);
+  RUN_TEST(test_equal_deadlines_go_by_priority);
+  RUN_TEST(test_periodic_task_cancels_itself);
+  exit(UNITY_END());
+}
+
+void loop() {}